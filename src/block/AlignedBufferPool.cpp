@@ -0,0 +1,112 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/AlignedBufferPool.h"
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+shared_ptr<AlignedBufferPool> AlignedBufferPool::instance = NULL;
+shared_ptr<AlignedBufferPool> AlignedBufferPool::streamInstance = NULL;
+
+static std::mutex instanceMutex;
+
+shared_ptr<AlignedBufferPool> AlignedBufferPool::getInstance() {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (!instance) {
+        /* one chunk plus the partial blocks at both ends */
+        int64_t bufferSize = Configuration::LOCAL_IO_CHUNK_SIZE + 2 * DIRECT_IO_MAX_ALIGNMENT;
+        instance = shared_ptr<AlignedBufferPool>(
+                new AlignedBufferPool(bufferSize, Configuration::DIRECT_IO_BUFFER_POOL_SIZE));
+    }
+    return instance;
+}
+
+shared_ptr<AlignedBufferPool> AlignedBufferPool::getStreamInstance() {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (!streamInstance) {
+        /* the data of a window followed by its framed chunks, the frame
+         * headers fit in the spare page */
+        int64_t bufferSize = 2 * Configuration::OSS_STREAM_WINDOW_SIZE + DIRECT_IO_MAX_ALIGNMENT;
+        streamInstance = shared_ptr<AlignedBufferPool>(
+                new AlignedBufferPool(bufferSize, Configuration::OSS_STREAM_BUFFER_POOL_SIZE));
+    }
+    return streamInstance;
+}
+
+char *AlignedBufferPool::allocate(int64_t length) {
+    void *buffer = NULL;
+    int rc = posix_memalign(&buffer, DIRECT_IO_MAX_ALIGNMENT, length);
+    if (rc != 0) {
+        THROW(GopherwoodIOException,
+              "[AlignedBufferPool::allocate] posix_memalign failed, length=%ld, errno=%d", length, rc);
+    }
+    return (char *) buffer;
+}
+
+AlignedBufferPool::AlignedBufferPool(int64_t bufferSize, size_t maxFree) :
+        mBufferSize(bufferSize), mMaxFree(maxFree) {
+}
+
+char *AlignedBufferPool::get(int64_t length) {
+    if (length > mBufferSize) {
+        return allocate(length);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mFree.empty()) {
+            char *buffer = mFree.back();
+            mFree.pop_back();
+            return buffer;
+        }
+    }
+    return allocate(mBufferSize);
+}
+
+void AlignedBufferPool::put(char *buffer, int64_t length) {
+    if (length <= mBufferSize) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mFree.size() < mMaxFree) {
+            mFree.push_back(buffer);
+            return;
+        }
+    }
+    free(buffer);
+}
+
+size_t AlignedBufferPool::getNumFree() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFree.size();
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    for (size_t i = 0; i < mFree.size(); i++) {
+        free(mFree[i]);
+    }
+    mFree.clear();
+}
+
+}
+}
@@ -0,0 +1,82 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_BLOCK_ALIGNEDBUFFERPOOL_H
+#define GOPHERWOOD_BLOCK_ALIGNEDBUFFERPOOL_H
+
+#include "platform.h"
+
+#include "common/Memory.h"
+
+#include <mutex>
+#include <vector>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* largest direct I/O alignment handled by the bounce buffers */
+#define DIRECT_IO_MAX_ALIGNMENT     4096
+
+/**
+ * AlignedBufferPool
+ *
+ * @desc Process wide pools of page aligned buffers. The bounce buffers for
+ * direct I/O on the local space file keep up to DIRECT_IO_BUFFER_POOL_SIZE
+ * free, the window buffers OssBlockWorker streams blocks through keep up
+ * to OSS_STREAM_BUFFER_POOL_SIZE. Buffers of the pool size are recycled,
+ * larger requests get a dedicated allocation that is released on put().
+ */
+class AlignedBufferPool {
+public:
+    static shared_ptr<AlignedBufferPool> getInstance();
+
+    static shared_ptr<AlignedBufferPool> getStreamInstance();
+
+    /* allocate length bytes aligned to DIRECT_IO_MAX_ALIGNMENT, never returns NULL */
+    static char *allocate(int64_t length);
+
+    char *get(int64_t length);
+
+    void put(char *buffer, int64_t length);
+
+    inline int64_t getBufferSize() {
+        return mBufferSize;
+    };
+
+    size_t getNumFree();
+
+    ~AlignedBufferPool();
+
+private:
+    AlignedBufferPool(int64_t bufferSize, size_t maxFree);
+
+    static shared_ptr<AlignedBufferPool> instance;
+    static shared_ptr<AlignedBufferPool> streamInstance;
+
+    int64_t mBufferSize;
+    size_t mMaxFree;
+    std::vector<char *> mFree;
+    std::mutex mMutex;
+};
+
+}
+}
+#endif //GOPHERWOOD_BLOCK_ALIGNEDBUFFERPOOL_H
@@ -0,0 +1,270 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/BlockCodec.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+shared_ptr<BlockCodec> BlockCodec::create(int32_t codecId) {
+    switch (codecId) {
+        case BLOCK_CODEC_NONE:
+            return shared_ptr<BlockCodec>(new NoneCodec());
+        case BLOCK_CODEC_LZ:
+            return shared_ptr<BlockCodec>(new LzCodec());
+        default:
+            THROW(GopherwoodInvalidParmException,
+                  "[BlockCodec] Unknown block codec %d", codecId);
+    }
+}
+
+int32_t NoneCodec::getId() {
+    return BLOCK_CODEC_NONE;
+}
+
+int64_t NoneCodec::compressBound(int64_t length) {
+    return length;
+}
+
+int64_t NoneCodec::compress(const char *src, int64_t length, char *dst, int64_t capacity) {
+    if (length > capacity) {
+        return -1;
+    }
+    memcpy(dst, src, length);
+    return length;
+}
+
+int64_t NoneCodec::decompress(const char *src, int64_t length, char *dst, int64_t capacity) {
+    if (length > capacity) {
+        THROW(GopherwoodIOException,
+              "[NoneCodec] Data of %ld bytes does not fit %ld bytes", length, capacity);
+    }
+    memcpy(dst, src, length);
+    return length;
+}
+
+/* the format requires the last literals to cover this many bytes */
+#define LZ_LAST_LITERALS    5
+/* and no match to start in the last bytes of the input */
+#define LZ_MATCH_MARGIN     12
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_OFFSET       65535
+#define LZ_HASH_BITS        12
+
+static inline uint32_t lzRead32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t lzHash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/* 15 in the token nibble, then 255 per byte until the remainder */
+static inline uint8_t *lzWriteLength(uint8_t *op, int64_t length) {
+    length -= 15;
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+/* a sequence costs at most this much on top of its literals */
+static inline int64_t lzSequenceBound(int64_t literals) {
+    return 1 + literals / 255 + 1 + 2 + 1;
+}
+
+int32_t LzCodec::getId() {
+    return BLOCK_CODEC_LZ;
+}
+
+int64_t LzCodec::compressBound(int64_t length) {
+    return length + length / 255 + 16;
+}
+
+int64_t LzCodec::compress(const char *src, int64_t length, char *dst, int64_t capacity) {
+    const uint8_t *base = (const uint8_t *) src;
+    const uint8_t *ip = base;
+    const uint8_t *anchor = base;
+    const uint8_t *end = base + length;
+    const uint8_t *matchLimit = end - LZ_LAST_LITERALS;
+    uint8_t *op = (uint8_t *) dst;
+    uint8_t *opEnd = op + capacity;
+    uint32_t table[1 << LZ_HASH_BITS];
+
+    memset(table, 0, sizeof(table));
+
+    if (length > LZ_MATCH_MARGIN) {
+        const uint8_t *limit = end - LZ_MATCH_MARGIN;
+        while (ip < limit) {
+            uint32_t seq = lzRead32(ip);
+            uint32_t h = lzHash(seq);
+            /* positions are stored plus one, 0 is an empty slot */
+            const uint8_t *ref = base + table[h] - 1;
+            bool found = table[h] != 0 && ip - ref <= LZ_MAX_OFFSET && lzRead32(ref) == seq;
+            table[h] = (uint32_t) (ip - base) + 1;
+
+            if (!found) {
+                /* skip faster through data that does not compress */
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            int64_t matchLength = LZ_MIN_MATCH;
+            while (ip + matchLength < matchLimit && ip[matchLength] == ref[matchLength]) {
+                matchLength++;
+            }
+
+            int64_t literals = ip - anchor;
+            if (opEnd - op < literals + lzSequenceBound(literals) + matchLength / 255) {
+                return -1;
+            }
+
+            uint8_t *token = op++;
+            *token = (uint8_t) ((literals >= 15 ? 15 : literals) << 4);
+            if (literals >= 15) {
+                op = lzWriteLength(op, literals);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            uint16_t offset = (uint16_t) (ip - ref);
+            *op++ = (uint8_t) offset;
+            *op++ = (uint8_t) (offset >> 8);
+
+            int64_t extra = matchLength - LZ_MIN_MATCH;
+            *token |= (uint8_t) (extra >= 15 ? 15 : extra);
+            if (extra >= 15) {
+                op = lzWriteLength(op, extra);
+            }
+
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    /* the last sequence has literals only */
+    int64_t literals = end - anchor;
+    if (opEnd - op < literals + lzSequenceBound(literals)) {
+        return -1;
+    }
+    *op++ = (uint8_t) ((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) {
+        op = lzWriteLength(op, literals);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - (uint8_t *) dst;
+}
+
+/* read the extension bytes of a length nibble, -1 if the input ends first */
+static inline int64_t lzReadLength(const uint8_t *&ip, const uint8_t *end) {
+    int64_t length = 0;
+    uint8_t b;
+    do {
+        if (ip >= end) {
+            return -1;
+        }
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return length;
+}
+
+int64_t LzCodec::decompress(const char *src, int64_t length, char *dst, int64_t capacity) {
+    const uint8_t *ip = (const uint8_t *) src;
+    const uint8_t *end = ip + length;
+    uint8_t *op = (uint8_t *) dst;
+    uint8_t *opEnd = op + capacity;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+
+        int64_t literals = token >> 4;
+        if (literals == 15) {
+            int64_t more = lzReadLength(ip, end);
+            if (more < 0) {
+                break;
+            }
+            literals += more;
+        }
+        if (end - ip < literals || opEnd - op < literals) {
+            break;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == end) {
+            return op - (uint8_t *) dst;
+        }
+
+        if (end - ip < 2) {
+            break;
+        }
+        int64_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - (uint8_t *) dst) {
+            break;
+        }
+
+        int64_t matchLength = token & 15;
+        if (matchLength == 15) {
+            int64_t more = lzReadLength(ip, end);
+            if (more < 0) {
+                break;
+            }
+            matchLength += more;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (opEnd - op < matchLength) {
+            break;
+        }
+
+        const uint8_t *ref = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, ref, matchLength);
+            op += matchLength;
+        } else {
+            /* overlapping copy repeats the last offset bytes */
+            for (int64_t i = 0; i < matchLength; i++) {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    THROW(GopherwoodIOException,
+          "[LzCodec] Malformed compressed data at input offset %ld",
+          (int64_t) (ip - (const uint8_t *) src));
+}
+
+}
+}
@@ -0,0 +1,90 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_BLOCK_BLOCKCODEC_H
+#define GOPHERWOOD_BLOCK_BLOCKCODEC_H
+
+#include "platform.h"
+
+#include "common/Memory.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+/* codecs of blocks written to OSS, see Configuration::OSS_BLOCK_CODEC.
+ * The id is stored in every object, never renumber them */
+#define BLOCK_CODEC_NONE    0
+#define BLOCK_CODEC_LZ      1
+
+/**
+ * Compresses one chunk of a block at a time. Codecs keep no state between
+ * calls, a single instance is shared by the codec threads.
+ */
+class BlockCodec {
+public:
+    /* THROW GopherwoodInvalidParmException on an unknown id */
+    static shared_ptr<BlockCodec> create(int32_t codecId);
+
+    virtual int32_t getId() = 0;
+
+    /* the largest output of compress for length bytes of input */
+    virtual int64_t compressBound(int64_t length) = 0;
+
+    /**
+     * @return the compressed length, or -1 if it does not fit in capacity
+     */
+    virtual int64_t compress(const char *src, int64_t length, char *dst, int64_t capacity) = 0;
+
+    /**
+     * Malformed input never writes past capacity, it throws GopherwoodIOException.
+     * @return the decompressed length
+     */
+    virtual int64_t decompress(const char *src, int64_t length, char *dst, int64_t capacity) = 0;
+
+    virtual ~BlockCodec() {
+    }
+};
+
+/* stores the data as is */
+class NoneCodec: public BlockCodec {
+public:
+    int32_t getId();
+    int64_t compressBound(int64_t length);
+    int64_t compress(const char *src, int64_t length, char *dst, int64_t capacity);
+    int64_t decompress(const char *src, int64_t length, char *dst, int64_t capacity);
+};
+
+/**
+ * Byte oriented LZ77 in the LZ4 block format: sequences of a token, literals
+ * and a 16 bit match offset, found through a hash table of 4 byte prefixes.
+ * Favors speed over ratio.
+ */
+class LzCodec: public BlockCodec {
+public:
+    int32_t getId();
+    int64_t compressBound(int64_t length);
+    int64_t compress(const char *src, int64_t length, char *dst, int64_t capacity);
+    int64_t decompress(const char *src, int64_t length, char *dst, int64_t capacity);
+};
+
+}
+}
+#endif //GOPHERWOOD_BLOCK_BLOCKCODEC_H
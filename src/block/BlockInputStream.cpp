@@ -19,6 +19,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "block/AlignedBufferPool.h"
 #include "block/BlockInputStream.h"
 #include "common/Configuration.h"
 #include "common/Logger.h"
@@ -27,10 +28,21 @@
 namespace Gopherwood {
 namespace Internal {
 
-BlockInputStream::BlockInputStream(int fd) : mLocalSpaceFD(fd) {
-    mLocalReader = shared_ptr<LocalBlockReader>(new LocalBlockReader(fd));
-    mOssWorker = shared_ptr<OssBlockWorker>(new OssBlockWorker(FileSystem::OSS_CONTEXT, fd));
+BlockInputStream::BlockInputStream(int fd, bool readAhead) : mLocalSpaceFD(fd) {
+    mIoEngine = IoEngine::create(fd);
+    mLocalReader = shared_ptr<LocalBlockReader>(new LocalBlockReader(mIoEngine));
+    mOssWorker = shared_ptr<OssBlockWorker>(new OssBlockWorker(fd));
     mBucketSize = Configuration::LOCAL_BUCKET_SIZE;
+    mBlockInfo.reset();
+    mReadAhead = readAhead && Configuration::READ_AHEAD_MAX_SIZE > 0;
+    mRaBuffer = NULL;
+    /* the window never outgrows the read-ahead buffer */
+    mRaWindow = std::min(Configuration::READ_AHEAD_MIN_SIZE, Configuration::READ_AHEAD_MAX_SIZE);
+    /* GW_SEQACC readers start at the file head */
+    mNextPos = 0;
+    mNumRaHits = 0;
+    mNumRaMisses = 0;
+    invalidate();
 }
 
 void BlockInputStream::setBlockInfo(BlockInfo info) {
@@ -38,6 +50,11 @@ void BlockInputStream::setBlockInfo(BlockInfo info) {
               "Set BlockInfo, new bucketId=%d, new blockOffset=%ld, %s",
         info.bucketId, info.offset, info.isLocal ? "local" : "remote");
     mBlockInfo = info;
+
+    /* the bucket may have been reused since the data was read ahead */
+    if (info.blockId != mRaBlockId || info.bucketId != mRaBucketId || !info.isLocal) {
+        invalidate();
+    }
 }
 
 int64_t BlockInputStream::remaining() {
@@ -48,8 +65,11 @@ int64_t BlockInputStream::read(char *buffer, int64_t length) {
     int64_t read = -1;
 
     if (mBlockInfo.isLocal) {
-        mLocalReader->seek(getLocalSpaceOffset());
-        read = mLocalReader->readLocal(buffer, length);
+        if (mReadAhead) {
+            read = readAhead(buffer, length);
+        } else {
+            read = mLocalReader->readLocal(buffer, length, getLocalSpaceOffset());
+        }
         LOG(DEBUG1, "[BlockInputStream]      |"
                 "Read from local space, bucketId=%d, offset=%ld, length=%ld",
             mBlockInfo.bucketId, mBlockInfo.offset, length);
@@ -63,8 +83,111 @@ int64_t BlockInputStream::read(char *buffer, int64_t length) {
     return read;
 }
 
-void BlockInputStream::flush() {
+void BlockInputStream::readBatch(std::vector<IoRequest> &requests) {
+    if (!mBlockInfo.isLocal) {
+        /* Read from OSS */
+        return;
+    }
+
+    LOG(DEBUG1, "[BlockInputStream]      |"
+            "Read batch from local space, bucketId=%d, numRequests=%lu",
+        mBlockInfo.bucketId, requests.size());
+    int64_t base = mBlockInfo.bucketId * mBucketSize;
+    for (size_t i = 0; i < requests.size(); i++) {
+        assert(requests[i].offset + requests[i].length <= mBucketSize);
+        requests[i].offset += base;
+    }
+    mIoEngine->submitBatch(requests.data(), requests.size());
+}
+
+int64_t BlockInputStream::readv(const struct iovec *iov, int iovcnt, int64_t length) {
+    int64_t read = -1;
+
+    if (mBlockInfo.isLocal) {
+        read = mLocalReader->readvLocal(iov, iovcnt, getLocalSpaceOffset());
+        LOG(DEBUG1, "[BlockInputStream]      |"
+                "Readv from local space, bucketId=%d, offset=%ld, length=%ld, iovcnt=%d",
+            mBlockInfo.bucketId, mBlockInfo.offset, length, iovcnt);
+    } else {
+        /* Read from OSS */
+    }
 
+    mBlockInfo.offset += read;
+    mNextPos = mBlockInfo.blockId * mBucketSize + mBlockInfo.offset;
+    assert(mBlockInfo.offset <= mBucketSize);
+
+    return read;
+}
+
+int64_t BlockInputStream::readAhead(char *buffer, int64_t length) {
+    int64_t pos = mBlockInfo.blockId * mBucketSize + mBlockInfo.offset;
+    bool isSequential = pos == mNextPos;
+    mNextPos = pos + length;
+
+    /* served from memory */
+    if (mBlockInfo.offset >= mRaOffset && mBlockInfo.offset + length <= mRaOffset + mRaLength) {
+        memcpy(buffer, mRaBuffer + (mBlockInfo.offset - mRaOffset), length);
+        mNumRaHits++;
+        return length;
+    }
+    mNumRaMisses++;
+
+    /* random access restarts with the smallest window */
+    if (!isSequential) {
+        mRaWindow = std::min(Configuration::READ_AHEAD_MIN_SIZE, Configuration::READ_AHEAD_MAX_SIZE);
+        return mLocalReader->readLocal(buffer, length, getLocalSpaceOffset());
+    }
+
+    /* large reads gain nothing from the buffer */
+    if (length >= mRaWindow) {
+        return mLocalReader->readLocal(buffer, length, getLocalSpaceOffset());
+    }
+
+    fillReadAhead(length);
+    mRaWindow = std::min(mRaWindow * 2, Configuration::READ_AHEAD_MAX_SIZE);
+    if (mBlockInfo.offset + length > mRaOffset + mRaLength) {
+        return mLocalReader->readLocal(buffer, length, getLocalSpaceOffset());
+    }
+    memcpy(buffer, mRaBuffer + (mBlockInfo.offset - mRaOffset), length);
+    return length;
+}
+
+int64_t BlockInputStream::fillReadAhead(int64_t length) {
+    /* page aligned reads, or the direct I/O alignment if it is larger */
+    int64_t alignment = std::max(mIoEngine->getAlignment(), (int64_t) DIRECT_IO_MAX_ALIGNMENT);
+    if (!mRaBuffer) {
+        /* the largest window rounded out to the alignment at both ends */
+        mRaBuffer = AlignedBufferPool::allocate(Configuration::READ_AHEAD_MAX_SIZE + 2 * alignment);
+    }
+
+    /* read the window from an aligned offset, never past the readable data of the block */
+    int64_t start = mBlockInfo.offset / alignment * alignment;
+    int64_t end = (mBlockInfo.offset + mRaWindow + alignment - 1) / alignment * alignment;
+    end = std::min(end, std::min(mBlockInfo.dataSize, mBucketSize));
+    end = std::max(end, mBlockInfo.offset + length);
+
+    LOG(DEBUG1, "[BlockInputStream]      |"
+            "Read ahead bucketId=%d, offset=%ld, length=%ld, window=%ld",
+        mBlockInfo.bucketId, start, end - start, mRaWindow);
+    invalidate();
+    int64_t read = mLocalReader->readLocal(mRaBuffer, end - start, mBlockInfo.bucketId * mBucketSize + start);
+    mRaBlockId = mBlockInfo.blockId;
+    mRaBucketId = mBlockInfo.bucketId;
+    mRaOffset = start;
+    mRaLength = read;
+    return read;
+}
+
+void BlockInputStream::invalidate() {
+    mRaBlockId = InvalidBlockId;
+    mRaBucketId = InvalidBucketId;
+    mRaOffset = 0;
+    mRaLength = 0;
+}
+
+void BlockInputStream::getStatistics(GWFileInfo *fileInfo) {
+    fileInfo->numReadAheadHits = mNumRaHits;
+    fileInfo->numReadAheadMisses = mNumRaMisses;
 }
 
 int64_t BlockInputStream::getLocalSpaceOffset() {
@@ -72,7 +195,10 @@ int64_t BlockInputStream::getLocalSpaceOffset() {
 }
 
 BlockInputStream::~BlockInputStream() {
-
+    if (mRaBuffer) {
+        free(mRaBuffer);
+        mRaBuffer = NULL;
+    }
 }
 
 }
@@ -29,29 +29,60 @@
 #include "core/FileActiveStatus.h"
 #include "common/Memory.h"
 #include "oss/oss.h"
+#include "client/gopherwood.h"
 
 namespace Gopherwood {
 namespace Internal {
 class BlockInputStream {
 public:
-    BlockInputStream(int fd);
+    /* readAhead enables the adaptive read-ahead buffer of sequential readers */
+    BlockInputStream(int fd, bool readAhead);
 
+    /* info.dataSize bounds the read-ahead within the block */
     void setBlockInfo(BlockInfo info);
 
     int64_t remaining();
 
     int64_t read(char *buffer, int64_t length);
 
-    void flush();
+    /* independent reads of the block, request offsets are block offsets */
+    void readBatch(std::vector<IoRequest> &requests);
+
+    /* vectored read of length bytes, bypasses the read-ahead buffer */
+    int64_t readv(const struct iovec *iov, int iovcnt, int64_t length);
+
+    /* drop the read-ahead data, the block has been written by this handle */
+    void invalidate();
+
+    void getStatistics(GWFileInfo *fileInfo);
 
     ~BlockInputStream();
 
 private:
     int64_t getLocalSpaceOffset();
 
+    int64_t readAhead(char *buffer, int64_t length);
+
+    int64_t fillReadAhead(int64_t length);
+
     int mLocalSpaceFD;
     int64_t mBucketSize;
     BlockInfo mBlockInfo;
+
+    /* read-ahead buffer, holds [mRaOffset, mRaOffset + mRaLength) of block
+     * mRaBlockId in bucket mRaBucketId */
+    bool mReadAhead;
+    char *mRaBuffer;
+    int32_t mRaBlockId;
+    int32_t mRaBucketId;
+    int64_t mRaOffset;
+    int64_t mRaLength;
+    int64_t mRaWindow;
+    int64_t mNextPos;
+    uint64_t mNumRaHits;
+    uint64_t mNumRaMisses;
+
+    shared_ptr<IoEngine> mIoEngine;
     shared_ptr<LocalBlockReader> mLocalReader;
     shared_ptr<OssBlockWorker> mOssWorker;
 };
@@ -19,6 +19,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "block/AlignedBufferPool.h"
 #include "block/BlockOutputStream.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
@@ -29,15 +30,21 @@
 namespace Gopherwood {
 namespace Internal {
 
-BlockOutputStream::BlockOutputStream(int fd) : mLocalSpaceFD(fd) {
-    mLocalWriter = shared_ptr<LocalBlockWriter>(new LocalBlockWriter(fd));
-    mOssWorker = shared_ptr<OssBlockWorker>(new OssBlockWorker(FileSystem::OSS_CONTEXT, fd));
+BlockOutputStream::BlockOutputStream(int fd, int64_t bufferSize) : mLocalSpaceFD(fd) {
+    mIoEngine = IoEngine::create(fd);
+    mLocalWriter = shared_ptr<LocalBlockWriter>(new LocalBlockWriter(mIoEngine));
+    mOssWorker = shared_ptr<OssBlockWorker>(new OssBlockWorker(fd));
     mBucketSize = Configuration::LOCAL_BUCKET_SIZE;
     mBlockInfo.reset();
-    mCached = false;
+    mDirtyOverflow = false;
+    mBuffer = NULL;
+    mBufferSize = bufferSize;
+    mBufferOffset = 0;
+    mBufferedLength = 0;
 }
 
 void BlockOutputStream::setBlockInfo(BlockInfo info) {
+    flushBuffer();
     LOG(DEBUG1, "[BlockOutputStream]     |"
               "Set BlockInfo bucketId=%d, new blockOffset=%ld, %s",
         info.bucketId, info.offset, info.isLocal ? "local" : "remote");
@@ -52,16 +59,57 @@ int64_t BlockOutputStream::write(const char *buffer, int64_t length) {
     int64_t written = -1;
 
     if (mBlockInfo.isLocal) {
-        mLocalWriter->seek(getLocalSpaceOffset());
         LOG(DEBUG1, "[BlockOutputStream]     |"
                   "Write to local space, bucketId=%d, offset=%ld, length=%ld",
             mBlockInfo.bucketId, mBlockInfo.offset, length);
-        written = mLocalWriter->writeLocal(buffer, length);
+        if (mBufferedLength + length > mBufferSize) {
+            flushBuffer();
+        }
+
+        if (length >= mBufferSize) {
+            /* large writes gain nothing from combining */
+            written = mLocalWriter->writeLocal(buffer, length, getLocalSpaceOffset());
+            markDirty(getLocalSpaceOffset(), written);
+        } else {
+            if (!mBuffer) {
+                mBuffer = AlignedBufferPool::allocate(mBufferSize);
+            }
+            if (mBufferedLength == 0) {
+                mBufferOffset = mBlockInfo.offset;
+            }
+            memcpy(mBuffer + mBufferedLength, buffer, length);
+            mBufferedLength += length;
+            written = length;
+        }
     } else {
         /* Write to OSS */
     }
 
-    mCached = true;
+    mBlockInfo.offset += written;
+    assert(mBlockInfo.offset <= mBucketSize);
+
+    return written;
+}
+
+int64_t BlockOutputStream::writev(const struct iovec *iov, int iovcnt, int64_t length) {
+    if (length < mBufferSize) {
+        for (int i = 0; i < iovcnt; i++) {
+            write((const char *) iov[i].iov_base, iov[i].iov_len);
+        }
+        return length;
+    }
+
+    int64_t written = -1;
+    if (mBlockInfo.isLocal) {
+        LOG(DEBUG1, "[BlockOutputStream]     |"
+                  "Writev to local space, bucketId=%d, offset=%ld, length=%ld, iovcnt=%d",
+            mBlockInfo.bucketId, mBlockInfo.offset, length, iovcnt);
+        flushBuffer();
+        written = mLocalWriter->writevLocal(iov, iovcnt, getLocalSpaceOffset());
+        markDirty(getLocalSpaceOffset(), written);
+    } else {
+        /* Write to OSS */
+    }
 
     mBlockInfo.offset += written;
     assert(mBlockInfo.offset <= mBucketSize);
@@ -69,23 +117,80 @@ int64_t BlockOutputStream::write(const char *buffer, int64_t length) {
     return written;
 }
 
+void BlockOutputStream::flushBuffer() {
+    if (mBufferedLength == 0) {
+        return;
+    }
+
+    LOG(DEBUG1, "[BlockOutputStream]     |"
+              "Flush write buffer, bucketId=%d, offset=%ld, length=%ld",
+        mBlockInfo.bucketId, mBufferOffset, mBufferedLength);
+    int64_t offset = mBlockInfo.bucketId * mBucketSize + mBufferOffset;
+    mLocalWriter->writeLocal(mBuffer, mBufferedLength, offset);
+    markDirty(offset, mBufferedLength);
+    mBufferedLength = 0;
+}
+
+void BlockOutputStream::discardBuffer() {
+    mBufferedLength = 0;
+}
+
 void BlockOutputStream::flush() {
-    if (!mCached){
+    flushBuffer();
+    if (mDirtyRanges.empty() && !mDirtyOverflow) {
         return;
     }
 
-    if (mBlockInfo.isLocal) {
-        mLocalWriter->flush();
-    } else {
-        /* TODO: Remote flush, currently we won't write to OSS directly */
+    int32_t policy = Configuration::LOCAL_SYNC_POLICY;
+    if (policy != LOCAL_SYNC_NONE) {
+        LOG(DEBUG1, "[BlockOutputStream]     |"
+                  "Sync %lu dirty ranges%s", mDirtyRanges.size(), mDirtyOverflow ? " (overflowed)" : "");
+        if (policy == LOCAL_SYNC_FULL || mDirtyOverflow) {
+            mLocalWriter->sync();
+        } else {
+            for (size_t i = 0; i < mDirtyRanges.size(); i++) {
+                mLocalWriter->syncRange(mDirtyRanges[i].first, mDirtyRanges[i].second);
+            }
+            /* sync_file_range neither commits the extent metadata of fallocated
+             * space nor flushes the device cache, finish with one fdatasync */
+            mLocalWriter->sync();
+        }
     }
+    mDirtyRanges.clear();
+    mDirtyOverflow = false;
 }
 
 int64_t BlockOutputStream::getLocalSpaceOffset() {
     return mBlockInfo.bucketId * mBucketSize + mBlockInfo.offset;
 }
 
+void BlockOutputStream::markDirty(int64_t offset, int64_t length) {
+    if (mDirtyOverflow || length <= 0) {
+        return;
+    }
+
+    /* sequential writes keep extending the last range */
+    if (!mDirtyRanges.empty()) {
+        std::pair<int64_t, int64_t> &last = mDirtyRanges.back();
+        if (last.first + last.second == offset) {
+            last.second += length;
+            return;
+        }
+    }
+
+    if (mDirtyRanges.size() >= Configuration::LOCAL_SYNC_MAX_RANGES) {
+        mDirtyRanges.clear();
+        mDirtyOverflow = true;
+        return;
+    }
+    mDirtyRanges.push_back(std::make_pair(offset, length));
+}
+
 BlockOutputStream::~BlockOutputStream() {
+    if (mBuffer) {
+        free(mBuffer);
+        mBuffer = NULL;
+    }
 
 }
 
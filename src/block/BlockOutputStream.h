@@ -34,7 +34,8 @@ namespace Gopherwood {
 namespace Internal {
 class BlockOutputStream {
 public:
-    BlockOutputStream(int fd);
+    /* bufferSize 0 writes through to the local space */
+    BlockOutputStream(int fd, int64_t bufferSize);
 
     void setBlockInfo(BlockInfo info);
 
@@ -42,6 +43,16 @@ public:
 
     int64_t write(const char *buffer, int64_t length);
 
+    /* vectored write of length bytes, small lists go to the combining buffer */
+    int64_t writev(const struct iovec *iov, int iovcnt, int64_t length);
+
+    /* write the combined data to the local space */
+    void flushBuffer();
+
+    /* drop the combined data, used when the file is canceled */
+    void discardBuffer();
+
+    /* write the combined data and sync the dirty ranges as LOCAL_SYNC_POLICY says */
     void flush();
 
     ~BlockOutputStream();
@@ -49,11 +60,24 @@ public:
 private:
     int64_t getLocalSpaceOffset();
 
+    void markDirty(int64_t offset, int64_t length);
+
     int mLocalSpaceFD;
     int64_t mBucketSize;
     BlockInfo mBlockInfo;
-    bool mCached;
 
+    /* local space ranges written since the last flush, as (offset, length) */
+    std::vector<std::pair<int64_t, int64_t>> mDirtyRanges;
+    bool mDirtyOverflow;
+
+    /* write combining buffer, holds a contiguous range of the current block
+     * starting at block offset mBufferOffset */
+    char *mBuffer;
+    int64_t mBufferSize;
+    int64_t mBufferOffset;
+    int64_t mBufferedLength;
+
+    shared_ptr<IoEngine> mIoEngine;
     shared_ptr<LocalBlockWriter> mLocalWriter;
     shared_ptr<OssBlockWorker> mOssWorker;
 };
@@ -0,0 +1,423 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/AlignedBufferPool.h"
+#include "block/IoEngine.h"
+#include "block/UringIoEngine.h"
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "common/Logger.h"
+#include "common/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace Gopherwood {
+namespace Internal {
+
+static std::atomic<bool> uringUnavailable(false);
+
+static mutex ioThreadPoolMutex;
+static shared_ptr<ThreadPool> ioThreadPool;
+
+/* read-modify-write of a partial block is serialized per block, the engines
+ * of all streams share the stripes since they write the same local space file */
+#define RMW_LOCK_STRIPES 64
+static mutex rmwLocks[RMW_LOCK_STRIPES];
+
+static shared_ptr<ThreadPool> getIoThreadPool() {
+    lock_guard<mutex> lock(ioThreadPoolMutex);
+    if (!ioThreadPool) {
+        ioThreadPool = shared_ptr<ThreadPool>(new ThreadPool(Configuration::LOCAL_IO_THREADS));
+    }
+    return ioThreadPool;
+}
+
+/* single pread/pwrite attempt, errors are reported as -errno */
+static void syncTransfer(int fd, IoRequest *request) {
+    ssize_t res;
+    if (request->opcode == IoRead) {
+        res = pread(fd, request->buffer, request->length, request->offset);
+    } else {
+        res = pwrite(fd, request->buffer, request->length, request->offset);
+    }
+    request->result = res < 0 ? -errno : res;
+}
+
+shared_ptr<IoEngine> IoEngine::create(int fd) {
+    return create(fd, Configuration::LOCAL_IO_ENGINE, Configuration::LOCAL_IO_QUEUE_DEPTH);
+}
+
+shared_ptr<IoEngine> IoEngine::create(int fd, int type, uint32_t queueDepth) {
+    if (type == IO_ENGINE_URING && !uringUnavailable) {
+        try {
+            return shared_ptr<IoEngine>(new UringIoEngine(fd, queueDepth));
+        } catch (const GopherwoodIOException &e) {
+            /* the kernel or the sandbox refuses io_uring, stop probing for it */
+            if (!uringUnavailable.exchange(true)) {
+                LOG(WARNING, "[IoEngine]              |"
+                        "io_uring is not available, fall back to the thread pool engine: %s", e.what());
+            }
+        }
+    }
+
+    if (type == IO_ENGINE_URING || type == IO_ENGINE_THREADPOOL) {
+        return shared_ptr<IoEngine>(new ThreadPoolIoEngine(fd, queueDepth));
+    }
+    return shared_ptr<IoEngine>(new SyncIoEngine(fd));
+}
+
+int64_t IoEngine::getDirectIoAlignment(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || !(flags & O_DIRECT)) {
+        return 0;
+    }
+
+#ifdef STATX_DIOALIGN
+    struct statx st;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &st) == 0 &&
+        (st.stx_mask & STATX_DIOALIGN) && st.stx_dio_offset_align > 0) {
+        return std::max(st.stx_dio_offset_align, st.stx_dio_mem_align);
+    }
+#endif
+    /* the kernel can not tell, a page covers every common device */
+    return DIRECT_IO_MAX_ALIGNMENT;
+}
+
+IoEngine::IoEngine(int fd, uint32_t queueDepth) : mFD(fd), mQueueDepth(queueDepth) {
+    if (mQueueDepth == 0) {
+        mQueueDepth = 1;
+    }
+    mAlignment = getDirectIoAlignment(fd);
+}
+
+int64_t IoEngine::read(char *buffer, int64_t length, int64_t offset) {
+    struct iovec iov = {buffer, (size_t) length};
+    return transfer(IoRead, &iov, 1, offset);
+}
+
+int64_t IoEngine::write(const char *buffer, int64_t length, int64_t offset) {
+    struct iovec iov = {(void *) buffer, (size_t) length};
+    return transfer(IoWrite, &iov, 1, offset);
+}
+
+int64_t IoEngine::readv(const struct iovec *iov, int iovcnt, int64_t offset) {
+    return transfer(IoRead, iov, iovcnt, offset);
+}
+
+int64_t IoEngine::writev(const struct iovec *iov, int iovcnt, int64_t offset) {
+    return transfer(IoWrite, iov, iovcnt, offset);
+}
+
+/* split a contiguous file range into chunk sized requests and submit them as one batch */
+int64_t IoEngine::transfer(IoOpcode opcode, const struct iovec *iov, int iovcnt, int64_t offset) {
+    std::vector<IoRequest> requests;
+    int64_t chunkSize = Configuration::LOCAL_IO_CHUNK_SIZE;
+    int64_t pos = offset;
+
+    for (int i = 0; i < iovcnt; i++) {
+        char *base = (char *) iov[i].iov_base;
+        int64_t len = iov[i].iov_len;
+        int64_t done = 0;
+        while (done < len) {
+            /* cut at chunk boundaries of the file, so only the ends of a range are unaligned */
+            int64_t chunkEnd = ((pos + done) / chunkSize + 1) * chunkSize;
+            int64_t piece = std::min(len - done, chunkEnd - pos - done);
+            requests.push_back(IoRequest(opcode, base + done, piece, pos + done));
+            done += piece;
+        }
+        pos += len;
+    }
+    if (requests.empty()) {
+        return 0;
+    }
+
+    if (mAlignment > 0) {
+        submitDirect(requests);
+    } else {
+        submit(requests.data(), requests.size());
+    }
+
+    int64_t total = 0;
+    for (size_t i = 0; i < requests.size(); i++) {
+        IoRequest &req = requests[i];
+        if (req.result < 0) {
+            THROW(GopherwoodIOException,
+                  "[IoEngine::transfer] %s %s failed, offset=%ld, length=%ld, errno=%ld",
+                  getName(), opcode == IoRead ? "read" : "write", req.offset, req.length, -req.result);
+        }
+        total += req.result;
+        /* short read means end of the local space file */
+        if (req.result < req.length) {
+            break;
+        }
+    }
+    return total;
+}
+
+void IoEngine::submit(IoRequest *requests, int num) {
+    std::vector<IoRequest> batch;
+    std::vector<int> owner;
+    std::vector<int64_t> done(num, 0);
+
+    for (int i = 0; i < num; i++) {
+        requests[i].result = 0;
+        if (requests[i].length > 0) {
+            batch.push_back(requests[i]);
+            owner.push_back(i);
+        }
+    }
+
+    while (!batch.empty()) {
+        submitOnce(batch.data(), batch.size());
+
+        std::vector<IoRequest> retry;
+        std::vector<int> retryOwner;
+        for (size_t j = 0; j < batch.size(); j++) {
+            IoRequest &req = batch[j];
+            int i = owner[j];
+            if (req.result == -EINTR || req.result == -EAGAIN) {
+                retry.push_back(req);
+                retryOwner.push_back(i);
+            } else if (req.result < 0) {
+                requests[i].result = req.result;
+            } else if (req.result == 0) {
+                /* a read stops at end of file, a write making no progress
+                 * would be resubmitted forever and fails instead */
+                requests[i].result = req.opcode == IoWrite ? -EIO : done[i];
+            } else {
+                done[i] += req.result;
+                if (req.result < req.length) {
+                    /* resubmit the remaining part of a short transfer */
+                    IoRequest rest(req.opcode, req.buffer + req.result,
+                                   req.length - req.result, req.offset + req.result);
+                    retry.push_back(rest);
+                    retryOwner.push_back(i);
+                } else {
+                    requests[i].result = done[i];
+                }
+            }
+        }
+        batch.swap(retry);
+        owner.swap(retryOwner);
+    }
+}
+
+void IoEngine::submitBatch(IoRequest *requests, int num) {
+    std::vector<IoRequest> pieces;
+    std::vector<int> owner;
+    int64_t chunkSize = Configuration::LOCAL_IO_CHUNK_SIZE;
+
+    for (int i = 0; i < num; i++) {
+        IoRequest &req = requests[i];
+        int64_t done = 0;
+        while (done < req.length) {
+            int64_t chunkEnd = ((req.offset + done) / chunkSize + 1) * chunkSize;
+            int64_t piece = std::min(req.length - done, chunkEnd - req.offset - done);
+            pieces.push_back(IoRequest(req.opcode, req.buffer + done, piece, req.offset + done));
+            owner.push_back(i);
+            done += piece;
+        }
+        req.result = 0;
+    }
+    if (pieces.empty()) {
+        return;
+    }
+
+    if (mAlignment > 0) {
+        submitDirect(pieces);
+    } else {
+        submit(pieces.data(), pieces.size());
+    }
+
+    /* pieces of a request are in file order, add them up until the first short one */
+    std::vector<bool> stopped(num, false);
+    for (size_t j = 0; j < pieces.size(); j++) {
+        IoRequest &req = requests[owner[j]];
+        if (stopped[owner[j]]) {
+            continue;
+        }
+        if (pieces[j].result < 0) {
+            req.result = pieces[j].result;
+            stopped[owner[j]] = true;
+        } else {
+            req.result += pieces[j].result;
+            stopped[owner[j]] = pieces[j].result < pieces[j].length;
+        }
+    }
+}
+
+/* holds the stripes of the partial blocks a batch rewrites, locked in
+ * ascending order so that overlapping batches can not deadlock */
+class RmwLockGuard {
+public:
+    RmwLockGuard(std::vector<int> &stripes) : mStripes(stripes) {
+        std::sort(mStripes.begin(), mStripes.end());
+        mStripes.erase(std::unique(mStripes.begin(), mStripes.end()), mStripes.end());
+        for (size_t i = 0; i < mStripes.size(); i++) {
+            rmwLocks[mStripes[i]].lock();
+        }
+    }
+
+    ~RmwLockGuard() {
+        for (size_t i = mStripes.size(); i > 0; i--) {
+            rmwLocks[mStripes[i - 1]].unlock();
+        }
+    }
+
+private:
+    std::vector<int> mStripes;
+};
+
+/* the part of an unaligned request that goes through a bounce buffer */
+typedef struct BounceRequest {
+    int index;
+    char *buffer;
+    int64_t offset;
+    int64_t length;
+} BounceRequest;
+
+void IoEngine::submitDirect(std::vector<IoRequest> &requests) {
+    shared_ptr<AlignedBufferPool> pool = AlignedBufferPool::getInstance();
+    int64_t align = mAlignment;
+    std::vector<BounceRequest> bounces;
+    std::vector<IoRequest> batch;
+    std::vector<IoRequest> prefetch;
+    std::vector<int> stripes;
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        IoRequest &req = requests[i];
+        if ((uint64_t) req.buffer % align == 0 && req.offset % align == 0 && req.length % align == 0) {
+            batch.push_back(req);
+            continue;
+        }
+
+        BounceRequest bounce;
+        bounce.index = i;
+        bounce.offset = req.offset / align * align;
+        bounce.length = (req.offset + req.length + align - 1) / align * align - bounce.offset;
+        bounce.buffer = pool->get(bounce.length);
+        bounces.push_back(bounce);
+
+        if (req.opcode == IoWrite) {
+            /* read the partial blocks at both ends, a hole past end of file stays zero */
+            bool head = req.offset % align != 0;
+            bool tail = (req.offset + req.length) % align != 0;
+            memset(bounce.buffer, 0, bounce.length);
+            if (head || (tail && bounce.length == align)) {
+                prefetch.push_back(IoRequest(IoRead, bounce.buffer, align, bounce.offset));
+                stripes.push_back(bounce.offset / align % RMW_LOCK_STRIPES);
+            }
+            if (tail && bounce.length > align) {
+                prefetch.push_back(IoRequest(IoRead, bounce.buffer + bounce.length - align, align,
+                                             bounce.offset + bounce.length - align));
+                stripes.push_back((bounce.offset + bounce.length - align) / align % RMW_LOCK_STRIPES);
+            }
+        }
+        batch.push_back(IoRequest(req.opcode, bounce.buffer, bounce.length, bounce.offset));
+    }
+
+    /* another thread must not write a partial block between our read and write back */
+    RmwLockGuard rmwLock(stripes);
+    int rc = 0;
+    if (!prefetch.empty()) {
+        submit(prefetch.data(), prefetch.size());
+        for (size_t i = 0; i < prefetch.size(); i++) {
+            if (prefetch[i].result < 0) {
+                rc = prefetch[i].result;
+            }
+        }
+    }
+
+    if (rc == 0) {
+        for (size_t i = 0; i < bounces.size(); i++) {
+            IoRequest &req = requests[bounces[i].index];
+            if (req.opcode == IoWrite) {
+                memcpy(bounces[i].buffer + (req.offset - bounces[i].offset), req.buffer, req.length);
+            }
+        }
+        submit(batch.data(), batch.size());
+    }
+
+    /* map the results back, the batch keeps the order of the requests */
+    size_t next = 0;
+    size_t bounced = 0;
+    for (size_t i = 0; i < requests.size(); i++) {
+        IoRequest &req = requests[i];
+        if (bounced < bounces.size() && bounces[bounced].index == (int) i) {
+            BounceRequest &bounce = bounces[bounced++];
+            int64_t res = rc < 0 ? rc : batch[next++].result;
+            if (res < 0) {
+                req.result = res;
+            } else if (req.opcode == IoWrite) {
+                req.result = req.length;
+            } else {
+                int64_t skip = req.offset - bounce.offset;
+                req.result = std::max((int64_t) 0, std::min(res - skip, req.length));
+                memcpy(req.buffer, bounce.buffer + skip, req.result);
+            }
+            pool->put(bounce.buffer, bounce.length);
+        } else {
+            req.result = rc < 0 ? rc : batch[next++].result;
+        }
+    }
+}
+
+bool IoEngine::registerBuffer(char *buffer, int64_t length) {
+    return false;
+}
+
+IoEngine::~IoEngine() {
+}
+
+SyncIoEngine::SyncIoEngine(int fd) : IoEngine(fd, 1) {
+}
+
+void SyncIoEngine::submitOnce(IoRequest *requests, int num) {
+    for (int i = 0; i < num; i++) {
+        syncTransfer(mFD, &requests[i]);
+    }
+}
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(int fd, uint32_t queueDepth) : IoEngine(fd, queueDepth) {
+}
+
+void ThreadPoolIoEngine::submitOnce(IoRequest *requests, int num) {
+    shared_ptr<ThreadPool> pool = getIoThreadPool();
+    int fd = mFD;
+
+    /* regular files do not work with epoll, so blocking calls are spread over the pool */
+    for (int start = 0; start < num; start += mQueueDepth) {
+        int end = std::min(num, start + (int) mQueueDepth);
+        std::vector<future<void> > inflight;
+        for (int i = start; i < end; i++) {
+            IoRequest *request = &requests[i];
+            inflight.push_back(pool->enqueue([fd, request] { syncTransfer(fd, request); }));
+        }
+        for (size_t i = 0; i < inflight.size(); i++) {
+            inflight[i].get();
+        }
+    }
+}
+
+}
+}
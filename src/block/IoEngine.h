@@ -0,0 +1,168 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_BLOCK_IOENGINE_H
+#define GOPHERWOOD_BLOCK_IOENGINE_H
+
+#include "platform.h"
+
+#include "common/Memory.h"
+
+#include <sys/uio.h>
+#include <vector>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* local space I/O engine types, see Configuration::LOCAL_IO_ENGINE */
+#define IO_ENGINE_SYNC          0
+#define IO_ENGINE_THREADPOOL    1
+#define IO_ENGINE_URING         2
+
+typedef enum IoOpcode {
+    IoRead = 0,
+    IoWrite
+} IoOpcode;
+
+typedef struct IoRequest {
+    IoOpcode opcode;
+    char *buffer;
+    int64_t length;
+    int64_t offset;
+    /* transferred bytes, or -errno when the request failed */
+    int64_t result;
+
+    IoRequest() : opcode(IoRead), buffer(NULL), length(0), offset(0), result(0) {};
+    IoRequest(IoOpcode op, char *buf, int64_t len, int64_t off) :
+            opcode(op), buffer(buf), length(len), offset(off), result(0) {};
+} IoRequest;
+
+/**
+ * Positional I/O on the local space file. An engine instance is owned by a
+ * single stream or worker and is not thread safe. Requests of a batch are
+ * submitted together and the call returns when all of them completed,
+ * interrupted and short transfers are resubmitted by the engine.
+ *
+ * When the local space file is opened with O_DIRECT, read/write/readv/writev
+ * take any buffer and range: unaligned pieces go through bounce buffers of
+ * the AlignedBufferPool, partial blocks of a write are read, modified and
+ * written back under a per block lock shared by all engines.
+ */
+class IoEngine {
+public:
+    /* create the engine configured by LOCAL_IO_ENGINE, falling back to a
+     * simpler engine when the kernel refuses the configured one */
+    static shared_ptr<IoEngine> create(int fd);
+
+    static shared_ptr<IoEngine> create(int fd, int type, uint32_t queueDepth);
+
+    /* offset, length and memory alignment required by an O_DIRECT fd, 0 for a buffered fd */
+    static int64_t getDirectIoAlignment(int fd);
+
+    IoEngine(int fd, uint32_t queueDepth);
+
+    int64_t read(char *buffer, int64_t length, int64_t offset);
+
+    int64_t write(const char *buffer, int64_t length, int64_t offset);
+
+    int64_t readv(const struct iovec *iov, int iovcnt, int64_t offset);
+
+    int64_t writev(const struct iovec *iov, int iovcnt, int64_t offset);
+
+    /* on an O_DIRECT fd the requests of a batch must be aligned */
+    void submit(IoRequest *requests, int num);
+
+    /* submit independent requests of any size and alignment as one batch,
+     * each is cut at chunk boundaries like read/write do. The result of a
+     * request stops at its first short piece */
+    void submitBatch(IoRequest *requests, int num);
+
+    /* pin a long living buffer, requests inside it skip the per I/O page mapping */
+    virtual bool registerBuffer(char *buffer, int64_t length);
+
+    virtual int getType() = 0;
+
+    virtual const char *getName() = 0;
+
+    inline int getFD() {
+        return mFD;
+    };
+
+    inline uint32_t getQueueDepth() {
+        return mQueueDepth;
+    };
+
+    inline int64_t getAlignment() {
+        return mAlignment;
+    };
+
+    virtual ~IoEngine();
+
+protected:
+    /* one attempt for every request, results are filled in place */
+    virtual void submitOnce(IoRequest *requests, int num) = 0;
+
+    int64_t transfer(IoOpcode opcode, const struct iovec *iov, int iovcnt, int64_t offset);
+
+    void submitDirect(std::vector<IoRequest> &requests);
+
+    int mFD;
+    uint32_t mQueueDepth;
+    int64_t mAlignment;
+};
+
+/* one pread/pwrite at a time on the calling thread */
+class SyncIoEngine : public IoEngine {
+public:
+    SyncIoEngine(int fd);
+
+    int getType() {
+        return IO_ENGINE_SYNC;
+    };
+
+    const char *getName() {
+        return "sync";
+    };
+
+protected:
+    void submitOnce(IoRequest *requests, int num);
+};
+
+/* pread/pwrite on a process wide pool of I/O threads */
+class ThreadPoolIoEngine : public IoEngine {
+public:
+    ThreadPoolIoEngine(int fd, uint32_t queueDepth);
+
+    int getType() {
+        return IO_ENGINE_THREADPOOL;
+    };
+
+    const char *getName() {
+        return "threadpool";
+    };
+
+protected:
+    void submitOnce(IoRequest *requests, int num);
+};
+
+}
+}
+#endif //GOPHERWOOD_BLOCK_IOENGINE_H
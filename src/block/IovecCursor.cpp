@@ -0,0 +1,69 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/IovecCursor.h"
+
+#include <limits.h>
+
+namespace Gopherwood {
+namespace Internal {
+
+IovecCursor::IovecCursor(const struct iovec *iov, int iovcnt) :
+        mIov(iov), mIovcnt(iovcnt), mIndex(0), mOffset(0) {
+}
+
+int64_t IovecCursor::totalLength(const struct iovec *iov, int iovcnt) {
+    int64_t length = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+    return length;
+}
+
+int64_t IovecCursor::next(int64_t length, std::vector<struct iovec> &slice) {
+    int64_t sliceLength = 0;
+    slice.clear();
+
+    while (sliceLength < length && mIndex < mIovcnt && slice.size() < IOV_MAX) {
+        const struct iovec &cur = mIov[mIndex];
+        size_t bytes = std::min((size_t) (length - sliceLength), cur.iov_len - mOffset);
+        if (bytes > 0) {
+            struct iovec part = {(char *) cur.iov_base + mOffset, bytes};
+            slice.push_back(part);
+            sliceLength += bytes;
+            mOffset += bytes;
+        }
+
+        /* the entry is used up, empty entries are skipped */
+        if (mOffset == cur.iov_len) {
+            mIndex++;
+            mOffset = 0;
+        }
+    }
+    return sliceLength;
+}
+
+IovecCursor::~IovecCursor() {
+
+}
+
+}
+}
@@ -0,0 +1,57 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_BLOCK_IOVECCURSOR_H
+#define GOPHERWOOD_BLOCK_IOVECCURSOR_H
+
+#include "platform.h"
+
+#include <sys/uio.h>
+#include <vector>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* walks a caller's scatter/gather list, handing out slices of it that
+ * fit in one block and one preadv/pwritev call */
+class IovecCursor {
+public:
+    IovecCursor(const struct iovec *iov, int iovcnt);
+
+    /* total number of bytes in the list */
+    static int64_t totalLength(const struct iovec *iov, int iovcnt);
+
+    /* fill slice with the next bytes of the list, at most length bytes and
+     * IOV_MAX entries. Returns the number of bytes in the slice */
+    int64_t next(int64_t length, std::vector<struct iovec> &slice);
+
+    ~IovecCursor();
+
+private:
+    const struct iovec *mIov;
+    int mIovcnt;
+    int mIndex;
+    size_t mOffset;
+};
+
+}
+}
+#endif //GOPHERWOOD_BLOCK_IOVECCURSOR_H
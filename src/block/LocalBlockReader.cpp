@@ -25,17 +25,15 @@
 namespace Gopherwood {
 namespace Internal {
 
-LocalBlockReader::LocalBlockReader(int fd) : mLocalSpaceFD(fd) {
+LocalBlockReader::LocalBlockReader(shared_ptr<IoEngine> ioEngine) : mIoEngine(ioEngine) {
 }
 
-int LocalBlockReader::seek(int64_t offset) {
-    int64_t res = lseek(mLocalSpaceFD, offset, SEEK_SET);
-    return res;
+int64_t LocalBlockReader::readLocal(char *buffer, int64_t length, int64_t offset) {
+    return mIoEngine->read(buffer, length, offset);
 }
 
-int LocalBlockReader::readLocal(char *buffer, int64_t length) {
-    int64_t res = read(mLocalSpaceFD, buffer, length);
-    return res;
+int64_t LocalBlockReader::readvLocal(const struct iovec *iov, int iovcnt, int64_t offset) {
+    return mIoEngine->readv(iov, iovcnt, offset);
 }
 
 LocalBlockReader::~LocalBlockReader() {
@@ -24,23 +24,27 @@
 
 #include "platform.h"
 
+#include "block/IoEngine.h"
 #include "common/Memory.h"
 
+#include <sys/uio.h>
+
 namespace Gopherwood {
 namespace Internal {
 
 class LocalBlockReader {
 public:
-    LocalBlockReader(int fd);
+    LocalBlockReader(shared_ptr<IoEngine> ioEngine);
 
-    int seek(int64_t offset);
+    /* positional reads, the shared fd offset is never used */
+    int64_t readLocal(char *buffer, int64_t length, int64_t offset);
 
-    int readLocal(char *buffer, int64_t length);
+    int64_t readvLocal(const struct iovec *iov, int iovcnt, int64_t offset);
 
     ~LocalBlockReader();
 
 private:
-    int mLocalSpaceFD;
+    shared_ptr<IoEngine> mIoEngine;
 };
 
 }
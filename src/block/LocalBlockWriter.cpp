@@ -20,27 +20,39 @@
  * limitations under the License.
  */
 #include "block/LocalBlockWriter.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
 #include "common/Logger.h"
 
 namespace Gopherwood {
 namespace Internal {
 
-LocalBlockWriter::LocalBlockWriter(int fd) : mLocalSpaceFD(fd) {
-    mOffset = 0;
+LocalBlockWriter::LocalBlockWriter(shared_ptr<IoEngine> ioEngine) : mIoEngine(ioEngine) {
 }
 
-int LocalBlockWriter::seek(int64_t offset) {
-    int res = lseek(mLocalSpaceFD, offset, SEEK_SET);
-    return res;
+int64_t LocalBlockWriter::writeLocal(const char *buffer, int64_t length, int64_t offset) {
+    return mIoEngine->write(buffer, length, offset);
 }
 
-int LocalBlockWriter::writeLocal(const char *buffer, int64_t length) {
-    int res = write(mLocalSpaceFD, buffer, length);
-    return res;
+int64_t LocalBlockWriter::writevLocal(const struct iovec *iov, int iovcnt, int64_t offset) {
+    return mIoEngine->writev(iov, iovcnt, offset);
 }
 
-void LocalBlockWriter::flush() {
-    fsync(mLocalSpaceFD);
+void LocalBlockWriter::syncRange(int64_t offset, int64_t length) {
+    int rc = sync_file_range(mIoEngine->getFD(), offset, length,
+                             SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    if (rc < 0) {
+        THROW(GopherwoodIOException,
+              "[LocalBlockWriter::syncRange] sync_file_range offset=%ld, length=%ld failed, errno=%d",
+              offset, length, errno);
+    }
+}
+
+void LocalBlockWriter::sync() {
+    if (fdatasync(mIoEngine->getFD()) < 0) {
+        THROW(GopherwoodIOException,
+              "[LocalBlockWriter::sync] fdatasync failed, errno=%d", errno);
+    }
 }
 
 LocalBlockWriter::~LocalBlockWriter() {
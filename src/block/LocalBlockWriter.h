@@ -24,30 +24,38 @@
 
 #include "platform.h"
 
+#include "block/IoEngine.h"
 #include "common/Memory.h"
 
+#include <sys/uio.h>
+
 namespace Gopherwood {
 namespace Internal {
 
+/* local space sync policies, see Configuration::LOCAL_SYNC_POLICY */
+#define LOCAL_SYNC_NONE         0
+#define LOCAL_SYNC_RANGE        1
+#define LOCAL_SYNC_FULL         2
+
 class LocalBlockWriter {
 public:
-    LocalBlockWriter(int fd);
+    LocalBlockWriter(shared_ptr<IoEngine> ioEngine);
 
-    int seek(int64_t offset);
+    /* positional writes, the shared fd offset is never used */
+    int64_t writeLocal(const char *buffer, int64_t length, int64_t offset);
 
-    int writeLocal(const char *buffer, int64_t length);
+    int64_t writevLocal(const struct iovec *iov, int iovcnt, int64_t offset);
 
-    void flush();
+    /* write back a byte range of the local space and wait for it */
+    void syncRange(int64_t offset, int64_t length);
 
-    inline int64_t getCurOffset() {
-        return mOffset;
-    };
+    /* fdatasync the whole local space file */
+    void sync();
 
     ~LocalBlockWriter();
 
 private:
-    int mLocalSpaceFD;
-    int64_t mOffset;            //offset of the local space file
+    shared_ptr<IoEngine> mIoEngine;
 };
 
 }
@@ -20,133 +20,1133 @@
  * limitations under the License.
  */
 #include <oss/oss.h>
+#include "block/AlignedBufferPool.h"
+#include "block/LocalBlockReader.h"
+#include "block/LocalBlockWriter.h"
 #include "block/OssBlockWorker.h"
 #include "common/Configuration.h"
+#include "common/Crc32c.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
+#include "common/OssContextPool.h"
+#include "common/ThreadPool.h"
 #include "file/FileSystem.h"
 
+#include <time.h>
+
 namespace Gopherwood {
 namespace Internal {
 
-OssBlockWorker::OssBlockWorker(ossContext ossCtx, int localSpaceFD) :
-        mOssContext(ossCtx),
-        mLocalSpaceFD(localSpaceFD){
+/* "GWB4", little endian */
+#define OSS_BLOCK_MAGIC 0x34425747
+
+/* the block has a chunk index object, see OssBlockHeader */
+#define OSS_BLOCK_INDEXED 0x1
+
+/* set in a chunk frame when the chunk did not shrink and is stored as is */
+#define OSS_CHUNK_RAW 0x80000000U
+
+/* at the start of every part object, followed by a frame per chunk of the
+ * part. Everything in it is known before the first chunk is read from the
+ * bucket. Part 0 is the head, it is written last and names the parts. An
+ * indexed block has an index object holding the head header followed by the
+ * stored length of every chunk, so that pages are loaded with ranged GETs */
+struct OssBlockHeader {
+    uint32_t magic;
+    int32_t codec;
+    /* chunks in this part */
+    uint32_t numChunks;
+    uint32_t chunkSize;
+    int64_t dataSize;
+    int64_t partSize;
+    uint32_t part;
+    uint32_t numParts;
+    /* the same in every part of an upload, it seeds the chunk checksums */
+    uint64_t generation;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+/* in front of the stored bytes of every chunk */
+struct OssChunkFrame {
+    uint32_t stored;
+    /* CRC32C of the chunk data */
+    uint32_t checksum;
+};
+
+/* what moving a part cost, and the stored length of its chunks on upload */
+struct OssPartResult {
+    int64_t storedSize;
+    int64_t cpuNanos;
+    std::vector<uint32_t> chunks;
+};
+
+static mutex codecThreadPoolMutex;
+static shared_ptr<ThreadPool> codecThreadPool;
+
+static shared_ptr<ThreadPool> getCodecThreadPool() {
+    lock_guard<mutex> lock(codecThreadPoolMutex);
+    if (!codecThreadPool) {
+        codecThreadPool = shared_ptr<ThreadPool>(new ThreadPool(Configuration::OSS_CODEC_THREADS));
+    }
+    return codecThreadPool;
 }
 
-void OssBlockWorker::writeBlock(BlockInfo info) {
-    int64_t rc = 0;
+static mutex streamThreadPoolMutex;
+static shared_ptr<ThreadPool> streamThreadPool;
+
+static shared_ptr<ThreadPool> getStreamThreadPool() {
+    lock_guard<mutex> lock(streamThreadPoolMutex);
+    if (!streamThreadPool) {
+        streamThreadPool = shared_ptr<ThreadPool>(new ThreadPool(Configuration::OSS_STREAM_THREADS));
+    }
+    return streamThreadPool;
+}
+
+static mutex transferThreadPoolMutex;
+static shared_ptr<ThreadPool> transferThreadPool;
+
+static shared_ptr<ThreadPool> getTransferThreadPool() {
+    lock_guard<mutex> lock(transferThreadPoolMutex);
+    if (!transferThreadPool) {
+        transferThreadPool = shared_ptr<ThreadPool>(new ThreadPool(Configuration::OSS_TRANSFER_THREADS));
+    }
+    return transferThreadPool;
+}
+
+static int64_t threadCpuNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int64_t monotonicNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* bytes per second one OSS stream moved lately, 0 until measured */
+static std::atomic<int64_t> streamBandwidth(0);
+
+/* parts smaller than the minimum part size are dominated by the request
+ * latency and tell little about the bandwidth */
+static void recordTransfer(int64_t bytes, int64_t nanos) {
+    if (bytes < Configuration::OSS_PART_MIN_SIZE || nanos <= 0) {
+        return;
+    }
+    int64_t sample = (int64_t) (bytes * 1000000000.0 / nanos);
+    int64_t last = streamBandwidth.load();
+    /* a sample lost to a concurrent transfer does not matter */
+    streamBandwidth.store(last == 0 ? sample : (3 * last + sample) / 4);
+}
 
-    int64_t bucketSize = Configuration::LOCAL_BUCKET_SIZE;
-    char *buffer = (char*)malloc(info.dataSize);
+/* a part takes about OSS_PART_TARGET_TIME on one stream at the measured
+ * bandwidth: slow streams split a block over more of them, a fast stream
+ * moves it alone. Parts are whole chunks */
+static int64_t getPartSize(int64_t dataSize, int64_t chunkSize) {
+    int64_t partSize = dataSize;
+    if (Configuration::OSS_TRANSFER_THREADS > 0) {
+        partSize = std::max(streamBandwidth.load() * Configuration::OSS_PART_TARGET_TIME / 1000,
+                            Configuration::OSS_PART_MIN_SIZE);
+    }
+    partSize = (partSize + chunkSize - 1) / chunkSize * chunkSize;
+    return std::max(partSize, chunkSize);
+}
+
+/* tells the parts of an upload from those of an earlier upload of the block */
+static uint64_t newGeneration() {
+    static std::atomic<uint64_t> counter(0);
+    return ((uint64_t) monotonicNanos() << 16) ^ (uint64_t) getpid() ^ (counter++ << 48);
+}
 
-    rc = lseek(mLocalSpaceFD, info.bucketId * bucketSize, SEEK_SET);
-    if (rc == -1){
+/* whole chunks of a window, at least one */
+static int64_t getWindowSize(int64_t chunkSize) {
+    return std::max<int64_t>(1, Configuration::OSS_STREAM_WINDOW_SIZE / chunkSize) * chunkSize;
+}
+
+/* the chunks of an upload are checked against its generation, a chunk of
+ * another upload fails the checksum */
+static uint32_t getChecksumSeed(const OssBlockHeader &header) {
+    return (uint32_t) (header.generation ^ (header.generation >> 32));
+}
+
+/* bytes of the block in the part */
+static int64_t getPartLength(const OssBlockHeader &header) {
+    int64_t offset = header.part * header.partSize;
+    return std::max<int64_t>(0, std::min(header.partSize, header.dataSize - offset));
+}
+
+/* the header tells the real size of a part, its GET asks for as much as a
+ * part can take up instead of a HEAD request. Chunks are never stored larger
+ * than raw */
+static int64_t getMaxObjectSize() {
+    return sizeof(OssBlockHeader) + 2 * Configuration::LOCAL_BUCKET_SIZE;
+}
+
+/* compress one chunk behind its frame, the slot takes the chunk raw. Return
+ * the CPU time spent */
+static int64_t encodeChunk(BlockCodec *codec, uint32_t seed, const char *src, int64_t length, char *slot) {
+    int64_t start = threadCpuNanos();
+    OssChunkFrame frame;
+    char *dst = slot + sizeof(frame);
+    int64_t rc = codec->compress(src, length, dst, length);
+    if (rc < 0 || rc >= length) {
+        memcpy(dst, src, length);
+        frame.stored = (uint32_t) length | OSS_CHUNK_RAW;
+    } else {
+        frame.stored = (uint32_t) rc;
+    }
+    frame.checksum = Crc32c::update(seed, src, length);
+    memcpy(slot, &frame, sizeof(frame));
+    return threadCpuNanos() - start;
+}
+
+/* decompress one chunk into its place in the window and check the data
+ * when verify is set, return the CPU time spent */
+static int64_t decodeChunk(BlockCodec *codec, uint32_t seed, bool verify, const char *src,
+                           OssChunkFrame frame, char *dst, int64_t length) {
+    int64_t start = threadCpuNanos();
+    int64_t storedLength = frame.stored & ~OSS_CHUNK_RAW;
+    int64_t rc;
+    if (frame.stored & OSS_CHUNK_RAW) {
+        rc = storedLength;
+        if (rc == length) {
+            memcpy(dst, src, length);
+        }
+    } else {
+        rc = codec->decompress(src, storedLength, dst, length);
+    }
+    if (rc != length) {
         THROW(GopherwoodIOException,
-              "[OssBlockWorker] Local file space seek error!");
+              "[OssBlockWorker] Chunk size mismatch, expect %ld, but got %ld", length, rc);
+    }
+    if (verify) {
+        uint32_t checksum = Crc32c::update(seed, dst, length);
+        if (checksum != frame.checksum) {
+            THROW(GopherwoodIOException,
+                  "[OssBlockWorker] Chunk checksum mismatch, expect %u, but got %u",
+                  frame.checksum, checksum);
+        }
+    }
+    return threadCpuNanos() - start;
+}
+
+/* run the chunk tasks on the codec threads, or inline for a single chunk */
+static int64_t runChunkTasks(std::vector<function<int64_t()> > &tasks) {
+    int64_t cpuNanos = 0;
+    if (tasks.size() <= 1 || Configuration::OSS_CODEC_THREADS == 0) {
+        for (size_t i = 0; i < tasks.size(); i++) {
+            cpuNanos += tasks[i]();
+        }
+        return cpuNanos;
+    }
+
+    shared_ptr<ThreadPool> pool = getCodecThreadPool();
+    std::vector<future<int64_t> > results;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        results.push_back(pool->enqueue(tasks[i]));
     }
+    /* wait for every task before the buffers can go, the first error wins */
+    exception_ptr error;
+    for (size_t i = 0; i < results.size(); i++) {
+        try {
+            cpuNanos += results[i].get();
+        } catch (...) {
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    return cpuNanos;
+}
 
-    rc = read(mLocalSpaceFD, buffer, info.dataSize);
-    if (rc != info.dataSize){
+/* wait for the bucket I/O of a window, errors are dropped. Used on the way
+ * out of a failed transfer before the window buffers go */
+static void drainLocalIo(future<int64_t> &pending) {
+    if (pending.valid()) {
+        try {
+            pending.get();
+        } catch (...) {
+        }
+    }
+}
+
+/* wait for the other parts of a block, add up what they cost and append
+ * their chunks in order. The first error wins, error may hold one already */
+static void waitParts(std::vector<future<OssPartResult> > &parts, OssPartResult &total,
+                      exception_ptr &error) {
+    for (size_t i = 0; i < parts.size(); i++) {
+        try {
+            OssPartResult result = parts[i].get();
+            total.storedSize += result.storedSize;
+            total.cpuNanos += result.cpuNanos;
+            total.chunks.insert(total.chunks.end(), result.chunks.begin(), result.chunks.end());
+        } catch (...) {
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    }
+}
+
+/**
+ * The two window buffers of a transfer: while one is on the wire, the bucket
+ * I/O of the other runs. A window buffer holds the data of the window
+ * followed by its framed chunks.
+ */
+class StreamWindows {
+public:
+    StreamWindows(int64_t windowSize, int64_t chunkSize) :
+            mPool(AlignedBufferPool::getStreamInstance()), mWindowSize(windowSize) {
+        int64_t numChunks = windowSize / chunkSize;
+        mLength = windowSize + numChunks * (int64_t) (sizeof(OssChunkFrame) + chunkSize);
+        mBuffers[0] = mPool->get(mLength);
+        try {
+            mBuffers[1] = mPool->get(mLength);
+        } catch (...) {
+            mPool->put(mBuffers[0], mLength);
+            throw;
+        }
+    }
+
+    ~StreamWindows() {
+        mPool->put(mBuffers[0], mLength);
+        mPool->put(mBuffers[1], mLength);
+    }
+
+    char *getData(int64_t window) {
+        return mBuffers[window % 2];
+    }
+
+    char *getFrames(int64_t window) {
+        return mBuffers[window % 2] + mWindowSize;
+    }
+
+private:
+    shared_ptr<AlignedBufferPool> mPool;
+    int64_t mWindowSize;
+    int64_t mLength;
+    char *mBuffers[2];
+};
+
+OssBlockWorker::OssBlockWorker(int localSpaceFD) :
+        mOssContexts(OssContextPool::getInstance()),
+        mPolicy(OssTransferPolicy::getInstance()),
+        mLocalSpaceFD(localSpaceFD),
+        mNumBytesEvicted(0),
+        mNumBytesUploaded(0),
+        mCompressNanos(0),
+        mDecompressNanos(0) {
+}
+
+void OssBlockWorker::deleteBlock(BlockInfo info) {
+    ossContext ctx = mOssContexts->acquire();
+    try {
+        deleteBlock(ctx, info);
+    } catch (...) {
+        mOssContexts->release(ctx, false);
+        throw;
+    }
+    mOssContexts->release(ctx);
+}
+
+/* the parts are uploaded in parallel, each on a context of its own. The
+ * head is committed after the other parts and the index, a failed upload
+ * leaves the head of the previous upload, which no longer matches its parts */
+void OssBlockWorker::writeBlock(BlockInfo info) {
+    int64_t chunkSize = Configuration::OSS_CODEC_CHUNK_SIZE;
+    int64_t partSize = getPartSize(info.dataSize, chunkSize);
+    int64_t numChunks = (info.dataSize + chunkSize - 1) / chunkSize;
+    shared_ptr<BlockCodec> codec = BlockCodec::create(Configuration::OSS_BLOCK_CODEC);
+
+    OssBlockHeader header;
+    header.magic = OSS_BLOCK_MAGIC;
+    header.codec = codec->getId();
+    header.chunkSize = chunkSize;
+    header.dataSize = info.dataSize;
+    header.partSize = partSize;
+    header.part = 0;
+    header.numParts = std::max<int64_t>(1, (info.dataSize + partSize - 1) / partSize);
+    header.generation = newGeneration();
+    /* a block of one chunk or one page is always loaded whole */
+    header.flags = Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE > 0 && numChunks > 1 &&
+                   info.dataSize > Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE ? OSS_BLOCK_INDEXED : 0;
+    header.reserved = 0;
+    header.numChunks = (getPartLength(header) + chunkSize - 1) / chunkSize;
+
+    std::vector<future<OssPartResult> > parts;
+    for (uint32_t part = 1; part < header.numParts; part++) {
+        OssBlockHeader partHeader = header;
+        partHeader.part = part;
+        partHeader.numChunks = (getPartLength(partHeader) + chunkSize - 1) / chunkSize;
+        parts.push_back(getTransferThreadPool()->enqueue([this, info, partHeader, codec]() {
+            return transferPart(info, partHeader, codec.get(), true);
+        }));
+    }
+
+    /* the head streams while the other parts move */
+    std::string name = getOssObjectName(info);
+    OssPartResult head;
+    OssPartResult total;
+    total.storedSize = 0;
+    total.cpuNanos = 0;
+    exception_ptr error;
+    exception_ptr headError;
+    bool headUploaded = false;
+    ossContext ctx = NULL;
+    ossObject remoteBlock = NULL;
+    try {
+        ctx = mOssContexts->acquire();
+        remoteBlock = openUpload(ctx, name);
+        head = uploadPart(ctx, remoteBlock, info, header, codec.get());
+        headUploaded = true;
+    } catch (...) {
+        headError = current_exception();
+    }
+    waitParts(parts, total, error);
+
+    /* the index and the head commit after the parts, a head whose upload or
+     * commit failed is uploaded again */
+    try {
+        if (error) {
+            rethrow_exception(error);
+        }
+        if (headError && !OssTransferPolicy::isRetryable(headError)) {
+            rethrow_exception(headError);
+        }
+        mPolicy->retry([&]() {
+            if (!headUploaded) {
+                if (remoteBlock != NULL) {
+                    mPolicy->getOps()->cancelObject(ctx, remoteBlock);
+                    remoteBlock = NULL;
+                }
+                mOssContexts->release(ctx, false);
+                ctx = NULL;
+                ctx = mOssContexts->acquire();
+                remoteBlock = openUpload(ctx, name);
+                head = uploadPart(ctx, remoteBlock, info, header, codec.get());
+                headUploaded = true;
+            }
+            if (header.flags & OSS_BLOCK_INDEXED) {
+                std::vector<uint32_t> chunks(head.chunks);
+                chunks.insert(chunks.end(), total.chunks.begin(), total.chunks.end());
+                writeIndex(info, header, chunks);
+            }
+            ossObject committed = remoteBlock;
+            remoteBlock = NULL;
+            headUploaded = false;
+            commitUpload(ctx, committed);
+        }, headError ? 1 : 0);
+        deleteStaleObjects(ctx, info, header);
+    } catch (...) {
+        if (remoteBlock != NULL) {
+            mPolicy->getOps()->cancelObject(ctx, remoteBlock);
+        }
+        mOssContexts->release(ctx, false);
+        throw;
+    }
+    mOssContexts->release(ctx);
+    total.storedSize += head.storedSize;
+    total.cpuNanos += head.cpuNanos;
+
+    mNumBytesEvicted += info.dataSize;
+    mNumBytesUploaded += total.storedSize;
+    mCompressNanos += total.cpuNanos;
+    LOG(DEBUG1, "[OssBlockWorker]        | writeBlock bucketId=%d, size %ld, stored %ld in %u parts, "
+            "ratio %.2f, codec cpu %ld us", info.bucketId, info.dataSize, total.storedSize,
+        header.numParts, total.storedSize > 0 ? (double) info.dataSize / total.storedSize : 1.0,
+        total.cpuNanos / 1000);
+}
+
+/* the head names the parts, they are fetched in parallel while the head is
+ * loaded. Every chunk is checked before it is written, a failed load leaves
+ * at most good data of the block in the bucket, which is not marked loaded */
+int64_t OssBlockWorker::readBlock(BlockInfo info, const LoadCallback &onLoaded) {
+    OssObjectReader remoteBlock(getOssObjectName(info), 0, getMaxObjectSize() - 1);
+
+    OssBlockHeader header;
+    OssPartResult total;
+    total.storedSize = 0;
+    total.cpuNanos = 0;
+    exception_ptr error;
+    std::vector<future<OssPartResult> > parts;
+    memset(&header, 0, sizeof(header));
+    int64_t headLength = remoteBlock.read((char *) &header, sizeof(header));
+    if (headLength > 0 && header.magic != OSS_BLOCK_MAGIC) {
+        if (!Configuration::OSS_LEGACY_RAW_BLOCKS) {
+            THROW(GopherwoodIOException,
+                  "[OssBlockWorker] Object %s has no block header", getOssObjectName(info).c_str());
+        }
+        return readRawBlock(remoteBlock, info, (const char *) &header, headLength, onLoaded);
+    }
+    if (headLength != (int64_t) sizeof(header)) {
         THROW(GopherwoodIOException,
-              "[OssBlockWorker] Local file space read error!");
+              "[OssBlockWorker] Object %s is truncated, no complete header",
+              getOssObjectName(info).c_str());
     }
+    verifyHeader(info, header, header, 0);
+    shared_ptr<BlockCodec> codec = BlockCodec::create(header.codec);
 
-    ossObject remoteBlock = ossPutObject(mOssContext,
-                                         FileSystem::OSS_BUCKET.c_str(),
-                                         getOssObjectName(info).c_str(),
-                                         false);
-    if (remoteBlock == NULL) {
-        THROW(GopherwoodIOException, "OssBlockWorker ossPutObject failed! errno=%d, errmsg=%s",
-              errno, ossGetLastError());
+    for (uint32_t part = 1; part < header.numParts; part++) {
+        OssBlockHeader partHeader = header;
+        partHeader.part = part;
+        partHeader.numChunks = (getPartLength(partHeader) + header.chunkSize - 1) / header.chunkSize;
+        parts.push_back(getTransferThreadPool()->enqueue([this, info, partHeader, codec, onLoaded]() {
+            return transferPart(info, partHeader, codec.get(), false, onLoaded);
+        }));
     }
 
-    int written = ossWrite(mOssContext, remoteBlock, buffer, info.dataSize);
-    if (written != info.dataSize) {
-        THROW(GopherwoodIOException, "OssBlockWorker ossWrite failed! writeSize=%ld, errno=%d, errmsg=%s",
-              info.dataSize, errno, ossGetLastError());
+    try {
+        OssPartResult result = downloadChunks(remoteBlock, info, header, codec.get(),
+                                              0, getPartLength(header), onLoaded,
+                                              Configuration::OSS_VERIFY_CHECKSUM);
+        total.storedSize += result.storedSize + sizeof(header);
+        total.cpuNanos += result.cpuNanos;
+    } catch (...) {
+        error = current_exception();
     }
+    waitParts(parts, total, error);
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    mDecompressNanos += total.cpuNanos;
+    LOG(DEBUG1, "[OssBlockWorker]        | readBlock bucketId=%d, ossPath=%s, size %ld, "
+            "stored %ld in %u parts, codec cpu %ld us", info.bucketId, getOssObjectName(info).c_str(),
+        header.dataSize, total.storedSize, header.numParts, total.cpuNanos / 1000);
 
-    ossCloseObject(mOssContext, remoteBlock);
-    free(buffer);
-    buffer = NULL;
+    return header.dataSize;
 }
 
-int64_t OssBlockWorker::readBlock(BlockInfo info) {
-    int64_t rc = 0;
+/* objects written before blocks had a header hold the block as is, they are
+ * loaded only with OSS_LEGACY_RAW_BLOCKS. One is only taken whole, the GET
+ * must return as many bytes as its HEAD tells and no more than a bucket.
+ * head is what was read as the header */
+int64_t OssBlockWorker::readRawBlock(OssObjectReader &remoteBlock, BlockInfo info, const char *head,
+                                     int64_t headLength, const LoadCallback &onLoaded) {
+    std::string name = getOssObjectName(info);
+    int64_t objectSize = remoteBlock.getObjectSize();
+    if (objectSize < headLength || objectSize > Configuration::LOCAL_BUCKET_SIZE) {
+        THROW(GopherwoodIOException, "[OssBlockWorker] Object %s is not a block", name.c_str());
+    }
+
+    /* the raw block is the data of a single part */
+    OssBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.dataSize = objectSize;
+    int64_t bucketOffset = info.bucketId * Configuration::LOCAL_BUCKET_SIZE;
+    int64_t chunkSize = Configuration::OSS_CODEC_CHUNK_SIZE;
+    int64_t windowSize = getWindowSize(chunkSize);
+    StreamWindows windows(windowSize, chunkSize);
 
-    int64_t bucketSize = Configuration::LOCAL_BUCKET_SIZE;
+    future<int64_t> pending;
+    int64_t pendingOffset = 0;
+    int64_t pendingLength = 0;
+    try {
+        for (int64_t window = 0; window * windowSize < objectSize; window++) {
+            int64_t offset = window * windowSize;
+            int64_t length = std::min(windowSize, objectSize - offset);
+            char *data = windows.getData(window);
+            int64_t done = 0;
+            if (window == 0) {
+                memcpy(data, head, headLength);
+                done = headLength;
+            }
+            if (remoteBlock.read(data + done, length - done) != length - done) {
+                THROW(GopherwoodIOException,
+                      "[OssBlockWorker] Object %s is truncated, expect %ld bytes", name.c_str(), objectSize);
+            }
 
-    /* get object info */
-    ossHeadResult *headResult = ossHeadObject(mOssContext,
-                                              FileSystem::OSS_BUCKET.c_str(),
-                                              getOssObjectName(info).c_str());
-    if (!headResult) {
-        THROW(GopherwoodIOException, "OssBlockWorker head object failed! errno=%d, errmsg=%s",
-              errno, ossGetLastError());
+            if (pending.valid()) {
+                finishLocalWrite(pending, header, pendingOffset, pendingLength, onLoaded);
+            }
+            pending = startLocalIo(IoWrite, data, length, bucketOffset + offset);
+            pendingOffset = offset;
+            pendingLength = length;
+        }
+        if (pending.valid()) {
+            finishLocalWrite(pending, header, pendingOffset, pendingLength, onLoaded);
+        }
+    } catch (...) {
+        drainLocalIo(pending);
+        throw;
+    }
+
+    char extra;
+    if (remoteBlock.read(&extra, 1) != 0) {
+        THROW(GopherwoodIOException, "[OssBlockWorker] Object %s changed while it was read", name.c_str());
+    }
+
+    LOG(DEBUG1, "[OssBlockWorker]        | readBlock bucketId=%d, ossPath=%s, size %ld, "
+            "stored without header", info.bucketId, name.c_str(), objectSize);
+    return objectSize;
+}
+
+/* the chunk index tells where the chunks holding the range are stored, they
+ * are fetched with a ranged GET per part. The GET skips the part header, so
+ * the checksums seeded with the generation of the index are always checked:
+ * a part left by another upload fails them. The rest of the block follows
+ * the same way, its parts in parallel on the transfer threads */
+int64_t OssBlockWorker::readPages(BlockInfo info, int64_t offset, int64_t length,
+                                  const LoadCallback &onLoaded, bool whole) {
+    OssBlockHeader header;
+    std::vector<uint32_t> chunks;
+    readIndex(info, header, chunks);
+
+    shared_ptr<BlockCodec> codec = BlockCodec::create(header.codec);
+    int64_t numChunks = chunks.size();
+    int64_t end = std::min(offset + length, header.dataSize);
+    int64_t firstChunk = numChunks;
+    int64_t lastChunk = numChunks - 1;
+    if (offset < end) {
+        firstChunk = offset / header.chunkSize;
+        lastChunk = (end - 1) / header.chunkSize;
+    }
+
+    OssPartResult total;
+    total.storedSize = 0;
+    total.cpuNanos = 0;
+    exception_ptr error;
+    std::vector<future<OssPartResult> > parts;
+    try {
+        OssPartResult result = readChunks(info, header, chunks, codec.get(), firstChunk, lastChunk, onLoaded,
+                                          parts);
+        waitParts(parts, result, error);
+        parts.clear();
+        total.storedSize += result.storedSize;
+        total.cpuNanos += result.cpuNanos;
+        if (whole && !error) {
+            result = readChunks(info, header, chunks, codec.get(), 0, firstChunk - 1, onLoaded, parts);
+            total.storedSize += result.storedSize;
+            total.cpuNanos += result.cpuNanos;
+            result = readChunks(info, header, chunks, codec.get(), lastChunk + 1, numChunks - 1, onLoaded,
+                                parts);
+            total.storedSize += result.storedSize;
+            total.cpuNanos += result.cpuNanos;
+        }
+    } catch (...) {
+        if (!error) {
+            error = current_exception();
+        }
+    }
+    waitParts(parts, total, error);
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    mDecompressNanos += total.cpuNanos;
+    LOG(DEBUG1, "[OssBlockWorker]        | readPages bucketId=%d, ossPath=%s, offset %ld, length %ld, "
+            "loaded chunks %ld to %ld%s, stored %ld", info.bucketId, getOssObjectName(info).c_str(),
+        offset, length, firstChunk, lastChunk, whole ? " and the rest" : "", total.storedSize);
+    return header.dataSize;
+}
+
+/* load the chunks first to last with a ranged GET per part they span. The
+ * first part is loaded here, the others are queued on the transfer threads
+ * and appended to parts */
+OssPartResult OssBlockWorker::readChunks(BlockInfo info, OssBlockHeader &header, std::vector<uint32_t> &chunks,
+                                         BlockCodec *codec, int64_t firstChunk, int64_t lastChunk,
+                                         const LoadCallback &onLoaded, std::vector<future<OssPartResult> > &parts) {
+    OssPartResult result;
+    result.storedSize = 0;
+    result.cpuNanos = 0;
+    if (firstChunk > lastChunk) {
+        return result;
+    }
+
+    int64_t chunksPerPart = header.partSize / header.chunkSize;
+    for (int64_t part = firstChunk / chunksPerPart; part <= lastChunk / chunksPerPart; part++) {
+        int64_t partFirst = part * chunksPerPart;
+        int64_t first = std::max(firstChunk, partFirst);
+        int64_t last = std::min(lastChunk, partFirst + chunksPerPart - 1);
+        OssBlockHeader partHeader = header;
+        partHeader.part = part;
+        if (part == firstChunk / chunksPerPart || Configuration::OSS_TRANSFER_THREADS == 0) {
+            OssPartResult partResult = readPartChunks(info, partHeader, chunks, codec, first, last, onLoaded);
+            result.storedSize += partResult.storedSize;
+            result.cpuNanos += partResult.cpuNanos;
+        } else {
+            std::vector<uint32_t> *index = &chunks;
+            parts.push_back(getTransferThreadPool()->enqueue([this, info, partHeader, index, codec,
+                                                              first, last, onLoaded]() {
+                return readPartChunks(info, partHeader, *index, codec, first, last, onLoaded);
+            }));
+        }
+    }
+    return result;
+}
+
+/* one ranged GET of the chunks first to last of a part, header is what the
+ * index says about the part */
+OssPartResult OssBlockWorker::readPartChunks(BlockInfo info, OssBlockHeader header,
+                                             const std::vector<uint32_t> &chunks, BlockCodec *codec,
+                                             int64_t first, int64_t last, LoadCallback onLoaded) {
+    int64_t partFirst = header.part * (header.partSize / header.chunkSize);
+    int64_t start = sizeof(OssBlockHeader);
+    int64_t size = 0;
+    for (int64_t i = partFirst; i <= last; i++) {
+        int64_t framed = sizeof(OssChunkFrame) + (chunks[i] & ~OSS_CHUNK_RAW);
+        if (i < first) {
+            start += framed;
+        } else {
+            size += framed;
+        }
+    }
+
+    OssObjectReader remotePart(getOssPartName(info, header.part), start, start + size - 1);
+    int64_t chunkOffset = first * header.chunkSize;
+    return downloadChunks(remotePart, info, header, codec, chunkOffset,
+                          std::min((last + 1) * header.chunkSize, header.dataSize) - chunkOffset,
+                          onLoaded, true);
+}
+
+/* move a part other than the head, runs on the transfer threads. header is
+ * what the head says about the part */
+OssPartResult OssBlockWorker::transferPart(BlockInfo info, OssBlockHeader header,
+                                           BlockCodec *codec, bool upload, LoadCallback onLoaded) {
+    int64_t start = monotonicNanos();
+    OssPartResult result;
+    if (upload) {
+        mPolicy->retry([this, info, header, codec, &result]() {
+            result = putPart(info, header, codec);
+        });
+    } else {
+        OssObjectReader remotePart(getOssPartName(info, header.part), 0, getMaxObjectSize() - 1);
+        OssBlockHeader partHeader;
+        readHeader(remotePart, info, partHeader);
+        verifyHeader(info, partHeader, header, header.part);
+        result = downloadChunks(remotePart, info, header, codec,
+                                header.part * header.partSize, getPartLength(header), onLoaded,
+                                Configuration::OSS_VERIFY_CHECKSUM);
+        result.storedSize += sizeof(header);
+    }
+    recordTransfer(result.storedSize, monotonicNanos() - start);
+    return result;
+}
+
+/* one try of the upload of a part on a context of its own, committed */
+OssPartResult OssBlockWorker::putPart(BlockInfo info, OssBlockHeader header, BlockCodec *codec) {
+    ossContext ctx = mOssContexts->acquire();
+    OssPartResult result;
+    try {
+        ossObject remotePart = openUpload(ctx, getOssPartName(info, header.part));
+        try {
+            result = uploadPart(ctx, remotePart, info, header, codec);
+        } catch (...) {
+            mPolicy->getOps()->cancelObject(ctx, remotePart);
+            throw;
+        }
+        commitUpload(ctx, remotePart);
+    } catch (...) {
+        mOssContexts->release(ctx, false);
+        throw;
+    }
+    mOssContexts->release(ctx);
+    return result;
+}
+
+/* the part is uploaded window by window, the bucket is read one window
+ * ahead of the window being compressed and sent */
+OssPartResult OssBlockWorker::uploadPart(ossContext ctx, ossObject remotePart, BlockInfo info,
+                                         OssBlockHeader &header, BlockCodec *codec) {
+    int64_t start = monotonicNanos();
+    int64_t partOffset = info.bucketId * Configuration::LOCAL_BUCKET_SIZE + header.part * header.partSize;
+    int64_t partLength = getPartLength(header);
+    int64_t windowSize = getWindowSize(header.chunkSize);
+    StreamWindows windows(windowSize, header.chunkSize);
+
+    OssPartResult result;
+    result.storedSize = sizeof(header);
+    result.cpuNanos = 0;
+    future<int64_t> pending;
+    try {
+        writeObject(ctx, remotePart, (const char *) &header, sizeof(header));
+        if (partLength > 0) {
+            pending = startLocalIo(IoRead, windows.getData(0),
+                                   std::min(windowSize, partLength), partOffset);
+        }
+        for (int64_t window = 0; window * windowSize < partLength; window++) {
+            int64_t offset = window * windowSize;
+            int64_t length = std::min(windowSize, partLength - offset);
+            if (pending.get() != length) {
+                THROW(GopherwoodIOException,
+                      "[OssBlockWorker] Local file space read error!");
+            }
+            if (offset + length < partLength) {
+                pending = startLocalIo(IoRead, windows.getData(window + 1),
+                                       std::min(windowSize, partLength - offset - length),
+                                       partOffset + offset + length);
+            }
+
+            int64_t framedSize = 0;
+            result.cpuNanos += encodeWindow(codec, getChecksumSeed(header), windows.getData(window), length,
+                                            header.chunkSize, windows.getFrames(window), &framedSize,
+                                            result.chunks);
+            writeObject(ctx, remotePart, windows.getFrames(window), framedSize);
+            result.storedSize += framedSize;
+        }
+    } catch (...) {
+        drainLocalIo(pending);
+        throw;
     }
+    if (header.part == 0) {
+        recordTransfer(result.storedSize, monotonicNanos() - start);
+    }
+    return result;
+}
+
+/* load the chunks of [blockOffset, blockOffset + length) of the block, the
+ * object is positioned at the frame of the first one. A window is written
+ * into the bucket while the next one is received and decoded, onLoaded is
+ * told about every window written */
+OssPartResult OssBlockWorker::downloadChunks(OssObjectReader &remotePart, BlockInfo info,
+                                             OssBlockHeader &header, BlockCodec *codec,
+                                             int64_t blockOffset, int64_t length,
+                                             const LoadCallback &onLoaded, bool verify) {
+    int64_t start = monotonicNanos();
+    int64_t bucketOffset = info.bucketId * Configuration::LOCAL_BUCKET_SIZE;
+    int64_t windowSize = getWindowSize(header.chunkSize);
+    StreamWindows windows(windowSize, header.chunkSize);
+
+    OssPartResult result;
+    result.storedSize = 0;
+    result.cpuNanos = 0;
+    future<int64_t> pending;
+    int64_t pendingOffset = 0;
+    int64_t pendingLength = 0;
+    try {
+        for (int64_t window = 0; window * windowSize < length; window++) {
+            int64_t offset = blockOffset + window * windowSize;
+            int64_t windowLength = std::min(windowSize, blockOffset + length - offset);
+            result.storedSize += receiveWindow(remotePart, info, windowLength, header.chunkSize,
+                                               windows.getFrames(window));
+            result.cpuNanos += decodeWindow(codec, getChecksumSeed(header), verify, windows.getFrames(window),
+                                            windowLength, header.chunkSize, windows.getData(window));
+
+            /* the window before is written out before this one goes */
+            if (pending.valid()) {
+                finishLocalWrite(pending, header, pendingOffset, pendingLength, onLoaded);
+            }
+            pending = startLocalIo(IoWrite, windows.getData(window), windowLength, bucketOffset + offset);
+            pendingOffset = offset;
+            pendingLength = windowLength;
+        }
+        if (pending.valid()) {
+            finishLocalWrite(pending, header, pendingOffset, pendingLength, onLoaded);
+        }
+    } catch (...) {
+        drainLocalIo(pending);
+        throw;
+    }
+    if (header.part == 0 && length == getPartLength(header)) {
+        recordTransfer(result.storedSize, monotonicNanos() - start);
+    }
+    return result;
+}
+
+/* wait for a window written into the bucket. The bucket holds no data of the
+ * block past its end, the last window covers the rest of the bucket */
+void OssBlockWorker::finishLocalWrite(future<int64_t> &pending, OssBlockHeader &header,
+                                      int64_t offset, int64_t length, const LoadCallback &onLoaded) {
+    if (pending.get() != length) {
+        THROW(GopherwoodIOException,
+              "[OssBlockWorker] Local file space write error!");
+    }
+    if (onLoaded) {
+        if (offset + length == header.dataSize) {
+            length = Configuration::LOCAL_BUCKET_SIZE - offset;
+        }
+        onLoaded(offset, length);
+    }
+}
 
-    /* malloc buffer based on the object size */
-    int64_t objectSize = headResult->content_length;
-    char *buffer = (char*)malloc(objectSize);
+/* the index is the head header followed by the stored length of every
+ * chunk, one try on a context of its own */
+void OssBlockWorker::writeIndex(BlockInfo info, OssBlockHeader &header, std::vector<uint32_t> &chunks) {
+    std::vector<char> index(sizeof(header) + chunks.size() * sizeof(uint32_t));
+    memcpy(index.data(), &header, sizeof(header));
+    memcpy(index.data() + sizeof(header), chunks.data(), chunks.size() * sizeof(uint32_t));
 
-    /* get object */
-    ossObject remoteBlock = ossGetObject(mOssContext,
-                                         FileSystem::OSS_BUCKET.c_str(),
-                                         getOssObjectName(info).c_str(),
-                                         0,
-                                         objectSize - 1);
-    if (!remoteBlock) {
-        THROW(GopherwoodIOException, "OssBlockWorker read failed, reader object is null! errno=%d, errmsg=%s",
+    ossContext ctx = mOssContexts->acquire();
+    try {
+        ossObject remoteIndex = openUpload(ctx, getOssIndexName(info));
+        try {
+            writeObject(ctx, remoteIndex, index.data(), index.size());
+        } catch (...) {
+            mPolicy->getOps()->cancelObject(ctx, remoteIndex);
+            throw;
+        }
+        commitUpload(ctx, remoteIndex);
+    } catch (...) {
+        mOssContexts->release(ctx, false);
+        throw;
+    }
+    mOssContexts->release(ctx);
+}
+
+/* an index left by an upload whose head did not commit must not be used,
+ * it is checked against the head */
+void OssBlockWorker::readIndex(BlockInfo info, OssBlockHeader &header, std::vector<uint32_t> &chunks) {
+    /* chunks are at least a byte */
+    int64_t maxIndexSize = sizeof(header) + Configuration::LOCAL_BUCKET_SIZE * sizeof(uint32_t);
+    OssObjectReader remoteIndex(getOssIndexName(info), 0, maxIndexSize - 1);
+    readHeader(remoteIndex, info, header);
+    verifyHeader(info, header, header, 0);
+    if (!(header.flags & OSS_BLOCK_INDEXED)) {
+        THROW(GopherwoodIOException,
+              "[OssBlockWorker] Object %s is not a chunk index", getOssIndexName(info).c_str());
+    }
+    chunks.resize((header.dataSize + header.chunkSize - 1) / header.chunkSize);
+    int64_t indexSize = chunks.size() * sizeof(uint32_t);
+    if (remoteIndex.read((char *) chunks.data(), indexSize) != indexSize) {
+        THROW(GopherwoodIOException,
+              "[OssBlockWorker] Object %s is truncated", getOssIndexName(info).c_str());
+    }
+
+    OssBlockHeader head;
+    OssObjectReader remoteBlock(getOssObjectName(info), 0, sizeof(head) - 1);
+    readHeader(remoteBlock, info, head);
+    verifyHeader(info, header, head, 0);
+}
+
+void OssBlockWorker::readHeader(OssObjectReader &remotePart, BlockInfo info, OssBlockHeader &header) {
+    if (remotePart.read((char *) &header, sizeof(header)) != (int64_t) sizeof(header)) {
+        THROW(GopherwoodIOException,
+              "[OssBlockWorker] Object %s is truncated, no complete header",
+              getOssObjectName(info).c_str());
+    }
+}
+
+ossObject OssBlockWorker::openUpload(ossContext ctx, const std::string &name) {
+    mPolicy->countAttempt();
+    ossObject remotePart = mPolicy->getOps()->putObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str());
+    if (remotePart == NULL) {
+        THROW(GopherwoodOSSException, "OssBlockWorker ossPutObject failed! errno=%d, errmsg=%s",
               errno, ossGetLastError());
     }
+    return remotePart;
+}
 
+void OssBlockWorker::writeObject(ossContext ctx, ossObject remotePart, const char *buffer, int64_t length) {
+    int written = mPolicy->getOps()->write(ctx, remotePart, buffer, length);
+    if (written != length) {
+        THROW(GopherwoodOSSException, "OssBlockWorker ossWrite failed! writeSize=%ld, errno=%d, errmsg=%s",
+              length, errno, ossGetLastError());
+    }
+}
 
-    int64_t bytesToRead = objectSize;
-    int64_t bytesRead = 0;
-    int64_t offset = 0;
+void OssBlockWorker::commitUpload(ossContext ctx, ossObject remotePart) {
+    if (mPolicy->getOps()->closeObject(ctx, remotePart) != 0) {
+        THROW(GopherwoodOSSException, "OssBlockWorker ossCloseObject failed! errno=%d, errmsg=%s",
+              errno, ossGetLastError());
+    }
+}
 
-    do {
-        bytesRead = ossRead(mOssContext, remoteBlock, buffer + offset, bytesToRead);
-        bytesToRead -= bytesRead;
-        offset += bytesRead;
-    } while (bytesRead > 0 && bytesToRead > 0);
+/* read or write a window of the bucket on the stream threads, the future
+ * tells the bytes transferred */
+future<int64_t> OssBlockWorker::startLocalIo(IoOpcode opcode, char *buffer, int64_t length, int64_t offset) {
+    function<int64_t()> io = [this, opcode, buffer, length, offset]() {
+        shared_ptr<IoEngine> engine = acquireIoEngine();
+        int64_t rc = opcode == IoRead ?
+                     LocalBlockReader(engine).readLocal(buffer, length, offset) :
+                     LocalBlockWriter(engine).writeLocal(buffer, length, offset);
+        if (rc == length) {
+            releaseIoEngine(engine);
+        }
+        return rc;
+    };
+    if (Configuration::OSS_STREAM_THREADS == 0) {
+        packaged_task<int64_t()> task(io);
+        future<int64_t> result = task.get_future();
+        task();
+        return result;
+    }
+    return getStreamThreadPool()->enqueue(io);
+}
 
-    ossCloseObject(mOssContext, remoteBlock);
-    if (offset != objectSize || bytesToRead !=0) {
+/* a bad header must never size the transfer, a part must belong to the
+ * upload of its head */
+void OssBlockWorker::verifyHeader(BlockInfo info, OssBlockHeader &header, OssBlockHeader &head,
+                                  uint32_t part) {
+    if (header.magic != OSS_BLOCK_MAGIC) {
         THROW(GopherwoodIOException,
-              "[OssBlockWorker] Remote file size mismatch, expect %ld, but got %ld!",
-              objectSize,
-              bytesRead);
+              "[OssBlockWorker] Object %s is not a block", getOssPartName(info, part).c_str());
     }
 
-    rc = lseek(mLocalSpaceFD, info.bucketId * bucketSize, SEEK_SET);
-    if (rc == -1){
+    bool valid = header.dataSize >= 0 && header.dataSize <= Configuration::LOCAL_BUCKET_SIZE &&
+                 header.chunkSize > 0 && header.chunkSize < OSS_CHUNK_RAW &&
+                 header.partSize > 0 && header.partSize % header.chunkSize == 0 &&
+                 header.numParts == std::max<int64_t>(1, (header.dataSize + header.partSize - 1) / header.partSize) &&
+                 header.part == part &&
+                 header.numChunks == (getPartLength(header) + header.chunkSize - 1) / header.chunkSize;
+    if (!valid) {
         THROW(GopherwoodIOException,
-              "[OssBlockWorker] Local file space seek error!");
+              "[OssBlockWorker] Object %s has a corrupted header, size %ld, chunk size %u, %u chunks",
+              getOssPartName(info, part).c_str(), header.dataSize, header.chunkSize, header.numChunks);
     }
 
-    rc = write(mLocalSpaceFD, buffer, objectSize);
-    if (rc != objectSize){
+    if (header.generation != head.generation || header.codec != head.codec ||
+        header.dataSize != head.dataSize || header.partSize != head.partSize ||
+        header.chunkSize != head.chunkSize) {
         THROW(GopherwoodIOException,
-              "[OssBlockWorker] Local file space read error!");
+              "[OssBlockWorker] Object %s is not a part of the upload of its head",
+              getOssPartName(info, part).c_str());
     }
+}
 
-    LOG(DEBUG1, "[OssBlockWorker]        | readBlock bucketId=%d, ossPath=%s",
-        info.bucketId, getOssObjectName(info).c_str());
-    free(headResult);
-    free(buffer);
-    buffer = NULL;
+/* compress the chunks of a window into their slots and pack them, their
+ * stored lengths go to chunks. Return the CPU time spent in the codec */
+int64_t OssBlockWorker::encodeWindow(BlockCodec *codec, uint32_t seed, const char *data, int64_t length,
+                                     int64_t chunkSize, char *frames, int64_t *framedSize,
+                                     std::vector<uint32_t> &chunks) {
+    int64_t slotSize = sizeof(OssChunkFrame) + chunkSize;
+    int64_t numChunks = (length + chunkSize - 1) / chunkSize;
 
-    return objectSize;
+    std::vector<function<int64_t()> > tasks;
+    for (int64_t i = 0; i < numChunks; i++) {
+        int64_t chunkLength = std::min(chunkSize, length - i * chunkSize);
+        tasks.push_back(bind(encodeChunk, codec, seed, data + i * chunkSize, chunkLength,
+                             frames + i * slotSize));
+    }
+    int64_t cpuNanos = runChunkTasks(tasks);
+
+    int64_t packed = 0;
+    for (int64_t i = 0; i < numChunks; i++) {
+        OssChunkFrame frame;
+        memcpy(&frame, frames + i * slotSize, sizeof(frame));
+        int64_t framed = sizeof(frame) + (frame.stored & ~OSS_CHUNK_RAW);
+        memmove(frames + packed, frames + i * slotSize, framed);
+        packed += framed;
+        chunks.push_back(frame.stored);
+    }
+    *framedSize = packed;
+    return cpuNanos;
 }
 
-void OssBlockWorker::deleteBlock(BlockInfo info) {
-    int rc = ossDeleteObject(mOssContext, FileSystem::OSS_BUCKET.c_str(), getOssObjectName(info).c_str());
-    if (rc == -1){
+/* receive the framed chunks of a window, return the bytes received */
+int64_t OssBlockWorker::receiveWindow(OssObjectReader &remotePart, BlockInfo info,
+                                      int64_t length, int64_t chunkSize, char *frames) {
+    int64_t received = 0;
+    for (int64_t offset = 0; offset < length; offset += chunkSize) {
+        int64_t chunkLength = std::min(chunkSize, length - offset);
+        OssChunkFrame frame;
+        int64_t rc = remotePart.read(frames + received, sizeof(frame));
+        if (rc == (int64_t) sizeof(frame)) {
+            memcpy(&frame, frames + received, sizeof(frame));
+            int64_t stored = frame.stored & ~OSS_CHUNK_RAW;
+            if (stored > chunkLength || ((frame.stored & OSS_CHUNK_RAW) && stored != chunkLength)) {
+                THROW(GopherwoodIOException,
+                      "[OssBlockWorker] Object %s has a corrupted chunk frame",
+                      getOssObjectName(info).c_str());
+            }
+            received += rc;
+            rc = remotePart.read(frames + received, stored);
+            received += rc;
+            if (rc == stored) {
+                continue;
+            }
+        }
+        THROW(GopherwoodIOException,
+              "[OssBlockWorker] Object %s is truncated, got %ld bytes of the chunk at %ld",
+              getOssObjectName(info).c_str(), rc, offset);
+    }
+    return received;
+}
+
+/* decompress the received chunks of a window into its data, return the CPU
+ * time spent in the codec */
+int64_t OssBlockWorker::decodeWindow(BlockCodec *codec, uint32_t seed, bool verify, const char *frames,
+                                     int64_t length, int64_t chunkSize, char *data) {
+    std::vector<function<int64_t()> > tasks;
+    int64_t framed = 0;
+    for (int64_t offset = 0; offset < length; offset += chunkSize) {
+        OssChunkFrame frame;
+        memcpy(&frame, frames + framed, sizeof(frame));
+        framed += sizeof(frame);
+        tasks.push_back(bind(decodeChunk, codec, seed, verify, frames + framed, frame, data + offset,
+                             std::min(chunkSize, length - offset)));
+        framed += frame.stored & ~OSS_CHUNK_RAW;
+    }
+    return runChunkTasks(tasks);
+}
+
+void OssBlockWorker::getStatistics(GWFileInfo *fileInfo) {
+    fileInfo->numBytesEvicted = mNumBytesEvicted;
+    fileInfo->numBytesUploaded = mNumBytesUploaded;
+    fileInfo->compressNanos = mCompressNanos;
+    fileInfo->decompressNanos = mDecompressNanos;
+}
+
+/* the head tells the number of parts and whether there is an index, a block
+ * without a readable head is taken for a single part */
+void OssBlockWorker::deleteBlock(ossContext ctx, BlockInfo info) {
+    uint32_t numParts = 1;
+    bool indexed = false;
+    try {
+        OssObjectReader remoteBlock(getOssObjectName(info), 0, sizeof(OssBlockHeader) - 1);
+        OssBlockHeader header;
+        if (remoteBlock.read((char *) &header, sizeof(header)) == (int64_t) sizeof(header) &&
+            header.magic == OSS_BLOCK_MAGIC) {
+            numParts = std::max<uint32_t>(1, header.numParts);
+            indexed = header.flags & OSS_BLOCK_INDEXED;
+        }
+    } catch (const GopherwoodIOException &) {
+        /* no head */
+    }
+
+    if (indexed && ossDeleteObject(ctx, FileSystem::OSS_BUCKET.c_str(),
+                                   getOssIndexName(info).c_str()) == -1) {
         THROW(GopherwoodIOException,  "[OssBlockWorker] ossDeleteObject failed! errno=%d, errmsg=%s",
               errno, ossGetLastError());
     }
+    for (uint32_t part = numParts; part > 0; part--) {
+        int rc = ossDeleteObject(ctx, FileSystem::OSS_BUCKET.c_str(),
+                                 getOssPartName(info, part - 1).c_str());
+        if (rc == -1){
+            THROW(GopherwoodIOException,  "[OssBlockWorker] ossDeleteObject failed! errno=%d, errmsg=%s",
+                  errno, ossGetLastError());
+        }
+    }
+}
+
+/* an upload in fewer parts than the one before leaves parts behind, the
+ * parts of a block are numbered without gaps. An upload without an index
+ * drops the index of the one before */
+void OssBlockWorker::deleteStaleObjects(ossContext ctx, BlockInfo info, OssBlockHeader &header) {
+    deleteParts(ctx, info, header.numParts);
+    if (header.flags & OSS_BLOCK_INDEXED) {
+        return;
+    }
+    std::string name = getOssIndexName(info);
+    ossHeadResult *head = ossHeadObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str());
+    if (head == NULL) {
+        return;
+    }
+    free(head);
+    if (ossDeleteObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str()) == -1) {
+        LOG(WARNING, "[OssBlockWorker]        | failed to delete stale index %s, errmsg=%s",
+            name.c_str(), ossGetLastError());
+    }
+}
+
+void OssBlockWorker::deleteParts(ossContext ctx, BlockInfo info, uint32_t numParts) {
+    for (uint32_t part = numParts; ; part++) {
+        std::string name = getOssPartName(info, part);
+        ossHeadResult *head = ossHeadObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str());
+        if (head == NULL) {
+            break;
+        }
+        free(head);
+        if (ossDeleteObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str()) == -1) {
+            LOG(WARNING, "[OssBlockWorker]        | failed to delete stale part %s, errmsg=%s",
+                name.c_str(), ossGetLastError());
+            break;
+        }
+    }
 }
 
 std::string OssBlockWorker::getOssObjectName(BlockInfo blockInfo){
@@ -158,8 +1158,42 @@ std::string OssBlockWorker::getOssObjectName(BlockInfo blockInfo){
     return ss.str();
 }
 
+/* part 0 is the head and keeps the name of the block */
+std::string OssBlockWorker::getOssPartName(BlockInfo blockInfo, uint32_t part) {
+    if (part == 0) {
+        return getOssObjectName(blockInfo);
+    }
+    std::stringstream ss;
+    ss << getOssObjectName(blockInfo) << ".part" << part;
+    return ss.str();
+}
+
+std::string OssBlockWorker::getOssIndexName(BlockInfo blockInfo) {
+    return getOssObjectName(blockInfo) + ".index";
+}
+
+/* engines are not thread safe, each upload or load in flight takes one of
+ * its own. They are created on first use, most workers never move data */
+shared_ptr<IoEngine> OssBlockWorker::acquireIoEngine() {
+    {
+        lock_guard<mutex> lock(mIdleMutex);
+        if (!mIdleIoEngines.empty()) {
+            shared_ptr<IoEngine> engine = mIdleIoEngines.back();
+            mIdleIoEngines.pop_back();
+            return engine;
+        }
+    }
+    return IoEngine::create(mLocalSpaceFD);
+}
+
+/* an engine that failed a transfer is not given back */
+void OssBlockWorker::releaseIoEngine(shared_ptr<IoEngine> engine) {
+    lock_guard<mutex> lock(mIdleMutex);
+    mIdleIoEngines.push_back(engine);
+}
+
 OssBlockWorker::~OssBlockWorker() {
 }
 
 }
-}
\ No newline at end of file
+}
@@ -23,29 +23,118 @@
 #define GOPHERWOOD_BLOCK_OSSBLOCKWORKER_H
 
 #include "platform.h"
+#include "block/BlockCodec.h"
+#include "block/IoEngine.h"
+#include "block/OssObjectReader.h"
+#include "block/OssTransferPolicy.h"
+#include "client/gopherwood.h"
+#include "common/OssContextPool.h"
+#include "common/Thread.h"
 #include "core/BlockStatus.h"
 #include "oss/oss.h"
 
+#include <atomic>
+
 namespace Gopherwood {
 namespace Internal {
 
+struct OssBlockHeader;
+struct OssPartResult;
+
+/**
+ * Moves blocks between their buckets and OSS. Objects start with a header
+ * holding the codec and the size of the block, followed by the block
+ * compressed in chunks of OSS_CODEC_CHUNK_SIZE on the codec threads, each
+ * framed with its stored length and checksum. Blocks are streamed in windows
+ * of OSS_STREAM_WINDOW_SIZE through two pooled buffers, so a transfer never
+ * holds the whole block in memory. A block larger than a part is split into
+ * part objects moved in parallel on the transfer threads, the part size
+ * follows the bandwidth measured on one stream. With OSS_PARTIAL_FETCH_PAGE_SIZE
+ * set, a block of several chunks gets an index object of the stored chunk
+ * lengths, so that a range of it is loaded with ranged GETs. Every call
+ * runs on contexts taken from the OssContextPool, workers are shared by the
+ * threads of a process. Objects are read through OssObjectReader, a part
+ * whose upload failed is uploaded again as the OssTransferPolicy says. An
+ * object without a header is refused, unless OSS_LEGACY_RAW_BLOCKS takes it
+ * for a block uploaded as is by an older release.
+ */
 class OssBlockWorker {
 public:
-    OssBlockWorker(ossContext ossCtx, int localSpaceFD);
+    /* told about every range of the bucket loaded, as offsets in the block */
+    typedef function<void(int64_t offset, int64_t length)> LoadCallback;
+
+    OssBlockWorker(int localSpaceFD);
 
     void writeBlock(BlockInfo info);
 
-    int64_t readBlock(BlockInfo info);
+    int64_t readBlock(BlockInfo info, const LoadCallback &onLoaded = LoadCallback());
+
+    /* load the chunks holding the range, and with whole set the rest of the
+     * block after them. The block must have an index. Return the block size */
+    int64_t readPages(BlockInfo info, int64_t offset, int64_t length, const LoadCallback &onLoaded,
+                      bool whole = false);
 
     void deleteBlock(BlockInfo info);
 
+    void getStatistics(GWFileInfo *fileInfo);
+
     ~OssBlockWorker();
 
 private:
+    void deleteBlock(ossContext ctx, BlockInfo info);
     std::string getOssObjectName(BlockInfo blockInfo);
+    std::string getOssPartName(BlockInfo blockInfo, uint32_t part);
+    std::string getOssIndexName(BlockInfo blockInfo);
+    OssPartResult transferPart(BlockInfo info, OssBlockHeader header, BlockCodec *codec, bool upload,
+                               LoadCallback onLoaded = LoadCallback());
+    OssPartResult putPart(BlockInfo info, OssBlockHeader header, BlockCodec *codec);
+    OssPartResult uploadPart(ossContext ctx, ossObject remotePart, BlockInfo info,
+                             OssBlockHeader &header, BlockCodec *codec);
+    OssPartResult readChunks(BlockInfo info, OssBlockHeader &header, std::vector<uint32_t> &chunks,
+                             BlockCodec *codec, int64_t firstChunk, int64_t lastChunk,
+                             const LoadCallback &onLoaded, std::vector<future<OssPartResult> > &parts);
+    OssPartResult readPartChunks(BlockInfo info, OssBlockHeader header, const std::vector<uint32_t> &chunks,
+                                 BlockCodec *codec, int64_t first, int64_t last, LoadCallback onLoaded);
+    OssPartResult downloadChunks(OssObjectReader &remotePart, BlockInfo info,
+                                 OssBlockHeader &header, BlockCodec *codec,
+                                 int64_t blockOffset, int64_t length, const LoadCallback &onLoaded,
+                                 bool verify);
+    void finishLocalWrite(future<int64_t> &pending, OssBlockHeader &header,
+                          int64_t offset, int64_t length, const LoadCallback &onLoaded);
+    void writeIndex(BlockInfo info, OssBlockHeader &header, std::vector<uint32_t> &chunks);
+    void readIndex(BlockInfo info, OssBlockHeader &header, std::vector<uint32_t> &chunks);
+    void readHeader(OssObjectReader &remotePart, BlockInfo info, OssBlockHeader &header);
+    int64_t readRawBlock(OssObjectReader &remoteBlock, BlockInfo info, const char *head,
+                         int64_t headLength, const LoadCallback &onLoaded);
+    void deleteParts(ossContext ctx, BlockInfo info, uint32_t numParts);
+    void deleteStaleObjects(ossContext ctx, BlockInfo info, OssBlockHeader &header);
+    ossObject openUpload(ossContext ctx, const std::string &name);
+    void writeObject(ossContext ctx, ossObject remotePart, const char *buffer, int64_t length);
+    void commitUpload(ossContext ctx, ossObject remotePart);
+    future<int64_t> startLocalIo(IoOpcode opcode, char *buffer, int64_t length, int64_t offset);
+    void verifyHeader(BlockInfo info, OssBlockHeader &header, OssBlockHeader &head, uint32_t part);
+    int64_t encodeWindow(BlockCodec *codec, uint32_t seed, const char *data, int64_t length,
+                         int64_t chunkSize, char *frames, int64_t *framedSize,
+                         std::vector<uint32_t> &chunks);
+    int64_t receiveWindow(OssObjectReader &remotePart, BlockInfo info,
+                          int64_t length, int64_t chunkSize, char *frames);
+    int64_t decodeWindow(BlockCodec *codec, uint32_t seed, bool verify, const char *frames,
+                         int64_t length, int64_t chunkSize, char *data);
+    shared_ptr<IoEngine> acquireIoEngine();
+    void releaseIoEngine(shared_ptr<IoEngine> engine);
 
-    ossContext mOssContext;
+    shared_ptr<OssContextPool> mOssContexts;
+    shared_ptr<OssTransferPolicy> mPolicy;
     int mLocalSpaceFD;
+    /* guards the idle engines */
+    mutex mIdleMutex;
+    std::vector<shared_ptr<IoEngine> > mIdleIoEngines;
+
+    /* codec statistics, blocks of a file are loaded by several threads */
+    std::atomic<uint64_t> mNumBytesEvicted;
+    std::atomic<uint64_t> mNumBytesUploaded;
+    std::atomic<uint64_t> mCompressNanos;
+    std::atomic<uint64_t> mDecompressNanos;
 };
 
 }
@@ -0,0 +1,491 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/OssObjectReader.h"
+#include "common/Configuration.h"
+#include "common/DateTime.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "common/OssContextPool.h"
+#include "file/FileSystem.h"
+
+#include <climits>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* one GET of a request, shared by the reader and the thread running it. The
+ * reader touches it only once it is done */
+struct OssReadAttempt {
+    shared_ptr<OssRequestOps> ops;
+    ossContext ctx;
+    ossObject object;
+    /* where the GET starts, the stream of a continued one is there */
+    int64_t offset;
+    int64_t length;
+    std::vector<char> buffer;
+    int64_t received;
+    bool eof;
+    bool hedge;
+    /* guarded by the state of the reader */
+    bool done;
+    bool abandoned;
+    exception_ptr error;
+};
+
+struct OssReadState {
+    mutex guard;
+    condition_variable cond;
+};
+
+/* the HEADs of one try of getObjectSize, the first to answer wins */
+struct OssHeadState {
+    shared_ptr<OssRequestOps> ops;
+    mutex guard;
+    condition_variable cond;
+    size_t numDone;
+    bool answered;
+    bool hedgeWon;
+    int64_t size;
+    exception_ptr error;
+};
+
+/* a context that saw a failed or abandoned GET is not reused */
+static void closeAttempt(shared_ptr<OssReadAttempt> attempt, bool healthy) {
+    if (attempt->object != NULL) {
+        if (attempt->ops->closeObject(attempt->ctx, attempt->object) != 0) {
+            healthy = false;
+        }
+        attempt->object = NULL;
+    }
+    if (attempt->ctx != NULL) {
+        OssContextPool::getInstance()->release(attempt->ctx, healthy);
+        attempt->ctx = NULL;
+    }
+}
+
+/* open the stream unless it is continued and read the request into the
+ * buffer of the attempt. An attempt abandoned meanwhile cleans up after itself */
+static void runAttempt(shared_ptr<OssReadState> state, shared_ptr<OssReadAttempt> attempt,
+                       std::string name, int64_t end) {
+    bool abandoned;
+    {
+        lock_guard<mutex> lock(state->guard);
+        abandoned = attempt->abandoned;
+    }
+    if (!abandoned) {
+        try {
+            if (attempt->object == NULL) {
+                if (attempt->ctx == NULL) {
+                    attempt->ctx = OssContextPool::getInstance()->acquire();
+                }
+                attempt->object = attempt->ops->getObject(attempt->ctx, FileSystem::OSS_BUCKET.c_str(),
+                                                          name.c_str(), attempt->offset, end);
+                if (attempt->object == NULL) {
+                    THROW(GopherwoodOSSException,
+                          "[OssObjectReader] ossGetObject of %s failed! errno=%d, errmsg=%s",
+                          name.c_str(), errno, ossGetLastError());
+                }
+            }
+            attempt->buffer.resize(attempt->length);
+            while (attempt->received < attempt->length) {
+                int32_t rc = attempt->ops->read(attempt->ctx, attempt->object,
+                                                attempt->buffer.data() + attempt->received,
+                                                std::min<int64_t>(attempt->length - attempt->received, INT_MAX));
+                if (rc < 0) {
+                    THROW(GopherwoodOSSException,
+                          "[OssObjectReader] ossRead of %s failed! errno=%d, errmsg=%s",
+                          name.c_str(), errno, ossGetLastError());
+                }
+                if (rc == 0) {
+                    attempt->eof = true;
+                    break;
+                }
+                attempt->received += rc;
+            }
+        } catch (...) {
+            attempt->error = current_exception();
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(state->guard);
+        attempt->done = true;
+        abandoned = attempt->abandoned;
+    }
+    state->cond.notify_all();
+    if (abandoned) {
+        closeAttempt(attempt, false);
+    }
+}
+
+/* a HEAD on a pooled context, liboss tells a missing object and a failed
+ * HEAD alike, both give size -1 */
+static void runHead(shared_ptr<OssHeadState> state, std::string name, bool hedge) {
+    int64_t size = -1;
+    exception_ptr error;
+    shared_ptr<OssContextPool> pool = OssContextPool::getInstance();
+    ossContext ctx = NULL;
+    try {
+        ctx = pool->acquire();
+        ossHeadResult *head = state->ops->headObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str());
+        if (head != NULL) {
+            size = head->content_length;
+            free(head);
+        }
+        pool->release(ctx);
+    } catch (...) {
+        error = current_exception();
+        if (ctx != NULL) {
+            pool->release(ctx, false);
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(state->guard);
+        state->numDone++;
+        if (error) {
+            if (!state->error) {
+                state->error = error;
+            }
+        } else if (!state->answered) {
+            state->answered = true;
+            state->hedgeWon = hedge;
+            state->size = size;
+        }
+    }
+    state->cond.notify_all();
+}
+
+OssObjectReader::OssObjectReader(const std::string &name, int64_t start, int64_t end) :
+        mPolicy(OssTransferPolicy::getInstance()),
+        mState(new OssReadState()),
+        mName(name),
+        mPosition(start),
+        mEnd(end),
+        mEof(start > end),
+        mBufferOffset(0) {
+}
+
+int64_t OssObjectReader::read(char *buffer, int64_t length) {
+    int64_t offset = 0;
+    while (offset < length) {
+        if (mBufferOffset == (int64_t) mBuffer.size()) {
+            if (mEof) {
+                break;
+            }
+            fill();
+            continue;
+        }
+        int64_t size = std::min<int64_t>(length - offset, mBuffer.size() - mBufferOffset);
+        memcpy(buffer + offset, mBuffer.data() + mBufferOffset, size);
+        mBufferOffset += size;
+        offset += size;
+    }
+    return offset;
+}
+
+void OssObjectReader::fill() {
+    mPolicy->retry([this]() {
+        request();
+    });
+}
+
+/* the first GET to answer wins the request, the others are abandoned. A
+ * request neither timed out nor hedged runs on this thread. A hedge is
+ * launched with the state held, the attempts take it once they are done */
+void OssObjectReader::request() {
+    steady_clock::time_point start = steady_clock::now();
+    int64_t timeout = Configuration::OSS_REQUEST_TIMEOUT;
+    int64_t hedgeDelay = mPolicy->getHedgeDelay();
+
+    shared_ptr<OssReadAttempt> primary = mStream;
+    mStream.reset();
+    if (!primary) {
+        primary = newAttempt(false);
+    }
+    primary->buffer.swap(mSpare);
+    std::vector<shared_ptr<OssReadAttempt> > attempts;
+    attempts.push_back(primary);
+
+    /* without a free request thread the GET runs here, neither timed out nor hedged */
+    shared_ptr<OssReadAttempt> winner;
+    bool timedOut = false;
+    bool pooled = (timeout > 0 || hedgeDelay > 0) && mPolicy->acquireThread();
+    launch(primary, pooled);
+    {
+        unique_lock<mutex> lock(mState->guard);
+        for (;;) {
+            size_t numFailed = 0;
+            for (size_t i = 0; i < attempts.size() && !winner; i++) {
+                if (attempts[i]->done) {
+                    if (attempts[i]->error) {
+                        numFailed++;
+                    } else {
+                        winner = attempts[i];
+                    }
+                }
+            }
+            if (winner || numFailed == attempts.size()) {
+                break;
+            }
+
+            steady_clock::time_point now = steady_clock::now();
+            steady_clock::time_point deadline = start + milliseconds(timeout);
+            steady_clock::time_point hedgeAt = start + microseconds(hedgeDelay);
+            bool canHedge = hedgeDelay > 0 && attempts.size() == 1;
+            if (canHedge && now >= hedgeAt) {
+                if (mPolicy->acquireThread()) {
+                    attempts.push_back(newAttempt(true));
+                    mPolicy->countHedge();
+                    launch(attempts.back(), true);
+                } else {
+                    hedgeDelay = 0;
+                }
+                continue;
+            }
+            if (timeout > 0 && now >= deadline) {
+                timedOut = true;
+                break;
+            }
+
+            if (canHedge && (timeout <= 0 || hedgeAt < deadline)) {
+                mState->cond.wait_until(lock, hedgeAt);
+            } else if (timeout > 0) {
+                mState->cond.wait_until(lock, deadline);
+            } else {
+                mState->cond.wait(lock);
+            }
+        }
+    }
+
+    /* every GET failed, one that could not be opened may be of a missing object */
+    exception_ptr error;
+    bool opened = true;
+    if (!winner && !timedOut) {
+        error = primary->error;
+        opened = primary->object != NULL;
+    }
+    for (size_t i = 0; i < attempts.size(); i++) {
+        if (attempts[i] != winner) {
+            abandon(attempts[i]);
+        }
+    }
+
+    if (!winner) {
+        if (timedOut) {
+            mPolicy->countTimeout();
+            THROW(GopherwoodTimeoutException,
+                  "[OssObjectReader] GET of %s at %ld got no answer in %ld ms",
+                  mName.c_str(), mPosition, timeout);
+        }
+        if (!opened) {
+            checkExists();
+        }
+        rethrow_exception(error);
+    }
+
+    mPolicy->recordLatency(duration_cast<microseconds>(steady_clock::now() - start).count());
+    if (winner->hedge) {
+        mPolicy->countHedgeWin();
+    }
+    winner->buffer.resize(winner->received);
+    mBuffer.swap(winner->buffer);
+    mSpare.swap(winner->buffer);
+    mBufferOffset = 0;
+    mPosition += winner->received;
+    if (winner->eof || mPosition > mEnd) {
+        mEof = true;
+        closeAttempt(winner, true);
+    } else {
+        mStream = winner;
+    }
+}
+
+int64_t OssObjectReader::getObjectSize() {
+    int64_t size = -1;
+    mPolicy->retry([this, &size]() {
+        size = head();
+    });
+    return size;
+}
+
+/* like request, a HEAD slower than the hedge delay is sent again and one
+ * without an answer after OSS_REQUEST_TIMEOUT ms fails. HEADs left running
+ * only touch their state */
+int64_t OssObjectReader::head() {
+    steady_clock::time_point start = steady_clock::now();
+    int64_t timeout = Configuration::OSS_REQUEST_TIMEOUT;
+    int64_t hedgeDelay = mPolicy->getHedgeDelay();
+
+    shared_ptr<OssHeadState> state(new OssHeadState());
+    state->ops = mPolicy->getOps();
+    state->numDone = 0;
+    state->answered = false;
+    state->hedgeWon = false;
+    state->size = -1;
+    size_t numLaunched = 1;
+    bool pooled = (timeout > 0 || hedgeDelay > 0) && mPolicy->acquireThread();
+    launchHead(state, pooled, false);
+
+    unique_lock<mutex> lock(state->guard);
+    for (;;) {
+        if (state->answered) {
+            break;
+        }
+        if (state->numDone == numLaunched) {
+            rethrow_exception(state->error);
+        }
+
+        steady_clock::time_point now = steady_clock::now();
+        steady_clock::time_point deadline = start + milliseconds(timeout);
+        steady_clock::time_point hedgeAt = start + microseconds(hedgeDelay);
+        bool canHedge = hedgeDelay > 0 && numLaunched == 1;
+        if (canHedge && now >= hedgeAt) {
+            if (!mPolicy->acquireThread()) {
+                hedgeDelay = 0;
+                continue;
+            }
+            numLaunched++;
+            mPolicy->countHedge();
+            lock.unlock();
+            launchHead(state, true, true);
+            lock.lock();
+            continue;
+        }
+        if (timeout > 0 && now >= deadline) {
+            mPolicy->countTimeout();
+            THROW(GopherwoodTimeoutException,
+                  "[OssObjectReader] HEAD of %s got no answer in %ld ms", mName.c_str(), timeout);
+        }
+
+        if (canHedge && (timeout <= 0 || hedgeAt < deadline)) {
+            state->cond.wait_until(lock, hedgeAt);
+        } else if (timeout > 0) {
+            state->cond.wait_until(lock, deadline);
+        } else {
+            state->cond.wait(lock);
+        }
+    }
+    if (state->hedgeWon) {
+        mPolicy->countHedgeWin();
+    }
+    return state->size;
+}
+
+void OssObjectReader::launchHead(shared_ptr<OssHeadState> state, bool pooled, bool hedge) {
+    mPolicy->countAttempt();
+    std::string name = mName;
+    if (!pooled) {
+        runHead(state, name, hedge);
+        return;
+    }
+    shared_ptr<OssTransferPolicy> policy = mPolicy;
+    try {
+        mPolicy->getThreadPool()->enqueue([policy, state, name, hedge]() {
+            runHead(state, name, hedge);
+            policy->releaseThread();
+        });
+    } catch (...) {
+        /* no thread has the HEAD, it fails as if it ran */
+        mPolicy->releaseThread();
+        lock_guard<mutex> lock(state->guard);
+        state->numDone++;
+        if (!state->error) {
+            state->error = current_exception();
+        }
+    }
+}
+
+void OssObjectReader::checkExists() {
+    shared_ptr<OssRequestOps> ops = mPolicy->getOps();
+    shared_ptr<OssContextPool> pool = OssContextPool::getInstance();
+    ossContext ctx = pool->acquire();
+    ossHeadResult *head = ops->headObject(ctx, FileSystem::OSS_BUCKET.c_str(), mName.c_str());
+    pool->release(ctx);
+    if (head == NULL) {
+        THROW(GopherwoodIOException, "[OssObjectReader] Object %s does not exist", mName.c_str());
+    }
+    free(head);
+}
+
+/* a new GET of the rest of the range */
+shared_ptr<OssReadAttempt> OssObjectReader::newAttempt(bool hedge) {
+    shared_ptr<OssReadAttempt> attempt(new OssReadAttempt());
+    attempt->ops = mPolicy->getOps();
+    attempt->ctx = NULL;
+    attempt->object = NULL;
+    attempt->offset = mPosition;
+    attempt->hedge = hedge;
+    return attempt;
+}
+
+void OssObjectReader::launch(shared_ptr<OssReadAttempt> attempt, bool pooled) {
+    attempt->length = std::min(std::max<int64_t>(1, Configuration::OSS_REQUEST_SIZE), mEnd - mPosition + 1);
+    attempt->received = 0;
+    attempt->eof = false;
+    attempt->done = false;
+    attempt->abandoned = false;
+    attempt->error = exception_ptr();
+    mPolicy->countAttempt();
+    if (!pooled) {
+        runAttempt(mState, attempt, mName, mEnd);
+        return;
+    }
+    shared_ptr<OssTransferPolicy> policy = mPolicy;
+    shared_ptr<OssReadState> state = mState;
+    std::string name = mName;
+    int64_t end = mEnd;
+    try {
+        mPolicy->getThreadPool()->enqueue([policy, state, attempt, name, end]() {
+            runAttempt(state, attempt, name, end);
+            policy->releaseThread();
+        });
+    } catch (...) {
+        /* no thread has the attempt, it fails as if it ran */
+        mPolicy->releaseThread();
+        attempt->error = current_exception();
+        attempt->done = true;
+    }
+}
+
+/* a GET still running closes its stream once its read returns, liboss
+ * cancels only uploads */
+void OssObjectReader::abandon(shared_ptr<OssReadAttempt> attempt) {
+    bool done;
+    {
+        lock_guard<mutex> lock(mState->guard);
+        attempt->abandoned = true;
+        done = attempt->done;
+    }
+    if (done) {
+        closeAttempt(attempt, !attempt->error);
+    }
+}
+
+OssObjectReader::~OssObjectReader() {
+    if (mStream) {
+        closeAttempt(mStream, true);
+    }
+}
+
+}
+}
@@ -0,0 +1,94 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_BLOCK_OSSOBJECTREADER_H
+#define GOPHERWOOD_BLOCK_OSSOBJECTREADER_H
+
+#include "platform.h"
+
+#include "block/OssTransferPolicy.h"
+#include "common/Memory.h"
+#include "oss/oss.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+struct OssHeadState;
+struct OssReadAttempt;
+struct OssReadState;
+
+/**
+ * OssObjectReader
+ *
+ * @desc Reads a range of an object in requests of OSS_REQUEST_SIZE bytes,
+ * each on a GET run on the request threads. The GET of a request goes on
+ * with the stream of the request before, on a pooled context. A request
+ * slower than the hedge delay of the OssTransferPolicy is sent again as a
+ * GET of the rest of the range on another context, the first to answer
+ * wins and the other is closed once its read returns. A request without an
+ * answer after OSS_REQUEST_TIMEOUT ms fails, failed requests are retried by
+ * the policy. While every request thread is taken, by abandoned GETs too, a
+ * request runs on the calling thread without timeout and hedge. A missing
+ * object fails with a GopherwoodIOException.
+ */
+class OssObjectReader {
+public:
+    /* the range of the object from start to end, both included, as ossGetObject */
+    OssObjectReader(const std::string &name, int64_t start, int64_t end);
+
+    /* read until length bytes arrived or the range ends */
+    int64_t read(char *buffer, int64_t length);
+
+    /* size of the object from a HEAD, retried, timed out and hedged as
+     * the GETs. -1 when the object does not exist */
+    int64_t getObjectSize();
+
+    ~OssObjectReader();
+
+private:
+    void fill();
+    void request();
+    int64_t head();
+    void launchHead(shared_ptr<OssHeadState> state, bool pooled, bool hedge);
+    void checkExists();
+    shared_ptr<OssReadAttempt> newAttempt(bool hedge);
+    void launch(shared_ptr<OssReadAttempt> attempt, bool pooled);
+    void abandon(shared_ptr<OssReadAttempt> attempt);
+
+    shared_ptr<OssTransferPolicy> mPolicy;
+    shared_ptr<OssReadState> mState;
+    std::string mName;
+    /* the next byte of the object to request */
+    int64_t mPosition;
+    int64_t mEnd;
+    bool mEof;
+    /* the stream of the last request, continued by the next one */
+    shared_ptr<OssReadAttempt> mStream;
+    /* bytes of the last request not read yet */
+    std::vector<char> mBuffer;
+    int64_t mBufferOffset;
+    std::vector<char> mSpare;
+};
+
+}
+}
+
+#endif //GOPHERWOOD_BLOCK_OSSOBJECTREADER_H
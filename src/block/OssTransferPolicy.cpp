@@ -0,0 +1,210 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/OssTransferPolicy.h"
+#include "common/Configuration.h"
+#include "common/DateTime.h"
+#include "common/Exception.h"
+#include "common/Logger.h"
+#include "common/OssContextPool.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* GET latencies kept for the hedge delay, and those needed before hedging */
+#define OSS_LATENCY_SAMPLES 128
+#define OSS_HEDGE_MIN_SAMPLES 20
+
+static mutex instanceMutex;
+shared_ptr<OssTransferPolicy> OssTransferPolicy::instance;
+
+shared_ptr<OssTransferPolicy> OssTransferPolicy::getInstance() {
+    lock_guard<mutex> lock(instanceMutex);
+    if (!instance) {
+        instance = shared_ptr<OssTransferPolicy>(new OssTransferPolicy());
+    }
+    return instance;
+}
+
+OssRequestOps OssTransferPolicy::getDefaultOps() {
+    OssRequestOps ops;
+    ops.getObject = ossGetObject;
+    ops.putObject = [](ossContext ctx, const char *bucket, const char *key) {
+        return ossPutObject(ctx, bucket, key, false);
+    };
+    ops.read = ossRead;
+    ops.write = ossWrite;
+    ops.closeObject = ossCloseObject;
+    ops.cancelObject = ossCancelObject;
+    ops.headObject = ossHeadObject;
+    return ops;
+}
+
+OssTransferPolicy::OssTransferPolicy() :
+        mOps(new OssRequestOps(getDefaultOps())),
+        mRandom((unsigned) getpid() ^ (unsigned) steady_clock::now().time_since_epoch().count()),
+        mNextLatency(0),
+        mNumThreads(0),
+        mNumPooled(0),
+        mNumRequests(0),
+        mNumAttempts(0),
+        mNumRetries(0),
+        mNumTimeouts(0),
+        mNumHedges(0),
+        mNumHedgeWins(0) {
+}
+
+void OssTransferPolicy::retry(const function<void()> &request, int numFailed) {
+    mNumRequests++;
+    for (;; numFailed++) {
+        if (numFailed > 0) {
+            mNumRetries++;
+            sleep_for(milliseconds(getBackoff(numFailed - 1)));
+        }
+        try {
+            request();
+            return;
+        } catch (...) {
+            exception_ptr error = current_exception();
+            if (!isRetryable(error) || numFailed >= Configuration::OSS_REQUEST_RETRIES) {
+                throw;
+            }
+            std::string buffer;
+            LOG(DEBUG1, "[OssTransferPolicy]     | retrying a failed OSS request, %d tries failed: %s",
+                numFailed + 1, GetExceptionDetail(error, buffer));
+        }
+    }
+}
+
+/* request failures and timeouts, a bad object is not fixed by asking again */
+bool OssTransferPolicy::isRetryable(exception_ptr error) {
+    try {
+        rethrow_exception(error);
+    } catch (const GopherwoodOSSException &) {
+        return true;
+    } catch (const GopherwoodTimeoutException &) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+/* full jitter, the retries of requests that failed together spread out */
+int64_t OssTransferPolicy::getBackoff(int numFailed) {
+    int64_t ceiling = Configuration::OSS_RETRY_BASE_DELAY;
+    for (int i = 0; i < numFailed && ceiling < Configuration::OSS_RETRY_MAX_DELAY; i++) {
+        ceiling *= 2;
+    }
+    ceiling = std::min(ceiling, Configuration::OSS_RETRY_MAX_DELAY);
+    if (ceiling <= 0) {
+        return 0;
+    }
+    lock_guard<mutex> lock(mMutex);
+    return std::uniform_int_distribution<int64_t>(0, ceiling)(mRandom);
+}
+
+/* the window is kept sorted as well, the percentile is read off it */
+int64_t OssTransferPolicy::getHedgeDelay() {
+    int32_t percentile = Configuration::OSS_HEDGE_PERCENTILE;
+    if (percentile <= 0 || percentile > 100) {
+        return 0;
+    }
+    lock_guard<mutex> lock(mMutex);
+    if (mSortedLatencies.size() < OSS_HEDGE_MIN_SAMPLES) {
+        return 0;
+    }
+    size_t rank = std::min(mSortedLatencies.size() - 1, mSortedLatencies.size() * percentile / 100);
+    return std::max<int64_t>(1, mSortedLatencies[rank]);
+}
+
+void OssTransferPolicy::recordLatency(int64_t micros) {
+    lock_guard<mutex> lock(mMutex);
+    if (mLatencies.size() < OSS_LATENCY_SAMPLES) {
+        mLatencies.push_back(micros);
+    } else {
+        mSortedLatencies.erase(std::lower_bound(mSortedLatencies.begin(), mSortedLatencies.end(),
+                                                mLatencies[mNextLatency]));
+        mLatencies[mNextLatency] = micros;
+    }
+    mSortedLatencies.insert(std::upper_bound(mSortedLatencies.begin(), mSortedLatencies.end(), micros),
+                            micros);
+    mNextLatency = (mNextLatency + 1) % OSS_LATENCY_SAMPLES;
+}
+
+/* a GET in flight and its hedge each take a thread */
+shared_ptr<ThreadPool> OssTransferPolicy::getThreadPool() {
+    lock_guard<mutex> lock(mMutex);
+    if (!mThreadPool) {
+        mNumThreads = Configuration::OSS_REQUEST_THREADS;
+        if (mNumThreads == 0) {
+            mNumThreads = 2 * std::max<size_t>(1, OssContextPool::getInstance()->getMaxIdle());
+        }
+        mThreadPool = shared_ptr<ThreadPool>(new ThreadPool(mNumThreads));
+    }
+    return mThreadPool;
+}
+
+/* requests abandoned by a timeout or a hedge keep their thread until OSS
+ * answers, no more of them are queued than there are threads */
+bool OssTransferPolicy::acquireThread() {
+    getThreadPool();
+    lock_guard<mutex> lock(mMutex);
+    if (mNumPooled >= mNumThreads) {
+        return false;
+    }
+    mNumPooled++;
+    return true;
+}
+
+void OssTransferPolicy::releaseThread() {
+    lock_guard<mutex> lock(mMutex);
+    assert(mNumPooled > 0);
+    mNumPooled--;
+}
+
+/* a request keeps the ops it started with */
+shared_ptr<OssRequestOps> OssTransferPolicy::getOps() {
+    lock_guard<mutex> lock(mMutex);
+    return mOps;
+}
+
+void OssTransferPolicy::setOps(const OssRequestOps &ops) {
+    lock_guard<mutex> lock(mMutex);
+    mOps = shared_ptr<OssRequestOps>(new OssRequestOps(ops));
+}
+
+void OssTransferPolicy::getStatistics(GWSysInfo *sysInfo) {
+    sysInfo->numOssRequests = mNumRequests;
+    sysInfo->numOssAttempts = mNumAttempts;
+    sysInfo->numOssRetries = mNumRetries;
+    sysInfo->numOssTimeouts = mNumTimeouts;
+    sysInfo->numOssHedges = mNumHedges;
+    sysInfo->numOssHedgeWins = mNumHedgeWins;
+}
+
+OssTransferPolicy::~OssTransferPolicy() {
+}
+
+}
+}
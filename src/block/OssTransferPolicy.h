@@ -0,0 +1,142 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_BLOCK_OSSTRANSFERPOLICY_H
+#define GOPHERWOOD_BLOCK_OSSTRANSFERPOLICY_H
+
+#include "platform.h"
+
+#include "client/gopherwood.h"
+#include "common/ExceptionInternal.h"
+#include "common/Memory.h"
+#include "common/Thread.h"
+#include "common/ThreadPool.h"
+#include "oss/oss.h"
+
+#include <atomic>
+#include <random>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* the OSS calls of the block transfers, liboss by default. Tests put a
+ * faulty store behind them */
+struct OssRequestOps {
+    function<ossObject(ossContext, const char *, const char *, int64_t, int64_t)> getObject;
+    function<ossObject(ossContext, const char *, const char *)> putObject;
+    function<int32_t(ossContext, ossObject, void *, int32_t)> read;
+    function<int32_t(ossContext, ossObject, const char *, int32_t)> write;
+    function<int(ossContext, ossObject)> closeObject;
+    function<int(ossContext, ossObject)> cancelObject;
+    function<ossHeadResult *(ossContext, const char *, const char *)> headObject;
+};
+
+/**
+ * OssTransferPolicy
+ *
+ * @desc Process wide policy of the requests the block transfers make to OSS.
+ * A request that fails with a GopherwoodOSSException or times out with a
+ * GopherwoodTimeoutException is run again after a backoff with full jitter,
+ * up to OSS_REQUEST_RETRIES times. The latency of the recent GETs gives the
+ * delay after which a GET is hedged, see OssObjectReader. The requests in
+ * flight run on the request threads, up to one per thread. Counters of the
+ * requests, their tries, retries, timeouts and hedges go to GWSysInfo.
+ */
+class OssTransferPolicy {
+public:
+    static shared_ptr<OssTransferPolicy> getInstance();
+
+    static OssRequestOps getDefaultOps();
+
+    /* run request until it succeeds or the retries run out, numFailed
+     * tells the tries that failed already */
+    void retry(const function<void()> &request, int numFailed = 0);
+
+    static bool isRetryable(exception_ptr error);
+
+    /* a random delay in ms before the try after numFailed failed ones */
+    int64_t getBackoff(int numFailed);
+
+    /* us after which a GET is hedged, 0 before enough GETs were seen */
+    int64_t getHedgeDelay();
+
+    void recordLatency(int64_t micros);
+
+    shared_ptr<ThreadPool> getThreadPool();
+
+    /* take a request thread for a request, false if all of them are taken */
+    bool acquireThread();
+
+    void releaseThread();
+
+    shared_ptr<OssRequestOps> getOps();
+
+    void setOps(const OssRequestOps &ops);
+
+    inline void countAttempt() {
+        mNumAttempts++;
+    }
+
+    inline void countTimeout() {
+        mNumTimeouts++;
+    }
+
+    inline void countHedge() {
+        mNumHedges++;
+    }
+
+    inline void countHedgeWin() {
+        mNumHedgeWins++;
+    }
+
+    void getStatistics(GWSysInfo *sysInfo);
+
+    ~OssTransferPolicy();
+
+private:
+    OssTransferPolicy();
+
+    static shared_ptr<OssTransferPolicy> instance;
+
+    mutex mMutex;
+    shared_ptr<OssRequestOps> mOps;
+    shared_ptr<ThreadPool> mThreadPool;
+    std::minstd_rand mRandom;
+    /* GET latencies in us, a ring of the recent ones and the same sorted */
+    std::vector<int64_t> mLatencies;
+    std::vector<int64_t> mSortedLatencies;
+    size_t mNextLatency;
+    /* request threads, and those taken by requests in flight */
+    size_t mNumThreads;
+    size_t mNumPooled;
+
+    std::atomic<uint64_t> mNumRequests;
+    std::atomic<uint64_t> mNumAttempts;
+    std::atomic<uint64_t> mNumRetries;
+    std::atomic<uint64_t> mNumTimeouts;
+    std::atomic<uint64_t> mNumHedges;
+    std::atomic<uint64_t> mNumHedgeWins;
+};
+
+}
+}
+
+#endif //GOPHERWOOD_BLOCK_OSSTRANSFERPOLICY_H
@@ -0,0 +1,257 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/UringIoEngine.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "common/Logger.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* the kernel may cap a single read/write, larger requests come back short and are resubmitted */
+#define URING_MAX_REQUEST_LENGTH (1L << 30)
+
+static int uringSetup(unsigned entries, struct io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int ringFD, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ringFD, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(int ringFD, unsigned opcode, const void *arg, unsigned nrArgs) {
+    return syscall(__NR_io_uring_register, ringFD, opcode, arg, nrArgs);
+}
+
+UringIoEngine::UringIoEngine(int fd, uint32_t queueDepth) :
+        IoEngine(fd, queueDepth),
+        mRingFD(-1),
+        mFixedFile(false),
+        mSqEntries(0),
+        mSqRing(MAP_FAILED),
+        mSqRingSize(0),
+        mCqRing(MAP_FAILED),
+        mCqRingSize(0),
+        mSqes((struct io_uring_sqe *) MAP_FAILED),
+        mSqesSize(0) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    mRingFD = uringSetup(mQueueDepth, &params);
+    if (mRingFD < 0) {
+        THROW(GopherwoodIOException,
+              "[UringIoEngine] io_uring_setup failed, entries=%u, errno=%d", mQueueDepth, errno);
+    }
+
+    /* IORING_OP_READ/WRITE arrived together with this feature */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        release();
+        THROW(GopherwoodIOException,
+              "[UringIoEngine] kernel io_uring lacks IORING_OP_READ/WRITE, features=%x", params.features);
+    }
+
+    try {
+        mapRings(params);
+    } catch (...) {
+        release();
+        throw;
+    }
+
+    /* fixed file saves the fd table lookup and reference on every request */
+    mFixedFile = uringRegister(mRingFD, IORING_REGISTER_FILES, &mFD, 1) == 0;
+
+    LOG(DEBUG1, "[UringIoEngine]         |"
+            "Created io_uring engine, fd=%d, entries=%u, fixedFile=%d",
+        mFD, mSqEntries, mFixedFile);
+}
+
+void UringIoEngine::mapRings(struct io_uring_params &params) {
+    mSqEntries = params.sq_entries;
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mSqRingSize = std::max(mSqRingSize, mCqRingSize);
+        mCqRingSize = 0;
+    }
+
+    mSqRing = mmap(NULL, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   mRingFD, IORING_OFF_SQ_RING);
+    if (mSqRing == MAP_FAILED) {
+        THROW(GopherwoodIOException, "[UringIoEngine] mmap submission ring failed, errno=%d", errno);
+    }
+
+    if (mCqRingSize == 0) {
+        mCqRing = mSqRing;
+    } else {
+        mCqRing = mmap(NULL, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       mRingFD, IORING_OFF_CQ_RING);
+        if (mCqRing == MAP_FAILED) {
+            THROW(GopherwoodIOException, "[UringIoEngine] mmap completion ring failed, errno=%d", errno);
+        }
+    }
+
+    mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    mSqes = (struct io_uring_sqe *) mmap(NULL, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         mRingFD, IORING_OFF_SQES);
+    if (mSqes == MAP_FAILED) {
+        THROW(GopherwoodIOException, "[UringIoEngine] mmap submission entries failed, errno=%d", errno);
+    }
+
+    char *sq = (char *) mSqRing;
+    mSqHead = (unsigned *) (sq + params.sq_off.head);
+    mSqTail = (unsigned *) (sq + params.sq_off.tail);
+    mSqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    mSqArray = (unsigned *) (sq + params.sq_off.array);
+
+    char *cq = (char *) mCqRing;
+    mCqHead = (unsigned *) (cq + params.cq_off.head);
+    mCqTail = (unsigned *) (cq + params.cq_off.tail);
+    mCqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    mCqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+}
+
+bool UringIoEngine::registerBuffer(char *buffer, int64_t length) {
+    struct iovec iov = {buffer, (size_t) length};
+    mBuffers.push_back(iov);
+
+    /* the registered buffer table is replaced as a whole */
+    if (mBuffers.size() > 1) {
+        uringRegister(mRingFD, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+    if (uringRegister(mRingFD, IORING_REGISTER_BUFFERS, mBuffers.data(), mBuffers.size()) == 0) {
+        return true;
+    }
+
+    LOG(WARNING, "[UringIoEngine]         |"
+            "Register buffer failed, length=%ld, errno=%d", length, errno);
+    mBuffers.pop_back();
+    if (!mBuffers.empty()) {
+        uringRegister(mRingFD, IORING_REGISTER_BUFFERS, mBuffers.data(), mBuffers.size());
+    }
+    return false;
+}
+
+int UringIoEngine::findRegisteredBuffer(const char *buffer, int64_t length) {
+    for (size_t i = 0; i < mBuffers.size(); i++) {
+        const char *base = (const char *) mBuffers[i].iov_base;
+        if (buffer >= base && buffer + length <= base + mBuffers[i].iov_len) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void UringIoEngine::prepare(IoRequest &request, uint64_t userData) {
+    unsigned tail = *mSqTail;
+    unsigned index = tail & *mSqMask;
+    struct io_uring_sqe *sqe = &mSqes[index];
+    int bufIndex = findRegisteredBuffer(request.buffer, request.length);
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (bufIndex >= 0) {
+        sqe->opcode = request.opcode == IoRead ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = bufIndex;
+    } else {
+        sqe->opcode = request.opcode == IoRead ? IORING_OP_READ : IORING_OP_WRITE;
+    }
+    if (mFixedFile) {
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = mFD;
+    }
+    sqe->off = request.offset;
+    sqe->addr = (uint64_t) request.buffer;
+    sqe->len = std::min(request.length, URING_MAX_REQUEST_LENGTH);
+    sqe->user_data = userData;
+
+    mSqArray[index] = index;
+    __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int UringIoEngine::reap(IoRequest *requests) {
+    unsigned head = *mCqHead;
+    unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    int reaped = 0;
+
+    for (; head != tail; head++, reaped++) {
+        struct io_uring_cqe *cqe = &mCqes[head & *mCqMask];
+        requests[cqe->user_data].result = cqe->res;
+    }
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+void UringIoEngine::submitOnce(IoRequest *requests, int num) {
+    int next = 0;
+    int completed = 0;
+    uint32_t inflight = 0;
+
+    while (completed < num) {
+        /* keep the ring full, one io_uring_enter submits the batch and waits for a completion */
+        while (next < num && inflight < mSqEntries) {
+            prepare(requests[next], next);
+            next++;
+            inflight++;
+        }
+
+        unsigned toSubmit = *mSqTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        int rc = uringEnter(mRingFD, toSubmit, 1, IORING_ENTER_GETEVENTS);
+        if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            THROW(GopherwoodIOException,
+                  "[UringIoEngine] io_uring_enter failed, submit=%u, errno=%d", toSubmit, errno);
+        }
+
+        int reaped = reap(requests);
+        inflight -= reaped;
+        completed += reaped;
+    }
+}
+
+void UringIoEngine::release() {
+    if (mSqes != MAP_FAILED) {
+        munmap(mSqes, mSqesSize);
+        mSqes = (struct io_uring_sqe *) MAP_FAILED;
+    }
+    if (mCqRing != MAP_FAILED && mCqRing != mSqRing) {
+        munmap(mCqRing, mCqRingSize);
+    }
+    mCqRing = MAP_FAILED;
+    if (mSqRing != MAP_FAILED) {
+        munmap(mSqRing, mSqRingSize);
+        mSqRing = MAP_FAILED;
+    }
+    if (mRingFD >= 0) {
+        close(mRingFD);
+        mRingFD = -1;
+    }
+}
+
+UringIoEngine::~UringIoEngine() {
+    release();
+}
+
+}
+}
@@ -0,0 +1,91 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_BLOCK_URINGIOENGINE_H
+#define GOPHERWOOD_BLOCK_URINGIOENGINE_H
+
+#include "platform.h"
+
+#include "block/IoEngine.h"
+
+#include <linux/io_uring.h>
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * io_uring engine driven by the raw syscalls. The local space fd is
+ * registered as fixed file 0, registered buffers turn requests inside
+ * them into READ_FIXED/WRITE_FIXED. The constructor throws
+ * GopherwoodIOException when the kernel does not provide io_uring.
+ */
+class UringIoEngine : public IoEngine {
+public:
+    UringIoEngine(int fd, uint32_t queueDepth);
+
+    bool registerBuffer(char *buffer, int64_t length);
+
+    int getType() {
+        return IO_ENGINE_URING;
+    };
+
+    const char *getName() {
+        return "io_uring";
+    };
+
+    ~UringIoEngine();
+
+protected:
+    void submitOnce(IoRequest *requests, int num);
+
+private:
+    void mapRings(struct io_uring_params &params);
+    void prepare(IoRequest &request, uint64_t userData);
+    int reap(IoRequest *requests);
+    int findRegisteredBuffer(const char *buffer, int64_t length);
+    void release();
+
+    int mRingFD;
+    bool mFixedFile;
+    uint32_t mSqEntries;
+
+    void *mSqRing;
+    size_t mSqRingSize;
+    void *mCqRing;
+    size_t mCqRingSize;
+    struct io_uring_sqe *mSqes;
+    size_t mSqesSize;
+
+    unsigned *mSqHead;
+    unsigned *mSqTail;
+    unsigned *mSqMask;
+    unsigned *mSqArray;
+    unsigned *mCqHead;
+    unsigned *mCqTail;
+    unsigned *mCqMask;
+    struct io_uring_cqe *mCqes;
+
+    std::vector<struct iovec> mBuffers;
+};
+
+}
+}
+#endif //GOPHERWOOD_BLOCK_URINGIOENGINE_H
@@ -80,6 +80,22 @@ private:
     File *__file;
 };
 
+/* the bytes of a scatter/gather list are returned in a tSize */
+static bool isIovecSizeValid(const struct iovec *iov, int iovcnt) {
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > (uint64_t) INT32_MAX - total) {
+            return false;
+        }
+        total += iov[i].iov_len;
+    }
+    return true;
+}
+
 static void handleException(const Gopherwood::exception_ptr &error) {
     try {
         std::string buffer;
@@ -268,6 +284,45 @@ tSize gwRead(gopherwoodFS fs, gwFile file, void *buffer, tSize length) {
     return -1;
 }
 
+tSize gwPread(gopherwoodFS fs, gwFile file, void *buffer, tSize length, tOffset position) {
+    LOG(Gopherwood::Internal::DEBUG1, "------------------gwPread start------------------");
+    try {
+        tSize bytesRead = file->getFile().pread(static_cast<char *>(buffer), length, position);
+        return bytesRead;
+    } catch (...) {
+        SetLastException(Gopherwood::current_exception());
+        handleException(Gopherwood::current_exception());
+    }
+
+    return -1;
+}
+
+tSize gwReadZeroCopy(gopherwoodFS fs, gwFile file, const void **buffer, tSize length) {
+    LOG(Gopherwood::Internal::DEBUG1, "------------------gwReadZeroCopy start------------------");
+    try {
+        tSize bytesRead = file->getFile().readZeroCopy(reinterpret_cast<const char **>(buffer), length);
+        return bytesRead;
+    } catch (...) {
+        SetLastException(Gopherwood::current_exception());
+        handleException(Gopherwood::current_exception());
+    }
+
+    return -1;
+}
+
+int gwReleaseZeroCopy(gopherwoodFS fs, gwFile file, const void *buffer) {
+    LOG(Gopherwood::Internal::DEBUG1, "------------------gwReleaseZeroCopy start------------------");
+    try {
+        file->getFile().releaseZeroCopy(static_cast<const char *>(buffer));
+        return 0;
+    } catch (...) {
+        SetLastException(Gopherwood::current_exception());
+        handleException(Gopherwood::current_exception());
+    }
+
+    return -1;
+}
+
 int64_t gwSeek(gopherwoodFS fs, gwFile file, tOffset desiredPos, int mode) {
     LOG(Gopherwood::Internal::DEBUG1, "------------------gwSeek start------------------");
     try {
@@ -293,6 +348,57 @@ tSize gwWrite(gopherwoodFS fs, gwFile file, const void *buffer, tSize length) {
     return -1;
 }
 
+tSize gwReadv(gopherwoodFS fs, gwFile file, const struct iovec *iov, int iovcnt) {
+    LOG(Gopherwood::Internal::DEBUG1, "------------------gwReadv start------------------");
+    PARAMETER_ASSERT(isIovecSizeValid(iov, iovcnt), -1, EINVAL);
+    try {
+        tSize bytesRead = file->getFile().readv(iov, iovcnt);
+        return bytesRead;
+    } catch (...) {
+        SetLastException(Gopherwood::current_exception());
+        handleException(Gopherwood::current_exception());
+    }
+
+    return -1;
+}
+
+int gwPreadBatch(gopherwoodFS fs, gwFile file, GWReadRequest *requests, int numRequests) {
+    LOG(Gopherwood::Internal::DEBUG1, "------------------gwPreadBatch start------------------");
+    try {
+        return file->getFile().preadBatch(requests, numRequests) ? 0 : -1;
+    } catch (...) {
+        SetLastException(Gopherwood::current_exception());
+        handleException(Gopherwood::current_exception());
+    }
+
+    return -1;
+}
+
+tSize gwWritev(gopherwoodFS fs, gwFile file, const struct iovec *iov, int iovcnt) {
+    LOG(Gopherwood::Internal::DEBUG1, "------------------gwWritev start------------------");
+    PARAMETER_ASSERT(isIovecSizeValid(iov, iovcnt), -1, EINVAL);
+    try {
+        return file->getFile().writev(iov, iovcnt);
+    } catch (...) {
+        SetLastException(Gopherwood::current_exception());
+        handleException(Gopherwood::current_exception());
+    }
+
+    return -1;
+}
+
+tSize gwPwrite(gopherwoodFS fs, gwFile file, const void *buffer, tSize length, tOffset position) {
+    LOG(Gopherwood::Internal::DEBUG1, "------------------gwPwrite start------------------");
+    try {
+        return file->getFile().pwrite(static_cast<const char *>(buffer), length, position);
+    } catch (...) {
+        SetLastException(Gopherwood::current_exception());
+        handleException(Gopherwood::current_exception());
+    }
+
+    return -1;
+}
+
 int gwFlush(gopherwoodFS fs, gwFile file) {
     LOG(Gopherwood::Internal::DEBUG1, "------------------gwFlush start------------------");
     try {
@@ -25,6 +25,7 @@
 #include <fcntl.h> /* for O_RDONLY, O_WRONLY */
 #include <errno.h> /* for EINTERNAL, etc. */
 #include <stdint.h> /* for uint64_t, etc. */
+#include <sys/uio.h> /* for struct iovec */
 
 #ifdef __cplusplus
 extern "C" {
@@ -93,6 +94,16 @@ typedef struct GWSysInfo {
     uint32_t numEvictingBuckets;
     uint32_t numAdminActiveStatus;
 	uint32_t numFileActiveStatus;
+	/* used buckets with an up to date copy in OSS, evicted without an upload */
+	uint32_t numCleanBuckets;
+	/* OSS requests of this process and the GETs and PUTs they took, with the
+	 * retries, the timeouts, and the hedged GETs and those that won */
+	uint64_t numOssRequests;
+	uint64_t numOssAttempts;
+	uint64_t numOssRetries;
+	uint64_t numOssTimeouts;
+	uint64_t numOssHedges;
+	uint64_t numOssHedgeWins;
 }GWSysInfo;
 
 typedef struct GWFileInfo {
@@ -103,8 +114,26 @@ typedef struct GWFileInfo {
 	uint32_t numEvicted;
 	uint32_t numLoaded;
 	uint32_t numActivated;
+	uint64_t numReadAheadHits;
+	uint64_t numReadAheadMisses;
+	/* block bytes evicted and object bytes uploaded, their quotient is the
+	 * compression ratio. CPU time of the block codec on evict and load */
+	uint64_t numBytesEvicted;
+	uint64_t numBytesUploaded;
+	uint64_t compressNanos;
+	uint64_t decompressNanos;
+	/* loads that fetched the pages of a read before the rest of the block */
+	uint32_t numPartialLoads;
 }GWFileInfo;
 
+typedef struct GWReadRequest {
+	tOffset offset;
+	void *buffer;
+	tSize length;
+	/* bytes read, short at end-of-file, -1 on error */
+	tSize result;
+}GWReadRequest;
+
 /**
  * gwGetLastError - Return error information of last failed operation.
  *
@@ -161,6 +190,108 @@ bool gwFileExists(gopherwoodFS fs,const char * fileName);
  */
 tSize gwRead(gopherwoodFS fs, gwFile file, void *buffer, tSize length);
 
+/**
+ * gwPread - Read data from a given position of an open file.
+ *
+ * The file position is neither used nor moved. Several threads may call
+ * gwPread and gwPwrite concurrently on the same file handle, the other
+ * operations of a handle must not run concurrently with them.
+ *
+ * @param   fs          The configured filesystem handle.
+ * @param   file        The file handle.
+ * @param   buffer      The buffer to copy read bytes into.
+ * @param   length      The length of the buffer.
+ * @param   position    The file offset to read from.
+ * @return  On success, a positive number indicating how many bytes
+ *          were read.
+ *          On end-of-file, 0.
+ *          On error, -1.  Errno will be set to the error code.
+ */
+tSize gwPread(gopherwoodFS fs, gwFile file, void *buffer, tSize length, tOffset position);
+
+/**
+ * gwReadZeroCopy - Read data from an open file without copying it.
+ *
+ * The block holding the current position is pinned in the local space and
+ * a pointer into a read only mapping of it is returned. The returned range
+ * never crosses a block boundary, so it might be shorter than length. The
+ * position moves past the returned bytes. The pointer stays valid, and the
+ * block can not be evicted, until gwReleaseZeroCopy or gwCloseFile.
+ *
+ * Every block with an outstanding buffer holds a bucket of the file quota,
+ * one bucket is always kept free for reading the other blocks. A read that
+ * would pin a new block beyond quota - 1 pinned blocks fails with errno
+ * EINVALIDPARM until a buffer of another block is released.
+ *
+ * @param   fs      The configured filesystem handle.
+ * @param   file    The file handle.
+ * @param   buffer  [out] Pointer to the first byte read.
+ * @param   length  The maximum number of bytes to read.
+ * @return  On success, a positive number indicating how many bytes
+ *          can be read from buffer.
+ *          On end-of-file, 0.
+ *          On error, -1.  Errno will be set to the error code.
+ */
+tSize gwReadZeroCopy(gopherwoodFS fs, gwFile file, const void **buffer, tSize length);
+
+/**
+ * gwReleaseZeroCopy - Release a buffer returned by gwReadZeroCopy.
+ *
+ * @param   fs      The configured filesystem handle.
+ * @param   file    The file handle.
+ * @param   buffer  The pointer returned by gwReadZeroCopy.
+ * @return  Returns 0 on success, -1 on error.
+ */
+int gwReleaseZeroCopy(gopherwoodFS fs, gwFile file, const void *buffer);
+
+/**
+ * gwReadv - Read data from an open file into a scatter list.
+ *
+ * The list is filled in order, as if gwRead was called for each entry,
+ * with one positioned read per block it spans.
+ *
+ * @param   fs      The configured filesystem handle.
+ * @param   file    The file handle.
+ * @param   iov     The buffers to copy read bytes into.
+ * @param   iovcnt  The number of buffers.
+ * @return  On success, a positive number indicating how many bytes
+ *          were read.
+ *          On end-of-file, 0.
+ *          On error, -1.  Errno will be set to the error code, EINVAL
+ *          if the buffers add up to more than INT32_MAX bytes.
+ */
+tSize gwReadv(gopherwoodFS fs, gwFile file, const struct iovec *iov, int iovcnt);
+
+/**
+ * gwWritev - Write data from a gather list into an open file.
+ *
+ * The list is written in order, as if gwWrite was called for each entry,
+ * with one positioned write per block it spans.
+ *
+ * @param   fs      The configured filesystem handle.
+ * @param   file    The file handle.
+ * @param   iov     The buffers to write.
+ * @param   iovcnt  The number of buffers.
+ * @return  Returns the number of bytes written, -1 on error. Errno is
+ *          EINVAL if the buffers add up to more than INT32_MAX bytes.
+ */
+tSize gwWritev(gopherwoodFS fs, gwFile file, const struct iovec *iov, int iovcnt);
+
+/**
+ * gwPreadBatch - Read a batch of file ranges without moving the position.
+ *
+ * The requests are grouped by block. Each block is activated once, blocks
+ * not in the local space are loaded in parallel, and the reads of a block
+ * are submitted to the local space together.
+ *
+ * @param   fs          The configured filesystem handle.
+ * @param   file        The file handle.
+ * @param   requests    The ranges to read, result is set for each of them.
+ * @param   numRequests The number of requests.
+ * @return  Returns 0 if every request succeeded, -1 otherwise.
+ */
+int gwPreadBatch(gopherwoodFS fs, gwFile file, GWReadRequest *requests, int numRequests);
+
 /**
  * gwWrite - Write data into an open file.
  *
@@ -172,6 +303,21 @@ tSize gwRead(gopherwoodFS fs, gwFile file, void *buffer, tSize length);
  */
 tSize gwWrite(gopherwoodFS fs, gwFile file, const void *buffer, tSize length);
 
+/**
+ * gwPwrite - Write data at a given position of an open file.
+ *
+ * The file position is neither used nor moved, the file is extended when
+ * the range ends beyond end-of-file. See gwPread for concurrency.
+ *
+ * @param   fs          The configured filesystem handle.
+ * @param   file        The file handle.
+ * @param   buffer      The data.
+ * @param   length      The no. of bytes to write.
+ * @param   position    The file offset to write to.
+ * @return  Returns the number of bytes written, -1 on error.
+ */
+tSize gwPwrite(gopherwoodFS fs, gwFile file, const void *buffer, tSize length, tOffset position);
+
 /**
  * gwFlush - Flush the data.
  *
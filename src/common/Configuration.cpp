@@ -42,6 +42,139 @@ int32_t Configuration::PRE_ACTIVATE_BLOCK_NUM = 4;
 
 size_t Configuration::MAX_LOADER_THREADS = 5;
 
+size_t Configuration::MAX_CACHED_MANIFESTS = 64;
+
+/* 0 sync, 1 thread pool, 2 io_uring (falls back to thread pool). Buffered
+ * local space I/O is served from the page cache inline, where pread wins */
+int32_t Configuration::LOCAL_IO_ENGINE = 0;
+
+uint32_t Configuration::LOCAL_IO_QUEUE_DEPTH = 32;
+
+int64_t Configuration::LOCAL_IO_CHUNK_SIZE = 1024 * 1024;
+
+size_t Configuration::LOCAL_IO_THREADS = 8;
+
+/* open the local space file with O_DIRECT, bypassing the page cache */
+bool Configuration::LOCAL_DIRECT_IO = false;
+
+size_t Configuration::DIRECT_IO_BUFFER_POOL_SIZE = 16;
+
+/* write combining buffer of GW_SEQACC write handles, 0 writes every gwWrite through */
+int64_t Configuration::WRITE_BUFFER_SIZE = 256 * 1024;
+
+/* what gwFlush syncs, 0 nothing, 1 writes back the dirty ranges of the handle
+ * with sync_file_range then fdatasyncs, 2 only fdatasync of the local space file */
+int32_t Configuration::LOCAL_SYNC_POLICY = 1;
+
+/* a handle with more dirty ranges than this syncs the whole local space file */
+size_t Configuration::LOCAL_SYNC_MAX_RANGES = 1024;
+
+/* read-ahead window of GW_SEQACC readers, doubles on each sequential refill
+ * up to the max and restarts on random access. Max size 0 disables it */
+int64_t Configuration::READ_AHEAD_MIN_SIZE = 128 * 1024;
+
+int64_t Configuration::READ_AHEAD_MAX_SIZE = 4 * 1024 * 1024;
+
+/* fallocate every bucket of the local space file when the file system starts */
+bool Configuration::LOCAL_PREALLOCATE = true;
+
+/* punch out the extents of a bucket holding stale data when it is freed,
+ * thin provisioned devices get a TRIM. The next write allocates again */
+bool Configuration::LOCAL_PUNCH_FREED_BUCKETS = false;
+
+/* check the CRC32C of each chunk loaded from OSS before it is written into
+ * its bucket. Size and format of the object are checked regardless, and the
+ * pages of a partial fetch are always checked */
+bool Configuration::OSS_VERIFY_CHECKSUM = true;
+
+/* load an object without a block header as a raw block, as older releases
+ * uploaded them. Such an object has no checksums, so a damaged header would
+ * load garbage: only for spaces written by older releases */
+bool Configuration::OSS_LEGACY_RAW_BLOCKS = false;
+
+/* codec of blocks written to OSS, 0 none, 1 LZ. Loads use the codec
+ * recorded in the object */
+int32_t Configuration::OSS_BLOCK_CODEC = 1;
+
+/* blocks are compressed in chunks of this size on OSS_CODEC_THREADS threads,
+ * 0 threads compresses on the evicting thread */
+int64_t Configuration::OSS_CODEC_CHUNK_SIZE = 1024 * 1024;
+
+size_t Configuration::OSS_CODEC_THREADS = 4;
+
+/* blocks are streamed between their bucket and OSS in windows of whole codec
+ * chunks, the bucket I/O of the next window runs on OSS_STREAM_THREADS
+ * threads while the current one is on the wire. 0 threads does it inline */
+int64_t Configuration::OSS_STREAM_WINDOW_SIZE = 4 * 1024 * 1024;
+
+size_t Configuration::OSS_STREAM_THREADS = 4;
+
+/* free window buffers kept for reuse, a transfer holds two of them */
+size_t Configuration::OSS_STREAM_BUFFER_POOL_SIZE = 8;
+
+/* blocks are split into parts moved in parallel on OSS_TRANSFER_THREADS
+ * threads, each part on a context of its own. A part takes about
+ * OSS_PART_TARGET_TIME ms at the bandwidth measured on one stream and is
+ * never smaller than OSS_PART_MIN_SIZE. 0 threads moves a block in one object */
+size_t Configuration::OSS_TRANSFER_THREADS = 8;
+
+int64_t Configuration::OSS_PART_MIN_SIZE = 8 * 1024 * 1024;
+
+int64_t Configuration::OSS_PART_TARGET_TIME = 500;
+
+/* a read of a remote block waits only for the pages of OSS_PARTIAL_FETCH_PAGE_SIZE
+ * it needs, fetched by ranged GETs, the rest of the block is loaded behind
+ * it. 0 loads the whole block before the read */
+int64_t Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 1024 * 1024;
+
+/* every request to OSS runs on a pooled context, up to OSS_CONTEXT_POOL_SIZE
+ * idle ones are kept for OSS_CONTEXT_IDLE_TIMEOUT ms. 0 sizes the pool to the
+ * loader, evict and transfer threads */
+size_t Configuration::OSS_CONTEXT_POOL_SIZE = 0;
+
+int64_t Configuration::OSS_CONTEXT_IDLE_TIMEOUT = 60000;
+
+/* objects are read in requests of OSS_REQUEST_SIZE bytes, a request without
+ * an answer after OSS_REQUEST_TIMEOUT ms is given up. 0 waits forever */
+int64_t Configuration::OSS_REQUEST_SIZE = 1024 * 1024;
+
+int64_t Configuration::OSS_REQUEST_TIMEOUT = 30000;
+
+/* a failed request or part upload is tried again up to OSS_REQUEST_RETRIES
+ * times, after a random backoff of up to OSS_RETRY_BASE_DELAY ms doubled on
+ * every retry and capped at OSS_RETRY_MAX_DELAY ms */
+int32_t Configuration::OSS_REQUEST_RETRIES = 3;
+
+int64_t Configuration::OSS_RETRY_BASE_DELAY = 50;
+
+int64_t Configuration::OSS_RETRY_MAX_DELAY = 2000;
+
+/* a request slower than the OSS_HEDGE_PERCENTILE percentile of the recent
+ * ones is sent again on another context, the first answer wins. 0 disables
+ * the hedged requests */
+int32_t Configuration::OSS_HEDGE_PERCENTILE = 95;
+
+/* the requests in flight run on OSS_REQUEST_THREADS threads, 0 runs two for
+ * every pooled context */
+size_t Configuration::OSS_REQUEST_THREADS = 0;
+
+/* evicted blocks are uploaded on OSS_EVICT_THREADS threads, 0 uploads on the
+ * evicting thread. An ActiveStatus has up to OSS_EVICT_MAX_INFLIGHT uploads
+ * running and goes on with the first bucket freed */
+size_t Configuration::OSS_EVICT_THREADS = 8;
+
+size_t Configuration::OSS_EVICT_MAX_INFLIGHT = 4;
+
+/* the background cleaner uploads cold used buckets once less than LOW percent
+ * of the buckets are free or clean, until HIGH percent are. Those buckets are
+ * evicted without an upload. 0 disables the cleaner */
+int32_t Configuration::BUCKET_CLEANER_LOW_WATERMARK = 10;
+
+int32_t Configuration::BUCKET_CLEANER_HIGH_WATERMARK = 20;
+
+/* milliseconds between two watermark checks of the cleaner */
+int32_t Configuration::BUCKET_CLEANER_INTERVAL = 100;
+
 uint32_t Configuration::getCurQuotaSize(){
     return Configuration::NUMBER_OF_BLOCKS/Configuration::CUR_CONNECTION;
 }
@@ -42,6 +42,46 @@ public:
 
     /* hard coded parameters */
     static size_t MAX_LOADER_THREADS;
+    static size_t MAX_CACHED_MANIFESTS;
+    static int32_t LOCAL_IO_ENGINE;
+    static uint32_t LOCAL_IO_QUEUE_DEPTH;
+    static int64_t LOCAL_IO_CHUNK_SIZE;
+    static size_t LOCAL_IO_THREADS;
+    static bool LOCAL_DIRECT_IO;
+    static size_t DIRECT_IO_BUFFER_POOL_SIZE;
+    static int64_t WRITE_BUFFER_SIZE;
+    static int32_t LOCAL_SYNC_POLICY;
+    static size_t LOCAL_SYNC_MAX_RANGES;
+    static int64_t READ_AHEAD_MIN_SIZE;
+    static int64_t READ_AHEAD_MAX_SIZE;
+    static bool LOCAL_PREALLOCATE;
+    static bool LOCAL_PUNCH_FREED_BUCKETS;
+    static bool OSS_VERIFY_CHECKSUM;
+    static bool OSS_LEGACY_RAW_BLOCKS;
+    static int32_t OSS_BLOCK_CODEC;
+    static int64_t OSS_CODEC_CHUNK_SIZE;
+    static size_t OSS_CODEC_THREADS;
+    static int64_t OSS_STREAM_WINDOW_SIZE;
+    static size_t OSS_STREAM_THREADS;
+    static size_t OSS_STREAM_BUFFER_POOL_SIZE;
+    static size_t OSS_TRANSFER_THREADS;
+    static int64_t OSS_PART_MIN_SIZE;
+    static int64_t OSS_PART_TARGET_TIME;
+    static int64_t OSS_PARTIAL_FETCH_PAGE_SIZE;
+    static size_t OSS_CONTEXT_POOL_SIZE;
+    static int64_t OSS_CONTEXT_IDLE_TIMEOUT;
+    static int64_t OSS_REQUEST_SIZE;
+    static int64_t OSS_REQUEST_TIMEOUT;
+    static int32_t OSS_REQUEST_RETRIES;
+    static int64_t OSS_RETRY_BASE_DELAY;
+    static int64_t OSS_RETRY_MAX_DELAY;
+    static int32_t OSS_HEDGE_PERCENTILE;
+    static size_t OSS_REQUEST_THREADS;
+    static size_t OSS_EVICT_THREADS;
+    static size_t OSS_EVICT_MAX_INFLIGHT;
+    static int32_t BUCKET_CLEANER_LOW_WATERMARK;
+    static int32_t BUCKET_CLEANER_HIGH_WATERMARK;
+    static int32_t BUCKET_CLEANER_INTERVAL;
 
     static uint32_t getCurQuotaSize();
 };
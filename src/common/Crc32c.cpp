@@ -0,0 +1,277 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace Gopherwood {
+namespace Internal {
+
+/* reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78
+
+typedef uint32_t (*Crc32cFunc)(uint32_t crc, const uint8_t *data, size_t length);
+
+static uint32_t Crc32cTable[8][256];
+
+static void initCrc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        Crc32cTable[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = Crc32cTable[0][i];
+        for (int k = 1; k < 8; k++) {
+            crc = Crc32cTable[0][crc & 0xFF] ^ (crc >> 8);
+            Crc32cTable[k][i] = crc;
+        }
+    }
+}
+
+/* slicing-by-8, works on the inverted crc */
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t *data, size_t length) {
+    while (length > 0 && ((uintptr_t) data & 7) != 0) {
+        crc = Crc32cTable[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        length--;
+    }
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        word ^= crc;
+        crc = Crc32cTable[7][word & 0xFF] ^
+              Crc32cTable[6][(word >> 8) & 0xFF] ^
+              Crc32cTable[5][(word >> 16) & 0xFF] ^
+              Crc32cTable[4][(word >> 24) & 0xFF] ^
+              Crc32cTable[3][(word >> 32) & 0xFF] ^
+              Crc32cTable[2][(word >> 40) & 0xFF] ^
+              Crc32cTable[1][(word >> 48) & 0xFF] ^
+              Crc32cTable[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = Crc32cTable[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        length--;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/*
+ * The crc32 instruction has a latency of three cycles but a throughput of one
+ * per cycle, so large buffers are split into three interleaved streams whose
+ * checksums are combined afterwards by shifting them over the bytes that
+ * follow. Each stream covers CRC32C_LONG bytes, tails of the buffer use
+ * CRC32C_SHORT streams.
+ */
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+static uint32_t Crc32cLongShift[4][256];
+static uint32_t Crc32cShortShift[4][256];
+
+/* multiply a vector by a 32x32 matrix over GF(2) */
+static uint32_t gf2MatrixTimes(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gf2MatrixSquare(uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+    }
+}
+
+/* build the tables that append length zero bytes to a crc, length is a power of 2 */
+static void initCrc32cShift(uint32_t shift[4][256], size_t length) {
+    uint32_t even[32];
+    uint32_t odd[32];
+
+    /* operator for one zero bit */
+    odd[0] = CRC32C_POLY;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    /* two, then four zero bits */
+    gf2MatrixSquare(even, odd);
+    gf2MatrixSquare(odd, even);
+
+    /* one zero byte, then keep squaring until length is used up */
+    uint32_t *op = even;
+    do {
+        gf2MatrixSquare(even, odd);
+        op = even;
+        length >>= 1;
+        if (length == 0) {
+            break;
+        }
+        gf2MatrixSquare(odd, even);
+        op = odd;
+        length >>= 1;
+    } while (length);
+
+    for (uint32_t n = 0; n < 256; n++) {
+        shift[0][n] = gf2MatrixTimes(op, n);
+        shift[1][n] = gf2MatrixTimes(op, n << 8);
+        shift[2][n] = gf2MatrixTimes(op, n << 16);
+        shift[3][n] = gf2MatrixTimes(op, n << 24);
+    }
+}
+
+static inline uint32_t crc32cShift(uint32_t shift[4][256], uint32_t crc) {
+    return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^
+           shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2")))
+static inline const uint8_t *crc32cInterleave(uint64_t &crc0, const uint8_t *data, size_t stride) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    const uint8_t *end = data + stride;
+    do {
+        uint64_t word0, word1, word2;
+        memcpy(&word0, data, 8);
+        memcpy(&word1, data + stride, 8);
+        memcpy(&word2, data + stride * 2, 8);
+        crc0 = _mm_crc32_u64(crc0, word0);
+        crc1 = _mm_crc32_u64(crc1, word1);
+        crc2 = _mm_crc32_u64(crc2, word2);
+        data += 8;
+    } while (data < end);
+
+    uint32_t (*shift)[256] = stride == CRC32C_LONG ? Crc32cLongShift : Crc32cShortShift;
+    crc0 = crc32cShift(shift, (uint32_t) crc0) ^ crc1;
+    crc0 = crc32cShift(shift, (uint32_t) crc0) ^ crc2;
+    return data + stride * 2;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t length) {
+    uint64_t crc64 = crc;
+    while (length > 0 && ((uintptr_t) data & 7) != 0) {
+        crc64 = _mm_crc32_u8((uint32_t) crc64, *data++);
+        length--;
+    }
+    while (length >= CRC32C_LONG * 3) {
+        data = crc32cInterleave(crc64, data, CRC32C_LONG);
+        length -= CRC32C_LONG * 3;
+    }
+    while (length >= CRC32C_SHORT * 3) {
+        data = crc32cInterleave(crc64, data, CRC32C_SHORT);
+        length -= CRC32C_SHORT * 3;
+    }
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc64 = _mm_crc32_u8((uint32_t) crc64, *data++);
+        length--;
+    }
+    return (uint32_t) crc64;
+}
+
+static bool hasCrc32cInstruction() {
+    return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t length) {
+    while (length > 0 && ((uintptr_t) data & 7) != 0) {
+        crc = __crc32cb(crc, *data++);
+        length--;
+    }
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = __crc32cb(crc, *data++);
+        length--;
+    }
+    return crc;
+}
+
+static bool hasCrc32cInstruction() {
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+}
+#else
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t length) {
+    return crc32cSoftware(crc, data, length);
+}
+
+static bool hasCrc32cInstruction() {
+    return false;
+}
+#endif
+
+static Crc32cFunc chooseCrc32cFunc() {
+    initCrc32cTable();
+#if defined(__x86_64__)
+    initCrc32cShift(Crc32cLongShift, CRC32C_LONG);
+    initCrc32cShift(Crc32cShortShift, CRC32C_SHORT);
+#endif
+    return hasCrc32cInstruction() ? crc32cHardware : crc32cSoftware;
+}
+
+static Crc32cFunc Crc32cImpl = chooseCrc32cFunc();
+
+uint32_t Crc32c::update(uint32_t crc, const void *data, size_t length) {
+    return ~Crc32cImpl(~crc, (const uint8_t *) data, length);
+}
+
+uint32_t Crc32c::updateSoftware(uint32_t crc, const void *data, size_t length) {
+    return ~crc32cSoftware(~crc, (const uint8_t *) data, length);
+}
+
+bool Crc32c::isHardwareAccelerated() {
+    return Crc32cImpl != crc32cSoftware;
+}
+
+}
+}
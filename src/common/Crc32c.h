@@ -0,0 +1,66 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _GOPHERWOOD_COMMON_CRC32C_H_
+#define _GOPHERWOOD_COMMON_CRC32C_H_
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * CRC32C (Castagnoli) checksum.
+ *
+ * Uses the SSE4.2 crc32 instruction on x86_64 and the ARMv8 CRC32 extension
+ * on aarch64 when the CPU supports them, otherwise falls back to a
+ * slicing-by-8 table implementation. The instruction set is probed once at
+ * startup. On x86_64 large buffers are checksummed as three interleaved
+ * streams, which keeps whole blocks close to memory bandwidth.
+ */
+class Crc32c {
+public:
+    /**
+     * Extend a checksum with more data. Start with crc = 0.
+     * @param crc the checksum of the preceding data
+     * @param data the data to checksum
+     * @param length the length of data
+     * @return the checksum of preceding data followed by data
+     */
+    static uint32_t update(uint32_t crc, const void *data, size_t length);
+
+    static uint32_t value(const void *data, size_t length) {
+        return update(0, data, length);
+    }
+
+    /* always use the table implementation, for testing and benchmarks */
+    static uint32_t updateSoftware(uint32_t crc, const void *data, size_t length);
+
+    static bool isHardwareAccelerated();
+};
+
+}
+}
+
+#endif /* _GOPHERWOOD_COMMON_CRC32C_H_ */
@@ -66,11 +66,10 @@ public:
         std::vector<key_t> deleteVector;
 
         if (_cache_items_map.size() > _max_size) {
-            auto last = _cache_items_list.end();
-            last--;
-            _cache_items_map.erase(last->first);
+            key_t lastKey = _cache_items_list.back().first;
+            _cache_items_map.erase(lastKey);
             _cache_items_list.pop_back();
-            deleteVector.push_back(last->first);
+            deleteVector.push_back(lastKey);
         }
         return deleteVector;
     }
@@ -79,11 +78,10 @@ public:
         std::vector<key_t> removeVector;
         size_t removeNum = num > _cache_items_map.size() ? _cache_items_map.size() : num;
         while (removeNum > 0) {
-            auto last = _cache_items_list.end();
-            last--;
-            _cache_items_map.erase(last->first);
+            key_t lastKey = _cache_items_list.back().first;
+            _cache_items_map.erase(lastKey);
             _cache_items_list.pop_back();
-            removeVector.push_back(last->first);
+            removeVector.push_back(lastKey);
             removeNum--;
         }
         return removeVector;
@@ -117,6 +115,17 @@ public:
         }
     }
 
+    /* get the value and move the key to the front */
+    bool get(const key_t &key, value_t &value) {
+        auto it = _cache_items_map.find(key);
+        if (it == _cache_items_map.end()) {
+            return false;
+        }
+        _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second);
+        value = it->second->second;
+        return true;
+    }
+
     bool exists(const key_t &key) const {
         return _cache_items_map.find(key) != _cache_items_map.end();
     }
@@ -0,0 +1,143 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "common/Logger.h"
+#include "common/OssBuilder.h"
+#include "common/OssContextPool.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+static std::mutex instanceMutex;
+shared_ptr<OssContextPool> OssContextPool::instance;
+
+shared_ptr<OssContextPool> OssContextPool::getInstance() {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (!instance) {
+        size_t maxIdle = Configuration::OSS_CONTEXT_POOL_SIZE;
+        if (maxIdle == 0) {
+            /* a context for every thread that talks to OSS, the
+             * loads of read ahead run on the loader threads */
+            maxIdle = Configuration::MAX_LOADER_THREADS + Configuration::OSS_EVICT_THREADS +
+                      Configuration::OSS_TRANSFER_THREADS;
+        }
+        instance = shared_ptr<OssContextPool>(
+                new OssContextPool(maxIdle, Configuration::OSS_CONTEXT_IDLE_TIMEOUT));
+    }
+    return instance;
+}
+
+OssContextPool::OssContextPool(size_t maxIdle, int64_t idleTimeout) :
+        mMaxIdle(maxIdle), mIdleTimeout(idleTimeout), mNumCreated(0) {
+}
+
+ossContext OssContextPool::acquire() {
+    std::vector<ossContext> expired;
+    ossContext ctx = NULL;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        trimLocked(expired);
+        if (!mIdle.empty()) {
+            ctx = mIdle.back().ctx;
+            mIdle.pop_back();
+        }
+    }
+    for (size_t i = 0; i < expired.size(); i++) {
+        ossDestroyContext(expired[i]);
+    }
+    if (ctx != NULL) {
+        return ctx;
+    }
+
+    ctx = ossRootBuilder.buildContext();
+    mNumCreated++;
+    LOG(DEBUG1, "[OssContextPool]        |"
+            "Created an OSS context, %lu created so far", (unsigned long) mNumCreated.load());
+    return ctx;
+}
+
+void OssContextPool::release(ossContext ctx, bool healthy) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    std::vector<ossContext> expired;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        trimLocked(expired);
+        if (healthy && mIdle.size() < mMaxIdle) {
+            IdleContext idle;
+            idle.ctx = ctx;
+            idle.releasedAt = steady_clock::now();
+            mIdle.push_back(idle);
+            ctx = NULL;
+        }
+    }
+    if (ctx != NULL) {
+        expired.push_back(ctx);
+        if (!healthy) {
+            LOG(DEBUG1, "[OssContextPool]        |"
+                    "Destroyed an OSS context after a failed request");
+        }
+    }
+    for (size_t i = 0; i < expired.size(); i++) {
+        ossDestroyContext(expired[i]);
+    }
+}
+
+void OssContextPool::trim() {
+    std::vector<ossContext> expired;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        trimLocked(expired);
+    }
+    for (size_t i = 0; i < expired.size(); i++) {
+        ossDestroyContext(expired[i]);
+    }
+}
+
+/* NOTE: You should have acquired the mutex before calling me. The oldest
+ * are at the front, they are destroyed by the caller outside of the mutex */
+void OssContextPool::trimLocked(std::vector<ossContext> &expired) {
+    steady_clock::time_point now = steady_clock::now();
+    while (!mIdle.empty() && ToMilliSeconds(mIdle.front().releasedAt, now) >= mIdleTimeout) {
+        expired.push_back(mIdle.front().ctx);
+        mIdle.pop_front();
+    }
+}
+
+size_t OssContextPool::getNumIdle() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mIdle.size();
+}
+
+OssContextPool::~OssContextPool() {
+    for (size_t i = 0; i < mIdle.size(); i++) {
+        ossDestroyContext(mIdle[i].ctx);
+    }
+    mIdle.clear();
+}
+
+}
+}
@@ -0,0 +1,97 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GOPHERWOOD_COMMON_OSSCONTEXTPOOL_H
+#define GOPHERWOOD_COMMON_OSSCONTEXTPOOL_H
+
+#include "platform.h"
+
+#include "common/DateTime.h"
+#include "common/Memory.h"
+#include "oss/oss.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * OssContextPool
+ *
+ * @desc Process wide pool of the OSS contexts built by ossRootBuilder. Every
+ * request to OSS runs on a context taken from the pool for its duration, so
+ * the loads, uploads and parts in flight each have a connection of their own
+ * and a warm one is reused by the next. Up to OSS_CONTEXT_POOL_SIZE idle
+ * contexts are kept, 0 sizes the pool to the loader, evict and transfer
+ * threads. A context given back after a failed request is destroyed, one
+ * idle for OSS_CONTEXT_IDLE_TIMEOUT ms is trimmed.
+ */
+class OssContextPool {
+public:
+    static shared_ptr<OssContextPool> getInstance();
+
+    /* the context given back last, or a new one. Never returns NULL */
+    ossContext acquire();
+
+    /* a context that saw an error is not trusted with the next request */
+    void release(ossContext ctx, bool healthy = true);
+
+    /* destroy the contexts idle for longer than the idle timeout */
+    void trim();
+
+    size_t getNumIdle();
+
+    inline size_t getMaxIdle() {
+        return mMaxIdle;
+    }
+
+    inline uint64_t getNumCreated() {
+        return mNumCreated;
+    }
+
+    ~OssContextPool();
+
+private:
+    OssContextPool(size_t maxIdle, int64_t idleTimeout);
+
+    void trimLocked(std::vector<ossContext> &expired);
+
+    struct IdleContext {
+        ossContext ctx;
+        steady_clock::time_point releasedAt;
+    };
+
+    static shared_ptr<OssContextPool> instance;
+
+    size_t mMaxIdle;
+    int64_t mIdleTimeout;
+    /* the most recently released at the back */
+    std::deque<IdleContext> mIdle;
+    std::mutex mMutex;
+    std::atomic<uint64_t> mNumCreated;
+};
+
+}
+}
+
+#endif //GOPHERWOOD_COMMON_OSSCONTEXTPOOL_H
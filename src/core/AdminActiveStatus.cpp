@@ -21,11 +21,13 @@
  */
 
 #include "core/AdminActiveStatus.h"
+#include "core/EvictPipeline.h"
 #include "common/Configuration.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
 #include "common/Logger.h"
 #include "core/Manifest.h"
+#include "core/ManifestCache.h"
 
 namespace Gopherwood {
 namespace Internal {
@@ -34,12 +36,12 @@ namespace Internal {
 #define SHARED_MEM_BEGIN    try { \
                                 mSharedMemoryContext->lock();
 
-#define SHARED_MEM_END          mSharedMemoryContext->unlock();\
-                            } catch (...) { \
+#define SHARED_MEM_END      } catch (...) { \
                                 SetLastException(Gopherwood::current_exception()); \
                                 mSharedMemoryContext->unlock(); \
                                 Gopherwood::rethrow_exception(Gopherwood::current_exception()); \
-                            }
+                            } \
+                            mSharedMemoryContext->unlock();
 
 AdminActiveStatus::AdminActiveStatus(shared_ptr<SharedMemoryContext> sharedMemoryContext,
                                      int localSpaceFD) :
@@ -66,7 +68,6 @@ void AdminActiveStatus::unregistInSharedMem() {
 
     int rc = mSharedMemoryContext->unregistAdmin(mActiveId, getpid());
     if (rc != 0) {
-        mSharedMemoryContext->unlock();
         THROW(GopherwoodSharedMemException,
               "[ActiveStatus::unregistInSharedMem] connection info mismatch with SharedMem ActiveId=%d, PID=%d",
               mActiveId, getpid());
@@ -86,62 +87,144 @@ void AdminActiveStatus::getShareMemStatistic(GWSysInfo* sysInfo) {
         sysInfo->numLoadingBuckets = mSharedMemoryContext->getLoadingBucketNum();
         sysInfo->numAdminActiveStatus = mSharedMemoryContext->getAdminActiveStatusNum();
         sysInfo->numFileActiveStatus = mSharedMemoryContext->getFileActiveStatusNum();
+        sysInfo->numCleanBuckets = mSharedMemoryContext->getCleanBucketNum();
     SHARED_MEM_END
 }
 
+/* Evict num used buckets to free buckets, the uploads run in a batch on an
+ * EvictPipeline. Return the number of evicted buckets */
 int32_t AdminActiveStatus::evictNumOfBlocks(int num) {
-    int numToEvict = num;
+    int numMarked = 0;
     int numEvicted = 0;
-    BlockInfo   evictBlockInfo;
-    bool found = false;
+    EvictPipeline pipeline(mOssWorker);
+    Gopherwood::exception_ptr error;
 
-    while (numToEvict > 0) {
+    for (;;) {
+        /* keep the pipeline full, stop at the first failed upload */
+        std::vector<BlockInfo> victims;
         SHARED_MEM_BEGIN
-            if (mSharedMemoryContext->getUsedBucketNum() > 0) {
-                evictBlockInfo = mSharedMemoryContext->markBucketEvicting(mActiveId);
-                found = true;
+            size_t room = pipeline.capacity();
+            while (!error && numMarked < num && victims.size() < room &&
+                   mSharedMemoryContext->getUsedBucketNum() > 0) {
+                BlockInfo evictBlockInfo = mSharedMemoryContext->markBucketEvicting(mActiveId);
+                if (evictBlockInfo.bucketId == InvalidBucketId) {
+                    break;
+                }
+                victims.push_back(evictBlockInfo);
+                numMarked++;
             }
         SHARED_MEM_END
+        for (BlockInfo &info : victims) {
+            pipeline.submit(info);
+        }
 
-        if (found) {
-            mOssWorker->writeBlock(evictBlockInfo);
+        EvictResult result;
+        if (!pipeline.next(result, true)) {
+            break;
         }
 
+        BlockInfo &evictBlockInfo = result.info;
+        bool deleteRemote = false;
         SHARED_MEM_BEGIN
-            int rc = mSharedMemoryContext->evictBucketFinishAndTryFree(evictBlockInfo.bucketId, mActiveId);
-
-            if (rc == 0) {
-                logEvictBlock(evictBlockInfo);
-                mNumEvicted ++;
-            } else if (rc == 1 || rc == 2) {
-                /* the evicted bucket has been activated by it's file owner, give up this one */
-                mOssWorker->deleteBlock(evictBlockInfo);
+            if (result.error) {
+                mSharedMemoryContext->cleanBucketFinish(evictBlockInfo, false);
+                if (!error) {
+                    error = result.error;
+                }
+            } else {
+                int rc = mSharedMemoryContext->evictBucketFinishAndTryFree(evictBlockInfo);
+
+                if (rc == 0) {
+                    logEvictBlock(evictBlockInfo);
+                    mNumEvicted++;
+                    numEvicted++;
+                } else if (rc == 1 || rc == 3) {
+                    /* the evicted block has been deleted, the owner of a rc 2 bucket keeps the copy */
+                    deleteRemote = true;
+                }
             }
         SHARED_MEM_END
+
+        if (deleteRemote) {
+            mOssWorker->deleteBlock(evictBlockInfo);
+        }
     }
 
+    if (error) {
+        Gopherwood::rethrow_exception(error);
+    }
     return numEvicted;
 }
 
+/* Upload cold used buckets once less than lowWatermark buckets are free or clean,
+ * until highWatermark are. The buckets keep their data, a later eviction just
+ * frees them. Return the number of cleaned buckets */
+int32_t AdminActiveStatus::cleanBuckets(int32_t lowWatermark, int32_t highWatermark) {
+    int32_t numCleaned = 0;
+    int32_t watermark = lowWatermark;
 
-void AdminActiveStatus::logEvictBlock(BlockInfo info) {
-    Block block(InvalidBucketId, info.blockId, false, BUCKET_FREE);
+    for (;;) {
+        BlockInfo cleanBlockInfo;
+        cleanBlockInfo.reset();
+        SHARED_MEM_BEGIN
+            int32_t numReclaimable = mSharedMemoryContext->getFreeBucketNum() +
+                                     mSharedMemoryContext->getCleanBucketNum();
+            if (numReclaimable < watermark) {
+                cleanBlockInfo = mSharedMemoryContext->markBucketCleaning(mActiveId);
+            }
+        SHARED_MEM_END
 
-        /* check file exist */
-        std::string manifestFileName = Manifest::getManifestFileName(mSharedMemoryContext->getWorkDir(), info.fileId);
-        if (access(manifestFileName.c_str(), F_OK) == -1) {
-            THROW(GopherwoodInvalidParmException,
-                  "[ActiveStatus::ActiveStatus] File does not exist %s",
-                  manifestFileName.c_str());
+        if (cleanBlockInfo.bucketId == InvalidBucketId) {
+            break;
+        }
+        /* clean until the high watermark once started */
+        watermark = highWatermark;
+
+        bool uploaded = false;
+        try {
+            mOssWorker->writeBlock(cleanBlockInfo);
+            uploaded = true;
+        } catch (...) {
+            LOG(WARNING, "[ActiveStatus]          |"
+                    "Clean bucket %d failed, file %s block %d", cleanBlockInfo.bucketId,
+                cleanBlockInfo.fileId.toString().c_str(), cleanBlockInfo.blockId);
         }
-        Manifest *manifest = new Manifest(manifestFileName);
-        manifest->mfSeek(0, SEEK_END);
-        manifest->logEvcitBlock(block);
 
+        int rc;
+        SHARED_MEM_BEGIN
+            rc = mSharedMemoryContext->cleanBucketFinish(cleanBlockInfo, uploaded);
+        SHARED_MEM_END
+
+        if (!uploaded) {
+            break;
+        }
+        if (rc == 1 || rc == 3) {
+            /* the block has been deleted meanwhile, nobody else knows the copy */
+            mOssWorker->deleteBlock(cleanBlockInfo);
+        } else {
+            numCleaned++;
+        }
+    }
+
+    if (numCleaned > 0) {
+        LOG(DEBUG1, "[ActiveStatus]          |"
+                "Cleaned %d buckets", numCleaned);
+    }
+    return numCleaned;
+}
+
+void AdminActiveStatus::logEvictBlock(BlockInfo info) {
+    Block block(InvalidBucketId, info.blockId, false, BUCKET_FREE);
+
+    shared_ptr<Manifest> manifest =
+            ManifestCache::getInstance()->getManifest(mSharedMemoryContext->getWorkDir(), info.fileId);
+    manifest->logEvcitBlock(block);
 }
 
 AdminActiveStatus::~AdminActiveStatus() {
-    unregistInSharedMem();
+    SHARED_MEM_BEGIN
+        unregistInSharedMem();
+    SHARED_MEM_END
 }
 
 }
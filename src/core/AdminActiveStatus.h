@@ -37,6 +37,8 @@ public:
 
     int32_t evictNumOfBlocks(int num);
 
+    int32_t cleanBuckets(int32_t lowWatermark, int32_t highWatermark);
+
     ~AdminActiveStatus();
 
 private:
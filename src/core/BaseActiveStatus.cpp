@@ -30,7 +30,7 @@ BaseActiveStatus::BaseActiveStatus(shared_ptr<SharedMemoryContext> sharedMemoryC
                                    int localSpaceFD) :
         mSharedMemoryContext(sharedMemoryContext),
         mLocalSpaceFD(localSpaceFD) {
-    mOssWorker = shared_ptr<OssBlockWorker>(new OssBlockWorker(FileSystem::OSS_CONTEXT, mLocalSpaceFD));
+    mOssWorker = shared_ptr<OssBlockWorker>(new OssBlockWorker(mLocalSpaceFD));
 
     mBucketSize = Configuration::LOCAL_BUCKET_SIZE;
 
@@ -0,0 +1,149 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "core/BlockMap.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+BlockMap::BlockMap() : mNumBlocks(0) {
+}
+
+int32_t BlockMap::size() const {
+    return mNumBlocks;
+}
+
+Block BlockMap::getBlock(int32_t blockId) const {
+    const BlockExtent &extent = mExtents[findExtent(blockId)];
+    Block block = extent.getBlock(blockId - extent.startBlockId);
+
+    std::unordered_map<int32_t, int16_t>::const_iterator it = mUsageCounts.find(blockId);
+    if (it != mUsageCounts.end()) {
+        block.usageCount = it->second;
+    }
+    return block;
+}
+
+void BlockMap::setBlock(const Block &block) {
+    int32_t index = findExtent(block.blockId);
+    BlockExtent extent = mExtents[index];
+    int32_t offset = block.blockId - extent.startBlockId;
+
+    Block old = extent.getBlock(offset);
+    if (old.bucketId == block.bucketId && old.isLocal == block.isLocal && old.state == block.state) {
+        return;
+    }
+
+    /* split the extent into [left][block][right] */
+    std::vector<BlockExtent> pieces;
+    if (offset > 0) {
+        BlockExtent left = extent;
+        left.length = offset;
+        pieces.push_back(left);
+    }
+    pieces.push_back(BlockExtent(block));
+    if (offset + 1 < extent.length) {
+        BlockExtent right(extent.getBlock(offset + 1));
+        right.length = extent.length - offset - 1;
+        pieces.push_back(right);
+    }
+
+    mExtents.erase(mExtents.begin() + index);
+    mExtents.insert(mExtents.begin() + index, pieces.begin(), pieces.end());
+    mergeAround(offset > 0 ? index + 1 : index);
+}
+
+void BlockMap::setState(int32_t blockId, uint8_t state) {
+    Block block = getBlock(blockId);
+    block.state = state;
+    setBlock(block);
+}
+
+void BlockMap::pushBack(const Block &block) {
+    pushBack(BlockExtent(block));
+}
+
+void BlockMap::pushBack(const BlockExtent &extent) {
+    if (extent.startBlockId != mNumBlocks || extent.length <= 0) {
+        THROW(GopherwoodInternalException,
+              "[BlockMap::pushBack] extent %d+%d does not follow the last block %d",
+              extent.startBlockId, extent.length, mNumBlocks);
+    }
+
+    if (!mExtents.empty() && mExtents.back().canAppend(extent)) {
+        mExtents.back().length += extent.length;
+    } else {
+        mExtents.push_back(extent);
+    }
+    mNumBlocks += extent.length;
+}
+
+void BlockMap::increaseUsage(int32_t blockId) {
+    mUsageCounts[blockId]++;
+}
+
+void BlockMap::clear() {
+    mExtents.clear();
+    mUsageCounts.clear();
+    mNumBlocks = 0;
+}
+
+std::vector<BlockExtent> &BlockMap::getExtents() {
+    return mExtents;
+}
+
+/* binary search the extent covering the block */
+int32_t BlockMap::findExtent(int32_t blockId) const {
+    if (blockId < 0 || blockId >= mNumBlocks) {
+        THROW(GopherwoodInternalException,
+              "[BlockMap::findExtent] blockId %d out of range, numBlocks=%d",
+              blockId, mNumBlocks);
+    }
+
+    int32_t low = 0;
+    int32_t high = mExtents.size() - 1;
+    while (low < high) {
+        int32_t mid = (low + high + 1) / 2;
+        if (mExtents[mid].startBlockId <= blockId) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+/* merge the extent with its previous and next extents if they form one run */
+void BlockMap::mergeAround(int32_t index) {
+    if (index + 1 < (int32_t) mExtents.size() && mExtents[index].canAppend(mExtents[index + 1])) {
+        mExtents[index].length += mExtents[index + 1].length;
+        mExtents.erase(mExtents.begin() + index + 1);
+    }
+    if (index > 0 && mExtents[index - 1].canAppend(mExtents[index])) {
+        mExtents[index - 1].length += mExtents[index].length;
+        mExtents.erase(mExtents.begin() + index);
+    }
+}
+
+}
+}
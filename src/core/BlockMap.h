@@ -0,0 +1,76 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _GOPHERWOOD_CORE_BLOCKMAP_H_
+#define _GOPHERWOOD_CORE_BLOCKMAP_H_
+
+#include "platform.h"
+
+#include "core/BlockStatus.h"
+
+#include <unordered_map>
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * BlockMap
+ *
+ * @desc The block id to bucket mapping of a file, kept as a sorted list of
+ * BlockExtents. Sequentially written files map to long runs of consecutive
+ * buckets (or long runs of remote blocks), so a handle only keeps a few
+ * extents in memory no matter how large the file is. Single block updates
+ * split the covering extent and merge it back with its neighbours.
+ */
+class BlockMap {
+public:
+    BlockMap();
+
+    int32_t size() const;
+    Block getBlock(int32_t blockId) const;
+
+    /* replace the status of an existing block */
+    void setBlock(const Block &block);
+    void setState(int32_t blockId, uint8_t state);
+
+    /* extend the file by one block or by a run of blocks */
+    void pushBack(const Block &block);
+    void pushBack(const BlockExtent &extent);
+
+    void increaseUsage(int32_t blockId);
+    void clear();
+
+    std::vector<BlockExtent> &getExtents();
+
+private:
+    int32_t findExtent(int32_t blockId) const;
+    void mergeAround(int32_t index);
+
+    std::vector<BlockExtent> mExtents;
+    /* usage counts of the blocks touched during the active status */
+    std::unordered_map<int32_t, int16_t> mUsageCounts;
+    int32_t mNumBlocks;
+};
+
+}
+}
+
+#endif //_GOPHERWOOD_CORE_BLOCKMAP_H_
@@ -0,0 +1,103 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "core/BlockResidency.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+BlockResidency::BlockResidency(const Block &bucket, int64_t pageSize, int64_t bucketSize,
+                               int64_t wantOffset, int64_t wantLength) :
+        mBucket(bucket), mPageSize(pageSize), mBucketSize(bucketSize), mWantOffset(wantOffset), mWantLength(wantLength),
+        mPages((bucketSize + pageSize - 1) / pageSize, false), mNumPins(0), mFailed(false) {
+}
+
+void BlockResidency::markLoaded(int64_t offset, int64_t length) {
+    int64_t first = (offset + mPageSize - 1) / mPageSize;
+    int64_t end = (offset + length) / mPageSize;
+    /* the last page of the bucket may be short */
+    if (offset + length >= mBucketSize) {
+        end = mPages.size();
+    }
+    for (int64_t page = first; page < end; page++) {
+        mPages[page] = true;
+    }
+}
+
+bool BlockResidency::isLoaded(int64_t offset, int64_t length) {
+    if (length <= 0) {
+        return false;
+    }
+    int64_t first = offset / mPageSize;
+    int64_t last = (offset + length - 1) / mPageSize;
+    if (offset < 0 || last >= (int64_t) mPages.size()) {
+        return false;
+    }
+    for (int64_t page = first; page <= last; page++) {
+        if (!mPages[page]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BlockResidency::pin() {
+    mNumPins++;
+}
+
+int BlockResidency::unpin() {
+    if (mNumPins <= 0) {
+        THROW(GopherwoodInternalException,
+              "[BlockResidency] Block %d of a loading bucket is not pinned", mBucket.blockId);
+    }
+    return --mNumPins;
+}
+
+int BlockResidency::getNumPins() {
+    return mNumPins;
+}
+
+void BlockResidency::setFailed() {
+    mFailed = true;
+}
+
+bool BlockResidency::isFailed() {
+    return mFailed;
+}
+
+Block BlockResidency::getBucket() {
+    return mBucket;
+}
+
+int64_t BlockResidency::getWantOffset() {
+    return mWantOffset;
+}
+
+int64_t BlockResidency::getWantLength() {
+    return mWantLength;
+}
+
+}
+}
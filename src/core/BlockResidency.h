@@ -0,0 +1,84 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _GOPHERWOOD_CORE_BLOCKRESIDENCY_H_
+#define _GOPHERWOOD_CORE_BLOCKRESIDENCY_H_
+
+#include "platform.h"
+
+#include "core/BlockStatus.h"
+
+#include <vector>
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * BlockResidency
+ *
+ * @desc The pages of a loading block that reached its bucket. A read of a
+ * resident range pins the block before the load finishes, the pins move to
+ * the active block once it does. A failed load keeps the bucket until the
+ * last pin goes. The owner guards it with its load mutex.
+ */
+class BlockResidency {
+public:
+    BlockResidency(const Block &bucket, int64_t pageSize, int64_t bucketSize,
+                   int64_t wantOffset, int64_t wantLength);
+
+    /* mark the pages the range covers completely */
+    void markLoaded(int64_t offset, int64_t length);
+
+    bool isLoaded(int64_t offset, int64_t length);
+
+    void pin();
+
+    /* return the pins left */
+    int unpin();
+
+    int getNumPins();
+
+    void setFailed();
+
+    bool isFailed();
+
+    /* the loading bucket */
+    Block getBucket();
+
+    int64_t getWantOffset();
+
+    int64_t getWantLength();
+
+private:
+    Block mBucket;
+    int64_t mPageSize;
+    int64_t mBucketSize;
+    int64_t mWantOffset;
+    int64_t mWantLength;
+    std::vector<bool> mPages;
+    int mNumPins;
+    bool mFailed;
+};
+
+}
+}
+
+#endif //_GOPHERWOOD_CORE_BLOCKRESIDENCY_H_
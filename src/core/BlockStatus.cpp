@@ -35,47 +35,34 @@ Block::Block(int32_t theBucketId, int32_t theBlockId, bool local, uint8_t s) :
         usageCount(0) {
 }
 
-std::string Block::toLogFormat() {
-    std::string res("");
-    BlockRecord record;
+static uint16_t toRecordFlags(bool isLocal, uint8_t state) {
+    uint16_t flags = 0;
 
-    /* build flags */
-    record.rFlags = 0;
     if (isLocal == RemoteBlock) {
-        record.rFlags |= BLOCK_RECORD_REMOTE;
+        flags |= BLOCK_RECORD_REMOTE;
     }
     switch (state) {
         /* No need to set bucket status free, since it's 0 */
         case BUCKET_FREE:
-            record.rFlags |= BLOCK_RECORD_FREE;
+            flags |= BLOCK_RECORD_FREE;
             break;
         case BUCKET_ACTIVE:
-            record.rFlags |= BLOCK_RECORD_ACTIVE;
+            flags |= BLOCK_RECORD_ACTIVE;
             break;
         case BUCKET_USED:
-            record.rFlags |= BLOCK_RECORD_USED;
+            flags |= BLOCK_RECORD_USED;
             break;
         default:
             THROW(GopherwoodException,
                   "[Block::toLogFormat] Unrecognized BlockState %d",
                   state);
     }
-
-    record.rBucketId = bucketId;
-    record.rBlockId = blockId;
-
-    char buf[sizeof(BlockRecord)];
-    memcpy(buf, &record, sizeof(BlockRecord));
-    res.append(buf, sizeof(buf));
-
-    return res;
+    return flags;
 }
 
-Block BlockRecord::toBlockFormat() {
+static uint8_t toBlockState(uint16_t flags) {
     uint8_t state = BUCKET_FREE;
-
-    bool isLocal = rFlags & BLOCK_RECORD_REMOTE ? RemoteBlock : LocalBlock;
-    int type = rFlags & BLOCK_RECORD_TYPE_MASK;
+    int type = flags & BLOCK_RECORD_TYPE_MASK;
 
     switch (type) {
         case BLOCK_RECORD_FREE:
@@ -90,10 +77,76 @@ Block BlockRecord::toBlockFormat() {
         default:
             THROW(GopherwoodException,
                   "[Block::toBlockFormat] Unrecognized BlockRecordState %d",
-                  state);
+                  type);
     }
+    return state;
+}
+
+std::string Block::toLogFormat() {
+    std::string res("");
+    BlockRecord record;
+
+    /* build flags */
+    record.rFlags = toRecordFlags(isLocal, state);
+    record.rPadding = 0;
+    record.rBucketId = bucketId;
+    record.rBlockId = blockId;
 
-    return Block(rBucketId, rBlockId, isLocal, state);
+    res.append((char *) &record, sizeof(BlockRecord));
+    return res;
+}
+
+Block BlockRecord::toBlockFormat() {
+    bool isLocal = rFlags & BLOCK_RECORD_REMOTE ? RemoteBlock : LocalBlock;
+    return Block(rBucketId, rBlockId, isLocal, toBlockState(rFlags));
+}
+
+BlockExtent::BlockExtent(const Block &block) :
+        startBlockId(block.blockId),
+        startBucketId(block.bucketId),
+        length(1),
+        isLocal(block.isLocal),
+        state(block.state) {
+}
+
+Block BlockExtent::getBlock(int32_t i) const {
+    assert(i >= 0 && i < length);
+    int32_t bucketId = isLocal ? startBucketId + i : startBucketId;
+    return Block(bucketId, startBlockId + i, isLocal, state);
+}
+
+bool BlockExtent::canAppend(const Block &block) const {
+    return canAppend(BlockExtent(block));
+}
+
+bool BlockExtent::canAppend(const BlockExtent &extent) const {
+    /* local runs map to consecutive buckets, remote runs share the invalid bucket id */
+    int32_t nextBucketId = isLocal ? startBucketId + length : startBucketId;
+    return startBlockId + length == extent.startBlockId &&
+           isLocal == extent.isLocal &&
+           state == extent.state &&
+           nextBucketId == extent.startBucketId;
+}
+
+std::string BlockExtent::toLogFormat() {
+    std::string res("");
+    BlockExtentRecord record;
+
+    record.rFlags = toRecordFlags(isLocal, state);
+    record.rPadding = 0;
+    record.rStartBucketId = startBucketId;
+    record.rStartBlockId = startBlockId;
+    record.rLength = length;
+
+    res.append((char *) &record, sizeof(BlockExtentRecord));
+    return res;
+}
+
+BlockExtent BlockExtentRecord::toExtentFormat() {
+    bool isLocal = rFlags & BLOCK_RECORD_REMOTE ? RemoteBlock : LocalBlock;
+    BlockExtent extent(Block(rStartBucketId, rStartBlockId, isLocal, toBlockState(rFlags)));
+    extent.length = rLength;
+    return extent;
 }
 
 }
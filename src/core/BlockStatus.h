@@ -80,6 +80,41 @@ typedef struct BlockRecord {
     Block toBlockFormat();
 } BlockRecord;
 
+/* A run of consecutive file blocks which are either mapped to consecutive
+ * local buckets or all located in OSS, sharing the same bucket status */
+typedef struct BlockExtent {
+    /* The first block id of the run */
+    int32_t startBlockId;
+    /* The bucket id of the first block, following blocks use the next buckets */
+    int32_t startBucketId;
+    /* Number of blocks in the run */
+    int32_t length;
+    bool isLocal;
+    uint8_t state;
+
+    BlockExtent(const Block &block);
+
+    /* get the i-th block of the run */
+    Block getBlock(int32_t i) const;
+    /* true if the block continues this run */
+    bool canAppend(const Block &block) const;
+    bool canAppend(const BlockExtent &extent) const;
+
+    std::string toLogFormat();
+} BlockExtent;
+
+/* The Block extent info for Manifest Log format */
+typedef struct BlockExtentRecord {
+    /* same as BlockRecord rFlags */
+    uint16_t rFlags;
+    uint16_t rPadding;
+    int32_t rStartBucketId;
+    int32_t rStartBlockId;
+    int32_t rLength;
+
+    BlockExtent toExtentFormat();
+} BlockExtentRecord;
+
 #define InvalidBlockOffset -1
 
 typedef struct BlockInfo {
@@ -89,6 +124,10 @@ typedef struct BlockInfo {
     int64_t offset;
     int64_t dataSize;
     bool isLocal;
+    /* the evicted block has an up to date copy in OSS already */
+    bool isClean;
+    /* the eviction of the bucket this upload belongs to */
+    uint32_t evictSeq;
 
     void reset(){
         fileId.reset();
@@ -96,6 +135,8 @@ typedef struct BlockInfo {
         bucketId = InvalidBucketId;
         offset = InvalidBlockOffset;
         dataSize = 0;
+        isClean = false;
+        evictSeq = 0;
     }
 } BlockInfo;
 
@@ -0,0 +1,84 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/Logger.h"
+#include "common/OssContextPool.h"
+#include "core/BucketCleaner.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+BucketCleaner::BucketCleaner(shared_ptr<SharedMemoryContext> sharedMemoryContext, int localSpaceFD) :
+        mStopped(false) {
+    mAdminActiveStatus = shared_ptr<AdminActiveStatus>(
+            new AdminActiveStatus(sharedMemoryContext, localSpaceFD));
+    CREATE_THREAD(mThread, bind(&BucketCleaner::run, this));
+
+    LOG(INFO, "[BucketCleaner]         |"
+            "Started, low watermark %d%%, high watermark %d%%",
+        Configuration::BUCKET_CLEANER_LOW_WATERMARK, Configuration::BUCKET_CLEANER_HIGH_WATERMARK);
+}
+
+void BucketCleaner::run() {
+    unique_lock<mutex> lock(mMutex);
+    while (!mStopped) {
+        lock.unlock();
+        /* the watermarks are percents of the buckets */
+        int64_t numBuckets = Configuration::NUMBER_OF_BLOCKS;
+        int32_t lowWatermark = (int32_t) (numBuckets * Configuration::BUCKET_CLEANER_LOW_WATERMARK / 100);
+        int32_t highWatermark = (int32_t) (numBuckets * Configuration::BUCKET_CLEANER_HIGH_WATERMARK / 100);
+        try {
+            mAdminActiveStatus->cleanBuckets(lowWatermark, std::max(lowWatermark, highWatermark));
+        } catch (const std::exception &e) {
+            LOG(WARNING, "[BucketCleaner]         |"
+                    "Clean buckets failed, %s", e.what());
+        }
+        /* idle connections are dropped while nothing moves */
+        OssContextPool::getInstance()->trim();
+        lock.lock();
+        mStopCond.wait_for(lock, std::chrono::milliseconds(Configuration::BUCKET_CLEANER_INTERVAL));
+    }
+}
+
+void BucketCleaner::stop() {
+    {
+        lock_guard<mutex> lock(mMutex);
+        if (mStopped) {
+            return;
+        }
+        mStopped = true;
+    }
+    mStopCond.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+BucketCleaner::~BucketCleaner() {
+    stop();
+}
+
+}
+}
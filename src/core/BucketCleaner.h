@@ -0,0 +1,64 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _GOPHERWOOD_CORE_BUCKETCLEANER_H_
+#define _GOPHERWOOD_CORE_BUCKETCLEANER_H_
+
+#include "platform.h"
+
+#include "common/Memory.h"
+#include "common/Thread.h"
+#include "core/AdminActiveStatus.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * BucketCleaner
+ *
+ * @desc The background thread of a context uploading cold used buckets before
+ * the free buckets run out, see AdminActiveStatus::cleanBuckets. It has an
+ * AdminActiveStatus of its own, so that the SharedMemory marks the buckets it
+ * is uploading and no other process cleans or evicts them meanwhile.
+ */
+class BucketCleaner {
+public:
+    BucketCleaner(shared_ptr<SharedMemoryContext> sharedMemoryContext, int localSpaceFD);
+
+    void stop();
+
+    ~BucketCleaner();
+
+private:
+    void run();
+
+    shared_ptr<AdminActiveStatus> mAdminActiveStatus;
+
+    mutex mMutex;
+    condition_variable mStopCond;
+    bool mStopped;
+    thread mThread;
+};
+
+}
+}
+
+#endif //_GOPHERWOOD_CORE_BUCKETCLEANER_H_
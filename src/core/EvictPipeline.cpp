@@ -0,0 +1,114 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+
+#include "common/Configuration.h"
+#include "common/Logger.h"
+#include "common/Memory.h"
+#include "common/ThreadPool.h"
+#include "core/EvictPipeline.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+static mutex evictThreadPoolMutex;
+static shared_ptr<ThreadPool> evictThreadPool;
+
+/* uploads wait on OSS, they get threads of their own rather than the codec or
+ * local I/O threads they use */
+static shared_ptr<ThreadPool> getEvictThreadPool() {
+    lock_guard<mutex> lock(evictThreadPoolMutex);
+    if (!evictThreadPool) {
+        evictThreadPool = shared_ptr<ThreadPool>(new ThreadPool(Configuration::OSS_EVICT_THREADS));
+    }
+    return evictThreadPool;
+}
+
+EvictPipeline::EvictPipeline(shared_ptr<OssBlockWorker> ossWorker) :
+        mOssWorker(ossWorker), mState(new State), mNumSubmitted(0) {
+}
+
+void EvictPipeline::submit(const BlockInfo &info) {
+    shared_ptr<State> state = mState;
+    shared_ptr<OssBlockWorker> worker = mOssWorker;
+    function<void()> upload = [state, worker, info]() {
+        EvictResult result;
+        result.info = info;
+        try {
+            /* a clean block is in OSS already */
+            if (!info.isClean) {
+                worker->writeBlock(info);
+            }
+        } catch (...) {
+            result.error = Gopherwood::current_exception();
+        }
+        lock_guard<mutex> lock(state->mMutex);
+        state->mFinished.push_back(result);
+        state->mCond.notify_all();
+    };
+
+    mNumSubmitted++;
+    if (info.isClean || Configuration::OSS_EVICT_THREADS == 0) {
+        upload();
+    } else {
+        getEvictThreadPool()->enqueue(upload);
+    }
+}
+
+size_t EvictPipeline::size() {
+    return mNumSubmitted;
+}
+
+size_t EvictPipeline::capacity() {
+    size_t limit = std::max<size_t>(Configuration::OSS_EVICT_MAX_INFLIGHT, 1);
+    return mNumSubmitted >= limit ? 0 : limit - mNumSubmitted;
+}
+
+bool EvictPipeline::next(EvictResult &result, bool wait) {
+    if (mNumSubmitted == 0) {
+        return false;
+    }
+
+    unique_lock<mutex> lock(mState->mMutex);
+    if (wait) {
+        mState->mCond.wait(lock, [this] { return !mState->mFinished.empty(); });
+    } else if (mState->mFinished.empty()) {
+        return false;
+    }
+    result = mState->mFinished.front();
+    mState->mFinished.pop_front();
+    mNumSubmitted--;
+    return true;
+}
+
+EvictPipeline::~EvictPipeline() {
+    /* the uploads read the local space file, which is closed with the context */
+    unique_lock<mutex> lock(mState->mMutex);
+    mState->mCond.wait(lock, [this] { return mState->mFinished.size() == mNumSubmitted; });
+    if (mNumSubmitted > 0) {
+        LOG(WARNING, "[EvictPipeline]         |"
+                "%lu evictions are left unfinished", mNumSubmitted);
+    }
+}
+
+}
+}
@@ -0,0 +1,87 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _GOPHERWOOD_CORE_EVICTPIPELINE_H_
+#define _GOPHERWOOD_CORE_EVICTPIPELINE_H_
+
+#include "platform.h"
+
+#include "block/OssBlockWorker.h"
+#include "common/ExceptionInternal.h"
+#include "common/Memory.h"
+#include "common/Thread.h"
+#include "core/BlockStatus.h"
+
+#include <deque>
+
+namespace Gopherwood {
+namespace Internal {
+
+/* a finished upload, error holds the exception of a failed one */
+typedef struct EvictResult {
+    BlockInfo info;
+    Gopherwood::exception_ptr error;
+} EvictResult;
+
+/**
+ * EvictPipeline
+ *
+ * @desc Uploads the blocks of evicting buckets on the process wide evict threads,
+ * up to OSS_EVICT_MAX_INFLIGHT of them at a time. The owner marks the victims in
+ * a batch, submits them and applies the uploads to the SharedMemory in the
+ * order they finish. Clean blocks are in OSS already and finish at once.
+ * The pipeline is used by one thread.
+ */
+class EvictPipeline {
+public:
+    EvictPipeline(shared_ptr<OssBlockWorker> ossWorker);
+
+    void submit(const BlockInfo &info);
+
+    /* submitted uploads not taken by next */
+    size_t size();
+
+    /* the number of uploads that can be submitted */
+    size_t capacity();
+
+    /* take the next finished upload, waits for one if wait is set. Return false
+     * if there is nothing to wait for, or nothing finished without wait */
+    bool next(EvictResult &result, bool wait);
+
+    /* waits for the uploads still running */
+    ~EvictPipeline();
+
+private:
+    struct State {
+        mutex mMutex;
+        condition_variable mCond;
+        std::deque<EvictResult> mFinished;
+    };
+
+    shared_ptr<OssBlockWorker> mOssWorker;
+    shared_ptr<State> mState;
+    size_t mNumSubmitted;
+};
+
+}
+}
+
+#endif //_GOPHERWOOD_CORE_EVICTPIPELINE_H_
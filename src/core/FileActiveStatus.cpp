@@ -19,12 +19,12 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#include <common/OssBuilder.h>
 #include "common/Configuration.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
 #include "common/Logger.h"
 #include "core/FileActiveStatus.h"
+#include "core/ManifestCache.h"
 #include "file/FileSystem.h"
 
 namespace Gopherwood {
@@ -34,12 +34,12 @@ namespace Internal {
                                 mSharedMemoryContext->lock(); \
                                 catchUpManifestLogs();
 
-#define SHARED_MEM_END          mSharedMemoryContext->unlock();\
-                            } catch (...) { \
+#define SHARED_MEM_END      } catch (...) { \
                                 SetLastException(Gopherwood::current_exception()); \
                                 mSharedMemoryContext->unlock(); \
                                 Gopherwood::rethrow_exception(Gopherwood::current_exception()); \
-                            }
+                            } \
+                            mSharedMemoryContext->unlock();
 
 
 FileActiveStatus::FileActiveStatus(FileId fileId,
@@ -78,10 +78,15 @@ FileActiveStatus::FileActiveStatus(FileId fileId,
 
     mLRUCache = shared_ptr<LRUCache<int, int>>(new LRUCache<int, int>(quotaSize));
     mManifest = shared_ptr<Manifest>(new Manifest(manifestFileName));
+    mEvictPipeline = shared_ptr<EvictPipeline>(new EvictPipeline(mOssWorker));
 
     /* init file related info */
     mPos = 0;
     mEof = 0;
+    mEofDirty = false;
+    mNumFailedPinnedBuckets = 0;
+    mNumPartialLoads = 0;
+    mAcquiring = false;
 
     SHARED_MEM_BEGIN
         registInSharedMem();
@@ -106,7 +111,6 @@ void FileActiveStatus::unregistInSharedMem(bool isCancel) {
 
     int rc = mSharedMemoryContext->unregistFile(mActiveId, getpid(), &mShouldDestroy);
     if (rc != 0) {
-        mSharedMemoryContext->unlock();
         THROW(GopherwoodSharedMemException,
               "[ActiveStatus::unregistInSharedMem] connection info mismatch with SharedMem ActiveId=%d, PID=%d",
               mActiveId, getpid());
@@ -127,6 +131,7 @@ void FileActiveStatus::setPosition(int64_t pos) {
     mPos = pos;
     if (mPos > mEof) {
         mEof = mPos;
+        mEofDirty = false;
         updateCurBlockSize();
     }
     LOG(DEBUG1, "[ActiveStatus]          |"
@@ -134,16 +139,46 @@ void FileActiveStatus::setPosition(int64_t pos) {
         mPos, mEof);
 }
 
+void FileActiveStatus::setBufferedPosition(int64_t pos) {
+    mPos = pos;
+    if (mPos > mEof) {
+        mEof = mPos;
+        mEofDirty = true;
+    }
+}
+
+void FileActiveStatus::publishEof() {
+    if (mEofDirty) {
+        mEofDirty = false;
+        updateCurBlockSize();
+        LOG(DEBUG1, "[ActiveStatus]          |"
+                "Publish buffered Eof, pos=%ld, eof=%ld",
+            mPos, mEof);
+    }
+}
+
+bool FileActiveStatus::isSequence() {
+    return mIsSequence;
+}
+
+/* a buffered Eof is ahead of the logs, never move it backwards */
+void FileActiveStatus::catchUpEof(int64_t eof) {
+    if (mEofDirty && eof < mEof) {
+        return;
+    }
+    mEof = eof;
+}
+
 int64_t FileActiveStatus::getEof() {
     return mEof;
 }
 
 Block FileActiveStatus::getCurBlock() {
-    return mBlockArray[mPos / mBucketSize];
+    return mBlockMap.getBlock(mPos / mBucketSize);
 }
 
 int32_t FileActiveStatus::getNumBlocks() {
-    return mBlockArray.size();
+    return mBlockMap.size();
 }
 
 int64_t FileActiveStatus::getCurBlockOffset() {
@@ -155,7 +190,8 @@ int32_t FileActiveStatus::getCurQuota() {
 }
 
 int32_t FileActiveStatus::getNumAcquiredBuckets() {
-    return mLRUCache->size() + mPreAllocatedBuckets.size() + mLoadingBuckets.size();
+    return mLRUCache->size() + mPinnedBlocks.size() + mPreAllocatedBuckets.size() + mLoadingBuckets.size() +
+           mNumFailedPinnedBuckets;
 }
 
 /* update the Eof in in current SharedMemBucket */
@@ -165,8 +201,8 @@ void FileActiveStatus::updateCurBlockSize() {
 
     SHARED_MEM_BEGIN
         if (eofBeforeCatchUp == mEof) {
-            int numBlocks = mBlockArray.size();
-            int32_t endBucketId = mBlockArray[numBlocks-1].bucketId;
+            int numBlocks = mBlockMap.size();
+            int32_t endBucketId = mBlockMap.getBlock(numBlocks-1).bucketId;
             int64_t blockDataSize = mEof - (numBlocks-1) * Configuration::LOCAL_BUCKET_SIZE;
 
             LOG(DEBUG1, "[ActiveStatus]          |"
@@ -192,7 +228,14 @@ std::string FileActiveStatus::getManifestFileName(FileId fileId) {
 }
 
 bool FileActiveStatus::isMyActiveBlock(int blockId) {
-    return mLRUCache->exists(blockId);
+    return mLRUCache->exists(blockId) || mPinnedBlocks.find(blockId) != mPinnedBlocks.end();
+}
+
+/* every bucket of my quota is loading or pinned, activating another block
+ * waits for a load to finish or a pin to go */
+bool FileActiveStatus::isQuotaBusy() {
+    return mLRUCache->size() == 0 && mPreAllocatedBuckets.empty() &&
+           getNumAcquiredBuckets() >= getCurQuota();
 }
 
 bool FileActiveStatus::isBlockLoading(int blockId) {
@@ -206,17 +249,26 @@ bool FileActiveStatus::isBlockLoading(int blockId) {
 /* [IMPORTANT] This is the main entry point of adjusting active status. OutpuStream/InputStream
  * will call this function to write/read to multi blocks. When mPos reaches block not activated
  * by current file instance, ActiveStatus will adjust the block status.*/
-BlockInfo FileActiveStatus::getCurBlockInfo() {
+BlockInfo FileActiveStatus::getCurBlockInfo(int64_t wantLength, bool *pinned) {
     int curBlockId = mPos / mBucketSize;
+    int64_t wantOffset = getCurBlockOffset();
+    wantLength = std::min(wantLength, mBucketSize - wantOffset);
 
     /* adjust the active block status */
-    adjustActiveBlock(curBlockId);
+    BlockInfo info;
+    bool isPinned = adjustActiveBlock(curBlockId, wantOffset, wantLength, pinned != NULL ? &info : NULL);
+    if (pinned != NULL) {
+        *pinned = isPinned;
+    }
 
     /* update the usage count */
-    mBlockArray[curBlockId].usageCount++;
+    mBlockMap.increaseUsage(curBlockId);
 
-    /* build the block info */
-    BlockInfo info;
+    /* build the block info, a loading block is not in the block map yet */
+    if (isPinned) {
+        info.offset = wantOffset;
+        return info;
+    }
     Block block = getCurBlock();
     info.fileId = mFileId;
     info.blockId = block.blockId;
@@ -226,23 +278,212 @@ BlockInfo FileActiveStatus::getCurBlockInfo() {
     return info;
 }
 
+BlockInfo FileActiveStatus::pinCurBlock() {
+    int curBlockId = mPos / mBucketSize;
+    {
+        /* the last bucket of the quota is kept for activating blocks */
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        if (mPinnedBlocks.find(curBlockId) == mPinnedBlocks.end() &&
+            (int32_t) mPinnedBlocks.size() + 1 >= getCurQuota()) {
+            THROW(GopherwoodInvalidParmException,
+                  "[ActiveStatus::pinCurBlock] Block %d can not be pinned, %lu blocks are pinned, quota=%d",
+                  curBlockId, mPinnedBlocks.size(), getCurQuota());
+        }
+    }
+
+    BlockInfo info = getCurBlockInfo();
+
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    pinActiveBlock(info.blockId);
+    return info;
+}
+
+/* NOTE: You should have acquired the load mutex before calling me.
+ * The block is activated by me, move it from the LRU to the pin map */
+void FileActiveStatus::pinActiveBlock(int blockId) {
+    mLRUCache->deleteObject(blockId);
+    mPinnedBlocks[blockId]++;
+    LOG(DEBUG1, "[ActiveStatus]          |"
+            "Pin block %d, bucketId=%d, pinCount=%d",
+        blockId, mBlockMap.getBlock(blockId).bucketId, mPinnedBlocks[blockId]);
+}
+
+/* NOTE: You should have acquired the load mutex before calling me.
+ * A loading block is pinned once the range is loaded, the pin moves to the
+ * active block when the load finishes */
+bool FileActiveStatus::pinLoadingBlock(int blockId, int64_t offset, int64_t length, BlockInfo &info) {
+    std::map<int, shared_ptr<BlockResidency>>::iterator it = mLoadingResidency.find(blockId);
+    if (it == mLoadingResidency.end() || it->second->isFailed() || !it->second->isLoaded(offset, length)) {
+        return false;
+    }
+    it->second->pin();
+
+    info.fileId = mFileId;
+    info.blockId = blockId;
+    info.bucketId = it->second->getBucket().bucketId;
+    info.isLocal = true;
+    info.offset = 0;
+    LOG(DEBUG1, "[ActiveStatus]          |"
+            "Pin loading block %d, bucketId=%d, offset=%ld, length=%ld, pinCount=%d",
+        blockId, info.bucketId, offset, length, it->second->getNumPins());
+    return true;
+}
+
+BlockInfo FileActiveStatus::pinBlock(int blockId, bool isWrite, int64_t offset, int64_t length) {
+    std::unique_lock<std::mutex> lock(mLoadMutex);
+
+    while (true) {
+        if (isMyActiveBlock(blockId)) {
+            pinActiveBlock(blockId);
+
+            BlockInfo info;
+            Block block = mBlockMap.getBlock(blockId);
+            info.fileId = mFileId;
+            info.blockId = block.blockId;
+            info.bucketId = block.bucketId;
+            info.isLocal = block.isLocal;
+            info.offset = 0;
+            return info;
+        }
+
+        BlockInfo loadingInfo;
+        if (!isWrite && pinLoadingBlock(blockId, offset, length, loadingInfo)) {
+            return loadingInfo;
+        }
+
+        /* a failed load keeps its bucket until the reads of its pages finish */
+        std::map<int, shared_ptr<BlockResidency>>::iterator loading = mLoadingResidency.find(blockId);
+        bool loadFailed = loading != mLoadingResidency.end() && loading->second->isFailed();
+
+        /* every bucket of my quota is pinned by other threads, wait for an unpin */
+        if (!isQuotaBusy()) {
+            if (blockId >= getNumBlocks()) {
+                if (!isWrite) {
+                    THROW(GopherwoodInvalidParmException,
+                          "[ActiveStatus::pinBlock] Block %d exceeds the file, numBlocks=%d",
+                          blockId, getNumBlocks());
+                }
+                extendOneBlock();
+                continue;
+            } else if (!loadFailed && !isBlockLoading(blockId) &&
+                       activateBlock(blockId, isWrite ? 0 : offset, isWrite ? 0 : length) == 1) {
+                continue;
+            }
+        }
+
+        /* loading by me or by others, only my loads signal the condition */
+        mBlockCond.wait_for(lock, seconds(1));
+    }
+}
+
+int64_t FileActiveStatus::getEofLocked() {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    return mEof;
+}
+
+void FileActiveStatus::updateEof(int64_t eof) {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    if (eof > mEof) {
+        mEof = eof;
+        mEofDirty = false;
+        updateCurBlockSize();
+        LOG(DEBUG1, "[ActiveStatus]          |"
+                "Update Eof by positional write, eof=%ld", mEof);
+    }
+}
+
+void FileActiveStatus::unpinBlock(int blockId) {
+    {
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        std::map<int, int>::iterator it = mPinnedBlocks.find(blockId);
+        if (it == mPinnedBlocks.end()) {
+            /* pinned while loading */
+            std::map<int, shared_ptr<BlockResidency>>::iterator loading = mLoadingResidency.find(blockId);
+            if (loading == mLoadingResidency.end() || loading->second->getNumPins() == 0) {
+                THROW(GopherwoodInvalidParmException,
+                      "[ActiveStatus::unpinBlock] Block %d is not pinned", blockId);
+            }
+            if (loading->second->unpin() > 0 || !loading->second->isFailed()) {
+                return;
+            }
+
+            /* the load failed, the last read of its pages gives the bucket back */
+            Block bucket = loading->second->getBucket();
+            bucket.blockId = InvalidBlockId;
+            mPreAllocatedBuckets.push_front(bucket);
+            mNumFailedPinnedBuckets--;
+            mLoadingResidency.erase(loading);
+        } else {
+            if (--it->second > 0) {
+                return;
+            }
+            mPinnedBlocks.erase(it);
+
+            /* back to the LRU, the quota might have shrunk while it was pinned */
+            std::vector<int> overflowBlocks = mLRUCache->put(blockId, mBlockMap.getBlock(blockId).bucketId);
+            if (overflowBlocks.size() > 0) {
+                SHARED_MEM_BEGIN
+                    inactivateBlocks(overflowBlocks);
+                SHARED_MEM_END
+            }
+        }
+    }
+    mBlockCond.notify_all();
+}
+
+/* NOTE: You should have acquired the ShareMem lock before calling me */
+void FileActiveStatus::inactivateBlocks(std::vector<int> &blockIds) {
+    std::vector<Block> blocksToInactivate;
+    for (int blockId : blockIds) {
+        blocksToInactivate.push_back(mBlockMap.getBlock(blockId));
+    }
+    std::vector<Block> turedToUsedBlocks =
+            mSharedMemoryContext->inactivateBuckets(blocksToInactivate,
+                                                    mFileId,
+                                                    mActiveId,
+                                                    mIsWrite);
+
+    /* update block status*/
+    for (Block b : turedToUsedBlocks) {
+        mBlockMap.setState(b.blockId, b.state);
+
+        /* the ending block been inactivated, flush EoF */
+        if (b.blockId + 1 == mBlockMap.size()) {
+            /* update EoF from SharedMemory */
+            getSharedMemEof();
+            /* add the Eof log */
+            RecOpaque opaque;
+            opaque.updateEof.eof = mEof;
+            mManifest->logUpdateEof(opaque);
+        }
+    }
+    /* log inactivate buckets */
+    mManifest->logInactivateBucket(turedToUsedBlocks);
+}
+
 void FileActiveStatus::getStatistics(GWFileInfo *fileInfo) {
     fileInfo->fileSize = getEof();
     fileInfo->maxQuota = mLRUCache->maxSize();
     fileInfo->curQuota = getNumAcquiredBuckets();
-    fileInfo->numBlocks = mBlockArray.size();
+    fileInfo->numBlocks = mBlockMap.size();
     fileInfo->numActivated = mNumActivated;
     fileInfo->numEvicted = mNumEvicted;
     fileInfo->numLoaded = mNumLoaded;
+    fileInfo->numPartialLoads = mNumPartialLoads;
+    mOssWorker->getStatistics(fileInfo);
 }
 
-void FileActiveStatus::adjustActiveBlock(int curBlockId) {
+/* the block asked for is loaded from the pages of the read on, see
+ * getCurBlockInfo. Return true when the loading block was pinned */
+bool FileActiveStatus::adjustActiveBlock(int curBlockId, int64_t wantOffset, int64_t wantLength,
+                                         BlockInfo *loadingInfo) {
     bool needWait = false;
 
     /* use load mutex in a big granularity.
      * This will make our concurrency design quite simple that
      * all adjustActiveBlock operation are accessing a stable
-     * load bucket list. */
+     * load bucket list. Only acquiring buckets releases it, see
+     * acquireNewBlocks */
     mLoadMutex.lock();
     if (curBlockId + 1 > getNumBlocks()) {
         extendOneBlock();
@@ -255,11 +496,15 @@ void FileActiveStatus::adjustActiveBlock(int curBlockId) {
 
         /* try to pre activate a few blocks */
         while (counter < numPreActivate) {
-            if (curBlockId + counter + 1 > getNumBlocks()) {
+            if (curBlockId + counter + 1 > getNumBlocks() || isQuotaBusy()) {
                 break;
             } else if (!isMyActiveBlock(curBlockId + counter) &&
                        !isBlockLoading(curBlockId + counter)){
-                activateBlock(curBlockId + counter);
+                if (counter == 0) {
+                    activateBlock(curBlockId, wantOffset, wantLength);
+                } else {
+                    activateBlock(curBlockId + counter);
+                }
             }
             counter++;
         }
@@ -271,25 +516,67 @@ void FileActiveStatus::adjustActiveBlock(int curBlockId) {
     }
     mLoadMutex.unlock();
 
-    /* wait until the block is activated by me */
-    while (needWait) {
-        mLoadMutex.lock();
-        if (isMyActiveBlock(curBlockId)) {
-            needWait = false;
-        } else if (!isBlockLoading(curBlockId)) {
+    if (needWait) {
+        return waitActiveBlock(curBlockId, wantOffset, wantLength, loadingInfo);
+    }
+    return false;
+}
+
+/* wait until the block is activated by me, or with loadingInfo until the
+ * wanted range of the loading block is loaded. Return true when the
+ * loading block was pinned */
+bool FileActiveStatus::waitActiveBlock(int blockId, int64_t wantOffset, int64_t wantLength,
+                                       BlockInfo *loadingInfo) {
+    std::unique_lock<std::mutex> lock(mLoadMutex);
+
+    while (true) {
+        if (isMyActiveBlock(blockId)) {
+            return false;
+        } else if (loadingInfo != NULL && pinLoadingBlock(blockId, wantOffset, wantLength, *loadingInfo)) {
+            return true;
+        } else if (!isBlockLoading(blockId) && !isQuotaBusy()) {
             /* we might waiting for others to load finish，
              * just retry to load it back by myself */
-            int rc = activateBlock(curBlockId);
+            int rc = activateBlock(blockId, wantOffset, wantLength);
             if (rc == 1) {
-                needWait = false;
+                return false;
             }
         }
-        mLoadMutex.unlock();
 
-        if (needWait) {
-            sleep_for(seconds(1));
+        /* only my own loads signal the condition, poll for the others */
+        mBlockCond.wait_for(lock, seconds(1));
+    }
+}
+
+void FileActiveStatus::activateBlocks(const std::vector<int> &blockIds) {
+    /* remote blocks are enqueued to the loader threads and load in parallel */
+    mLoadMutex.lock();
+    for (int blockId : blockIds) {
+        if (blockId < getNumBlocks() && !isMyActiveBlock(blockId) && !isBlockLoading(blockId)) {
+            activateBlock(blockId);
         }
     }
+    mLoadMutex.unlock();
+}
+
+BlockInfo FileActiveStatus::getBlockInfo(int blockId) {
+    if (blockId >= getNumBlocks()) {
+        THROW(GopherwoodInvalidParmException,
+              "[ActiveStatus::getBlockInfo] Block %d exceeds the file, numBlocks=%d",
+              blockId, getNumBlocks());
+    }
+
+    waitActiveBlock(blockId);
+    mBlockMap.increaseUsage(blockId);
+
+    BlockInfo info;
+    Block block = mBlockMap.getBlock(blockId);
+    info.fileId = mFileId;
+    info.blockId = block.blockId;
+    info.bucketId = block.bucketId;
+    info.isLocal = block.isLocal;
+    info.offset = 0;
+    return info;
 }
 
 /* All block activation should follow these steps:
@@ -306,12 +593,42 @@ void FileActiveStatus::adjustActiveBlock(int curBlockId) {
  *       Then -> release blocks and use own quota
  * Notes: When got chance to acquire new blocks, active status will try to
  *        pre acquire a number of buckets to reduce the Shared Memory contention. */
+/* NOTE: You should have acquired the load mutex before calling me.
+ * The mutex is released while waiting for the uploads of the evictions, the
+ * other blocks of the file are pinned, loaded and activated meanwhile. One
+ * acquire runs at a time, the others wait for it and take its buckets */
 void FileActiveStatus::acquireNewBlocks() {
+    std::unique_lock<std::mutex> loadLock(mLoadMutex, std::adopt_lock);
+    while (mAcquiring) {
+        mBlockCond.wait(loadLock);
+    }
+    if (!mPreAllocatedBuckets.empty()) {
+        loadLock.release();
+        return;
+    }
+
+    mAcquiring = true;
+    try {
+        acquireNewBlocks(loadLock);
+    } catch (...) {
+        if (!loadLock.owns_lock()) {
+            loadLock.lock();
+        }
+        mAcquiring = false;
+        loadLock.release();
+        mBlockCond.notify_all();
+        throw;
+    }
+    mAcquiring = false;
+    loadLock.release();
+    mBlockCond.notify_all();
+}
+
+void FileActiveStatus::acquireNewBlocks(std::unique_lock<std::mutex> &loadLock) {
     std::vector<Block> blocksForLog;
     std::vector<int32_t> newBuckets;
-    BlockInfo evictBlockInfo;
-    evictBlockInfo.bucketId = -1;
-    bool evicting = false;
+    std::vector<BlockInfo> victims;
+    Gopherwood::exception_ptr evictError;
 
     uint32_t numToAcquire = 0;
     uint32_t numToInactivate = 0;
@@ -321,6 +638,15 @@ void FileActiveStatus::acquireNewBlocks() {
     uint32_t numAvailable;
     uint32_t numAcquiredBuckets;
 
+    /* free the buckets of the uploads left in flight by the last acquire, the
+     * quota below decides how many of the free buckets are ours */
+    Gopherwood::exception_ptr leftoverError;
+    while (finishNextEviction(false, false, leftoverError) >= 0);
+    if (leftoverError) {
+        LOG(WARNING, "[ActiveStatus]          |"
+                "Evict a block failed in the background, file %s", mFileId.toString().c_str());
+    }
+
     SHARED_MEM_BEGIN
         uint32_t newQuota = mSharedMemoryContext->calcDynamicQuotaNum();
         numFreeBuckets = mSharedMemoryContext->getFreeBucketNum();
@@ -410,7 +736,7 @@ void FileActiveStatus::acquireNewBlocks() {
             std::vector<int> blockIds = mLRUCache->removeNumOfKeys(numToInactivate);
 
             for (int blockId : blockIds) {
-                blocksToInactivate.push_back(mBlockArray[blockId]);
+                blocksToInactivate.push_back(mBlockMap.getBlock(blockId));
             }
             std::vector<Block> turedToUsedBlocks =
                     mSharedMemoryContext->inactivateBuckets(blocksToInactivate,
@@ -420,10 +746,10 @@ void FileActiveStatus::acquireNewBlocks() {
 
             /* update block status*/
             for (Block b : turedToUsedBlocks) {
-                mBlockArray[b.blockId].state = b.state;
+                mBlockMap.setState(b.blockId, b.state);
 
                 /* the ending block been inactivated, flush EoF */
-                if ((uint32_t)b.blockId + 1 == mBlockArray.size()){
+                if (b.blockId + 1 == mBlockMap.size()){
                     /* update EoF from SharedMemory */
                     getSharedMemEof();
                     /* add the Eof log */
@@ -467,59 +793,32 @@ void FileActiveStatus::acquireNewBlocks() {
             mManifest->logAcquireNewBlock(blocksForLog);
             blocksForLog.clear();
 
-            /* start evict 1st used bucket */
+            /* start evicting used buckets, the uploads run in a batch */
             if (numToEvict > 0) {
-                evictBlockInfo = mSharedMemoryContext->markBucketEvicting(mActiveId);
-                evicting = true;
+                markEvictVictims(numToEvict, victims);
             }
         }
     SHARED_MEM_END
+    submitEvictions(victims);
 
     /************************************************
-     * Step2: Loop to get used buckets
-     * 1. check if there is any free buckets again
-     * 2. evict used buckets
+     * Step3: Loop to get used buckets
+     * 1. apply the evictions as their uploads finish
+     * 2. check if there is any free buckets again
+     * 3. evict more used buckets
+     * Go on as soon as a bucket is acquired, the uploads left
+     * in flight are freed by the next acquire or close. The
+     * uploads finishing meanwhile are taken first
      ************************************************/
-    while (numToAcquire > 0 || evicting) {
-        /* evict the bucket */
-        if (evicting) {
-            mOssWorker->writeBlock(evictBlockInfo);
+    while (numToAcquire > 0) {
+        int acquired = finishNextEviction(mPreAllocatedBuckets.empty(), true, evictError, &loadLock);
+        if (acquired < 0) {
+            break;
         }
+        numToAcquire -= acquired;
 
+        victims.clear();
         SHARED_MEM_BEGIN
-            /* mark evict finish */
-            if (evicting) {
-                int rc = mSharedMemoryContext->evictBucketFinishAndTryAcquire(evictBlockInfo.bucketId,
-                                                                              mActiveId,
-                                                                              mFileId,
-                                                                              mIsWrite);
-                if (rc == 0 || rc == 1) {
-                    Block newBlock(evictBlockInfo.bucketId, InvalidBlockId, LocalBlock, BUCKET_ACTIVE);
-                    LOG(DEBUG1, "[ActiveStatus]          |"
-                            "Add block %d to pre-allocated bucket array.",
-                        newBlock.bucketId);
-                    blocksForLog.push_back(newBlock);
-                    mPreAllocatedBuckets.push_back(newBlock);
-                    evicting = false;
-                    numToAcquire--;
-                    /* update statistics */
-                    mNumActivated++;
-                }
-
-                /* add log to the evicted file */
-                if (rc == 0) {
-                    logEvictBlock(evictBlockInfo);
-                    mNumEvicted ++;
-                }
-
-                /* 1: the evicted block has been deleted during eviction
-                 * 2: the evicted bucket has been activated by it's file owner, give up this one*/
-                if (rc == 1 || rc == 2) {
-                    /* the evicted bucket has been activated by it's file owner, give up this one */
-                    mOssWorker->deleteBlock(evictBlockInfo);
-                }
-            }
-
             /* acquire free buckets */
             numFreeBuckets = mSharedMemoryContext->getFreeBucketNum();
             uint32_t numAcqurieFree = numToAcquire > numFreeBuckets ? numFreeBuckets : numToAcquire;
@@ -546,25 +845,133 @@ void FileActiveStatus::acquireNewBlocks() {
             mManifest->logAcquireNewBlock(blocksForLog);
             blocksForLog.clear();
 
-            /* start evict next bucket */
-            if (numToAcquire > 0) {
-                evictBlockInfo = mSharedMemoryContext->markBucketEvicting(mActiveId);
-                evicting = true;
+            /* evict next buckets, stop at the first failed upload */
+            if (!evictError && numToAcquire > mEvictPipeline->size()) {
+                markEvictVictims(numToAcquire - mEvictPipeline->size(), victims);
             }
         SHARED_MEM_END
+        submitEvictions(victims);
+    }
+
+    if (evictError) {
+        if (mPreAllocatedBuckets.empty()) {
+            Gopherwood::rethrow_exception(evictError);
+        }
+        LOG(WARNING, "[ActiveStatus]          |"
+                "Evict a block of file %s failed, going on with %lu buckets",
+            mFileId.toString().c_str(), mPreAllocatedBuckets.size());
     }
     if (mPreAllocatedBuckets.size() <= 0) {
         THROW(GopherwoodException, "Did not acquire any block!");
     }
 }
 
+/* Mark up to num used buckets evicting, as many as the pipeline has room for.
+ * NOTE: You should have acquired the ShareMem lock before calling me */
+void FileActiveStatus::markEvictVictims(uint32_t num, std::vector<BlockInfo> &victims) {
+    uint32_t numToMark = std::min<uint32_t>(num, mEvictPipeline->capacity());
+    while (victims.size() < numToMark && mSharedMemoryContext->getUsedBucketNum() > 0) {
+        BlockInfo info = mSharedMemoryContext->markBucketEvicting(mActiveId);
+        if (info.bucketId == InvalidBucketId) {
+            break;
+        }
+        victims.push_back(info);
+    }
+}
+
+void FileActiveStatus::submitEvictions(std::vector<BlockInfo> &victims) {
+    for (BlockInfo &info : victims) {
+        mEvictPipeline->submit(info);
+    }
+}
+
+/* Apply the next finished eviction to the SharedMemory, waiting for it if wait is
+ * set. The bucket is acquired if acquire is set, otherwise it is freed. A failed
+ * upload gives the bucket back to its block and is kept in error.
+ * return code:
+ * -1 -- no eviction finished
+ * 0  -- the eviction finished without a bucket for us
+ * 1  -- the bucket has been acquired */
+int FileActiveStatus::finishNextEviction(bool wait, bool acquire, Gopherwood::exception_ptr &error,
+                                         std::unique_lock<std::mutex> *loadLock) {
+    EvictResult result;
+    if (!mEvictPipeline->next(result, false)) {
+        if (!wait) {
+            return -1;
+        }
+
+        /* the load mutex is not held across the upload */
+        if (loadLock != NULL) {
+            loadLock->unlock();
+        }
+        bool finished = mEvictPipeline->next(result, true);
+        if (loadLock != NULL) {
+            loadLock->lock();
+        }
+        if (!finished) {
+            return -1;
+        }
+    }
+
+    BlockInfo &info = result.info;
+    int acquired = 0;
+    bool deleteRemote = false;
+    SHARED_MEM_BEGIN
+        if (result.error) {
+            mSharedMemoryContext->cleanBucketFinish(info, false);
+            if (!error) {
+                error = result.error;
+            }
+        } else {
+            int rc = acquire ?
+                     mSharedMemoryContext->evictBucketFinishAndTryAcquire(info, mActiveId, mFileId, mIsWrite) :
+                     mSharedMemoryContext->evictBucketFinishAndTryFree(info);
+
+            if (acquire && (rc == 0 || rc == 1)) {
+                Block newBlock(info.bucketId, InvalidBlockId, LocalBlock, BUCKET_ACTIVE);
+                LOG(DEBUG1, "[ActiveStatus]          |"
+                        "Add block %d to pre-allocated bucket array.",
+                    newBlock.bucketId);
+                std::vector<Block> blocksForLog(1, newBlock);
+                mManifest->logAcquireNewBlock(blocksForLog);
+                mPreAllocatedBuckets.push_back(newBlock);
+                acquired = 1;
+                /* update statistics */
+                mNumActivated++;
+            }
+
+            /* add log to the evicted file */
+            if (rc == 0) {
+                logEvictBlock(info);
+                mNumEvicted ++;
+            }
+
+            /* 1: the evicted block has been deleted during eviction
+             * 3: the evicted bucket has been activated by it's file owner, and the file
+             *    deleted since. The owner of a rc 2 bucket keeps the copy */
+            deleteRemote = rc == 1 || rc == 3;
+        }
+    SHARED_MEM_END
+
+    /* nobody knows the copy any more, delete it out of the lock */
+    if (deleteRemote) {
+        mOssWorker->deleteBlock(info);
+    }
+    return acquired;
+}
+
 /* Extend the file to create a new block, the block will get bucket from the
  * pre allocated bucket array */
 void FileActiveStatus::extendOneBlock() {
     std::vector<Block> blocksModified;
 
     if (mPreAllocatedBuckets.size() == 0) {
+        /* another thread might extend the file while I am acquiring */
+        int32_t numBlocks = getNumBlocks();
         acquireNewBlocks();
+        if (getNumBlocks() != numBlocks) {
+            return;
+        }
     }
 
     /* build the block */
@@ -573,7 +980,7 @@ void FileActiveStatus::extendOneBlock() {
     b.blockId = getNumBlocks();
 
     /* add to block array */
-    mBlockArray.push_back(b);
+    mBlockMap.pushBack(b);
 
     /* add to LRU cache */
     mLRUCache->put(b.blockId, b.bucketId);
@@ -594,24 +1001,42 @@ void FileActiveStatus::extendOneBlock() {
         b.blockId, b.bucketId);
 }
 
-void FileActiveStatus::loadBlock(BlockInfo info) {
+void FileActiveStatus::loadBlock(BlockInfo info, shared_ptr<BlockResidency> residency) {
     bool success = true;
+    bool partial = false;
     int64_t blockSize = -1;
 
     try {
-        ossContext ctx = ossRootBuilder.buildContext();
-        OssBlockWorker* worker = new OssBlockWorker(ctx, mLocalSpaceFD);
-
-        /* load the block back */
-        blockSize = mOssWorker->readBlock(info);
-        /* delete the remote block */
-        BlockInfo deleteBlockinfo = info;
-        deleteBlockinfo.bucketId = -1;
-        mOssWorker->deleteBlock(deleteBlockinfo);
-
-        /* clean up liboss staff */
-        delete worker;
-        ossDestroyContext(ctx);
+        /* the loaded pages are published to the reads waiting for them */
+        OssBlockWorker::LoadCallback onLoaded;
+        if (residency) {
+            onLoaded = [this, residency](int64_t offset, int64_t length) {
+                {
+                    std::lock_guard<std::mutex> lock(mLoadMutex);
+                    residency->markLoaded(offset, length);
+                }
+                mBlockCond.notify_all();
+            };
+
+            /* the pages of the read first, then the rest of the block around
+             * them. A block without an index is loaded whole */
+            try {
+                blockSize = mOssWorker->readPages(info, residency->getWantOffset(), residency->getWantLength(),
+                                                  onLoaded, true);
+                partial = true;
+            } catch (...) {
+                std::string errBuffer;
+                LOG(DEBUG1, "[ActiveStatus]          |"
+                        "No partial load of block %d: %s",
+                    info.blockId, GetExceptionDetail(current_exception(), errBuffer));
+            }
+        }
+
+        /* load the block back, the remote block is kept until the file is
+         * deleted. Evicting the block again skips the upload unless it is written */
+        if (!partial) {
+            blockSize = mOssWorker->readBlock(info, onLoaded);
+        }
     } catch (...) {
         std::string errBuffer;
         LOG(LOG_ERROR, "Got error in multi-thread load: %s",
@@ -619,8 +1044,17 @@ void FileActiveStatus::loadBlock(BlockInfo info) {
         success = false;
     }
 
-    /* lock loadMutex to make sure my thread can communicate with SharedMem */
+    /* lock loadMutex to make sure my thread can communicate with SharedMem,
+     * the SharedMem lock keeps out the other threads of this process */
     mLoadMutex.lock();
+    mSharedMemoryContext->lock();
+    int numPins = 0;
+    if (residency) {
+        numPins = residency->getNumPins();
+        if (success || numPins == 0) {
+            mLoadingResidency.erase(info.blockId);
+        }
+    }
     if (success) {
         /* mark block load finish */
         for (uint32_t i=0; i<mLoadingBuckets.size(); i++){
@@ -631,13 +1065,20 @@ void FileActiveStatus::loadBlock(BlockInfo info) {
                 /* move out of loading Buckets */
                 Block theBlock = mLoadingBuckets[i];
                 mLoadingBuckets.erase(mLoadingBuckets.begin() + i);
-                /* add to active block list */
-                mLRUCache->put(theBlock.blockId, theBlock.bucketId);
-                mBlockArray[theBlock.blockId] = theBlock;
+                /* add to active block list, the reads pinned while loading keep it pinned */
+                if (numPins > 0) {
+                    mPinnedBlocks[theBlock.blockId] += numPins;
+                } else {
+                    mLRUCache->put(theBlock.blockId, theBlock.bucketId);
+                }
+                mBlockMap.setBlock(theBlock);
                 /* wrtie load finish log */
                 mManifest->logLoadBlock(theBlock);
                 /* update statistics */
                 mNumLoaded++;
+                if (partial) {
+                    mNumPartialLoads++;
+                }
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Load block success, BucketId=%d, BlockId=%d, BlockEof=%ld",
                     info.bucketId, info.blockId, blockSize);
@@ -653,23 +1094,30 @@ void FileActiveStatus::loadBlock(BlockInfo info) {
                 Block theBlock = mLoadingBuckets[i];
                 theBlock.blockId = InvalidBlockId;
                 mLoadingBuckets.erase(mLoadingBuckets.begin() + i);
-                /* release back to preallocate list */
-                mPreAllocatedBuckets.push_front(theBlock);
+                /* release back to preallocate list, or after the last read of its loaded pages */
+                if (numPins > 0) {
+                    residency->setFailed();
+                    mNumFailedPinnedBuckets++;
+                } else {
+                    mPreAllocatedBuckets.push_front(theBlock);
+                }
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Load block failed, BucketId=%d, BlockId=%d, BlockEof=%ld",
                     info.bucketId, info.blockId, blockSize);
             }
         }
     }
+    mSharedMemoryContext->unlock();
     mLoadMutex.unlock();
+    mBlockCond.notify_all();
 }
 
 /* 1    activated
  * 2    loading by others
  * 3    start loading
  * -1   error */
-int FileActiveStatus::activateBlock(int blockId) {
-    Block *theLoadingBlock = NULL;
+int FileActiveStatus::activateBlock(int blockId, int64_t wantOffset, int64_t wantLength) {
+    Block theLoadingBlock(InvalidBucketId, InvalidBlockId, LocalBlock, BUCKET_ACTIVE);
     bool isLoadBlock = false;
     int rc = -1;
     int returnType = -1;
@@ -679,30 +1127,37 @@ int FileActiveStatus::activateBlock(int blockId) {
      * Actually only loadBlock need acquire new block, but we
      * still acquire for all cases to simplify the logic. */
     if (mPreAllocatedBuckets.size() == 0) {
+        /* another thread might activate the block while I am acquiring */
         acquireNewBlocks();
+        if (isMyActiveBlock(blockId)) {
+            return 1;
+        } else if (isBlockLoading(blockId)) {
+            return 2;
+        }
     }
 
     /* all blocks not activated by me can not be trusted
      * Need to lock Shared Memory and catch up logs */
     SHARED_MEM_BEGIN
-        if (!mBlockArray[blockId].isLocal) {
+        Block block = mBlockMap.getBlock(blockId);
+        if (!block.isLocal) {
             bool markSuccess;
 
-            /* build the block */
-            theLoadingBlock = &mPreAllocatedBuckets.front();
+            /* build the block, a copy since pop_front destroys the list element */
+            theLoadingBlock = mPreAllocatedBuckets.front();
 
             /* If the markBucketLoading failed, then it means the block is loading by others */
-            markSuccess = mSharedMemoryContext->markBucketLoading(theLoadingBlock->bucketId, blockId, mActiveId,
+            markSuccess = mSharedMemoryContext->markBucketLoading(theLoadingBlock.bucketId, blockId, mActiveId,
                                                                   mFileId);
             if (markSuccess) {
                 mPreAllocatedBuckets.pop_front();
-                theLoadingBlock->blockId = blockId;
+                theLoadingBlock.blockId = blockId;
                 isLoadBlock = true;
             } else {
                 returnType = 2;
             }
-        } else if (mBlockArray[blockId].state == BUCKET_USED ||
-                   mBlockArray[blockId].state == BUCKET_ACTIVE) {
+        } else if (block.state == BUCKET_USED ||
+                   block.state == BUCKET_ACTIVE) {
             /* activate the block */
             /* inactivate first if Current Quota is used up */
             if (getNumAcquiredBuckets() == getCurQuota()) {
@@ -712,7 +1167,7 @@ int FileActiveStatus::activateBlock(int blockId) {
                     std::vector<int> blockIds = mLRUCache->removeNumOfKeys(1);
                     std::vector<Block> blocksToInactivate;
                     for (int i : blockIds) {
-                        blocksToInactivate.push_back(mBlockArray[i]);
+                        blocksToInactivate.push_back(mBlockMap.getBlock(i));
                     }
                     std::vector<Block> turedToUsedBlocks =
                             mSharedMemoryContext->inactivateBuckets(blocksToInactivate,
@@ -722,10 +1177,10 @@ int FileActiveStatus::activateBlock(int blockId) {
 
                     /* update block status*/
                     for (Block b : turedToUsedBlocks) {
-                        mBlockArray[b.blockId].state = b.state;
+                        mBlockMap.setState(b.blockId, b.state);
 
                         /* the ending block been inactivated, flush EoF */
-                        if ((uint32_t) b.blockId + 1 == mBlockArray.size()) {
+                        if (b.blockId + 1 == mBlockMap.size()) {
                             /* update EoF from SharedMemory */
                             getSharedMemEof();
                             /* add the Eof log */
@@ -757,17 +1212,17 @@ int FileActiveStatus::activateBlock(int blockId) {
 
             /* activate the block */
             rc = mSharedMemoryContext->activateBucket(mFileId,
-                                                      mBlockArray[blockId],
+                                                      block,
                                                       mActiveId,
                                                       mIsWrite);
             /* the block is activated by me */
             if (rc == 1) {
-                mManifest->logActivateBucket(mBlockArray[blockId]);
+                mManifest->logActivateBucket(block);
             } else if (rc == -1) {
                 THROW(GopherwoodException, "[ActiveStatus] activateBucket in SharedMemory got error!");
             }
 
-            mLRUCache->put(mBlockArray[blockId].blockId, mBlockArray[blockId].bucketId);
+            mLRUCache->put(block.blockId, block.bucketId);
             returnType = 1;
         } else {
             THROW(GopherwoodInternalException, "[ActiveStatus] block active status mismatch!");
@@ -778,14 +1233,26 @@ int FileActiveStatus::activateBlock(int blockId) {
         BlockInfo info;
         info.fileId = mFileId;
         info.blockId = blockId;
-        info.bucketId = theLoadingBlock->bucketId;
+        info.bucketId = theLoadingBlock.bucketId;
         info.isLocal = false;
         info.offset = InvalidBlockOffset;
 
+        /* a read waiting for a range goes on once its pages are loaded */
+        shared_ptr<BlockResidency> residency;
+        if (wantLength > 0 && Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE > 0 &&
+            mLoadingResidency.find(blockId) == mLoadingResidency.end()) {
+            residency = shared_ptr<BlockResidency>(
+                    new BlockResidency(theLoadingBlock, Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE,
+                                       Configuration::LOCAL_BUCKET_SIZE, wantOffset, wantLength));
+            mLoadingResidency[blockId] = residency;
+        }
+
         /* acquire a thread to load this block */
-        mThreadPool->enqueue([this](BlockInfo info) { loadBlock(info); }, info);
+        mThreadPool->enqueue([this](BlockInfo info, shared_ptr<BlockResidency> residency) {
+            loadBlock(info, residency);
+        }, info, residency);
         /* add the block to loading list */
-        mLoadingBuckets.push_back(*theLoadingBlock);
+        mLoadingBuckets.push_back(theLoadingBlock);
     }
 
     return returnType;
@@ -795,17 +1262,10 @@ void FileActiveStatus::logEvictBlock(BlockInfo info) {
     Block block(InvalidBucketId, info.blockId, false, BUCKET_FREE);
     if(mFileId==info.fileId){
         mManifest->logEvcitBlock(block);
-        mBlockArray[block.blockId] = block;
+        mBlockMap.setBlock(block);
     }else {
-        /* check file exist */
-        std::string manifestFileName = Manifest::getManifestFileName(mSharedMemoryContext->getWorkDir(), info.fileId);
-        if (access(manifestFileName.c_str(), F_OK) == -1) {
-            THROW(GopherwoodInvalidParmException,
-                  "[ActiveStatus::ActiveStatus] File does not exist %s",
-                  manifestFileName.c_str());
-        }
-        Manifest *manifest = new Manifest(manifestFileName);
-        manifest->mfSeek(0, SEEK_END);
+        shared_ptr<Manifest> manifest =
+                ManifestCache::getInstance()->getManifest(mSharedMemoryContext->getWorkDir(), info.fileId);
         manifest->logEvcitBlock(block);
     }
 }
@@ -813,8 +1273,8 @@ void FileActiveStatus::logEvictBlock(BlockInfo info) {
 /* NOTE: You should have acquired the ShareMem lock before calling me */
 void FileActiveStatus::getSharedMemEof(){
     /* Calculate the shared memory file EOF info */
-    int numBlocks = mBlockArray.size();
-    int32_t endBucketId = mBlockArray[numBlocks - 1].bucketId;
+    int numBlocks = mBlockMap.size();
+    int32_t endBucketId = mBlockMap.getBlock(numBlocks - 1).bucketId;
     int64_t lastDataSize = mSharedMemoryContext->getBucketDataSize(endBucketId, mFileId, numBlocks - 1);
     int64_t shareMemEof = (numBlocks - 1) * Configuration::LOCAL_BUCKET_SIZE + lastDataSize;
 
@@ -830,9 +1290,9 @@ void FileActiveStatus::flush() {
     SHARED_MEM_BEGIN
         /* no other file exceed my Eof, I should try to flush Eof info */
         if (eofBeforeCatchUp <= mEof) {
-            int numBlocks = mBlockArray.size();
+            Block lastBlock = mBlockMap.getBlock(mBlockMap.size() - 1);
             /* if the last block is not in activate status, then the Eof info should have been flushed */
-            if (mBlockArray[numBlocks-1].isLocal && mBlockArray[numBlocks-1].state == BUCKET_ACTIVE) {
+            if (lastBlock.isLocal && lastBlock.state == BUCKET_ACTIVE) {
                 /* update EoF from SharedMemory */
                 getSharedMemEof();
                 /* add the Eof log */
@@ -855,12 +1315,32 @@ void FileActiveStatus::close(bool isCancel) {
     std::vector<Block> localBlocks;
     std::vector<Block> remoteBlocks;
 
+    /* a load still running reports to me, reads may have returned before it finished */
+    {
+        std::unique_lock<std::mutex> lock(mLoadMutex);
+        while (!mLoadingBuckets.empty()) {
+            mBlockCond.wait(lock);
+        }
+    }
+
+    /* nobody waits for the buckets still being evicted, free them */
+    Gopherwood::exception_ptr evictError;
+    while (finishNextEviction(true, false, evictError) >= 0);
+    if (evictError) {
+        LOG(WARNING, "[ActiveStatus]          |"
+                "Evict a block failed when closing file %s", mFileId.toString().c_str());
+    }
+
     SHARED_MEM_BEGIN
-        /* get blocks to inactivate */
+        /* get blocks to inactivate, zero copy pins end with the file */
         std::vector<int> activeBlockIds = mLRUCache->removeNumOfKeys(mLRUCache->size());
+        for (std::pair<const int, int> &pinned : mPinnedBlocks) {
+            activeBlockIds.push_back(pinned.first);
+        }
+        mPinnedBlocks.clear();
         std::vector<Block> activeBlocks;
         for (int32_t activeBlockId : activeBlockIds) {
-            activeBlocks.push_back(mBlockArray[activeBlockId]);
+            activeBlocks.push_back(mBlockMap.getBlock(activeBlockId));
         }
 
         /* release all preAllocatedBlocks & active buckets */
@@ -877,10 +1357,10 @@ void FileActiveStatus::close(bool isCancel) {
                                                                                        mIsWrite);
         /* update block status*/
         for (Block b : turedToUsedBlocks) {
-            mBlockArray[b.blockId].state = b.state;
+            mBlockMap.setState(b.blockId, b.state);
 
             /* the ending block been inactivated, flush EoF */
-            if ((uint32_t)b.blockId + 1 == mBlockArray.size()){
+            if (b.blockId + 1 == mBlockMap.size()){
                 /* update EoF from SharedMemory */
                 getSharedMemEof();
                 /* add the Eof log */
@@ -901,23 +1381,28 @@ void FileActiveStatus::close(bool isCancel) {
         if (!mSharedMemoryContext->isFileOpening(mFileId)) {
             if (mShouldDestroy) {
                 /* check all blocks are not in active status */
-                for (Block block : mBlockArray) {
-                    if (block.isLocal && block.state == BUCKET_USED) {
-                        localBlocks.push_back(block);
-                    } else if (block.isLocal && block.state == BUCKET_ACTIVE) {
+                for (BlockExtent &extent : mBlockMap.getExtents()) {
+                    if (extent.isLocal && extent.state == BUCKET_ACTIVE) {
                         THROW(GopherwoodException,
                               "[ActiveStatus] File %s still using active bucket %d",
-                              mFileId.toString().c_str(), block.bucketId);
-                    } else if (!block.isLocal) {
-                        remoteBlocks.push_back(block);
-                    } else {
+                              mFileId.toString().c_str(), extent.startBucketId);
+                    } else if (extent.isLocal && extent.state != BUCKET_USED) {
                         THROW(GopherwoodException,
                               "[ActiveStatus] Dead Zone, Internal Error!");
                     }
+                    for (int32_t i = 0; i < extent.length; i++) {
+                        if (extent.isLocal) {
+                            localBlocks.push_back(extent.getBlock(i));
+                        } else {
+                            remoteBlocks.push_back(extent.getBlock(i));
+                        }
+                    }
                 }
-                /* delete the used blocks first */
-                mSharedMemoryContext->deleteBlocks(localBlocks, mFileId);
+                /* delete the used blocks first, and the copies they keep in OSS */
+                std::vector<Block> remoteCopies = mSharedMemoryContext->deleteBlocks(localBlocks, mFileId);
+                remoteBlocks.insert(remoteBlocks.end(), remoteCopies.begin(), remoteCopies.end());
                 /* delete the Manifest File */
+                ManifestCache::getInstance()->invalidate(mSharedMemoryContext->getWorkDir(), mFileId);
                 mManifest->destroy();
             } else {
                 /* truncate existing Manifest file and flush latest block status to it.
@@ -925,14 +1410,14 @@ void FileActiveStatus::close(bool isCancel) {
                  * this file. */
                 RecOpaque opaque;
                 opaque.fullStatus.eof = mEof;
-                mManifest->logFullStatus(mBlockArray, opaque);
+                mManifest->logFullStatus(mBlockMap, opaque);
             }
         } else {
             mShouldDestroy = false;
         }
 
         /* clear LRU & blockArray */
-        mBlockArray.clear();
+        mBlockMap.clear();
         mLRUCache.reset();
 
     SHARED_MEM_END
@@ -955,14 +1440,15 @@ void FileActiveStatus::close(bool isCancel) {
 
 void FileActiveStatus::catchUpManifestLogs() {
     std::vector<Block> blocks;
+    std::vector<BlockExtent> extents;
 
     while (true) {
-        RecordHeader header = mManifest->fetchOneLogRecord(blocks);
+        RecordHeader header = mManifest->fetchOneLogRecord(blocks, extents);
         if (header.type == RecordType::invalidLog) {
             break;
         }
         /* integrity checks */
-        assert(header.numBlocks == blocks.size());
+        assert(header.numBlocks == blocks.size() + extents.size());
 
         /* replay the log */
         switch (header.type) {
@@ -970,14 +1456,14 @@ void FileActiveStatus::catchUpManifestLogs() {
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Replay activeBlock log record with %lu blocks.", blocks.size());
                 for (Block block : blocks) {
-                    mBlockArray[block.blockId].state = BUCKET_ACTIVE;
+                    mBlockMap.setState(block.blockId, BUCKET_ACTIVE);
                 }
                 break;
             case RecordType::inactiveBlock:
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Replay inactiveBlock log record with %lu blocks.", blocks.size());
                 for (Block block : blocks) {
-                    mBlockArray[block.blockId].state = BUCKET_USED;
+                    mBlockMap.setState(block.blockId, BUCKET_USED);
                 }
                 break;
             case RecordType::acquireNewBlock:
@@ -1001,15 +1487,16 @@ void FileActiveStatus::catchUpManifestLogs() {
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Replay assignBlock log record with %lu blocks.", blocks.size());
                 assert(header.numBlocks == 1);
-                mBlockArray.push_back(blocks[0]);
-                mEof = header.opaque.extendBlock.eof;
+                mBlockMap.pushBack(blocks[0]);
+                catchUpEof(header.opaque.extendBlock.eof);
                 break;
             case RecordType::evictBlock:
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Replay evictBlock log record with %lu blocks.", blocks.size());
                 assert(header.numBlocks == 1);
-                if (mBlockArray[blocks[0].blockId].isLocal && mBlockArray[blocks[0].blockId].state == BUCKET_USED) {
-                    mBlockArray[blocks[0].blockId] = blocks[0];
+                if (mBlockMap.getBlock(blocks[0].blockId).isLocal &&
+                    mBlockMap.getBlock(blocks[0].blockId).state == BUCKET_USED) {
+                    mBlockMap.setBlock(blocks[0]);
                 } else {
                     THROW(GopherwoodException,
                           "[ActiveStatus] The block %d status is not BUCKET_USED when replaying the evictBlock log ",
@@ -1020,8 +1507,8 @@ void FileActiveStatus::catchUpManifestLogs() {
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Replay loadBlock log record with %lu blocks.", blocks.size());
                 assert(header.numBlocks == 1);
-                if (!mBlockArray[blocks[0].blockId].isLocal) {
-                    mBlockArray[blocks[0].blockId] = blocks[0];
+                if (!mBlockMap.getBlock(blocks[0].blockId).isLocal) {
+                    mBlockMap.setBlock(blocks[0]);
                 } else {
                     THROW(GopherwoodException,
                           "[ActiveStatus] The block %d is not remote when replaying the loadBlock log ",
@@ -1029,19 +1516,23 @@ void FileActiveStatus::catchUpManifestLogs() {
                 }
                 break;
             case RecordType::fullStatus:
+                /* a large fullStatus record comes back one chunk at a time */
                 LOG(DEBUG1, "[ActiveStatus]          |"
-                        "Replay fullStatus log record with %lu blocks. EOF=%lu", blocks.size(),
-                    header.opaque.fullStatus.eof);
+                        "Replay fullStatus log record with %lu blocks, %lu extents. EOF=%lu", blocks.size(),
+                    extents.size(), header.opaque.fullStatus.eof);
                 for (Block block : blocks) {
-                    mBlockArray.push_back(block);
+                    mBlockMap.pushBack(block);
+                }
+                for (BlockExtent extent : extents) {
+                    mBlockMap.pushBack(extent);
                 }
-                mEof = header.opaque.fullStatus.eof;
+                catchUpEof(header.opaque.fullStatus.eof);
                 break;
             case RecordType::updateEof:
                 assert(header.numBlocks == 0);
                 LOG(DEBUG1, "[ActiveStatus]          |"
                         "Replay updateEof log record eof=%ld.", header.opaque.updateEof.eof);
-                mEof = header.opaque.updateEof.eof;
+                catchUpEof(header.opaque.updateEof.eof);
                 break;
             default:
                 THROW(GopherwoodNotImplException,
@@ -1049,6 +1540,7 @@ void FileActiveStatus::catchUpManifestLogs() {
                       header.type);
         }
         blocks.clear();
+        extents.clear();
     }
 }
 
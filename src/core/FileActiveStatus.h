@@ -30,10 +30,15 @@
 #include "common/ThreadPool.h"
 #include "core/SharedMemoryContext.h"
 #include "core/BaseActiveStatus.h"
+#include "core/BlockMap.h"
+#include "core/BlockResidency.h"
 #include "core/BlockStatus.h"
+#include "core/EvictPipeline.h"
 #include "core/Manifest.h"
 #include "file/FileId.h"
 
+#include <map>
+
 namespace Gopherwood {
 namespace Internal {
 
@@ -51,7 +56,7 @@ enum ActiveStatusType {
  * 1. Communicate with Shared Memory to acquire/release local buckets
  * 2. Maintain Manifest Log to syncronize file status with Shared Memory status
  * 3. Provide the file/block status to OutputStream/InputStream
- * @BlockArray The array to save all block status
+ * @BlockMap The extent map to save all block status
  * @PreAllocatedBlocks To eliminate the Share Memory contention issue, each time
  * it need to acquire new buckets, a number of buckets will be pre-allocated.
  * @SharedMemoryContext The filesystem level Shared Memory instance to control
@@ -73,15 +78,49 @@ public:
     int64_t getPosition();
     void setPosition(int64_t pos);
 
+    /* Move the position over data still held in the write buffer. The Eof
+     * only grows locally, publishEof() makes it visible in SharedMemory
+     * once the data reached the local space. */
+    void setBufferedPosition(int64_t pos);
+    void publishEof();
+
+    bool isSequence();
+
     /**** The main entry point to adjust block status ****/
-    BlockInfo getCurBlockInfo();
+    /* A read of wantLength bytes at the position loads their pages of a
+     * remote block first. With pinned set, it goes on once they are loaded,
+     * the loading block is pinned for it and *pinned tells so */
+    BlockInfo getCurBlockInfo(int64_t wantLength = 0, bool *pinned = NULL);
     void getStatistics(GWFileInfo *fileInfo);
 
+    /* Pin the block at the current position for zero copy reads. A pinned
+     * block stays active outside the LRU, so it is neither inactivated
+     * nor evicted until every pin of it is released. Pinning another block
+     * fails when it would take the last bucket of the quota. */
+    BlockInfo pinCurBlock();
+    void unpinBlock(int blockId);
+
+    /* Batched random reads: activate a group of blocks, starting all the
+     * remote loads together, then get each block once it is active. The
+     * returned info has offset 0 and does not move the position. */
+    void activateBlocks(const std::vector<int> &blockIds);
+    BlockInfo getBlockInfo(int blockId);
+    int32_t getCurQuota();
+
+    /* Positional I/O, safe to call from several threads on one handle.
+     * pinBlock waits until the block is active and pins it, a write extends
+     * the file up to the block. The I/O runs outside of the load mutex while
+     * the pin keeps the bucket, unpinBlock wakes up the waiters. A read of
+     * a remote block tells its range, it goes on once the range is loaded. */
+    BlockInfo pinBlock(int blockId, bool isWrite, int64_t offset = 0, int64_t length = 0);
+    int64_t getEofLocked();
+    void updateEof(int64_t eof);
+
     void flush();
     void close(bool isCancel);
 
-    /* used as a Thread function */
-    void loadBlock(BlockInfo info);
+    /* used as a Thread function, residency is set for a partial fetch */
+    void loadBlock(BlockInfo info, shared_ptr<BlockResidency> residency);
 
     ~FileActiveStatus();
 
@@ -92,28 +131,41 @@ private:
     Block getCurBlock();
     int32_t getNumBlocks();
     int64_t getCurBlockOffset();
-    int32_t getCurQuota();
     int32_t getNumAcquiredBuckets();
     std::string getManifestFileName(FileId fileId);
     bool isMyActiveBlock(int blockId);
     bool isBlockLoading(int blockId);
+    bool isQuotaBusy();
 
     /***** active status block manipulations *****/
     void catchUpManifestLogs();
-    void adjustActiveBlock(int curBlockId);
+    bool adjustActiveBlock(int curBlockId, int64_t wantOffset = 0, int64_t wantLength = 0,
+                           BlockInfo *loadingInfo = NULL);
+    bool waitActiveBlock(int blockId, int64_t wantOffset = 0, int64_t wantLength = 0,
+                         BlockInfo *loadingInfo = NULL);
     void acquireNewBlocks();
+    void acquireNewBlocks(std::unique_lock<std::mutex> &loadLock);
+    void markEvictVictims(uint32_t num, std::vector<BlockInfo> &victims);
+    void submitEvictions(std::vector<BlockInfo> &victims);
+    int finishNextEviction(bool wait, bool acquire, Gopherwood::exception_ptr &error,
+                           std::unique_lock<std::mutex> *loadLock = NULL);
     void extendOneBlock();
-    int activateBlock(int blockId);
+    int activateBlock(int blockId, int64_t wantOffset = 0, int64_t wantLength = 0);
     void updateCurBlockSize();
     void getSharedMemEof();
 
     void logEvictBlock(BlockInfo info);
+    void catchUpEof(int64_t eof);
+    void inactivateBlocks(std::vector<int> &blockIds);
+    void pinActiveBlock(int blockId);
+    bool pinLoadingBlock(int blockId, int64_t offset, int64_t length, BlockInfo &info);
 
     /****************** Fields *******************/
     FileId mFileId;
     shared_ptr<ThreadPool> mThreadPool;
     shared_ptr<Manifest> mManifest;
     shared_ptr<LRUCache<int, int>> mLRUCache;
+    std::map<int, int> mPinnedBlocks;
 
     bool mIsWrite;
     bool mIsDelete;
@@ -121,11 +173,22 @@ private:
     bool mShouldDestroy;
     int64_t mPos;
     int64_t mEof;
+    bool mEofDirty;
 
-    std::vector<Block> mBlockArray;
+    BlockMap mBlockMap;
     std::list<Block> mPreAllocatedBuckets;
+    shared_ptr<EvictPipeline> mEvictPipeline;
     std::vector<Block> mLoadingBuckets;
+    /* loading blocks a read waits for a range of, and failed loads still
+     * pinned by reads of their loaded pages */
+    std::map<int, shared_ptr<BlockResidency>> mLoadingResidency;
+    int32_t mNumFailedPinnedBuckets;
+    uint32_t mNumPartialLoads;
     std::mutex mLoadMutex;
+    /* a thread is acquiring buckets with the load mutex released */
+    bool mAcquiring;
+    /* signaled when a block load finishes or a block is unpinned */
+    std::condition_variable mBlockCond;
 };
 
 
@@ -20,6 +20,7 @@
  * limitations under the License.
  */
 #include "common/Configuration.h"
+#include "common/Crc32c.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
 #include "common/Memory.h"
@@ -27,6 +28,8 @@
 #include "core/Manifest.h"
 
 #include <sys/fcntl.h>
+#include <sys/stat.h>
+#include <stddef.h>
 
 namespace Gopherwood {
 namespace Internal {
@@ -34,12 +37,34 @@ namespace Internal {
 int64_t Manifest::BUFFER_SIZE = 4 * 1024;
 
 Manifest::Manifest(std::string path) :
-        mFilePath(path), mFD(-1) {
+        mFilePath(path), mFD(-1), mPendingChunks(0) {
     mfOpen();
     mfSeek(0, SEEK_SET);
     mBuffer = (char *) malloc(BUFFER_SIZE);
 }
 
+uint32_t Manifest::getMaxBlocksPerRecord() {
+    return (BUFFER_SIZE - sizeof(RecordHeader)) / sizeof(BlockRecord);
+}
+
+uint32_t Manifest::getMaxExtentsPerRecord() {
+    return (BUFFER_SIZE - sizeof(RecordHeader)) / sizeof(BlockExtentRecord);
+}
+
+uint32_t Manifest::getEntrySize(uint8_t flags) {
+    return flags & MANIFEST_RECORD_FLAG_EXTENT ? sizeof(BlockExtentRecord) : sizeof(BlockRecord);
+}
+
+bool Manifest::isRemoved() {
+    struct stat st;
+    if (fstat(mFD, &st) == -1) {
+        THROW(GopherwoodIOException,
+              "[Manifest::isRemoved] fstat failed %s.",
+              mFilePath.c_str());
+    }
+    return st.st_nlink == 0;
+}
+
 std::string Manifest::getManifestFileName(std::string workDir, FileId fileId) {
     std::stringstream ss;
     ss << workDir << Configuration::MANIFEST_FOLDER << '/' << fileId.hashcode << '-'
@@ -52,21 +77,15 @@ void Manifest::logAcquireNewBlock(std::vector<Block> &blocks) {
     RecOpaque opaque;
     opaque.acquireNewBlock.padding = 0;
 
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::acquireNewBlock, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(blocks, RecordType::acquireNewBlock, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
               "New acquireNewBlock log record");
 }
 
 void Manifest::logExtendBlock(std::vector<Block> &blocks, RecOpaque opaque) {
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::extendBlock, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(blocks, RecordType::extendBlock, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
               "New extendBlock log record");
 }
@@ -75,11 +94,8 @@ void Manifest::logUpdateEof(RecOpaque opaque) {
     /* Empty vector */
     std::vector<Block> blocks;
 
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::updateEof, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(blocks, RecordType::updateEof, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
               "New updateEof log record");
 }
@@ -94,11 +110,8 @@ void Manifest::logReleaseBucket(std::list<Block> &blocks) {
         logBlocks.push_back(b);
     }
 
-    /* build log record */
-    std::string logRecord = serializeManifestLog(logBlocks, RecordType::releaseBlock, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(logBlocks, RecordType::releaseBlock, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
               "New releaseBlock log record");
 }
@@ -108,11 +121,8 @@ void Manifest::logInactivateBucket(std::vector<Block> &blocks) {
     RecOpaque opaque;
     opaque.common.padding = 0;
 
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::inactiveBlock, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(blocks, RecordType::inactiveBlock, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
               "New inactiveBlock log record");
 }
@@ -125,11 +135,8 @@ void Manifest::logActivateBucket(Block &block) {
     std::vector<Block> blocks;
     blocks.push_back(block);
 
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::activeBlock, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(blocks, RecordType::activeBlock, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
             "New activeBlock log record");
 }
@@ -142,11 +149,8 @@ void Manifest::logEvcitBlock(Block &block) {
     std::vector<Block> blocks;
     blocks.push_back(block);
 
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::evictBlock, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(blocks, RecordType::evictBlock, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
             "New evictBlock log record");
 }
@@ -159,69 +163,198 @@ void Manifest::logLoadBlock(Block &block) {
     std::vector<Block> blocks;
     blocks.push_back(block);
 
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::loadBlock, opaque);
-
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to log */
+    writeManifestLog(blocks, RecordType::loadBlock, 0, opaque);
     LOG(DEBUG1, "[Manifest]              |"
             "New loadBlock log record");
 }
 
-void Manifest::logFullStatus(std::vector<Block> &blocks, RecOpaque opaque) {
-    /* truncate existing Manifest file */
-    mfTruncate();
-
-    /* build log record */
-    std::string logRecord = serializeManifestLog(blocks, RecordType::fullStatus, opaque);
+/* The full status is written to a new file renamed over the log, a crash
+ * leaves either the old records or the whole new status. Handles cached by
+ * other processes see the old file unlinked and open the new one. */
+void Manifest::logFullStatus(BlockMap &blockMap, RecOpaque opaque) {
+    std::string tempPath = mFilePath + ".tmp";
+    int tempFD = open(tempPath.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (tempFD == -1) {
+        THROW(GopherwoodIOException,
+              "[Manifest::logFullStatus] open failed %s.",
+              tempPath.c_str());
+    }
 
-    /* flush to log */
-    mfWrite(logRecord);
+    /* build log record and flush to the new file */
+    int logFD = mFD;
+    mFD = tempFD;
+    try {
+        writeManifestLog(blockMap.getExtents(), RecordType::fullStatus, MANIFEST_RECORD_FLAG_EXTENT, opaque);
+        if (fdatasync(tempFD) == -1 || rename(tempPath.c_str(), mFilePath.c_str()) == -1) {
+            THROW(GopherwoodIOException,
+                  "[Manifest::logFullStatus] replace %s failed, errno=%d.",
+                  mFilePath.c_str(), errno);
+        }
+    } catch (...) {
+        mFD = logFD;
+        close(tempFD);
+        unlink(tempPath.c_str());
+        throw;
+    }
+    close(logFD);
     LOG(DEBUG1, "[Manifest]              |"
               "New fullStatus log record");
 }
 
-RecordHeader Manifest::fetchOneLogRecord(std::vector<Block> &blocks) {
+/* append the entries of a record in the buffer to blocks or extents */
+static void appendEntries(uint8_t flags, const char *entries, uint32_t numEntries,
+                          std::vector<Block> &blocks, std::vector<BlockExtent> &extents) {
+    if (flags & MANIFEST_RECORD_FLAG_EXTENT) {
+        BlockExtentRecord *extentRecord = (BlockExtentRecord *) entries;
+        for (uint32_t i = 0; i < numEntries; i++) {
+            extents.push_back(extentRecord->toExtentFormat());
+            extentRecord++;
+        }
+    } else {
+        BlockRecord *blockRecord = (BlockRecord *) entries;
+        for (uint32_t i = 0; i < numEntries; i++) {
+            blocks.push_back(blockRecord->toBlockFormat());
+            blockRecord++;
+        }
+    }
+}
+
+/* The chunks of a logical record are all verified before the first one is
+ * returned, a record is replayed whole or not at all while only one chunk is
+ * held at a time. A torn or broken chunk drops the log from the first chunk
+ * of its record on. */
+RecordHeader Manifest::fetchOneLogRecord(std::vector<Block> &blocks, std::vector<BlockExtent> &extents) {
+    int64_t recordOffset = lseek(mFD, 0, SEEK_CUR);
+    if (mPendingChunks == 0) {
+        const char *reason = verifyRecord();
+        if (reason != NULL) {
+            return truncateBrokenLog(recordOffset, reason);
+        }
+        if (mPendingChunks == 0) {
+            RecordHeader header;
+            header.type = RecordType::invalidLog;
+            return header;
+        }
+        lseek(mFD, recordOffset, SEEK_SET);
+    }
+
+    /* the chunk was verified, only a log changed behind our back fails here */
     RecordHeader header;
-    int64_t bytesRead;
+    const char *reason = readChunk(header, &blocks, &extents);
+    if (reason != NULL || header.type == RecordType::invalidLog) {
+        THROW(GopherwoodIOException,
+              "[Manifest::fetchOneLogRecord] %s changed at offset %ld: %s",
+              mFilePath.c_str(), recordOffset, reason != NULL ? reason : "log ends");
+    }
+    mPendingChunks--;
+    return header;
+}
 
-    /* get log size and eyecatcher */
-    bytesRead = mfRead(mBuffer, 10);
+/* Read the chunks of the next logical record without keeping their entries.
+ * Return why the record is broken, or NULL and set mPendingChunks to its
+ * number of chunks, 0 at the end of the log */
+const char *Manifest::verifyRecord() {
+    RecordHeader record;
+    for (uint32_t numChunks = 0; ; numChunks++) {
+        RecordHeader header;
+        const char *reason = readChunk(header, NULL, NULL);
+        if (reason != NULL) {
+            return reason;
+        }
+        if (header.type == RecordType::invalidLog) {
+            if (numChunks > 0) {
+                return "log ends in the middle of a chunked record";
+            }
+            return NULL;
+        }
+
+        if (numChunks == 0) {
+            record = header;
+        } else if (header.type != record.type ||
+                   (header.flags & MANIFEST_RECORD_FLAG_EXTENT) != (record.flags & MANIFEST_RECORD_FLAG_EXTENT)) {
+            return "chunked record continued by another record";
+        }
+        if (!(header.flags & MANIFEST_RECORD_FLAG_CONTINUED)) {
+            mPendingChunks = numChunks + 1;
+            return NULL;
+        }
+    }
+}
+
+/* Read the next physical record and append its entries, unless blocks and
+ * extents are NULL. Return why the record is broken, or NULL for a good one,
+ * whose type is invalidLog at the end of the log */
+const char *Manifest::readChunk(RecordHeader &header, std::vector<Block> *blocks,
+                                std::vector<BlockExtent> *extents) {
+    int64_t bytesRead = mfRead(mBuffer, sizeof(RecordHeader));
     if (bytesRead == 0) {
         header.type = RecordType::invalidLog;
-        return header;
+        return NULL;
+    }
+    if (bytesRead != sizeof(RecordHeader)) {
+        return "incomplete record header";
     }
 
-    int64_t recLength = *(int64_t *) mBuffer;
-    uint16_t eyecatcher = *(uint16_t *) (mBuffer + 8);
-    if (recLength > BUFFER_SIZE) {
-        THROW(GopherwoodException,
-              "[Manifest::fetchOneLogRecord] recLength should not exceed buffer size.");
+    header = *(RecordHeader *) mBuffer;
+    if (header.eyecatcher == MANIFEST_RECORD_EYECATCHER) {
+        /* version 1 record, the length is 64 bits */
+        header.checksum = 0;
+    } else if (header.eyecatcher != MANIFEST_RECORD_EYECATCHER_V2) {
+        return "bad eyecatcher";
     }
-    if (bytesRead == -1 ||
-        bytesRead != 10 ||
-        eyecatcher != MANIFEST_RECORD_EYECATCHER) {
-        THROW(GopherwoodException, "[Manifest::fetchOneLogRecord] read log error, fd=%dbytesRead=%ld",
-              mFD, bytesRead);
+    uint32_t entrySize = getEntrySize(header.flags);
+    if (header.recordLength != sizeof(RecordHeader) + header.numBlocks * entrySize) {
+        return "bad record length";
     }
 
-    /* read the whole log record to buffer */
-    bytesRead = mfRead(mBuffer + 10, recLength - 10);
-    if (bytesRead != recLength - 10) {
-        THROW(GopherwoodException, "[Manifest::fetchOneLogRecord] read log error.");
+    /* version 2 records always fit in the buffer, verify the whole record */
+    if (header.eyecatcher == MANIFEST_RECORD_EYECATCHER_V2) {
+        int64_t bodySize = header.recordLength - sizeof(RecordHeader);
+        if (header.recordLength > BUFFER_SIZE) {
+            return "record exceeds buffer size";
+        }
+        if (mfRead(mBuffer + sizeof(RecordHeader), bodySize) != bodySize) {
+            return "incomplete record";
+        }
+        ((RecordHeader *) mBuffer)->checksum = 0;
+        if (Crc32c::value(mBuffer, header.recordLength) != header.checksum) {
+            return "checksum mismatch";
+        }
+        if (blocks != NULL) {
+            appendEntries(header.flags, mBuffer + sizeof(RecordHeader), header.numBlocks, *blocks, *extents);
+        }
+        return NULL;
     }
 
-    /* build log header and block info */
-    header = *(RecordHeader *) mBuffer;
-    uint32_t numBlocks = 0;
-    BlockRecord *blockRecord = (BlockRecord *) (mBuffer + sizeof(RecordHeader));
-    while (numBlocks < header.numBlocks) {
-        Block block = blockRecord->toBlockFormat();
-        blocks.push_back(block);
-        blockRecord++;
-        numBlocks++;
+    /* version 1 records written before chunking was introduced may exceed
+     * the buffer, they are read a buffer at a time */
+    uint32_t maxEntries = BUFFER_SIZE / entrySize;
+    for (uint32_t done = 0; done < header.numBlocks;) {
+        uint32_t numEntries = std::min(header.numBlocks - done, maxEntries);
+        int64_t entriesSize = numEntries * entrySize;
+        if (mfRead(mBuffer, entriesSize) != entriesSize) {
+            return "incomplete record";
+        }
+        if (blocks != NULL) {
+            appendEntries(header.flags, mBuffer, numEntries, *blocks, *extents);
+        }
+        done += numEntries;
     }
+    return NULL;
+}
 
+/* A broken record can only be the tail of a torn write, since every record is
+ * appended under the Shared Memory lock. Drop it, so that new records are
+ * appended right after the last valid one. */
+RecordHeader Manifest::truncateBrokenLog(int64_t offset, const char *reason) {
+    LOG(WARNING, "[Manifest]              |"
+            "Broken log record in %s at offset %ld: %s, truncate the log",
+        mFilePath.c_str(), offset, reason);
+    mfTruncate(offset);
+
+    RecordHeader header;
+    header.type = RecordType::invalidLog;
     return header;
 }
 
@@ -234,38 +367,57 @@ void Manifest::destroy() {
     mfRemove();
 }
 
-std::string Manifest::serializeManifestLog(std::vector<Block> &blocks, RecordType type, RecOpaque opaque) {
+template<typename T>
+void Manifest::writeManifestLog(std::vector<T> &entries, RecordType type, uint8_t flags, RecOpaque opaque) {
+    uint32_t maxEntries = (BUFFER_SIZE - sizeof(RecordHeader)) / getEntrySize(flags);
+    uint32_t start = 0;
+
+    /* split the entries into chunks, every chunk fits in one log buffer */
+    do {
+        uint32_t numEntries = std::min((uint32_t) entries.size() - start, maxEntries);
+        uint8_t chunkFlags = flags;
+        if (start + numEntries < entries.size()) {
+            chunkFlags |= MANIFEST_RECORD_FLAG_CONTINUED;
+        }
+
+        std::string logRecord = serializeManifestLog(entries, start, numEntries, type, chunkFlags, opaque);
+        mfWrite(logRecord);
+        start += numEntries;
+    } while (start < entries.size());
+}
+
+template<typename T>
+std::string Manifest::serializeManifestLog(std::vector<T> &entries, uint32_t start, uint32_t numEntries,
+                                           RecordType type, uint8_t flags, RecOpaque opaque) {
     /* build log record header */
     std::string logRecord;
 
     RecordHeader header;
-    header.recordLength = sizeof(RecordHeader) + blocks.size() * sizeof(BlockRecord);
-    header.eyecatcher = MANIFEST_RECORD_EYECATCHER;
+    header.recordLength = sizeof(RecordHeader) + numEntries * getEntrySize(flags);
+    header.checksum = 0;
+    header.eyecatcher = MANIFEST_RECORD_EYECATCHER_V2;
     header.type = type;
-    header.flags = 0;
+    header.flags = flags;
     header.opaque = opaque;
-    header.numBlocks = blocks.size();
-
-    /* build header string */
-    std::string headerStr;
-    char buf[sizeof(RecordHeader)];
-    memcpy(buf, &header, sizeof(RecordHeader));
-    headerStr.append(buf, sizeof(buf));
+    header.numBlocks = numEntries;
 
     /* build the log record */
-    std::stringstream ss;
-    ss << headerStr;
-    for (unsigned int i = 0; i < blocks.size(); i++) {
-        ss << blocks[i].toLogFormat();
+    logRecord.reserve(header.recordLength);
+    logRecord.append((char *) &header, sizeof(RecordHeader));
+    for (uint32_t i = start; i < start + numEntries; i++) {
+        logRecord.append(entries[i].toLogFormat());
     }
 
-    logRecord = ss.str();
     if (logRecord.size() != header.recordLength) {
         THROW(GopherwoodIOException,
-              "[Manifest::serializeManifestLog] Broken log record, expect_size=%lu, actual_size=%lu",
+              "[Manifest::serializeManifestLog] Broken log record, expect_size=%u, actual_size=%lu",
               header.recordLength, logRecord.size());
     }
 
+    /* fill in the checksum of the whole record */
+    uint32_t checksum = Crc32c::value(logRecord.data(), logRecord.size());
+    logRecord.replace(offsetof(RecordHeader, checksum), sizeof(checksum), (char *) &checksum, sizeof(checksum));
+
     return logRecord;
 }
 
@@ -284,6 +436,7 @@ void Manifest::mfOpen() {
 
 void Manifest::mfSeek(int64_t offset, int flag) {
     lseek(mFD, offset, flag);
+    mPendingChunks = 0;
 }
 
 void Manifest::mfWrite(std::string &record) {
@@ -300,8 +453,16 @@ inline int64_t Manifest::mfRead(char *buffer, int64_t size) {
 }
 
 void Manifest::mfTruncate() {
-    ftruncate(mFD, 0);
-    mfSeek(0, SEEK_SET);
+    mfTruncate(0);
+}
+
+void Manifest::mfTruncate(int64_t offset) {
+    if (ftruncate(mFD, offset) == -1) {
+        THROW(GopherwoodIOException,
+              "[Manifest::mfTruncate] truncate %s to %ld failed.",
+              mFilePath.c_str(), offset);
+    }
+    mfSeek(offset, SEEK_SET);
 }
 
 void Manifest::lock() {
@@ -23,6 +23,7 @@
 #define GOPHERWOOD_CORE_MANIFEST_H
 
 #include "file/FileId.h"
+#include "core/BlockMap.h"
 #include "core/BlockStatus.h"
 
 namespace Gopherwood {
@@ -85,19 +86,34 @@ typedef union RecOpaque {
     UpdateEof updateEof;
 } RecOpaque;
 
-/* this is a random prime number to check log record integrity */
-#define MANIFEST_RECORD_EYECATCHER 0xCAED
+/* this is a random prime number to check log record integrity.
+ * Version 1 records are only guarded by the eyecatcher. Version 2 records
+ * carry a CRC32C of the whole record, they are written since the checksum
+ * was introduced, version 1 records are still accepted when replaying. */
+#define MANIFEST_RECORD_EYECATCHER      0xCAED
+#define MANIFEST_RECORD_EYECATCHER_V2   0xCAEF
+
+/* RecordHeader flags.
+ * A logical record carrying more blocks than one log buffer can hold is split into
+ * several physical records of the same type and opaque. Every chunk except the
+ * last one is marked CONTINUED, so writers never need more than one buffer. */
+#define MANIFEST_RECORD_FLAG_CONTINUED 0x01
+/* The record carries BlockExtentRecords instead of BlockRecords */
+#define MANIFEST_RECORD_FLAG_EXTENT    0x02
 
 /* A Manifest Log contains a RecordHeader and a number of BlockRecords */
 struct RecordHeader {
-    /* The total length of header and blocks */
-    uint64_t recordLength;
+    /* The total length of header and blocks. Version 1 records stored
+     * a 64 bit length, whose high half overlays the checksum field. */
+    uint32_t recordLength;
+    /* CRC32C of the whole record computed with this field set to 0 */
+    uint32_t checksum;
     /* The safe guard of each log record */
     uint16_t eyecatcher;
     /* Log Record Type */
     uint8_t type;
     uint8_t flags;
-    /* Number of blocks in this log record */
+    /* Number of blocks (or extents) in this log record */
     uint32_t numBlocks;
     /* The data for each type of log records */
     RecOpaque opaque;
@@ -113,7 +129,7 @@ public:
 
     void logAcquireNewBlock(std::vector<Block> &blocks);
     void logExtendBlock(std::vector<Block> &blocks, RecOpaque opaque);
-    void logFullStatus(std::vector<Block> &blocks, RecOpaque opaque);
+    void logFullStatus(BlockMap &blockMap, RecOpaque opaque);
     void logUpdateEof(RecOpaque opaque);
     void logReleaseBucket(std::list<Block> &blocks);
     void logInactivateBucket(std::vector<Block> &blocks);
@@ -121,26 +137,44 @@ public:
     void logEvcitBlock(Block &block);
     void logLoadBlock(Block &block);
 
-    RecordHeader fetchOneLogRecord(std::vector<Block> &blocks);
+    /* Fetch the next chunk of a logical log record, every chunk but the last
+     * one has MANIFEST_RECORD_FLAG_CONTINUED set. The first chunk is returned
+     * once all chunks of the record are verified. Records with
+     * MANIFEST_RECORD_FLAG_EXTENT set are returned in extents instead of blocks. */
+    RecordHeader fetchOneLogRecord(std::vector<Block> &blocks, std::vector<BlockExtent> &extents);
+
+    static uint32_t getMaxBlocksPerRecord();
+    static uint32_t getMaxExtentsPerRecord();
 
     void mfSeek(int64_t offset, int flag);
     void flush();
     void lock();
     void unlock();
     void destroy();
+    /* true if the Manifest file has been removed since it was opened */
+    bool isRemoved();
 
     ~Manifest();
 
 private:
     static int64_t BUFFER_SIZE;
 
-    std::string serializeManifestLog(std::vector<Block> &blocks, RecordType type, RecOpaque opaque);
+    template<typename T>
+    void writeManifestLog(std::vector<T> &entries, RecordType type, uint8_t flags, RecOpaque opaque);
+    template<typename T>
+    std::string serializeManifestLog(std::vector<T> &entries, uint32_t start, uint32_t numEntries,
+                                     RecordType type, uint8_t flags, RecOpaque opaque);
+    static uint32_t getEntrySize(uint8_t flags);
+    const char *verifyRecord();
+    const char *readChunk(RecordHeader &header, std::vector<Block> *blocks, std::vector<BlockExtent> *extents);
+    RecordHeader truncateBrokenLog(int64_t offset, const char *reason);
 
     /******************** File Operations ********************/
     inline void mfOpen();
     inline void mfWrite(std::string &record);
     inline int64_t mfRead(char *buffer, int64_t size);
     inline void mfTruncate();
+    inline void mfTruncate(int64_t offset);
     inline void mfClose();
     inline void mfRemove();
 
@@ -148,6 +182,8 @@ private:
     std::string mFilePath;
     int mFD;
     char *mBuffer;
+    /* verified chunks of the current record not fetched yet */
+    uint32_t mPendingChunks;
 };
 
 }
@@ -0,0 +1,87 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "common/Logger.h"
+#include "core/ManifestCache.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+shared_ptr<ManifestCache> ManifestCache::instance = NULL;
+
+static std::mutex instanceMutex;
+
+shared_ptr<ManifestCache> ManifestCache::getInstance() {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (!instance) {
+        instance = shared_ptr<ManifestCache>(new ManifestCache(Configuration::MAX_CACHED_MANIFESTS));
+    }
+    return instance;
+}
+
+ManifestCache::ManifestCache(size_t maxSize) :
+        mCache(maxSize) {
+}
+
+shared_ptr<Manifest> ManifestCache::getManifest(std::string workDir, FileId fileId) {
+    std::string manifestFileName = Manifest::getManifestFileName(workDir, fileId);
+    shared_ptr<Manifest> manifest;
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    /* the file may have been deleted and re-created by another process */
+    if (mCache.get(manifestFileName, manifest) && manifest->isRemoved()) {
+        LOG(DEBUG1, "[ManifestCache]         |"
+                "Cached Manifest %s has been removed", manifestFileName.c_str());
+        mCache.deleteObject(manifestFileName);
+        manifest.reset();
+    }
+
+    if (!manifest) {
+        /* check file exist */
+        if (access(manifestFileName.c_str(), F_OK) == -1) {
+            THROW(GopherwoodInvalidParmException,
+                  "[ManifestCache::getManifest] File does not exist %s",
+                  manifestFileName.c_str());
+        }
+        manifest = shared_ptr<Manifest>(new Manifest(manifestFileName));
+        mCache.put(manifestFileName, manifest);
+    }
+
+    /* the owner may have appended or shrunk the log since last time */
+    manifest->mfSeek(0, SEEK_END);
+    return manifest;
+}
+
+void ManifestCache::invalidate(std::string workDir, FileId fileId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCache.deleteObject(Manifest::getManifestFileName(workDir, fileId));
+}
+
+size_t ManifestCache::size() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCache.size();
+}
+
+}
+}
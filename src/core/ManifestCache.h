@@ -0,0 +1,73 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _GOPHERWOOD_CORE_MANIFESTCACHE_H_
+#define _GOPHERWOOD_CORE_MANIFESTCACHE_H_
+
+#include "platform.h"
+
+#include "common/Configuration.h"
+#include "common/LRUCache.cpp"
+#include "common/Memory.h"
+#include "core/Manifest.h"
+#include "file/FileId.h"
+
+#include <mutex>
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * ManifestCache
+ *
+ * @desc A bounded, process wide LRU cache of open Manifest handles of other
+ * files. Evicting a block of another file only appends one evictBlock
+ * record to its Manifest, so the handles are kept open across evictions
+ * instead of opening the file each time. A cached handle is dropped when
+ * the file is deleted, either through invalidate() by a deleter in this
+ * process or when the Manifest is found unlinked by another process.
+ */
+class ManifestCache {
+public:
+    static shared_ptr<ManifestCache> getInstance();
+
+    /* Get the Manifest of a file ready for appending log records.
+     * Throw GopherwoodInvalidParmException if the file does not exist. */
+    shared_ptr<Manifest> getManifest(std::string workDir, FileId fileId);
+
+    /* drop the cached Manifest when the file is deleted */
+    void invalidate(std::string workDir, FileId fileId);
+
+    size_t size();
+
+private:
+    ManifestCache(size_t maxSize);
+
+    LRUCache<std::string, shared_ptr<Manifest>> mCache;
+    std::mutex mMutex;
+
+    static shared_ptr<ManifestCache> instance;
+};
+
+}
+}
+
+#endif //_GOPHERWOOD_CORE_MANIFESTCACHE_H_
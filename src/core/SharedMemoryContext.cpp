@@ -26,11 +26,14 @@
 #include "common/ExceptionInternal.h"
 #include "common/Logger.h"
 
+#include <cassert>
+#include <mutex>
+
 namespace Gopherwood {
 namespace Internal {
 
 SharedMemoryContext::SharedMemoryContext(std::string dir, shared_ptr<mapped_region> region, int lockFD, bool reset) :
-        workDir(dir), mShareMem(region), mLockFD(lockFD) {
+        workDir(dir), mShareMem(region), mLockFD(lockFD), mLocalSpaceFD(-1) {
     void *addr = region->get_address();
 
     header = static_cast<ShareMemHeader *>(addr);
@@ -59,14 +62,68 @@ void SharedMemoryContext::reset() {
     std::memset(mShareMem->get_address(), 0, mShareMem->get_size());
 }
 
+/* lockf only excludes other processes, threads of this process
+ * (loaders, positional I/O on a shared handle) queue up here first.
+ * The lock nests on the thread holding it, the outermost lock/unlock
+ * pair enters and exits the SharedMem */
+static std::mutex processMutex;
+static __thread SharedMemoryContext *lockOwner = NULL;
+static __thread int lockDepth = 0;
+
 void SharedMemoryContext::lock() {
+    if (lockDepth > 0) {
+        assert(lockOwner == this);
+        lockDepth++;
+        return;
+    }
+
+    processMutex.lock();
     lockf(mLockFD, F_LOCK, 0);
+    lockOwner = this;
+    lockDepth = 1;
     header->enter();
 }
 
+/* every unlock pairs with a lock of the same thread, a failed lock
+ * (dirty SharedMem) still has to be unlocked */
 void SharedMemoryContext::unlock() {
-    header->exit();
+    assert(lockDepth > 0 && lockOwner == this);
+    if (--lockDepth > 0) {
+        return;
+    }
+    lockOwner = NULL;
+
+    try {
+        header->exit();
+    } catch (...) {
+        lockf(mLockFD, F_ULOCK, 0);
+        processMutex.unlock();
+        throw;
+    }
     lockf(mLockFD, F_ULOCK, 0);
+    processMutex.unlock();
+}
+
+void SharedMemoryContext::setLocalSpaceFD(int fd) {
+    mLocalSpaceFD = fd;
+}
+
+/* NOTE: You should have acquired the lock before calling me. Punching
+ * after the bucket turns free could hit the data of its next owner */
+void SharedMemoryContext::releaseBucketSpace(int32_t bucketId) {
+    if (!Configuration::LOCAL_PUNCH_FREED_BUCKETS || mLocalSpaceFD == -1) {
+        return;
+    }
+
+    int64_t bucketSize = Configuration::LOCAL_BUCKET_SIZE;
+    if (fallocate(mLocalSpaceFD, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  bucketId * bucketSize, bucketSize) == -1) {
+        LOG(WARNING, "[SharedMemoryContext]   |"
+                "Punch hole of bucket %d failed, errno=%d", bucketId, errno);
+        return;
+    }
+    LOG(DEBUG1, "[SharedMemoryContext]   |"
+            "Punched hole of freed bucket %d", bucketId);
 }
 
 int16_t SharedMemoryContext::registFile(int pid, FileId fileId, bool isWrite, bool isDelete) {
@@ -226,10 +283,12 @@ std::vector<int32_t> SharedMemoryContext::acquireFreeBucket(int16_t activeId, in
 
 /* When activate buckets from Used Buckets(2->1), we need to evict the data first.
  * The steps are:
- * 1. markBucketEvicting -- set the evicting ActiveStatus status in SharedMem.
- *             This will mark write/read blockId to inform other activestatus
- *             of same File
- * 2. evictBlockFinish -- finally reset evicting ActiveStatus and activate the bucket */
+ * 1. markBucketEvicting -- set the bucket evicting in SharedMem. The owner of the
+ *             block activating it meanwhile marks the eviction stolen
+ * 2. evictBlockFinish -- finally reset evicting status and activate the bucket
+ * An ActiveStatus may have several evictions in flight, each upload carries the
+ * evictSeq of its bucket. Return a BlockInfo with InvalidBucketId if no used
+ * bucket can be evicted */
 BlockInfo SharedMemoryContext::markBucketEvicting(int16_t activeId) {
     BlockInfo info;
     info.reset();
@@ -254,32 +313,15 @@ BlockInfo SharedMemoryContext::markBucketEvicting(int16_t activeId) {
             else
             {
                 /* Found a usable buffer */
-                bucket->setBucketEvicting();
-                bucket->evictLoadActiveId = activeId;
-
-                /* fill ActiveStatus evict info */
-                activeStatus[activeId].evictFileId = bucket->fileId;
-                activeStatus[activeId].fileBlockIndex = bucket->fileBlockIndex;
-                activeStatus[activeId].setEvicting();
-
-                /* fill result BlockInfo */
-                info.fileId = bucket->fileId;
-                info.blockId = bucket->fileBlockIndex;
-                info.bucketId = bucketId;
-                info.isLocal = true;
-                info.offset = InvalidBlockOffset;
-                info.dataSize = bucket->dataSize;
-
-                /* update statistics */
-                header->numUsedBuckets--;
-                header->numEvictingBuckets++;
+                info = startEvicting(bucketId, activeId);
                 break;
             }
         }
         else if (--trycounter == 0){
-            THROW(GopherwoodSharedMemException,
-                  "[SharedMemoryContext::acquireBlock] statistic incorrect, there should be %d used"
-                          "buckets.", header->numUsedBuckets);
+            /* the used buckets activated during their eviction wait for the upload */
+            LOG(DEBUG1, "[SharedMemoryContext]   |"
+                      "No bucket to evict, %d used buckets", header->numUsedBuckets);
+            return info;
         }
     }
 
@@ -290,22 +332,115 @@ BlockInfo SharedMemoryContext::markBucketEvicting(int16_t activeId) {
     return info;
 }
 
+/* Claim a used bucket for an upload, the bucket stays in the evicting state until
+ * the evict/clean finish. Return the BlockInfo to upload */
+BlockInfo SharedMemoryContext::startEvicting(int32_t bucketId, int16_t activeId) {
+    BlockInfo info;
+    info.reset();
+    ShareMemBucket* bucket = &buckets[bucketId];
+
+    bucket->setBucketEvicting();
+    bucket->evictLoadActiveId = activeId;
+    bucket->evictSeq++;
+
+    /* fill result BlockInfo */
+    info.fileId = bucket->fileId;
+    info.blockId = bucket->fileBlockIndex;
+    info.bucketId = bucketId;
+    info.isLocal = true;
+    info.offset = InvalidBlockOffset;
+    info.dataSize = bucket->dataSize;
+    info.isClean = bucket->hasRemoteCopy() && !bucket->isDirtyBucket();
+    info.evictSeq = bucket->evictSeq;
+    /* nobody writes a used bucket, the upload will hold its data. A
+     * writer stealing the bucket back marks it dirty again */
+    bucket->setBucketClean();
+
+    /* update statistics */
+    header->numUsedBuckets--;
+    header->numEvictingBuckets++;
+    return info;
+}
+
+/* The background cleaner uploads cold used buckets ahead of eviction, so that
+ * evicting them later costs no upload. The steps are:
+ * 1. markBucketCleaning -- pick the coldest used bucket without an up to date
+ *             copy in OSS and mark it evicting, no other process will evict or
+ *             clean it meanwhile
+ * 2. cleanBucketFinish -- the bucket goes back to used, keeping its data */
+BlockInfo SharedMemoryContext::markBucketCleaning(int16_t activeId) {
+    BlockInfo info;
+    info.reset();
+
+    /* scan in clock order from the victim hand, the next victims get cleaned first */
+    int32_t victim = InvalidBucketId;
+    for (int32_t i = 0; i < header->numBuckets; i++) {
+        int32_t bucketId = (header->nextVictimBucket + i) % header->numBuckets;
+        ShareMemBucket* bucket = &buckets[bucketId];
+        if (!bucket->isUsedBucket() || bucket->isEvictingBucket() ||
+            (bucket->hasRemoteCopy() && !bucket->isDirtyBucket())) {
+            continue;
+        }
+        if (victim == InvalidBucketId || bucket->usageCount < buckets[victim].usageCount) {
+            victim = bucketId;
+        }
+        if (bucket->usageCount == 0) {
+            break;
+        }
+    }
+
+    if (victim == InvalidBucketId) {
+        return info;
+    }
+
+    info = startEvicting(victim, activeId);
+    LOG(DEBUG1, "[SharedMemoryContext]   |"
+              "Start cleaning bucketId %d, FileId %s, BlockId %d",
+        info.bucketId, info.fileId.toString().c_str(), info.blockId);
+    printStatistics();
+    return info;
+}
+
+/* Return 0 if the upload belongs to the current eviction of the bucket and the
+ * owner has not activated it meanwhile, otherwise the return code of the finish.
+ * The bucket activated by the owner keeps the uploaded copy for its next eviction */
+int SharedMemoryContext::finishStolenEviction(const BlockInfo &info, bool uploaded) {
+    ShareMemBucket* bucket = &buckets[info.bucketId];
+
+    /* the owner activated the bucket and deleted the block since, the bucket
+     * may have been reused and even evicted again */
+    if (!bucket->isEvictingBucket() || bucket->evictSeq != info.evictSeq) {
+        return 3;
+    }
+
+    if (!bucket->isEvictStolen()) {
+        return 0;
+    }
+
+    bucket->setBucketEvictFinish();
+    bucket->unsetEvictStolen();
+    if (uploaded) {
+        bucket->setRemoteCopy();
+    }
+    return 2;
+}
+
 /* return code:
  * 0 -- evict finish successfully
  * 1 -- the evicted block has been deleted during the eviction
- * 2 -- the evicted bucket has been activated by it's file owner, give up this one
+ * 2 -- the evicted bucket has been activated by it's file owner, give up this one.
+ *      The copy in OSS is kept for the owner
+ * 3 -- the evicted bucket has been activated by it's file owner and deleted since,
+ *      give up this one
  */
-int SharedMemoryContext::evictBucketFinishAndTryAcquire(int32_t bucketId, int16_t activeId, FileId fileId, int isWrite) {
+int SharedMemoryContext::evictBucketFinishAndTryAcquire(const BlockInfo &info, int16_t activeId,
+                                                        FileId fileId, int isWrite) {
     int rc = 0;
+    int32_t bucketId = info.bucketId;
 
-    /* reset activestatus evict info  */
-    activeStatus[activeId].evictFileId.reset();
-    activeStatus[activeId].fileBlockIndex = InvalidBlockId;
-    activeStatus[activeId].unsetEvicting();
-
-    if (activeStatus[activeId].isEvictBucketStolen()) {
-        activeStatus[activeId].unsetBucketStolen();
-        return 2;
+    int stolen = finishStolenEviction(info, true);
+    if (stolen != 0) {
+        return stolen;
     }
 
     /* check whether the evicted block been deleted during evicting */
@@ -335,17 +470,13 @@ int SharedMemoryContext::evictBucketFinishAndTryAcquire(int32_t bucketId, int16_
     return rc;
 }
 
-int SharedMemoryContext::evictBucketFinishAndTryFree(int32_t bucketId, int16_t activeId) {
+int SharedMemoryContext::evictBucketFinishAndTryFree(const BlockInfo &info) {
     int rc = 0;
+    int32_t bucketId = info.bucketId;
 
-    /* reset activestatus evict info  */
-    activeStatus[activeId].evictFileId.reset();
-    activeStatus[activeId].fileBlockIndex = InvalidBlockId;
-    activeStatus[activeId].unsetEvicting();
-
-    if (activeStatus[activeId].isEvictBucketStolen()) {
-        activeStatus[activeId].unsetBucketStolen();
-        return 2;
+    int stolen = finishStolenEviction(info, true);
+    if (stolen != 0) {
+        return stolen;
     }
 
     /* check whether the evicted block been deleted during evicting */
@@ -354,6 +485,7 @@ int SharedMemoryContext::evictBucketFinishAndTryFree(int32_t bucketId, int16_t a
     }
 
     /* clear bucket info */
+    releaseBucketSpace(bucketId);
     buckets[bucketId].reset();
     buckets[bucketId].setBucketFree();
 
@@ -368,6 +500,54 @@ int SharedMemoryContext::evictBucketFinishAndTryFree(int32_t bucketId, int16_t a
     return rc;
 }
 
+/* Also ends an eviction whose upload failed, the bucket goes back to used.
+ * return code:
+ * 0 -- clean finish successfully, the bucket is used and clean
+ * 1 -- the cleaned block has been deleted during the upload, the bucket is freed
+ * 2 -- the cleaned bucket has been activated by it's file owner, the copy in OSS
+ *      is kept for the owner
+ * 3 -- the cleaned bucket has been activated by it's file owner and deleted since
+ */
+int SharedMemoryContext::cleanBucketFinish(const BlockInfo &info, bool uploaded) {
+    int32_t bucketId = info.bucketId;
+
+    /* a failed upload leaves the data only in the bucket, the next eviction uploads it */
+    if (!uploaded && buckets[bucketId].isEvictingBucket() &&
+        buckets[bucketId].evictSeq == info.evictSeq) {
+        buckets[bucketId].setBucketDirty();
+    }
+
+    int stolen = finishStolenEviction(info, uploaded);
+    if (stolen != 0) {
+        return stolen;
+    }
+
+    /* deleteBlocks left the bucket of a deleted block to us */
+    if (buckets[bucketId].isDeletedBucket()) {
+        releaseBucketSpace(bucketId);
+        buckets[bucketId].reset();
+        buckets[bucketId].setBucketFree();
+        header->numEvictingBuckets--;
+        header->numFreeBuckets++;
+        printStatistics();
+        return 1;
+    }
+
+    buckets[bucketId].setBucketEvictFinish();
+    if (uploaded) {
+        buckets[bucketId].setRemoteCopy();
+    }
+
+    /* update statistics */
+    header->numEvictingBuckets--;
+    header->numUsedBuckets++;
+
+    LOG(DEBUG1, "[SharedMemoryContext]   |"
+            "Bucket %d clean finished.", bucketId);
+    printStatistics();
+    return 0;
+}
+
 /* Mark a block is loading by me
  * return true -- I've marked the block loading
  * return false -- The block is loading by some others
@@ -410,8 +590,9 @@ bool SharedMemoryContext::markBucketLoading(int32_t bucketId, int32_t blockId, i
 void SharedMemoryContext::markLoadFinish(int32_t bucketId, int16_t activeId, FileId fileId) {
     assert(buckets[bucketId].isActiveBucket());
     assert(buckets[bucketId].isLoadingBucket());
-    /* update the bucket info */
+    /* update the bucket info, the loaded block keeps its copy in OSS */
     buckets[bucketId].setBucketLoadFinish();
+    buckets[bucketId].setRemoteCopy();
 
     /* clear ActiveStatus loading info */
     activeStatus[activeId].fileBlockIndex = InvalidBlockId;
@@ -438,6 +619,7 @@ void SharedMemoryContext::releaseBuckets(std::list<Block> &blocks) {
     for (Block block : blocks) {
         int32_t bucketId = block.bucketId;
         if (buckets[bucketId].isActiveBucket()) {
+            releaseBucketSpace(bucketId);
             buckets[bucketId].reset();
             buckets[bucketId].setBucketFree();
             /* update statistics */
@@ -489,16 +671,10 @@ int SharedMemoryContext::activateBucket(FileId fileId, Block &block, int16_t act
                       "Mark Read-Active activeId %d, bucketId %d", activeId, bucketId);
         }
 
-        if (buckets[bucketId].isEvictingBucket()) {
-            int32_t evictId = buckets[bucketId].evictLoadActiveId;
-            if (activeStatus[evictId].evictFileId == buckets[bucketId].fileId &&
-                activeStatus[evictId].fileBlockIndex == buckets[bucketId].fileBlockIndex) {
-                activeStatus[evictId].setBucketStolen();
-            } else {
-                THROW(GopherwoodSharedMemException,
-                      "[activateBucket] The activeStatus %d is not evicting file %s block %d",
-                      evictId, buckets[bucketId].fileId.toString().c_str(), buckets[bucketId].fileBlockIndex);
-            }
+        if (buckets[bucketId].isEvictingBucket() && !buckets[bucketId].isEvictStolen()) {
+            /* the bucket stays evicting until the upload finishes, so that nobody
+             * evicts it again meanwhile */
+            buckets[bucketId].setEvictStolen();
             header->numEvictingBuckets--;
             header->numActiveBuckets++;
         } else {
@@ -575,21 +751,30 @@ void SharedMemoryContext::updateActiveFileInfo(std::vector<Block> &blocks, FileI
     }
 }
 
-void SharedMemoryContext::deleteBlocks(std::vector<Block> &blocks, FileId fileId) {
+/* return the blocks whose copy in OSS is left to the caller to delete, the
+ * copies of evicting blocks are deleted by the evicting ActiveStatus */
+std::vector<Block> SharedMemoryContext::deleteBlocks(std::vector<Block> &blocks, FileId fileId) {
+    std::vector<Block> remoteCopies;
     for (uint32_t i = 0; i < blocks.size(); i++) {
         Block b = blocks[i];
 
-        /* set free if the bucket still in used status */
-        if (buckets[b.bucketId].isUsedBucket() && buckets[b.bucketId].fileId == fileId) {
+        /* mark deleted if it's been evicting by someone */
+        if (buckets[b.bucketId].isEvictingBucket() && !buckets[b.bucketId].isEvictStolen() &&
+            buckets[b.bucketId].fileId == fileId) {
+            buckets[b.bucketId].setBucketDeleted();
+        }
+            /* set free if the bucket still in used status. The upload of a bucket
+             * activated during its eviction finds the bucket gone */
+        else if (buckets[b.bucketId].isUsedBucket() && buckets[b.bucketId].fileId == fileId) {
+            if (buckets[b.bucketId].hasRemoteCopy()) {
+                remoteCopies.push_back(b);
+            }
+            releaseBucketSpace(b.bucketId);
             buckets[b.bucketId].reset();
             buckets[b.bucketId].setBucketFree();
             /* update statistics */
             header->numUsedBuckets--;
             header->numFreeBuckets++;
-        }
-            /* mark deleted if it's been evicting by someone */
-        else if (buckets[b.bucketId].isEvictingBucket() && buckets[b.bucketId].fileId == fileId) {
-            buckets[b.bucketId].setBucketDeleted();
         } else {
             THROW(GopherwoodSharedMemException,
                   "[SharedMemoryContext] Bucket %d status mismatch!", b.bucketId);
@@ -598,6 +783,7 @@ void SharedMemoryContext::deleteBlocks(std::vector<Block> &blocks, FileId fileId
     LOG(DEBUG1, "[SharedMemoryContext]   |"
               "Deleted %lu blocks.", blocks.size());
     printStatistics();
+    return remoteCopies;
 }
 
 void SharedMemoryContext::updateBucketDataSize(int32_t bucketId, int64_t size, FileId fileId, int16_t activeId) {
@@ -657,6 +843,17 @@ int32_t SharedMemoryContext::getEvictingBucketNum() {
     return header->numEvictingBuckets;
 }
 
+int32_t SharedMemoryContext::getCleanBucketNum() {
+    int32_t num = 0;
+    for (int32_t i = 0; i < header->numBuckets; i++) {
+        if (buckets[i].isUsedBucket() && !buckets[i].isEvictingBucket() &&
+            buckets[i].hasRemoteCopy() && !buckets[i].isDirtyBucket()) {
+            num++;
+        }
+    }
+    return num;
+}
+
 int32_t SharedMemoryContext::getLoadingBucketNum() {
     return header->numLoadingBuckets;
 }
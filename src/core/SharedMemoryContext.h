@@ -66,27 +66,34 @@ public:
     int activateBucket(FileId fileId, Block &block, int16_t activeId, bool isWrite);
     std::vector<Block> inactivateBuckets(std::vector<Block> &blocks, FileId fileId, int16_t activeId, bool isWrite);
     void updateActiveFileInfo(std::vector<Block> &blocks, FileId fileId);
-    void deleteBlocks(std::vector<Block> &blocks, FileId fileId);
+    std::vector<Block> deleteBlocks(std::vector<Block> &blocks, FileId fileId);
     void updateBucketDataSize(int32_t bucketId, int64_t size, FileId fileId, int16_t activeId);
 
     /* evict/load logic related APIs*/
     BlockInfo markBucketEvicting(int16_t activeId);
-    int evictBucketFinishAndTryAcquire(int32_t bucketId, int16_t activeId, FileId fileId, int isWrite);
-    int evictBucketFinishAndTryFree(int32_t bucketId, int16_t activeId);
+    int evictBucketFinishAndTryAcquire(const BlockInfo &info, int16_t activeId, FileId fileId, int isWrite);
+    int evictBucketFinishAndTryFree(const BlockInfo &info);
     bool markBucketLoading(int32_t bucketId, int32_t blockId, int16_t activeId, FileId fileId);
     void markLoadFinish(int32_t bucketId, int16_t activeId, FileId fileId);
+    BlockInfo markBucketCleaning(int16_t activeId);
+    int cleanBucketFinish(const BlockInfo &info, bool uploaded);
     bool isBlockLoading(FileId fileId, int32_t blockId);
 
     void reset();
+    /* re-entrant on the owner thread, each lock needs its unlock */
     void lock();
     void unlock();
 
+    /* the local space file whose freed buckets get punched */
+    void setLocalSpaceFD(int fd);
+
     /* getter & setter */
     int32_t getFreeBucketNum();
     int32_t getActiveBucketNum();
     int32_t getUsedBucketNum();
     int32_t getEvictingBucketNum();
     int32_t getLoadingBucketNum();
+    int32_t getCleanBucketNum();
     int32_t getFileActiveStatusNum();
     int32_t getAdminActiveStatusNum();
 
@@ -98,10 +105,14 @@ public:
 
 private:
     void printStatistics();
+    void releaseBucketSpace(int32_t bucketId);
+    BlockInfo startEvicting(int32_t bucketId, int16_t activeId);
+    int finishStolenEviction(const BlockInfo &info, bool uploaded);
 
     std::string workDir;
     shared_ptr<mapped_region> mShareMem;
     int mLockFD;
+    int mLocalSpaceFD;
     ShareMemHeader *header;
     ShareMemBucket *buckets;
     ShareMemActiveStatus *activeStatus;
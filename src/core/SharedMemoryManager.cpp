@@ -73,6 +73,20 @@ shared_ptr<SharedMemoryContext> SharedMemoryManager::buildSharedMemoryContext(co
         }
     }
 
+    /* refuse a SharedMem left by processes of another layout, gwFormatContext removes it */
+    if (shmExist) {
+        ShareMemHeader *header = static_cast<ShareMemHeader *>(region->get_address());
+        if (region->get_size() < sizeof(ShareMemHeader) ||
+            header->layoutVersion != SHARED_MEMORY_LAYOUT_VERSION) {
+            uint16_t version = region->get_size() < sizeof(ShareMemHeader) ? 0 : header->layoutVersion;
+            lockf(lockFD, F_ULOCK, 0);
+            THROW(GopherwoodSharedMemException,
+                  "[SharedMemoryManager::buildSharedMemoryContext] SharedMemory %s has layout version %u, "
+                          "expect %u",
+                  Configuration::SHARED_MEMORY_NAME.c_str(), version, SHARED_MEMORY_LAYOUT_VERSION);
+        }
+    }
+
     ctx = shared_ptr<SharedMemoryContext>(new SharedMemoryContext(workDir, region, lockFD, !shmExist));
 
     /* TODO: Rebuild Shared Memory status from existing manifest logs */
@@ -55,7 +55,9 @@ void ShareMemBucket::reset() {
     }
 }
 
+/* a writer may change the block, the copy in OSS is no longer trusted */
 void ShareMemBucket::markWrite(int activeId) {
+    setBucketDirty();
     for (int i = 0; i < SMBUCKET_MAX_CONCURRENT_OPEN; i++) {
         if (activeInfos[i].activeId == InvalidActiveId) {
             activeInfos[i].activeId = activeId;
@@ -38,9 +38,15 @@ namespace Internal {
 #define InvalidPid -1
 #define InvalidActiveId -1
 
+/* the layout of the SharedMem, bumped when a field or a flag bit changes.
+ * A SharedMem built by another layout is not attached to */
+#define SHARED_MEMORY_LAYOUT_VERSION 1
+
 typedef struct ShareMemHeader {
     uint8_t flags;
-    char padding[3];
+    char padding;
+    /* SHARED_MEMORY_LAYOUT_VERSION of the processes that built it */
+    uint16_t layoutVersion;
 
     /* num buckets */
     int32_t numBuckets;
@@ -66,6 +72,7 @@ typedef struct ShareMemHeader {
 
     void reset(int32_t totalBucketNum, uint16_t maxConn) {
         flags = 0;
+        layoutVersion = SHARED_MEMORY_LAYOUT_VERSION;
         numBuckets = totalBucketNum;
         numMaxActiveStatus = maxConn;
         nextVictimBucket = 0;
@@ -97,6 +104,11 @@ typedef struct BucketActiveInfo {
 
 /* Bit usages in flags field (low to high)
  * bit 0~1:     Bucket type 0/1/2
+ * bit 26:      Mark the owner activated the bucket during its eviction, the
+ *              bucket stays evicting until the upload finishes
+ * bit 27:      Mark the block has a copy in OSS, kept when the block was loaded
+ * bit 28:      Mark the block was written since it was loaded or uploaded,
+ *              a clean block with a copy in OSS is evicted without upload
  * bit 29:      Mark the block is loading
  * bit 30:      Mark the evicting block has been deleted
  * bit 31:      Evicting bucket will set this bit to 1
@@ -108,6 +120,9 @@ typedef struct ShareMemBucket {
     int32_t fileBlockIndex;
     int64_t dataSize;
     int16_t evictLoadActiveId;
+    /* bumped by every eviction, kept across reset so that a finishing upload
+     * tells its own eviction from a later one */
+    uint32_t evictSeq;
     BucketActiveInfo activeInfos[SMBUCKET_MAX_CONCURRENT_OPEN];
 
     /* Bucket status operations */
@@ -117,6 +132,9 @@ typedef struct ShareMemBucket {
     bool isEvictingBucket() { return (flags & 0x80000000); };
     bool isDeletedBucket() { return (flags & 0x40000000); };
     bool isLoadingBucket() { return (flags & 0x20000000); };
+    bool isDirtyBucket() { return (flags & 0x10000000); };
+    bool hasRemoteCopy() { return (flags & 0x08000000); };
+    bool isEvictStolen() { return (flags & 0x04000000); };
     void setBucketFree() { flags = (flags & BucketTypeMask) | 0x00000000; };
     void setBucketActive() { flags = (flags & BucketTypeMask) | 0x00000001; };
     void setBucketUsed() { flags = (flags & BucketTypeMask) | 0x00000002; };
@@ -125,6 +143,11 @@ typedef struct ShareMemBucket {
     void setBucketDeleted() { flags = (flags | 0x40000000); };
     void setBucketLoading() { flags = (flags | 0x20000000); };
     void setBucketLoadFinish() { flags = (flags & 0xDFFFFFFF); };
+    void setBucketDirty() { flags = (flags | 0x10000000); };
+    void setBucketClean() { flags = (flags & 0xEFFFFFFF); };
+    void setRemoteCopy() { flags = (flags | 0x08000000); };
+    void setEvictStolen() { flags = (flags | 0x04000000); };
+    void unsetEvictStolen() { flags = (flags & 0xFBFFFFFF); };
 
     void reset();
     void markWrite(int activeId);
@@ -137,43 +160,36 @@ typedef struct ShareMemBucket {
 
 /* This field is to support multiple-read and protect single-wirte
  * Each ActiveStatus will regist here when constructing, and set the
- * evicting/loading status to let others know the overall status.
+ * loading status to let others know the overall status. The evictions
+ * are tracked by the buckets, an ActiveStatus may have several in flight.
  * Operations are:
  * 1. Check whether all ActiveStatus of a File is closed
- * 2. Check the evicting ActiveStatus pid
- * 3. Check the loading status(from OSS) of a file block
+ * 2. Check the loading status(from OSS) of a file block
  *
  * FLAGS (low -> high):
- * 0  bit: mark evicting
  * 1  bit: mark loading
  * 28 bit: mark the activeStatus is an AdminActiveStatus
  * 29 bit: mark the activeStatus opened file has been unlinked, should destroy when
  *          closing this activestatus if it's the last opened activestatus
- * 30 bit: mark the evict bucket has been stolen(the owner get it back)
  * 31 bit: mark the evict bucket has been deleted(the owner file has been deleted)
  */
 typedef struct ShareMemActiveStatus {
     int pid;
     int32_t flags;
     FileId fileId;
-    FileId evictFileId;
+    /* the block being loaded */
     int32_t fileBlockIndex;
 
-    void setEvicting() { flags |= 0x00000001; };
     void setLoading() { flags |= 0x00000002; };
     void setForDelete() { flags |= 0x80000000; };
-    void setBucketStolen() { flags |= 0x40000000; };
     void setShouldDestroy() { flags |= 0x20000000; };
     void setIsAdmin() { flags |= 0x10000000; };
-    void unsetEvicting() { flags &= 0xFFFFFFFE; };
     void unsetLoading() { flags &= 0xFFFFFFFD; };
-    void unsetBucketStolen() { flags &= 0xBFFFFFFF; };
     void unsetShouldDestroy() { flags &= 0xDFFFFFFF; };
     void unsetIsAdmin() { flags &= 0xEFFFFFFF; };
 
     bool isLoading() {return flags & 0x00000002;};
     bool isForDelete() { return flags & 0x80000000; };
-    bool isEvictBucketStolen() { return flags & 0x40000000; };
     bool shouldDestroy() { return flags & 0x20000000; };
     bool isAdmin() { return flags & 0x10000000; };
 
@@ -181,7 +197,6 @@ typedef struct ShareMemActiveStatus {
         pid = InvalidPid;
         flags = 0;
         fileId.reset();
-        evictFileId.reset();
         fileBlockIndex = InvalidBlockId;
     };
 } ShareMemActiveStatus;
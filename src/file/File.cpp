@@ -35,9 +35,14 @@ File::File(FileId id, std::string fileName, int flags, int fd, shared_ptr<FileAc
     }
 
     mInStream = shared_ptr<InputStream>(new InputStream(localFD, status));
+    mPositionalStream = shared_ptr<PositionalStream>(new PositionalStream(localFD, status));
 }
 
 int64_t File::read(char *buffer, int64_t length) {
+    if (mOutStream) {
+        mOutStream->flushBuffer();
+    }
+
     int64_t bytesToRead = length < remaining() ? length : remaining();
     if (bytesToRead == 0) {
         return 0;
@@ -47,19 +52,96 @@ int64_t File::read(char *buffer, int64_t length) {
     return bytesToRead;
 }
 
+int64_t File::readZeroCopy(const char **buffer, int64_t length) {
+    if (mOutStream) {
+        mOutStream->flushBuffer();
+    }
+
+    int64_t bytesToRead = length < remaining() ? length : remaining();
+    if (bytesToRead == 0) {
+        *buffer = NULL;
+        return 0;
+    }
+
+    return mInStream->readZeroCopy(buffer, bytesToRead);
+}
+
+void File::releaseZeroCopy(const char *buffer) {
+    mInStream->releaseZeroCopy(buffer);
+}
+
 void File::write(const char *buffer, int64_t length) {
+    mInStream->invalidate();
     mOutStream->write(buffer, length, false);
 }
 
+int64_t File::readv(const struct iovec *iov, int iovcnt) {
+    if (mOutStream) {
+        mOutStream->flushBuffer();
+    }
+
+    int64_t length = IovecCursor::totalLength(iov, iovcnt);
+    int64_t bytesToRead = length < remaining() ? length : remaining();
+    if (bytesToRead == 0) {
+        return 0;
+    }
+
+    mInStream->readv(iov, iovcnt, bytesToRead);
+    return bytesToRead;
+}
+
+bool File::preadBatch(GWReadRequest *requests, int num) {
+    if (mOutStream) {
+        mOutStream->flushBuffer();
+    }
+
+    return mInStream->preadBatch(requests, num);
+}
+
+int64_t File::writev(const struct iovec *iov, int iovcnt) {
+    int64_t length = IovecCursor::totalLength(iov, iovcnt);
+    mInStream->invalidate();
+    mOutStream->writev(iov, iovcnt, length);
+    return length;
+}
+
+int64_t File::pread(char *buffer, int64_t length, int64_t offset) {
+    syncStreams(false);
+    return mPositionalStream->pread(buffer, length, offset);
+}
+
+int64_t File::pwrite(const char *buffer, int64_t length, int64_t offset) {
+    if ((mFlags & OPEN_TYPE_MASK) == GW_RDONLY) {
+        THROW(GopherwoodInvalidParmException, "[File] Can not write a read only file.");
+    }
+    syncStreams(true);
+    return mPositionalStream->pwrite(buffer, length, offset);
+}
+
+void File::syncStreams(bool isWrite) {
+    std::lock_guard<std::mutex> lock(mStreamMutex);
+    if (mOutStream) {
+        mOutStream->flushBuffer();
+    }
+    if (isWrite) {
+        mInStream->invalidate();
+    }
+}
+
 void File::flush() {
     if ((mFlags & OPEN_TYPE_MASK) == GW_RDONLY) {
         THROW(GopherwoodInvalidParmException, "[File] Can not flush a read only file.");
     }
     mOutStream->flush();
+    mPositionalStream->flush();
     mStatus->flush();
 }
 
 int64_t File::seek(int64_t pos, int mode) {
+    if (mOutStream) {
+        mOutStream->flushBuffer();
+    }
+
     int64_t eof = mStatus->getEof();
     int64_t targetPos = -1;
 
@@ -94,12 +176,13 @@ int64_t File::seek(int64_t pos, int mode) {
 }
 
 void File::close(bool isCancel) {
-    mStatus->close(isCancel);
-
+    /* buffered data must reach the local space before the blocks are inactivated */
     if (mOutStream) {
-        mOutStream->close();
+        mOutStream->close(isCancel);
     }
 
+    mStatus->close(isCancel);
+
     if (mInStream) {
         mInStream->close();
     }
@@ -117,6 +200,7 @@ FileId File::getFileId() {
 
 void File::getFileInfo(GWFileInfo *fileInfo) {
     mStatus->getStatistics(fileInfo);
+    mInStream->getStatistics(fileInfo);
 }
 
 File::~File() {
@@ -29,6 +29,7 @@
 #include "common/Memory.h"
 #include "file/OutputStream.h"
 #include "file/InputStream.h"
+#include "file/PositionalStream.h"
 #include "oss/oss.h"
 
 namespace Gopherwood {
@@ -42,8 +43,23 @@ public:
 
     int64_t read(char *buffer, int64_t length);
 
+    int64_t readZeroCopy(const char **buffer, int64_t length);
+
+    void releaseZeroCopy(const char *buffer);
+
     void write(const char *buffer, int64_t length);
 
+    int64_t readv(const struct iovec *iov, int iovcnt);
+
+    bool preadBatch(GWReadRequest *requests, int num);
+
+    int64_t writev(const struct iovec *iov, int iovcnt);
+
+    /* positional I/O, may be called by several threads concurrently */
+    int64_t pread(char *buffer, int64_t length, int64_t offset);
+
+    int64_t pwrite(const char *buffer, int64_t length, int64_t offset);
+
     void flush();
 
     int64_t seek(int64_t pos, int mode);
@@ -52,6 +68,9 @@ public:
 
     int64_t remaining();
 
+    /* make the positional I/O see the data of the streams */
+    void syncStreams(bool isWrite);
+
     FileId getFileId();
 
     void getFileInfo(GWFileInfo *fileInfo);
@@ -67,6 +86,8 @@ private:
     shared_ptr<FileActiveStatus> mStatus;
     shared_ptr<OutputStream> mOutStream;
     shared_ptr<InputStream> mInStream;
+    shared_ptr<PositionalStream> mPositionalStream;
+    std::mutex mStreamMutex;
 };
 
 }
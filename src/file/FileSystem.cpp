@@ -20,17 +20,20 @@
  * limitations under the License.
  */
 #include "file/FileSystem.h"
+#include "block/AlignedBufferPool.h"
+#include "block/IoEngine.h"
+#include "block/OssTransferPolicy.h"
 #include "common/Configuration.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
 #include "common/Hash.h"
 #include "common/OssBuilder.h"
+#include "common/OssContextPool.h"
 #include <fstream>
 
 namespace Gopherwood {
 namespace Internal {
 
-ossContext FileSystem::OSS_CONTEXT = NULL;
 std::string FileSystem::OSS_BUCKET = "";
 
 void FileSystem::Format(const char *workDir) {
@@ -48,11 +51,20 @@ FileSystem::FileSystem(const char *workDir) :
     std::stringstream ss;
     ss << workDir << '/' << Configuration::LOCAL_SPACE_FILE;
     std::string filePath = ss.str();
+    int openFlags = Configuration::LOCAL_DIRECT_IO ? O_DIRECT : 0;
     if( access(filePath.c_str(), F_OK ) != -1 ) {
-        mLocalSpaceFile = open(filePath.c_str(), O_RDWR, 0644);
+        mLocalSpaceFile = open(filePath.c_str(), O_RDWR | openFlags, 0644);
     } else {
+        mLocalSpaceFile = open(filePath.c_str(), O_CREAT | O_RDWR | openFlags, 0644);
+    }
+    if (mLocalSpaceFile == -1 && openFlags && errno == EINVAL) {
+        /* e.g. tmpfs does not support direct I/O */
+        LOG(WARNING, "[FileSystem]            |"
+                "O_DIRECT is not supported for %s, use buffered I/O", filePath.c_str());
         mLocalSpaceFile = open(filePath.c_str(), O_CREAT | O_RDWR, 0644);
     }
+    checkDirectIo();
+    preallocateLocalSpace();
 
     /* create lock file */
     ss.str("");
@@ -70,6 +82,7 @@ FileSystem::FileSystem(const char *workDir) :
     }
 
     mSharedMemoryContext = SharedMemoryManager::getInstance()->buildSharedMemoryContext(workDir, lockFile);
+    mSharedMemoryContext->setLocalSpaceFD(mLocalSpaceFile);
     mActiveStatusContext = shared_ptr<ActiveStatusContext>(new ActiveStatusContext(mSharedMemoryContext));
 
     /* init liboss context */
@@ -77,10 +90,52 @@ FileSystem::FileSystem(const char *workDir) :
 
     /* init AdminActiveStatus */
     mAdminActiveStatus = shared_ptr<AdminActiveStatus>(new AdminActiveStatus(mSharedMemoryContext, mLocalSpaceFile));
+
+    /* start the background cleaner */
+    if (Configuration::BUCKET_CLEANER_LOW_WATERMARK > 0) {
+        mBucketCleaner = shared_ptr<BucketCleaner>(new BucketCleaner(mSharedMemoryContext, mLocalSpaceFile));
+    }
+}
+
+/* bucket boundaries must be aligned, so that only the ends of a request need a bounce buffer */
+void FileSystem::checkDirectIo() {
+    int64_t alignment = IoEngine::getDirectIoAlignment(mLocalSpaceFile);
+    if (alignment == 0) {
+        return;
+    }
+
+    if (alignment > DIRECT_IO_MAX_ALIGNMENT || Configuration::LOCAL_BUCKET_SIZE % alignment != 0) {
+        THROW(GopherwoodInvalidParmException,
+              "[FileSystem::checkDirectIo] bucket size %ld is not aligned to the direct I/O alignment %ld",
+              Configuration::LOCAL_BUCKET_SIZE, alignment);
+    }
+    LOG(INFO, "[FileSystem]            |"
+            "Local space file uses direct I/O, alignment=%ld", alignment);
+}
+
+/* allocate all buckets up front, so the extents are contiguous and the
+ * first write to a bucket does not allocate */
+void FileSystem::preallocateLocalSpace() {
+    if (!Configuration::LOCAL_PREALLOCATE) {
+        return;
+    }
+
+    int64_t size = (int64_t) Configuration::NUMBER_OF_BLOCKS * Configuration::LOCAL_BUCKET_SIZE;
+    if (fallocate(mLocalSpaceFile, 0, 0, size) == -1) {
+        /* not fatal, the local space file stays sparse */
+        LOG(WARNING, "[FileSystem]            |"
+                "Preallocate %ld bytes of local space failed, errno=%d", size, errno);
+        return;
+    }
+    LOG(INFO, "[FileSystem]            |"
+            "Preallocated %ld bytes of local space", size);
 }
 
+/* a bad OSS configuration fails the mount rather than the first eviction,
+ * the context is kept warm in the pool for it */
 void FileSystem::initOssContext() {
-    OSS_CONTEXT = ossRootBuilder.buildContext();
+    shared_ptr<OssContextPool> pool = OssContextPool::getInstance();
+    pool->release(pool->acquire());
     OSS_BUCKET = ossRootBuilder.getBucketName();
 }
 
@@ -159,6 +214,7 @@ void FileSystem::DeleteFile(const char *fileName) {
 
 void FileSystem::getStatistics(GWSysInfo* sysInfo) {
     mAdminActiveStatus->getShareMemStatistic(sysInfo);
+    OssTransferPolicy::getInstance()->getStatistics(sysInfo);
 }
 
 int32_t FileSystem::preEvictNumOfBlocks(int num) {
@@ -167,6 +223,8 @@ int32_t FileSystem::preEvictNumOfBlocks(int num) {
 
 
 FileSystem::~FileSystem() {
+    /* the cleaner uploads from the local space file */
+    mBucketCleaner.reset();
     if (mLocalSpaceFile > 0) {
         close(mLocalSpaceFile);
         mLocalSpaceFile = -1;
@@ -30,6 +30,7 @@
 #include "core/SharedMemoryManager.h"
 #include "core/SharedMemoryContext.h"
 #include "core/AdminActiveStatus.h"
+#include "core/BucketCleaner.h"
 #include "file/File.h"
 #include "oss/oss.h"
 
@@ -40,8 +41,6 @@ class FileSystem {
 public:
     static void Format(const char *workDir);
 
-    static ossContext OSS_CONTEXT;
-
     static std::string OSS_BUCKET;
 
     FileSystem(const char *workDir);
@@ -65,12 +64,15 @@ public:
 private:
     FileId makeFileId(const std::string filePath);
     void initOssContext();
+    void checkDirectIo();
+    void preallocateLocalSpace();
 
     int32_t mLocalSpaceFile = -1;
     const char *workDir;
     shared_ptr<SharedMemoryContext> mSharedMemoryContext;
     shared_ptr<ActiveStatusContext> mActiveStatusContext;
     shared_ptr<AdminActiveStatus> mAdminActiveStatus;
+    shared_ptr<BucketCleaner> mBucketCleaner;
 };
 
 }
@@ -20,6 +20,12 @@
  * limitations under the License.
  */
 #include "file/InputStream.h"
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+
+#include <algorithm>
+#include <sys/mman.h>
 
 namespace Gopherwood {
 namespace Internal {
@@ -27,53 +33,265 @@ namespace Internal {
 InputStream::InputStream(int fd, shared_ptr<FileActiveStatus> status) :
         mLocalSpaceFD(fd), mStatus(status) {
     mPos = 0;
-    mBlockInputStream = shared_ptr<BlockInputStream>(new BlockInputStream(mLocalSpaceFD));
+    mLoadingBlockId = InvalidBlockId;
+    mBlockInputStream = shared_ptr<BlockInputStream>(new BlockInputStream(mLocalSpaceFD, status->isSequence()));
 }
 
-void InputStream::updateBlockStream() {
-    /* TODO: Implement this once we make BlockOutput stream a buffered stream */
-    mBlockInputStream->flush();
+/* A remote block is loaded from the pages of the read on, the read goes on
+ * with the loading block pinned once they are loaded */
+void InputStream::updateBlockStream(int64_t length) {
+    /* File flushes the combining buffer of the OutputStream before any read,
+     * the bucket holds everything written through this handle */
+    releaseLoadingBlock();
 
-    /* Update the BlockInfo of the BlockOutputStream */
-    mBlockInputStream->setBlockInfo(mStatus->getCurBlockInfo());
+    /* Update the BlockInfo of the BlockInputStream, the readable data
+     * of the block ends at the file Eof */
+    bool pinned = false;
+    BlockInfo info = mStatus->getCurBlockInfo(length, &pinned);
+    int64_t blockStart = mStatus->getPosition() - info.offset;
+    info.dataSize = std::min(Configuration::LOCAL_BUCKET_SIZE, mStatus->getEof() - blockStart);
+    if (pinned) {
+        /* no read-ahead past the pages loaded so far */
+        info.dataSize = std::min(info.dataSize, info.offset + length);
+        mLoadingBlockId = info.blockId;
+    }
+    mBlockInputStream->setBlockInfo(info);
 
     /* Update the position*/
     mPos = mStatus->getPosition();
 }
 
+void InputStream::releaseLoadingBlock() {
+    if (mLoadingBlockId != InvalidBlockId) {
+        int blockId = mLoadingBlockId;
+        mLoadingBlockId = InvalidBlockId;
+        mStatus->unpinBlock(blockId);
+    }
+}
+
 void InputStream::read(char *buffer, int64_t length) {
     int64_t bytesToRead = length;
     int64_t bytesRead = 0;
     bool needUpdate = true;
 
-    /* write the buffer, switch target block if needed */
-    while (bytesToRead > 0) {
-        /* update BlockOutputStream, flush previous cached data
-         * and switch to target block id & offset */
-        if (needUpdate) {
-            updateBlockStream();
-            needUpdate = false;
+    try {
+        /* write the buffer, switch target block if needed */
+        while (bytesToRead > 0) {
+            /* update BlockOutputStream, flush previous cached data
+             * and switch to target block id & offset */
+            if (needUpdate) {
+                updateBlockStream(bytesToRead);
+                needUpdate = false;
+            }
+
+            /* write to target block */
+            int64_t read;
+            if (bytesToRead <= mBlockInputStream->remaining()) {
+                read = mBlockInputStream->read(buffer + bytesRead, bytesToRead);
+            } else {
+                read = mBlockInputStream->read(buffer + bytesRead, mBlockInputStream->remaining());
+                needUpdate = true;
+            }
+
+            /* update statistics */
+            bytesToRead -= read;
+            bytesRead += read;
+            mPos += read;
+            mStatus->setPosition(mPos);
+        }
+    } catch (...) {
+        releaseLoadingBlock();
+        throw;
+    }
+    releaseLoadingBlock();
+}
+
+void InputStream::readv(const struct iovec *iov, int iovcnt, int64_t length) {
+    IovecCursor cursor(iov, iovcnt);
+    std::vector<struct iovec> slice;
+    int64_t bytesToRead = length;
+
+    try {
+        while (bytesToRead > 0) {
+            updateBlockStream(bytesToRead);
+
+            /* the part of the list in this block */
+            int64_t blockBytes = std::min(bytesToRead, mBlockInputStream->remaining());
+            while (blockBytes > 0) {
+                int64_t sliceBytes = cursor.next(blockBytes, slice);
+                int64_t read = mBlockInputStream->readv(slice.data(), slice.size(), sliceBytes);
+                if (read != sliceBytes) {
+                    THROW(GopherwoodIOException,
+                          "[InputStream::readv] read %ld bytes, expect %ld", read, sliceBytes);
+                }
+                blockBytes -= read;
+                bytesToRead -= read;
+                mPos += read;
+            }
+
+            /* the position moves once per block */
+            mStatus->setPosition(mPos);
+        }
+    } catch (...) {
+        releaseLoadingBlock();
+        throw;
+    }
+    releaseLoadingBlock();
+}
+
+bool InputStream::preadBatch(GWReadRequest *requests, int num) {
+    int64_t bucketSize = Configuration::LOCAL_BUCKET_SIZE;
+    int64_t eof = mStatus->getEof();
+    std::vector<BatchPiece> pieces;
+    bool success = true;
+
+    /* cut the requests at block boundaries, nothing is read past Eof */
+    for (int i = 0; i < num; i++) {
+        GWReadRequest &req = requests[i];
+        if (req.offset < 0 || req.length < 0 || (req.length > 0 && req.buffer == NULL)) {
+            req.result = -1;
+            success = false;
+            continue;
+        }
+        req.result = 0;
+
+        int64_t end = std::min(req.offset + req.length, eof);
+        for (int64_t pos = req.offset; pos < end;) {
+            BatchPiece piece;
+            piece.request = i;
+            piece.blockId = pos / bucketSize;
+            piece.blockOffset = pos % bucketSize;
+            piece.buffer = (char *) req.buffer + (pos - req.offset);
+            piece.length = std::min(end - pos, bucketSize - piece.blockOffset);
+            piece.result = 0;
+            pieces.push_back(piece);
+            pos += piece.length;
+        }
+    }
+    std::stable_sort(pieces.begin(), pieces.end());
+
+    std::vector<int> blockIds;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        if (blockIds.empty() || blockIds.back() != pieces[i].blockId) {
+            blockIds.push_back(pieces[i].blockId);
+        }
+    }
+
+    /* activate the blocks in groups that fit in the quota, leaving a bucket
+     * for the blocks being loaded */
+    size_t groupSize = std::max(1, mStatus->getCurQuota() - 1);
+    size_t next = 0;
+    for (size_t first = 0; first < blockIds.size(); first += groupSize) {
+        std::vector<int> group(blockIds.begin() + first,
+                               blockIds.begin() + std::min(first + groupSize, blockIds.size()));
+        mStatus->activateBlocks(group);
+
+        for (int blockId : group) {
+            mBlockInputStream->setBlockInfo(mStatus->getBlockInfo(blockId));
+
+            std::vector<IoRequest> ioRequests;
+            size_t begin = next;
+            while (next < pieces.size() && pieces[next].blockId == blockId) {
+                BatchPiece &piece = pieces[next];
+                ioRequests.push_back(IoRequest(IoRead, piece.buffer, piece.length, piece.blockOffset));
+                next++;
+            }
+            mBlockInputStream->readBatch(ioRequests);
+
+            for (size_t i = 0; i < ioRequests.size(); i++) {
+                pieces[begin + i].result = ioRequests[i].result;
+            }
         }
+    }
 
-        /* write to target block */
-        int64_t read;
-        if (bytesToRead <= mBlockInputStream->remaining()) {
-            read = mBlockInputStream->read(buffer + bytesRead, bytesToRead);
+    /* the pieces of a request come in file order, a request ends at its
+     * first short piece. Bytes past it are not counted */
+    std::vector<bool> ended(num, false);
+    for (BatchPiece &piece : pieces) {
+        GWReadRequest &req = requests[piece.request];
+        if (req.result < 0 || ended[piece.request]) {
+            continue;
+        }
+        if (piece.result < 0) {
+            LOG(LOG_ERROR, "[InputStream]           |"
+                    "Batched read of block %d failed, offset=%ld, length=%ld, errno=%ld",
+                piece.blockId, piece.blockOffset, piece.length, -piece.result);
+            req.result = -1;
+            success = false;
         } else {
-            read = mBlockInputStream->read(buffer + bytesRead, mBlockInputStream->remaining());
-            needUpdate = true;
+            req.result += piece.result;
+            ended[piece.request] = piece.result < piece.length;
         }
+    }
+
+    return success;
+}
+
+int64_t InputStream::readZeroCopy(const char **buffer, int64_t length) {
+    int64_t bucketSize = Configuration::LOCAL_BUCKET_SIZE;
+    BlockInfo info = mStatus->pinCurBlock();
+    int64_t bytesToRead = std::min(length, bucketSize - info.offset);
+
+    /* mmap offsets must be page aligned, map from the page holding the first byte */
+    int64_t pageSize = sysconf(_SC_PAGESIZE);
+    int64_t fileOffset = info.bucketId * bucketSize + info.offset;
+    int64_t mapOffset = fileOffset / pageSize * pageSize;
+    size_t mapLength = fileOffset + bytesToRead - mapOffset;
+    void *addr = mmap(NULL, mapLength, PROT_READ, MAP_SHARED, mLocalSpaceFD, mapOffset);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        mStatus->unpinBlock(info.blockId);
+        THROW(GopherwoodIOException,
+              "[InputStream::readZeroCopy] mmap bucket %d failed, offset=%ld, length=%ld, errno=%d",
+              info.bucketId, mapOffset, mapLength, err);
+    }
 
-        /* update statistics */
-        bytesToRead -= read;
-        bytesRead += read;
-        mPos += read;
-        mStatus->setPosition(mPos);
+    ZeroCopyRegion region;
+    region.mapAddr = addr;
+    region.mapLength = mapLength;
+    region.blockId = info.blockId;
+    *buffer = (const char *) addr + (fileOffset - mapOffset);
+    mZeroCopyRegions[*buffer] = region;
+
+    mPos = mStatus->getPosition() + bytesToRead;
+    mStatus->setPosition(mPos);
+    return bytesToRead;
+}
+
+void InputStream::releaseZeroCopy(const char *buffer) {
+    std::map<const char *, ZeroCopyRegion>::iterator it = mZeroCopyRegions.find(buffer);
+    if (it == mZeroCopyRegions.end()) {
+        THROW(GopherwoodInvalidParmException,
+              "[InputStream::releaseZeroCopy] %p is not a zero copy buffer of this file", buffer);
     }
+    ZeroCopyRegion region = it->second;
+    mZeroCopyRegions.erase(it);
+
+    unmapRegion(region);
+    mStatus->unpinBlock(region.blockId);
 }
 
-void InputStream::close() {
+void InputStream::invalidate() {
+    mBlockInputStream->invalidate();
+}
 
+void InputStream::getStatistics(GWFileInfo *fileInfo) {
+    mBlockInputStream->getStatistics(fileInfo);
+}
+
+void InputStream::unmapRegion(ZeroCopyRegion &region) {
+    if (munmap(region.mapAddr, region.mapLength) == -1) {
+        LOG(WARNING, "[InputStream]           |"
+                "munmap zero copy region of block %d failed, errno=%d", region.blockId, errno);
+    }
+}
+
+void InputStream::close() {
+    /* the pins have been dropped by closing the ActiveStatus */
+    for (std::pair<const char *const, ZeroCopyRegion> &it : mZeroCopyRegions) {
+        unmapRegion(it.second);
+    }
+    mZeroCopyRegions.clear();
 }
 
 InputStream::~InputStream() {
@@ -25,10 +25,13 @@
 #include "platform.h"
 
 #include "block/BlockInputStream.h"
+#include "block/IovecCursor.h"
 #include "common/Memory.h"
 #include "core/FileActiveStatus.h"
 #include "oss/oss.h"
 
+#include <map>
+
 namespace Gopherwood {
 namespace Internal {
 
@@ -38,17 +41,64 @@ public:
 
     void read(char *buffer, int64_t length);
 
+    /* read length bytes into the list, one preadv per block */
+    void readv(const struct iovec *iov, int iovcnt, int64_t length);
+
+    /* read the ranges block by block, the position is not used.
+     * Returns false if any request failed */
+    bool preadBatch(GWReadRequest *requests, int num);
+
+    /* map the bytes at the current position, stops at the block end */
+    int64_t readZeroCopy(const char **buffer, int64_t length);
+
+    void releaseZeroCopy(const char *buffer);
+
+    /* this handle has written the file, the read-ahead data may be stale */
+    void invalidate();
+
+    void getStatistics(GWFileInfo *fileInfo);
+
     void close();
 
     ~InputStream();
 
 private:
-    void updateBlockStream();
+    /* an mmap of a pinned block range handed out by readZeroCopy */
+    typedef struct ZeroCopyRegion {
+        void *mapAddr;
+        size_t mapLength;
+        int blockId;
+    } ZeroCopyRegion;
+
+    /* the part of a batched read request inside one block */
+    typedef struct BatchPiece {
+        int request;
+        int blockId;
+        int64_t blockOffset;
+        char *buffer;
+        int64_t length;
+        /* bytes read, -1 on error */
+        int64_t result;
+
+        bool operator<(const BatchPiece &other) const {
+            return blockId < other.blockId ||
+                   (blockId == other.blockId && blockOffset < other.blockOffset);
+        }
+    } BatchPiece;
+
+    /* switch to the block at the position for a read of length bytes */
+    void updateBlockStream(int64_t length);
+    /* unpin the loading block the last read went on with */
+    void releaseLoadingBlock();
+    void unmapRegion(ZeroCopyRegion &region);
 
     int mLocalSpaceFD;
     shared_ptr<FileActiveStatus> mStatus;
     shared_ptr<BlockInputStream> mBlockInputStream;
     int64_t mPos;
+    /* the loading block pinned for the current read, or InvalidBlockId */
+    int mLoadingBlockId;
+    std::map<const char *, ZeroCopyRegion> mZeroCopyRegions;
 };
 
 }
@@ -19,6 +19,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "common/Configuration.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
 #include "file/OutputStream.h"
@@ -29,11 +30,19 @@ namespace Internal {
 OutputStream::OutputStream(int fd, shared_ptr<FileActiveStatus> status) :
         mLocalSpaceFD(fd), mStatus(status) {
     mPos = 0;
-    mBlockOutputStream = shared_ptr<BlockOutputStream>(new BlockOutputStream(mLocalSpaceFD));
+    mNeedUpdate = true;
+    /* only sequential writers combine writes, others see every gwWrite in the local space at once */
+    int64_t bufferSize = status->isSequence() ? Configuration::WRITE_BUFFER_SIZE : 0;
+    mBuffered = bufferSize > 0;
+    mBlockOutputStream = shared_ptr<BlockOutputStream>(new BlockOutputStream(mLocalSpaceFD, bufferSize));
 }
 
 void OutputStream::updateBlockStream() {
-    mBlockOutputStream->flush();
+    /* no sync on block switch, the dirty ranges are synced by flush */
+    mBlockOutputStream->flushBuffer();
+
+    /* the Eof of the previous block must be published before a new block is extended */
+    mStatus->publishEof();
 
     /* Update the BlockInfo of the BlockOutputStream */
     mBlockOutputStream->setBlockInfo(mStatus->getCurBlockInfo());
@@ -45,7 +54,8 @@ void OutputStream::updateBlockStream() {
 void OutputStream::write(const char *buffer, int64_t length, bool isSeek) {
     int64_t bytesToWrite = length;
     int64_t bytesWritten = 0;
-    bool needUpdate = true;
+    /* keep writing to the current block unless the position has been moved by others */
+    bool needUpdate = mNeedUpdate || mPos != mStatus->getPosition();
 
     /* write the buffer, switch target block if needed */
     while (bytesToWrite > 0) {
@@ -85,16 +95,74 @@ void OutputStream::write(const char *buffer, int64_t length, bool isSeek) {
         bytesToWrite -= written;
         bytesWritten += written;
         mPos += written;
-        mStatus->setPosition(mPos);
+        if (mBuffered) {
+            mStatus->setBufferedPosition(mPos);
+        } else {
+            mStatus->setPosition(mPos);
+        }
+    }
+
+    /* a seek skips the block stream, its offset is stale now */
+    mNeedUpdate = needUpdate || isSeek;
+}
+
+void OutputStream::writev(const struct iovec *iov, int iovcnt, int64_t length) {
+    IovecCursor cursor(iov, iovcnt);
+    std::vector<struct iovec> slice;
+    int64_t bytesToWrite = length;
+    bool needUpdate = mNeedUpdate || mPos != mStatus->getPosition();
+
+    while (bytesToWrite > 0) {
+        if (needUpdate) {
+            updateBlockStream();
+            needUpdate = false;
+        }
+
+        /* the part of the list in this block */
+        int64_t blockBytes = bytesToWrite;
+        if (bytesToWrite > mBlockOutputStream->remaining()) {
+            blockBytes = mBlockOutputStream->remaining();
+            needUpdate = true;
+        }
+        while (blockBytes > 0) {
+            int64_t sliceBytes = cursor.next(blockBytes, slice);
+            int64_t written = mBlockOutputStream->writev(slice.data(), slice.size(), sliceBytes);
+            if (written != sliceBytes) {
+                THROW(GopherwoodIOException,
+                      "[OutputStream::writev] wrote %ld bytes, expect %ld", written, sliceBytes);
+            }
+            blockBytes -= written;
+            bytesToWrite -= written;
+            mPos += written;
+        }
+
+        /* the position and Eof move once per block */
+        if (mBuffered) {
+            mStatus->setBufferedPosition(mPos);
+        } else {
+            mStatus->setPosition(mPos);
+        }
     }
+
+    mNeedUpdate = needUpdate;
+}
+
+void OutputStream::flushBuffer() {
+    mBlockOutputStream->flushBuffer();
+    mStatus->publishEof();
 }
 
 void OutputStream::flush() {
     mBlockOutputStream->flush();
+    mStatus->publishEof();
 }
 
-void OutputStream::close() {
-    mBlockOutputStream->flush();
+void OutputStream::close(bool isCancel) {
+    if (isCancel) {
+        mBlockOutputStream->discardBuffer();
+    } else {
+        flush();
+    }
 }
 
 
@@ -25,6 +25,7 @@
 #include "platform.h"
 
 #include "block/BlockOutputStream.h"
+#include "block/IovecCursor.h"
 #include "common/Memory.h"
 #include "core/FileActiveStatus.h"
 #include "oss/oss.h"
@@ -37,9 +38,16 @@ public:
 
     void write(const char *buffer, int64_t length, bool isSeek);
 
+    /* write length bytes of the list, one pwritev per block */
+    void writev(const struct iovec *iov, int iovcnt, int64_t length);
+
+    /* write out the combined data and publish the Eof, before the
+     * position moves or the file is read through the same handle */
+    void flushBuffer();
+
     void flush();
 
-    void close();
+    void close(bool isCancel);
 
     ~OutputStream();
 
@@ -50,6 +58,8 @@ private:
     shared_ptr<BlockOutputStream> mBlockOutputStream;
     shared_ptr<FileActiveStatus> mStatus;
     int64_t mPos;
+    bool mNeedUpdate;
+    bool mBuffered;
 };
 
 }
@@ -0,0 +1,132 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "file/PositionalStream.h"
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "common/Logger.h"
+
+namespace Gopherwood {
+namespace Internal {
+
+PositionalStream::PositionalStream(int fd, shared_ptr<FileActiveStatus> status) :
+        mLocalSpaceFD(fd), mStatus(status), mDirty(false) {
+    mBucketSize = Configuration::LOCAL_BUCKET_SIZE;
+    /* the sync engine keeps no per request state, unlike the queued engines */
+    mIoEngine = IoEngine::create(fd, IO_ENGINE_SYNC, 1);
+    mLocalReader = shared_ptr<LocalBlockReader>(new LocalBlockReader(mIoEngine));
+    mLocalWriter = shared_ptr<LocalBlockWriter>(new LocalBlockWriter(mIoEngine));
+}
+
+int64_t PositionalStream::pread(char *buffer, int64_t length, int64_t offset) {
+    if (offset < 0 || length < 0) {
+        THROW(GopherwoodInvalidParmException,
+              "[PositionalStream::pread] invalid offset %ld or length %ld", offset, length);
+    }
+
+    int64_t end = std::min(offset + length, mStatus->getEofLocked());
+    int64_t pos = offset;
+
+    while (pos < end) {
+        int blockId = pos / mBucketSize;
+        int64_t blockOffset = pos % mBucketSize;
+        int64_t bytes = std::min(end - pos, mBucketSize - blockOffset);
+
+        BlockInfo info = mStatus->pinBlock(blockId, false, blockOffset, bytes);
+        int64_t read;
+        try {
+            LOG(DEBUG1, "[PositionalStream]      |"
+                    "Pread from local space, bucketId=%d, offset=%ld, length=%ld",
+                info.bucketId, blockOffset, bytes);
+            read = mLocalReader->readLocal(buffer + (pos - offset), bytes, info.bucketId * mBucketSize + blockOffset);
+        } catch (...) {
+            mStatus->unpinBlock(blockId);
+            throw;
+        }
+        mStatus->unpinBlock(blockId);
+
+        if (read != bytes) {
+            THROW(GopherwoodIOException,
+                  "[PositionalStream::pread] read %ld bytes, expect %ld", read, bytes);
+        }
+        pos += bytes;
+    }
+
+    return pos > offset ? pos - offset : 0;
+}
+
+int64_t PositionalStream::pwrite(const char *buffer, int64_t length, int64_t offset) {
+    if (offset < 0 || length < 0) {
+        THROW(GopherwoodInvalidParmException,
+              "[PositionalStream::pwrite] invalid offset %ld or length %ld", offset, length);
+    }
+
+    int64_t end = offset + length;
+    int64_t pos = offset;
+
+    while (pos < end) {
+        int blockId = pos / mBucketSize;
+        int64_t blockOffset = pos % mBucketSize;
+        int64_t bytes = std::min(end - pos, mBucketSize - blockOffset);
+
+        /* the Eof is moved while the block is still pinned, so it is published
+         * to the bucket that holds the data */
+        BlockInfo info = mStatus->pinBlock(blockId, true);
+        try {
+            LOG(DEBUG1, "[PositionalStream]      |"
+                    "Pwrite to local space, bucketId=%d, offset=%ld, length=%ld",
+                info.bucketId, blockOffset, bytes);
+            int64_t written = mLocalWriter->writeLocal(buffer + (pos - offset), bytes,
+                                                       info.bucketId * mBucketSize + blockOffset);
+            if (written != bytes) {
+                THROW(GopherwoodIOException,
+                      "[PositionalStream::pwrite] wrote %ld bytes, expect %ld", written, bytes);
+            }
+            mDirty = true;
+            mStatus->updateEof(pos + bytes);
+        } catch (...) {
+            mStatus->unpinBlock(blockId);
+            throw;
+        }
+        mStatus->unpinBlock(blockId);
+        pos += bytes;
+    }
+
+    return length;
+}
+
+void PositionalStream::flush() {
+    if (!mDirty.exchange(false)) {
+        return;
+    }
+
+    if (Configuration::LOCAL_SYNC_POLICY != LOCAL_SYNC_NONE) {
+        mLocalWriter->sync();
+    }
+}
+
+PositionalStream::~PositionalStream() {
+
+}
+
+}
+}
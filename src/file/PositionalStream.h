@@ -0,0 +1,71 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _GOPHERWOOD_FILE_POSITIONALSTREAM_H_
+#define _GOPHERWOOD_FILE_POSITIONALSTREAM_H_
+
+#include "platform.h"
+
+#include "block/LocalBlockReader.h"
+#include "block/LocalBlockWriter.h"
+#include "common/Memory.h"
+#include "core/FileActiveStatus.h"
+
+#include <atomic>
+
+namespace Gopherwood {
+namespace Internal {
+
+/**
+ * Positional reads and writes of a file, they neither use nor move the
+ * position. Unlike InputStream/OutputStream, several threads may call them
+ * concurrently on one handle: each block is pinned in the ActiveStatus for
+ * the duration of its I/O, which runs outside of any lock on a stateless
+ * sync IoEngine shared by the threads.
+ */
+class PositionalStream {
+public:
+    PositionalStream(int fd, shared_ptr<FileActiveStatus> status);
+
+    int64_t pread(char *buffer, int64_t length, int64_t offset);
+
+    int64_t pwrite(const char *buffer, int64_t length, int64_t offset);
+
+    /* sync the positional writes as LOCAL_SYNC_POLICY says */
+    void flush();
+
+    ~PositionalStream();
+
+private:
+    int mLocalSpaceFD;
+    int64_t mBucketSize;
+    shared_ptr<FileActiveStatus> mStatus;
+    shared_ptr<IoEngine> mIoEngine;
+    shared_ptr<LocalBlockReader> mLocalReader;
+    shared_ptr<LocalBlockWriter> mLocalWriter;
+    /* positional writes are not tracked by range, flush syncs the whole file */
+    std::atomic<bool> mDirty;
+};
+
+}
+}
+
+#endif //_GOPHERWOOD_FILE_POSITIONALSTREAM_H_
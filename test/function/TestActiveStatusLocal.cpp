@@ -23,8 +23,13 @@
 #include "common/DateTime.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
+#include "core/SharedMemoryObj.h"
 #include "gtest/gtest.h"
 
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+
 using namespace Gopherwood;
 using namespace Gopherwood::Internal;
 
@@ -66,6 +71,26 @@ TEST_F(TestActiveStatusLocal, TestFormatContext) {
     ASSERT_NO_THROW(gwFormatContext(workDir));
 }
 
+/* a SharedMem of another layout is not attached to */
+TEST_F(TestActiveStatusLocal, TestLayoutMismatch) {
+    int shmFD = open("/dev/shm/GopherwoodSharedMem", O_RDWR);
+    ASSERT_NE(-1, shmFD);
+    uint16_t version = 0;
+    ASSERT_EQ(2, pwrite(shmFD, &version, 2, offsetof(ShareMemHeader, layoutVersion)));
+
+    GWContextConfig config;
+    config.blockSize = 10;
+    config.numBlocks = 50;
+    config.numPreDefinedConcurrency = 10;
+    config.severity = LOGSEV_INFO;
+    ASSERT_TRUE(gwCreateContext(workDir, &config) == NULL);
+    ASSERT_TRUE(strstr(gwGetLastError(), "layout version") != NULL);
+
+    version = SHARED_MEMORY_LAYOUT_VERSION;
+    ASSERT_EQ(2, pwrite(shmFD, &version, 2, offsetof(ShareMemHeader, layoutVersion)));
+    close(shmFD);
+}
+
 /* test read while the file is writing by another activeStatus */
 TEST_F(TestActiveStatusLocal, TestWriteReadConcurrent) {
     char fileName[] = "TestFormatWorkDir/TestWriteReadConcurrent";
@@ -356,4 +381,104 @@ TEST_F(TestActiveStatusLocal, TestAutoFlushTriggerByInactivate) {
     ASSERT_NO_THROW(gwDeleteFile(fs, fileName));
     EXPECT_FALSE(gwFileExists(fs, fileName));
 
-}
\ No newline at end of file
+}
+/* a GW_SEQACC writer combines small writes, others see them after gwFlush */
+TEST_F(TestActiveStatusLocal, TestSequentialWriteBuffer) {
+    char fileName[] = "TestFormatWorkDir/TestSequentialWriteBuffer";
+    char input[] = "abc";
+    char expect[] = "abcabcabcabcabcabcabcXYZcabc";
+
+    gwFile file = NULL;
+    gwFile file1 = NULL;
+    GWFileInfo info;
+    int64_t pos;
+    int len;
+
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_CREAT|GW_RDWR|GW_SEQACC));
+    for (int i=0; i<7; i++) {
+        ASSERT_NO_THROW(len = gwWrite(fs, file, input, 3));
+        EXPECT_EQ(3, len);
+    }
+    ASSERT_NO_THROW(gwStatFile(fs, file, &info));
+    EXPECT_EQ(21, info.fileSize);
+
+    /* the tail is still buffered, another handle only sees the full blocks */
+    ASSERT_NO_THROW(file1 = gwOpenFile(fs, fileName, GW_RDONLY));
+    ASSERT_NO_THROW(gwStatFile(fs, file1, &info));
+    EXPECT_EQ(20, info.fileSize);
+    ASSERT_NO_THROW(gwCloseFile(fs, file1));
+
+    /* reading through the writing handle flushes first */
+    ASSERT_NO_THROW(pos = gwSeek(fs, file, 18, SEEK_SET));
+    EXPECT_EQ(18, pos);
+    ASSERT_NO_THROW(len = gwRead(fs, file, buffer, 3));
+    EXPECT_EQ(3, len);
+    EXPECT_EQ(0, memcmp("abc", buffer, 3));
+
+    /* overwrite across the block boundary, then append */
+    ASSERT_NO_THROW(pos = gwSeek(fs, file, 21, SEEK_SET));
+    ASSERT_NO_THROW(len = gwWrite(fs, file, "XYZ", 3));
+    ASSERT_NO_THROW(len = gwWrite(fs, file, "cabc", 4));
+    ASSERT_NO_THROW(gwFlush(fs, file));
+
+    ASSERT_NO_THROW(file1 = gwOpenFile(fs, fileName, GW_RDONLY));
+    ASSERT_NO_THROW(gwStatFile(fs, file1, &info));
+    EXPECT_EQ(28, info.fileSize);
+    ASSERT_NO_THROW(len = gwRead(fs, file1, buffer, info.fileSize));
+    EXPECT_EQ(28, len);
+    buffer[len] = '\0';
+    EXPECT_STREQ(expect, buffer);
+
+    ASSERT_NO_THROW(gwCloseFile(fs, file1));
+    ASSERT_NO_THROW(gwCloseFile(fs, file));
+    ASSERT_NO_THROW(gwDeleteFile(fs, fileName));
+    EXPECT_FALSE(gwFileExists(fs, fileName));
+}
+
+TEST_F(TestActiveStatusLocal, TestSequentialReadAhead) {
+    char fileName[] = "TestFormatWorkDir/TestSequentialReadAhead";
+    char input[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    gwFile file = NULL;
+    gwFile file1 = NULL;
+    GWFileInfo info;
+    int len;
+
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_CREAT|GW_WRONLY));
+    ASSERT_NO_THROW(len = gwWrite(fs, file, input, 36));
+    ASSERT_NO_THROW(gwCloseFile(fs, file));
+
+    /* byte by byte, each block is read ahead once */
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_RDWR|GW_SEQACC));
+    for (int i=0; i<36; i++) {
+        ASSERT_NO_THROW(len = gwRead(fs, file, buffer + i, 1));
+        EXPECT_EQ(1, len);
+    }
+    EXPECT_EQ(0, memcmp(input, buffer, 36));
+    ASSERT_NO_THROW(gwStatFile(fs, file, &info));
+    EXPECT_EQ(4u, info.numReadAheadMisses);
+    EXPECT_EQ(32u, info.numReadAheadHits);
+
+    /* another handle changes a block, the read ahead data is dropped on block switch */
+    ASSERT_NO_THROW(file1 = gwOpenFile(fs, fileName, GW_WRONLY));
+    ASSERT_NO_THROW(gwSeek(fs, file1, 12, SEEK_SET));
+    ASSERT_NO_THROW(gwWrite(fs, file1, "CD", 2));
+    ASSERT_NO_THROW(gwCloseFile(fs, file1));
+
+    /* random access is read directly, writes through this handle drop the buffer */
+    ASSERT_NO_THROW(gwSeek(fs, file, 5, SEEK_SET));
+    ASSERT_NO_THROW(len = gwRead(fs, file, buffer, 1));
+    EXPECT_EQ('5', buffer[0]);
+    ASSERT_NO_THROW(gwSeek(fs, file, 7, SEEK_SET));
+    ASSERT_NO_THROW(gwWrite(fs, file, "XY", 2));
+    ASSERT_NO_THROW(gwSeek(fs, file, 6, SEEK_SET));
+    ASSERT_NO_THROW(len = gwRead(fs, file, buffer, 8));
+    EXPECT_EQ(8, len);
+    EXPECT_EQ(0, memcmp("6XY9abCD", buffer, 8));
+    ASSERT_NO_THROW(gwStatFile(fs, file, &info));
+    EXPECT_EQ(7u, info.numReadAheadMisses);
+
+    ASSERT_NO_THROW(gwCloseFile(fs, file));
+    ASSERT_NO_THROW(gwDeleteFile(fs, fileName));
+    EXPECT_FALSE(gwFileExists(fs, fileName));
+}
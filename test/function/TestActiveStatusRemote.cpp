@@ -20,6 +20,7 @@
  * limitations under the License.
  */
 #include "client/gopherwood.h"
+#include "common/Configuration.h"
 #include "common/DateTime.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
@@ -127,6 +128,162 @@ TEST_F(TestActiveStatusRemote, TestWriteFileExceedLocalQuota) {
     EXPECT_FALSE(gwFileExists(fs, fileName));
 }
 
+/* Blocks loaded back keep their copy in OSS, evicting them again while they
+ * are clean uploads nothing */
+TEST_F(TestActiveStatusRemote, TestEvictCleanBlock) {
+    char fileName[] = "TestActiveStatusRemote/TestEvictCleanBlock";
+    /* more blocks than buckets, every pass evicts all of them */
+    int fileSize = 40 * 60;
+    std::vector<char> data(fileSize);
+    std::vector<char> out(fileSize);
+    for (int i = 0; i < fileSize; i++) {
+        data[i] = (char) ('a' + i % 26);
+    }
+
+    gwFile file = gwOpenFile(fs, fileName, GW_CREAT|GW_WRONLY|GW_SEQACC);
+    ASSERT_TRUE(file != NULL);
+    ASSERT_EQ(fileSize, gwWrite(fs, file, data.data(), fileSize));
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+
+    file = gwOpenFile(fs, fileName, GW_RDONLY|GW_SEQACC);
+    ASSERT_TRUE(file != NULL);
+    GWFileInfo before, after;
+    for (int pass = 0; pass < 3; pass++) {
+        ASSERT_NO_THROW(gwStatFile(fs, file, &before));
+        ASSERT_EQ(0, gwSeek(fs, file, 0, SEEK_SET));
+        int done = 0;
+        while (done < fileSize) {
+            int len = gwRead(fs, file, out.data() + done, 100);
+            ASSERT_GT(len, 0);
+            done += len;
+        }
+        ASSERT_EQ(data, out);
+        ASSERT_NO_THROW(gwStatFile(fs, file, &after));
+    }
+
+    /* the blocks the writer left dirty are gone after two passes, the last
+     * pass only evicted blocks loaded by the ones before */
+    EXPECT_GT(after.numEvicted, before.numEvicted);
+    EXPECT_EQ(before.numBytesEvicted, after.numBytesEvicted);
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+    EXPECT_FALSE(gwFileExists(fs, fileName));
+}
+
+/* A positional read of a remote block goes on once the pages it needs are
+ * loaded, the rest of the block follows */
+TEST_F(TestActiveStatusRemote, TestPartialFetch) {
+    char fileName[] = "TestActiveStatusRemote/TestPartialFetch";
+    Configuration::OSS_CODEC_CHUNK_SIZE = 8;
+    Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 8;
+    int fileSize = 40 * 60;
+    std::vector<char> data(fileSize);
+    std::vector<char> out(fileSize);
+    for (int i = 0; i < fileSize; i++) {
+        data[i] = (char) ('a' + i % 23);
+    }
+
+    gwFile file = gwOpenFile(fs, fileName, GW_CREAT|GW_WRONLY|GW_SEQACC);
+    ASSERT_TRUE(file != NULL);
+    ASSERT_EQ(fileSize, gwWrite(fs, file, data.data(), fileSize));
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+
+    /* more blocks than buckets, some of them are remote */
+    file = gwOpenFile(fs, fileName, GW_RDONLY);
+    ASSERT_TRUE(file != NULL);
+    GWFileInfo before, after;
+    ASSERT_NO_THROW(gwStatFile(fs, file, &before));
+    for (int blockId = 0; blockId < 60; blockId++) {
+        char small[4];
+        ASSERT_EQ(4, gwPread(fs, file, small, 4, blockId * 40 + 17));
+        ASSERT_EQ(0, memcmp(small, data.data() + blockId * 40 + 17, 4));
+    }
+    ASSERT_NO_THROW(gwStatFile(fs, file, &after));
+    EXPECT_GT(after.numPartialLoads, before.numPartialLoads);
+
+    /* and so does a read at a random position */
+    before = after;
+    for (int blockId = 59; blockId >= 0; blockId -= 3) {
+        char small[4];
+        ASSERT_EQ(blockId * 40 + 29, gwSeek(fs, file, blockId * 40 + 29, SEEK_SET));
+        ASSERT_EQ(4, gwRead(fs, file, small, 4));
+        ASSERT_EQ(0, memcmp(small, data.data() + blockId * 40 + 29, 4));
+    }
+    ASSERT_NO_THROW(gwStatFile(fs, file, &after));
+    EXPECT_GT(after.numPartialLoads, before.numPartialLoads);
+
+    ASSERT_EQ(fileSize, gwPread(fs, file, out.data(), fileSize, 0));
+    ASSERT_EQ(data, out);
+    ASSERT_EQ(0, gwSeek(fs, file, 0, SEEK_SET));
+    std::fill(out.begin(), out.end(), 0);
+    ASSERT_EQ(fileSize, gwRead(fs, file, out.data(), fileSize));
+    ASSERT_EQ(data, out);
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+    EXPECT_FALSE(gwFileExists(fs, fileName));
+    Configuration::OSS_CODEC_CHUNK_SIZE = 1024 * 1024;
+    Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 1024 * 1024;
+}
+
+/* The background cleaner uploads used buckets while they are still local, the
+ * data reads back unchanged and the copies go away with the file */
+TEST_F(TestActiveStatusRemote, TestBackgroundCleaner) {
+    char fileName[] = "TestActiveStatusRemote/TestBackgroundCleaner";
+    int32_t lowWatermark = Configuration::BUCKET_CLEANER_LOW_WATERMARK;
+    int32_t highWatermark = Configuration::BUCKET_CLEANER_HIGH_WATERMARK;
+    int32_t interval = Configuration::BUCKET_CLEANER_INTERVAL;
+    /* keep every used bucket clean */
+    Configuration::BUCKET_CLEANER_LOW_WATERMARK = 100;
+    Configuration::BUCKET_CLEANER_HIGH_WATERMARK = 100;
+    Configuration::BUCKET_CLEANER_INTERVAL = 10;
+
+    /* fits in the local quota of the file */
+    int numBlocks = 5;
+    int fileSize = 40 * numBlocks;
+    std::vector<char> data(fileSize);
+    std::vector<char> out(fileSize);
+    for (int i = 0; i < fileSize; i++) {
+        data[i] = (char) ('a' + i % 26);
+    }
+
+    GWSysInfo before, info;
+    ASSERT_EQ(0, gwGetSysStat(fs, &before));
+    gwFile file = gwOpenFile(fs, fileName, GW_CREAT|GW_WRONLY);
+    ASSERT_TRUE(file != NULL);
+    ASSERT_EQ(fileSize, gwWrite(fs, file, data.data(), fileSize));
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+
+    for (int i = 0; i < 500; i++) {
+        ASSERT_EQ(0, gwGetSysStat(fs, &info));
+        if (info.numCleanBuckets >= before.numCleanBuckets + numBlocks) {
+            break;
+        }
+        usleep(10000);
+    }
+    EXPECT_EQ(before.numCleanBuckets + numBlocks, info.numCleanBuckets);
+    EXPECT_EQ(info.numUsedBuckets, info.numCleanBuckets);
+
+    Configuration::BUCKET_CLEANER_LOW_WATERMARK = lowWatermark;
+    Configuration::BUCKET_CLEANER_HIGH_WATERMARK = highWatermark;
+    Configuration::BUCKET_CLEANER_INTERVAL = interval;
+
+    /* reading does not dirty the buckets */
+    file = gwOpenFile(fs, fileName, GW_RDONLY);
+    ASSERT_TRUE(file != NULL);
+    ASSERT_EQ(fileSize, gwRead(fs, file, out.data(), fileSize));
+    ASSERT_EQ(data, out);
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+    ASSERT_EQ(0, gwGetSysStat(fs, &info));
+    EXPECT_EQ(before.numCleanBuckets + numBlocks, info.numCleanBuckets);
+
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+    EXPECT_FALSE(gwFileExists(fs, fileName));
+    ASSERT_EQ(0, gwGetSysStat(fs, &info));
+    EXPECT_EQ(before.numCleanBuckets, info.numCleanBuckets);
+}
+
 /* some evict bucket are the ending block of a file, the dataSize might smaller
  * than Local_Bucket_Size*/
 TEST_F(TestActiveStatusRemote, TestEvictHalfBucket) {
@@ -0,0 +1,100 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/BlockCodec.h"
+#include "common/Exception.h"
+#include "gtest/gtest.h"
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+static std::vector<char> RoundTrip(shared_ptr<BlockCodec> codec, const std::vector<char> &data) {
+    std::vector<char> compressed(codec->compressBound(data.size()));
+    int64_t length = codec->compress(data.data(), data.size(), compressed.data(), compressed.size());
+    EXPECT_GE(length, 0);
+    compressed.resize(length);
+
+    std::vector<char> out(data.size());
+    EXPECT_EQ((int64_t) data.size(), codec->decompress(compressed.data(), length, out.data(), out.size()));
+    return compressed;
+}
+
+TEST(TestBlockCodec, TestRoundTrip) {
+    shared_ptr<BlockCodec> codec = BlockCodec::create(BLOCK_CODEC_LZ);
+    unsigned int seed = 7;
+    size_t sizes[] = {0, 1, 12, 13, 100, 4096, 70000, 1024 * 1024};
+
+    for (size_t size : sizes) {
+        std::vector<char> text(size);
+        std::vector<char> random(size);
+        std::vector<char> zeros(size, 0);
+        for (size_t i = 0; i < size; i++) {
+            text[i] = "lorem ipsum dolor sit amet, "[i % 28] + (i / 5000) % 3;
+            random[i] = (char) rand_r(&seed);
+        }
+
+        std::vector<char> compressed = RoundTrip(codec, text);
+        if (size >= 4096) {
+            ASSERT_LT(compressed.size() * 5, size);
+        }
+        RoundTrip(codec, random);
+        compressed = RoundTrip(codec, zeros);
+        if (size >= 4096) {
+            ASSERT_LT(compressed.size() * 100, size);
+        }
+    }
+
+    ASSERT_THROW(BlockCodec::create(99), GopherwoodInvalidParmException);
+}
+
+/* decompressed length, -1 when the codec rejects the input */
+static int64_t TryDecompress(shared_ptr<BlockCodec> codec, const char *src, int64_t length,
+                             char *dst, int64_t capacity) {
+    try {
+        return codec->decompress(src, length, dst, capacity);
+    } catch (const GopherwoodIOException &) {
+        return -1;
+    }
+}
+
+/* damaged input must fail or come out short, never write past the output */
+TEST(TestBlockCodec, TestMalformedInput) {
+    shared_ptr<BlockCodec> codec = BlockCodec::create(BLOCK_CODEC_LZ);
+    std::vector<char> data(65536);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (char) (i % 251 + i / 1000);
+    }
+    std::vector<char> compressed(codec->compressBound(data.size()));
+    int64_t length = codec->compress(data.data(), data.size(), compressed.data(), compressed.size());
+
+    std::vector<char> out(data.size() + 16, 'x');
+    for (int64_t cut = 1; cut < length; cut += length / 17 + 1) {
+        /* a cut right behind literals is a valid shorter stream */
+        ASSERT_LT(TryDecompress(codec, compressed.data(), cut, out.data(), data.size()),
+                  (int64_t) data.size());
+        ASSERT_EQ(std::vector<char>(16, 'x'), std::vector<char>(out.end() - 16, out.end()));
+    }
+    ASSERT_THROW(codec->decompress(compressed.data(), length, out.data(), data.size() - 1),
+                 GopherwoodIOException);
+
+    /* too small an output makes compress give up */
+    ASSERT_EQ(-1, codec->compress(data.data(), data.size(), compressed.data(), 10));
+}
@@ -20,11 +20,15 @@
  * limitations under the License.
  */
 #include "client/gopherwood.h"
+#include "common/Configuration.h"
 #include "common/DateTime.h"
 #include "common/Exception.h"
 #include "common/ExceptionInternal.h"
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <thread>
+
 using namespace Gopherwood;
 using namespace Gopherwood::Internal;
 
@@ -96,3 +100,271 @@ TEST_F(TestCInterface, TestOpen_Fail_OpenSecondWrite) {
 }
 
 
+
+TEST_F(TestCInterface, TestReadZeroCopy) {
+    char fileName[] = "TestCInterface/TestReadZeroCopy";
+    char input[] = "0123456789";
+    char expected[120];
+
+    gwFile file = NULL;
+    const void *pinned[2];
+    const void *buffer = NULL;
+    int len;
+
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_CREAT|GW_RDWR));
+    for (int i=0; i<12; i++) {
+        input[0] = 'a' + i;
+        memcpy(expected + i * 10, input, 10);
+        ASSERT_NO_THROW(len = gwWrite(fs, file, input, 10));
+        EXPECT_EQ(10, len);
+    }
+
+    /* a zero copy read stops at the block end */
+    ASSERT_EQ(3, gwSeek(fs, file, 3, SEEK_SET));
+    ASSERT_EQ(7, gwReadZeroCopy(fs, file, &pinned[0], 25));
+    ASSERT_EQ(0, memcmp(expected + 3, pinned[0], 7));
+    ASSERT_EQ(10, gwReadZeroCopy(fs, file, &pinned[1], 25));
+    ASSERT_EQ(0, memcmp(expected + 10, pinned[1], 10));
+
+    /* more blocks than the quota rotate through the LRU, the pinned ones stay */
+    for (int i = 2; i < 12; i++) {
+        ASSERT_EQ(10, gwReadZeroCopy(fs, file, &buffer, 10));
+        ASSERT_EQ(0, memcmp(expected + i * 10, buffer, 10));
+        ASSERT_EQ(0, gwReleaseZeroCopy(fs, file, buffer));
+    }
+    ASSERT_EQ(0, gwReadZeroCopy(fs, file, &buffer, 10));
+    ASSERT_EQ(0, memcmp(expected + 3, pinned[0], 7));
+    ASSERT_EQ(0, memcmp(expected + 10, pinned[1], 10));
+
+    /* pins stop one bucket short of the quota of 5, a pinned block takes no other */
+    const void *more[2];
+    ASSERT_EQ(20, gwSeek(fs, file, 20, SEEK_SET));
+    ASSERT_EQ(10, gwReadZeroCopy(fs, file, &more[0], 10));
+    ASSERT_EQ(10, gwReadZeroCopy(fs, file, &more[1], 10));
+    ASSERT_EQ(-1, gwReadZeroCopy(fs, file, &buffer, 10));
+    ASSERT_EQ(EINVALIDPARM, errno);
+    ASSERT_EQ(35, gwSeek(fs, file, 35, SEEK_SET));
+    ASSERT_EQ(5, gwReadZeroCopy(fs, file, &buffer, 10));
+    ASSERT_EQ(0, gwReleaseZeroCopy(fs, file, buffer));
+    ASSERT_EQ(0, gwReleaseZeroCopy(fs, file, more[0]));
+    ASSERT_EQ(10, gwReadZeroCopy(fs, file, &buffer, 10));
+    ASSERT_EQ(0, memcmp(expected + 40, buffer, 10));
+    ASSERT_EQ(0, gwReleaseZeroCopy(fs, file, buffer));
+    ASSERT_EQ(0, gwReleaseZeroCopy(fs, file, more[1]));
+
+    ASSERT_EQ(0, gwReleaseZeroCopy(fs, file, pinned[0]));
+    ASSERT_EQ(-1, gwReleaseZeroCopy(fs, file, pinned[0]));
+
+    /* outstanding buffers are released by close */
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+}
+
+TEST_F(TestCInterface, TestReadvWritev) {
+    char fileName[] = "TestCInterface/TestReadvWritev";
+    char expected[] = "0123456789abcdefghijklmnopqrstuvwxyzABCD";
+    char out[40];
+
+    gwFile file = NULL;
+    int len;
+
+    /* fragments of all sizes crossing block boundaries, an empty one in between */
+    struct iovec wiov[5] = {{expected, 3}, {expected + 3, 14}, {expected + 17, 0},
+                            {expected + 17, 20}, {expected + 37, 3}};
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_CREAT|GW_RDWR));
+    ASSERT_NO_THROW(len = gwWritev(fs, file, wiov, 5));
+    EXPECT_EQ(40, len);
+
+    memset(out, 0, sizeof(out));
+    struct iovec riov[3] = {{out, 12}, {out + 12, 1}, {out + 13, 30}};
+    ASSERT_EQ(0, gwSeek(fs, file, 0, SEEK_SET));
+    ASSERT_NO_THROW(len = gwReadv(fs, file, riov, 3));
+    EXPECT_EQ(40, len);
+    EXPECT_EQ(0, memcmp(expected, out, 40));
+    EXPECT_EQ(0, gwReadv(fs, file, riov, 3));
+
+    /* overwrite in the middle, the position continues after the list */
+    struct iovec over[2] = {{(void *) "XY", 2}, {(void *) "Z", 1}};
+    ASSERT_EQ(8, gwSeek(fs, file, 8, SEEK_SET));
+    ASSERT_EQ(3, gwWritev(fs, file, over, 2));
+    ASSERT_NO_THROW(len = gwRead(fs, file, out, 2));
+    EXPECT_EQ(0, memcmp("bc", out, 2));
+    ASSERT_EQ(6, gwSeek(fs, file, 6, SEEK_SET));
+    ASSERT_EQ(12, gwReadv(fs, file, riov, 1));
+    EXPECT_EQ(0, memcmp("67XYZbcdefgh", out, 12));
+
+    /* the byte count of the list must fit the result */
+    struct iovec huge[2] = {{out, (size_t) INT32_MAX}, {out, 1}};
+    EXPECT_EQ(-1, gwReadv(fs, file, huge, 2));
+    EXPECT_EQ(EINVAL, errno);
+    EXPECT_EQ(-1, gwWritev(fs, file, huge, 2));
+    EXPECT_EQ(EINVAL, errno);
+
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+}
+
+TEST_F(TestCInterface, TestPreadBatch) {
+    char fileName[] = "TestCInterface/TestPreadBatch";
+    char expected[120];
+    char out[6][30];
+
+    gwFile file = NULL;
+
+    for (int i = 0; i < 120; i++) {
+        expected[i] = 'A' + i % 53;
+    }
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_CREAT|GW_RDWR));
+    ASSERT_EQ(120, gwWrite(fs, file, expected, 120));
+    ASSERT_EQ(17, gwSeek(fs, file, 17, SEEK_SET));
+
+    /* unordered ranges over more blocks than the quota, across block
+     * boundaries, past Eof, and an invalid one */
+    GWReadRequest requests[6] = {{113, out[0], 4, 0}, {2, out[1], 25, 0}, {57, out[2], 3, 0},
+                                 {115, out[3], 20, 0}, {-1, out[4], 5, 0}, {95, out[5], 10, 0}};
+    ASSERT_EQ(-1, gwPreadBatch(fs, file, requests, 6));
+    EXPECT_EQ(4, requests[0].result);
+    EXPECT_EQ(25, requests[1].result);
+    EXPECT_EQ(3, requests[2].result);
+    EXPECT_EQ(5, requests[3].result);
+    EXPECT_EQ(-1, requests[4].result);
+    EXPECT_EQ(10, requests[5].result);
+    for (int i = 0; i < 6; i++) {
+        if (requests[i].result > 0) {
+            EXPECT_EQ(0, memcmp(expected + requests[i].offset, out[i], requests[i].result));
+        }
+    }
+
+    /* the position is not moved */
+    ASSERT_EQ(17, gwSeek(fs, file, 0, SEEK_CUR));
+    ASSERT_EQ(0, gwPreadBatch(fs, file, requests, 4));
+
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+}
+
+TEST_F(TestCInterface, TestPreadPwriteConcurrent) {
+    char fileName[] = "TestCInterface/TestPreadPwriteConcurrent";
+    const int numThreads = 8;
+    const int numRecords = 40;
+    const int recordSize = 4;
+    char expected[numRecords * recordSize];
+    std::atomic<int> numErrors(0);
+
+    gwFile file = NULL;
+
+    for (int i = 0; i < numRecords * recordSize; i++) {
+        expected[i] = 'a' + (i / recordSize) % 26;
+    }
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_CREAT|GW_RDWR));
+
+    /* the records are interleaved over the threads, pinning more blocks than the quota */
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (int r = numRecords - numThreads + t; r >= 0; r -= numThreads) {
+                if (gwPwrite(fs, file, expected + r * recordSize, recordSize, r * recordSize) != recordSize) {
+                    numErrors++;
+                }
+            }
+        }));
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(0, numErrors);
+    ASSERT_EQ(0, gwSeek(fs, file, 0, SEEK_CUR));
+    ASSERT_EQ(numRecords * recordSize, gwSeek(fs, file, 0, SEEK_END));
+
+    threads.clear();
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            char out[recordSize + 1];
+            for (int r = t; r < numRecords; r += numThreads) {
+                int len = gwPread(fs, file, out, recordSize + 1, r * recordSize);
+                int expectLen = r + 1 == numRecords ? recordSize : recordSize + 1;
+                if (len != expectLen || memcmp(expected + r * recordSize, out, len) != 0) {
+                    numErrors++;
+                }
+            }
+        }));
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(0, numErrors);
+
+    /* the streams see the positional writes */
+    char out[numRecords * recordSize];
+    ASSERT_EQ(0, gwSeek(fs, file, 0, SEEK_SET));
+    ASSERT_EQ(numRecords * recordSize, gwRead(fs, file, out, numRecords * recordSize));
+    EXPECT_EQ(0, memcmp(expected, out, numRecords * recordSize));
+    EXPECT_EQ(0, gwPread(fs, file, out, 10, numRecords * recordSize));
+
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+}
+
+/* unaligned records sharing direct I/O blocks, each pwrite reads, modifies and writes back its blocks */
+TEST_F(TestCInterface, TestPreadPwriteConcurrentDirectIo) {
+    char fileName[] = "TestCInterface/TestPreadPwriteConcurrentDirectIo";
+    const int numThreads = 8;
+    const int numRounds = 20;
+    const int recordSize = 100;
+    const int numRecords = 3 * 4096 / recordSize;
+    std::vector<char> expected(numRecords * recordSize);
+    std::atomic<int> numErrors(0);
+
+    /* direct I/O needs aligned buckets */
+    GWContextConfig config;
+    config.blockSize = 4096;
+    config.numBlocks = 16;
+    config.numPreDefinedConcurrency = 10;
+    config.severity = LOGSEV_INFO;
+    ASSERT_EQ(0, gwDestroyContext(fs));
+    gwFormatContext(workDir);
+    Configuration::LOCAL_DIRECT_IO = true;
+    fs = gwCreateContext(workDir, &config);
+    ASSERT_TRUE(fs != NULL);
+
+    gwFile file = NULL;
+    ASSERT_NO_THROW(file = gwOpenFile(fs, fileName, GW_CREAT|GW_RDWR));
+    for (int round = 0; round < numRounds && numErrors == 0; round++) {
+        for (int i = 0; i < numRecords * recordSize; i++) {
+            expected[i] = 'a' + (i / recordSize + round) % 26;
+        }
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.push_back(std::thread([&, t]() {
+                for (int r = t; r < numRecords; r += numThreads) {
+                    if (gwPwrite(fs, file, expected.data() + r * recordSize, recordSize,
+                                 r * recordSize) != recordSize) {
+                        numErrors++;
+                    }
+                }
+            }));
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+
+        /* a lost update shows up as a record of the previous round */
+        std::vector<char> out(numRecords * recordSize);
+        if (gwPread(fs, file, out.data(), out.size(), 0) != (int) out.size() || out != expected) {
+            numErrors++;
+        }
+    }
+    EXPECT_EQ(0, numErrors);
+
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+
+    /* the other tests use the buffered fixture context */
+    ASSERT_EQ(0, gwDestroyContext(fs));
+    Configuration::LOCAL_DIRECT_IO = false;
+    gwFormatContext(workDir);
+    config.blockSize = 10;
+    config.numBlocks = 50;
+    fs = gwCreateContext(workDir, &config);
+}
@@ -0,0 +1,171 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/OssBuilder.h"
+#include "core/EvictPipeline.h"
+#include "file/FileSystem.h"
+#include "gtest/gtest.h"
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+#define NUM_TEST_BUCKETS 8
+
+/* Upload the buckets of a local space file through the pipeline, the blocks
+ * are read back with the OssBlockWorker into a spare bucket */
+class TestEvictPipeline: public ::testing::Test {
+public:
+    TestEvictPipeline() {
+        savedBucketSize = Configuration::LOCAL_BUCKET_SIZE;
+        savedMaxInflight = Configuration::OSS_EVICT_MAX_INFLIGHT;
+        Configuration::LOCAL_BUCKET_SIZE = 4096;
+        Configuration::OSS_EVICT_MAX_INFLIGHT = 4;
+
+        ctx = ossRootBuilder.buildContext();
+        FileSystem::OSS_BUCKET = ossRootBuilder.getBucketName();
+        fd = open("/data/gopherwood/TestEvictPipeline", O_CREAT | O_RDWR | O_TRUNC, 0644);
+        ftruncate(fd, (NUM_TEST_BUCKETS + 1) * Configuration::LOCAL_BUCKET_SIZE);
+        worker = Internal::shared_ptr<OssBlockWorker>(new OssBlockWorker(fd));
+
+        for (int i = 0; i < NUM_TEST_BUCKETS; i++) {
+            BlockInfo info;
+            info.reset();
+            info.fileId.hashcode = 20180402;
+            info.fileId.collisionId = 0;
+            info.blockId = i;
+            info.bucketId = i;
+            info.isLocal = true;
+            info.dataSize = Configuration::LOCAL_BUCKET_SIZE - i;
+            infos.push_back(info);
+
+            std::vector<char> block(info.dataSize, (char) ('a' + i));
+            pwrite(fd, block.data(), block.size(), i * Configuration::LOCAL_BUCKET_SIZE);
+            blocks.push_back(block);
+        }
+    }
+
+    ~TestEvictPipeline() {
+        for (BlockInfo &info : infos) {
+            try {
+                worker->deleteBlock(info);
+            } catch (...) {
+            }
+        }
+        worker.reset();
+        ossDestroyContext(ctx);
+        close(fd);
+        unlink("/data/gopherwood/TestEvictPipeline");
+        Configuration::LOCAL_BUCKET_SIZE = savedBucketSize;
+        Configuration::OSS_EVICT_MAX_INFLIGHT = savedMaxInflight;
+    }
+
+    /* load a block into the spare bucket */
+    std::vector<char> loadBlock(BlockInfo info) {
+        info.bucketId = NUM_TEST_BUCKETS;
+        std::vector<char> loaded(Configuration::LOCAL_BUCKET_SIZE);
+        int64_t size = worker->readBlock(info);
+        pread(fd, loaded.data(), loaded.size(), NUM_TEST_BUCKETS * Configuration::LOCAL_BUCKET_SIZE);
+        loaded.resize(size);
+        return loaded;
+    }
+
+protected:
+    int64_t savedBucketSize;
+    size_t savedMaxInflight;
+    ossContext ctx;
+    int fd;
+    Internal::shared_ptr<OssBlockWorker> worker;
+    std::vector<BlockInfo> infos;
+    std::vector<std::vector<char> > blocks;
+};
+
+TEST_F(TestEvictPipeline, TestUploadsInFlight) {
+    EvictPipeline pipeline(worker);
+    std::vector<bool> finished(NUM_TEST_BUCKETS, false);
+    size_t numSubmitted = 0;
+    int numFinished = 0;
+
+    while (numFinished < NUM_TEST_BUCKETS) {
+        /* never more than OSS_EVICT_MAX_INFLIGHT uploads */
+        while (pipeline.capacity() > 0 && numSubmitted < infos.size()) {
+            pipeline.submit(infos[numSubmitted++]);
+        }
+        ASSERT_LE(pipeline.size(), Configuration::OSS_EVICT_MAX_INFLIGHT);
+
+        EvictResult result;
+        ASSERT_TRUE(pipeline.next(result, true));
+        ASSERT_FALSE(result.error);
+        ASSERT_FALSE(finished[result.info.blockId]);
+        finished[result.info.blockId] = true;
+        numFinished++;
+    }
+
+    EvictResult result;
+    ASSERT_EQ(0u, pipeline.size());
+    ASSERT_FALSE(pipeline.next(result, true));
+
+    for (int i = 0; i < NUM_TEST_BUCKETS; i++) {
+        ASSERT_EQ(blocks[i], loadBlock(infos[i]));
+    }
+}
+
+/* a clean block is in OSS already, it is not uploaded again */
+TEST_F(TestEvictPipeline, TestCleanBlock) {
+    worker->writeBlock(infos[0]);
+    std::vector<char> changed(infos[0].dataSize, 'z');
+    pwrite(fd, changed.data(), changed.size(), 0);
+
+    EvictPipeline pipeline(worker);
+    BlockInfo info = infos[0];
+    info.isClean = true;
+    pipeline.submit(info);
+
+    EvictResult result;
+    ASSERT_TRUE(pipeline.next(result, false));
+    ASSERT_FALSE(result.error);
+    ASSERT_EQ(blocks[0], loadBlock(infos[0]));
+}
+
+/* the failed upload is reported with its block, the others go on */
+TEST_F(TestEvictPipeline, TestFailedUpload) {
+    EvictPipeline pipeline(worker);
+    BlockInfo broken = infos[1];
+    /* beyond the end of the local space file */
+    broken.bucketId = NUM_TEST_BUCKETS + 1;
+    pipeline.submit(broken);
+    pipeline.submit(infos[2]);
+
+    int numFailed = 0;
+    EvictResult result;
+    while (pipeline.next(result, true)) {
+        if (result.info.blockId == broken.blockId) {
+            ASSERT_TRUE((bool) result.error);
+            ASSERT_THROW(Gopherwood::rethrow_exception(result.error), GopherwoodIOException);
+            numFailed++;
+        } else {
+            ASSERT_FALSE(result.error);
+        }
+    }
+    ASSERT_EQ(1, numFailed);
+    ASSERT_EQ(blocks[2], loadBlock(infos[2]));
+}
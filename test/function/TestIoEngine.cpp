@@ -0,0 +1,201 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/AlignedBufferPool.h"
+#include "block/IoEngine.h"
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "gtest/gtest.h"
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+class TestIoEngine: public ::testing::TestWithParam<int> {
+public:
+    TestIoEngine() {
+        sprintf(filePath, "/data/gopherwood/TestIoEngine");
+        remove(filePath);
+        fd = open(filePath, O_CREAT | O_RDWR, 0644);
+    }
+
+    ~TestIoEngine() {
+        close(fd);
+        remove(filePath);
+    }
+
+protected:
+    char filePath[64];
+    int fd;
+};
+
+static void fillPattern(std::vector<char> &buffer, int seed) {
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (char) (i * 31 + seed);
+    }
+}
+
+/* multi chunk writes and reads, vectored I/O and the short read at end of file */
+TEST_P(TestIoEngine, TestReadWrite) {
+    shared_ptr<IoEngine> engine = IoEngine::create(fd, GetParam(), 8);
+    int64_t length = 5 * Configuration::LOCAL_IO_CHUNK_SIZE + 123;
+    std::vector<char> data(length);
+    fillPattern(data, 7);
+
+    ASSERT_EQ(length, engine->write(data.data(), length, 4096));
+
+    std::vector<char> readBack(length);
+    ASSERT_EQ(length, engine->read(readBack.data(), length, 4096));
+    ASSERT_TRUE(data == readBack);
+
+    /* three buffers, the middle one spans chunks */
+    std::vector<char> a(100), b(2 * Configuration::LOCAL_IO_CHUNK_SIZE + 1), c(4000);
+    struct iovec iov[3] = {{a.data(), a.size()}, {b.data(), b.size()}, {c.data(), c.size()}};
+    int64_t total = a.size() + b.size() + c.size();
+    ASSERT_EQ(total, engine->readv(iov, 3, 4096 + 10));
+    ASSERT_EQ(0, memcmp(a.data(), data.data() + 10, a.size()));
+    ASSERT_EQ(0, memcmp(b.data(), data.data() + 10 + a.size(), b.size()));
+    ASSERT_EQ(0, memcmp(c.data(), data.data() + 10 + a.size() + b.size(), c.size()));
+
+    /* only the bytes before end of file come back */
+    std::vector<char> tail(3 * Configuration::LOCAL_IO_CHUNK_SIZE);
+    ASSERT_EQ(1000, engine->read(tail.data(), tail.size(), 4096 + length - 1000));
+    ASSERT_EQ(0, memcmp(tail.data(), data.data() + length - 1000, 1000));
+    ASSERT_EQ(0, engine->read(tail.data(), tail.size(), 4096 + length + 1));
+}
+
+/* a batch of independent requests, partly inside a registered buffer */
+TEST_P(TestIoEngine, TestBatchSubmit) {
+    shared_ptr<IoEngine> engine = IoEngine::create(fd, GetParam(), 4);
+    int numRequests = 64;
+    int64_t requestSize = 8192;
+    std::vector<char> data(numRequests * requestSize);
+    fillPattern(data, 3);
+    ASSERT_EQ((int64_t) data.size(), engine->write(data.data(), data.size(), 0));
+
+    std::vector<char> readBack(data.size());
+    bool registered = engine->registerBuffer(readBack.data(), readBack.size() / 2);
+    if (engine->getType() == IO_ENGINE_URING) {
+        ASSERT_TRUE(registered);
+    }
+
+    /* reversed order, so completions never match file order */
+    std::vector<IoRequest> requests;
+    for (int i = numRequests - 1; i >= 0; i--) {
+        requests.push_back(IoRequest(IoRead, readBack.data() + i * requestSize, requestSize, i * requestSize));
+    }
+    requests.push_back(IoRequest(IoRead, NULL, 0, 0));
+    engine->submit(requests.data(), requests.size());
+
+    for (int i = 0; i < numRequests; i++) {
+        ASSERT_EQ(requestSize, requests[i].result);
+    }
+    ASSERT_EQ(0, requests[numRequests].result);
+    ASSERT_TRUE(data == readBack);
+}
+
+/* unaligned buffers and ranges on an O_DIRECT fd go through bounce buffers */
+TEST_P(TestIoEngine, TestDirectIo) {
+    int directFD = open(filePath, O_RDWR | O_DIRECT);
+    ASSERT_GT(directFD, 0);
+    shared_ptr<IoEngine> engine = IoEngine::create(directFD, GetParam(), 8);
+    shared_ptr<IoEngine> buffered = IoEngine::create(fd, IO_ENGINE_SYNC, 1);
+    int64_t align = engine->getAlignment();
+    ASSERT_GT(align, 0);
+    ASSERT_EQ(0, buffered->getAlignment());
+
+    int64_t length = 3 * Configuration::LOCAL_IO_CHUNK_SIZE;
+    std::vector<char> expected(length + 2 * align, 0);
+
+    /* aligned body, then small writes inside, across and past a block */
+    char *aligned = AlignedBufferPool::allocate(length);
+    std::vector<char> data(length);
+    fillPattern(data, 5);
+    memcpy(aligned, data.data(), length);
+    ASSERT_EQ(length, engine->write(aligned, length, 0));
+    memcpy(expected.data(), data.data(), length);
+
+    int64_t offsets[] = {1, align - 3, 2 * align + 7, Configuration::LOCAL_IO_CHUNK_SIZE - 5, length - 2};
+    int64_t sizes[] = {10, 6, align, 3 * align + 11, 100};
+    for (int i = 0; i < 5; i++) {
+        std::vector<char> piece(sizes[i]);
+        fillPattern(piece, 11 + i);
+        ASSERT_EQ(sizes[i], engine->write(piece.data(), sizes[i], offsets[i]));
+        memcpy(expected.data() + offsets[i], piece.data(), sizes[i]);
+    }
+
+    std::vector<char> readBack(length + 98);
+    ASSERT_EQ(length + 98, buffered->read(readBack.data(), readBack.size(), 0));
+    ASSERT_EQ(0, memcmp(expected.data(), readBack.data(), readBack.size()));
+
+    /* unaligned reads through the direct engine see the same bytes */
+    for (int i = 0; i < 5; i++) {
+        std::vector<char> piece(sizes[i] + 3);
+        ASSERT_EQ(sizes[i] + 3, engine->read(piece.data() + 1, sizes[i] + 2, offsets[i] - 1) + 1);
+        ASSERT_EQ(0, memcmp(expected.data() + offsets[i] - 1, piece.data() + 1, sizes[i] + 2));
+    }
+
+    ASSERT_LE(AlignedBufferPool::getInstance()->getNumFree(), Configuration::DIRECT_IO_BUFFER_POOL_SIZE);
+    free(aligned);
+    close(directFD);
+}
+
+/* moves a few bytes per call until the budget is used up, then nothing,
+ * like a full device that returns 0 instead of an error */
+class StallingIoEngine : public IoEngine {
+public:
+    StallingIoEngine(int64_t budget) : IoEngine(-1, 1), mBudget(budget) {
+    }
+
+    int getType() {
+        return IO_ENGINE_SYNC;
+    };
+
+    const char *getName() {
+        return "stalling";
+    };
+
+protected:
+    void submitOnce(IoRequest *requests, int num) {
+        for (int i = 0; i < num; i++) {
+            requests[i].result = std::min(std::min(requests[i].length, (int64_t) 3), mBudget);
+            mBudget -= requests[i].result;
+        }
+    }
+
+    int64_t mBudget;
+};
+
+/* a write that stops making progress fails, a read that does ends short */
+TEST(TestIoEngineStall, TestZeroTransfer) {
+    std::vector<char> buffer(100);
+    StallingIoEngine writer(10);
+    ASSERT_THROW(writer.write(buffer.data(), buffer.size(), 0), GopherwoodIOException);
+
+    struct iovec iov[2] = {{buffer.data(), 40}, {buffer.data() + 40, 60}};
+    ASSERT_THROW(writer.writev(iov, 2, 0), GopherwoodIOException);
+
+    StallingIoEngine reader(10);
+    ASSERT_EQ(10, reader.read(buffer.data(), buffer.size(), 0));
+    ASSERT_EQ(0, reader.readv(iov, 2, 0));
+}
+
+INSTANTIATE_TEST_CASE_P(Engines, TestIoEngine,
+                        ::testing::Values(IO_ENGINE_SYNC, IO_ENGINE_THREADPOOL, IO_ENGINE_URING));
@@ -0,0 +1,89 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "client/gopherwood.h"
+#include "common/Configuration.h"
+#include "gtest/gtest.h"
+
+#include <sys/stat.h>
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+class TestLocalSpace: public ::testing::Test {
+public:
+    TestLocalSpace() {
+        sprintf(workDir, "/data/gopherwood");
+        sprintf(localSpaceFile, "%s/%s", workDir, Configuration::LOCAL_SPACE_FILE.c_str());
+        Configuration::LOCAL_PUNCH_FREED_BUCKETS = true;
+
+        /* buckets large enough to own whole file system blocks */
+        GWContextConfig config;
+        config.blockSize = 1024 * 1024;
+        config.numBlocks = 8;
+        config.numPreDefinedConcurrency = 2;
+        config.severity = LOGSEV_INFO;
+        gwFormatContext(workDir);
+        fs = gwCreateContext(workDir, &config);
+    }
+
+    ~TestLocalSpace() {
+        Configuration::LOCAL_PUNCH_FREED_BUCKETS = false;
+        gwDestroyContext(fs);
+        /* the other tests use their own bucket layout */
+        gwFormatContext(workDir);
+    }
+
+    int64_t allocatedSize() {
+        struct stat st;
+        stat(localSpaceFile, &st);
+        return st.st_blocks * 512;
+    }
+
+protected:
+    char workDir[40];
+    char localSpaceFile[80];
+    gopherwoodFS fs;
+};
+
+TEST_F(TestLocalSpace, TestPreallocateAndPunch) {
+    char fileName[] = "TestLocalSpace/TestPreallocateAndPunch";
+    int64_t bucketSize = 1024 * 1024;
+    std::vector<char> buffer(3 * bucketSize, 'p');
+
+    ASSERT_TRUE(fs != NULL);
+    ASSERT_GE(allocatedSize(), 8 * bucketSize);
+
+    gwFile file = gwOpenFile(fs, fileName, GW_CREAT|GW_WRONLY);
+    ASSERT_TRUE(file != NULL);
+    ASSERT_EQ(3 * bucketSize, gwWrite(fs, file, buffer.data(), 3 * bucketSize));
+    ASSERT_EQ(0, gwCloseFile(fs, file));
+    /* the written buckets keep their space, a spare bucket may be released on close */
+    ASSERT_GE(allocatedSize(), 7 * bucketSize);
+
+    /* the buckets of the deleted file are given back to the file system */
+    ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+    ASSERT_LE(allocatedSize(), 5 * bucketSize);
+
+    struct stat st;
+    ASSERT_EQ(0, stat(localSpaceFile, &st));
+    ASSERT_EQ(8 * bucketSize, st.st_size);
+}
@@ -0,0 +1,356 @@
+/********************************************************************
+ * 2016 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Configuration.h"
+#include "common/Crc32c.h"
+#include "common/Exception.h"
+#include "common/ExceptionInternal.h"
+#include "core/Manifest.h"
+#include "core/ManifestCache.h"
+#include "core/SharedMemoryObj.h"
+#include "gtest/gtest.h"
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+class TestManifest: public ::testing::Test {
+public:
+    TestManifest() {
+        sprintf(manifestPath, "/data/gopherwood/TestManifest");
+        remove(manifestPath);
+    }
+
+    ~TestManifest() {
+        remove(manifestPath);
+    }
+
+protected:
+    char manifestPath[64];
+};
+
+static void buildFragmentedBlockMap(BlockMap &blockMap, uint32_t numBlocks) {
+    /* alternate local and remote blocks, so that every block is one extent */
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        blockMap.pushBack(Block(i % 2 ? InvalidBucketId : (int32_t) i, i, i % 2 ? RemoteBlock : LocalBlock,
+                                i % 2 ? BUCKET_FREE : BUCKET_USED));
+    }
+}
+
+/* single block updates split and merge the extents */
+TEST_F(TestManifest, TestBlockMapExtents) {
+    BlockMap blockMap;
+    for (int32_t i = 0; i < 1000; i++) {
+        blockMap.pushBack(Block(i + 10, i, LocalBlock, BUCKET_USED));
+    }
+    ASSERT_EQ(1000, blockMap.size());
+    ASSERT_EQ(1u, blockMap.getExtents().size());
+    ASSERT_EQ(510, blockMap.getBlock(500).bucketId);
+
+    blockMap.setState(500, BUCKET_ACTIVE);
+    ASSERT_EQ(3u, blockMap.getExtents().size());
+    ASSERT_EQ(BUCKET_ACTIVE, blockMap.getBlock(500).state);
+    ASSERT_EQ(BUCKET_USED, blockMap.getBlock(501).state);
+    ASSERT_EQ(511, blockMap.getBlock(501).bucketId);
+
+    blockMap.setBlock(Block(InvalidBucketId, 999, RemoteBlock, BUCKET_FREE));
+    blockMap.setBlock(Block(InvalidBucketId, 998, RemoteBlock, BUCKET_FREE));
+    ASSERT_EQ(4u, blockMap.getExtents().size());
+    ASSERT_FALSE(blockMap.getBlock(998).isLocal);
+
+    blockMap.setState(500, BUCKET_USED);
+    ASSERT_EQ(2u, blockMap.getExtents().size());
+
+    blockMap.increaseUsage(3);
+    blockMap.increaseUsage(3);
+    ASSERT_EQ(2, blockMap.getBlock(3).usageCount);
+    ASSERT_EQ(0, blockMap.getBlock(4).usageCount);
+}
+
+/* a fullStatus record larger than one log buffer is split into chunks */
+TEST_F(TestManifest, TestChunkedFullStatus) {
+    uint32_t numBlocks = Manifest::getMaxExtentsPerRecord() * 3 + 7;
+    BlockMap blockMap;
+    buildFragmentedBlockMap(blockMap, numBlocks);
+
+    RecOpaque opaque;
+    opaque.fullStatus.eof = 12345;
+    {
+        Manifest manifest(manifestPath);
+        ASSERT_NO_THROW(manifest.logFullStatus(blockMap, opaque));
+        opaque.updateEof.eof = 54321;
+        ASSERT_NO_THROW(manifest.logUpdateEof(opaque));
+    }
+
+    /* 4 chunks on disk, returned one at a time */
+    struct stat st;
+    ASSERT_EQ(0, stat(manifestPath, &st));
+    ASSERT_EQ(5 * sizeof(RecordHeader) + numBlocks * sizeof(BlockExtentRecord), (size_t) st.st_size);
+
+    Manifest manifest(manifestPath);
+    std::vector<Block> blocks;
+    std::vector<BlockExtent> extents;
+    BlockMap fetched;
+    RecordHeader header;
+    for (int i = 0; i < 4; i++) {
+        header = manifest.fetchOneLogRecord(blocks, extents);
+        ASSERT_EQ(RecordType::fullStatus, header.type);
+        ASSERT_EQ(12345, header.opaque.fullStatus.eof);
+        ASSERT_EQ(i < 3, (bool) (header.flags & MANIFEST_RECORD_FLAG_CONTINUED));
+        ASSERT_EQ(i < 3 ? Manifest::getMaxExtentsPerRecord() : 7u, header.numBlocks);
+        ASSERT_EQ(header.numBlocks, extents.size());
+        ASSERT_EQ(0u, blocks.size());
+        for (BlockExtent extent : extents) {
+            fetched.pushBack(extent);
+        }
+        extents.clear();
+    }
+    ASSERT_EQ(blockMap.size(), fetched.size());
+    for (int32_t i = 0; i < blockMap.size(); i++) {
+        ASSERT_EQ(blockMap.getBlock(i).bucketId, fetched.getBlock(i).bucketId);
+        ASSERT_EQ(blockMap.getBlock(i).isLocal, fetched.getBlock(i).isLocal);
+        ASSERT_EQ(blockMap.getBlock(i).state, fetched.getBlock(i).state);
+    }
+
+    header = manifest.fetchOneLogRecord(blocks, extents);
+    ASSERT_EQ(RecordType::updateEof, header.type);
+    ASSERT_EQ(54321, header.opaque.updateEof.eof);
+    header = manifest.fetchOneLogRecord(blocks, extents);
+    ASSERT_EQ(RecordType::invalidLog, header.type);
+}
+
+/* a sequentially written file is checkpointed as a single extent */
+TEST_F(TestManifest, TestSequentialFullStatus) {
+    BlockMap blockMap;
+    for (int32_t i = 0; i < 100000; i++) {
+        blockMap.pushBack(Block(i, i, LocalBlock, BUCKET_USED));
+    }
+
+    RecOpaque opaque;
+    opaque.fullStatus.eof = 0;
+    {
+        Manifest manifest(manifestPath);
+        manifest.logFullStatus(blockMap, opaque);
+    }
+
+    struct stat st;
+    ASSERT_EQ(0, stat(manifestPath, &st));
+    ASSERT_EQ(sizeof(RecordHeader) + sizeof(BlockExtentRecord), (size_t) st.st_size);
+}
+
+/* the full status replaces the log only once it is written whole */
+TEST_F(TestManifest, TestFullStatusReplacesLog) {
+    BlockMap blockMap;
+    buildFragmentedBlockMap(blockMap, Manifest::getMaxExtentsPerRecord() + 1);
+
+    RecOpaque opaque;
+    Manifest manifest(manifestPath);
+    Manifest other(manifestPath);
+    opaque.updateEof.eof = 1;
+    manifest.logUpdateEof(opaque);
+    opaque.fullStatus.eof = 2;
+    manifest.logFullStatus(blockMap, opaque);
+    opaque.updateEof.eof = 3;
+    manifest.logUpdateEof(opaque);
+
+    /* a handle of the old log sees it removed */
+    ASSERT_TRUE(other.isRemoved());
+    ASSERT_FALSE(manifest.isRemoved());
+    ASSERT_EQ(-1, access((std::string(manifestPath) + ".tmp").c_str(), F_OK));
+
+    Manifest replayed(manifestPath);
+    std::vector<Block> blocks;
+    std::vector<BlockExtent> extents;
+    RecordHeader header = replayed.fetchOneLogRecord(blocks, extents);
+    ASSERT_EQ(RecordType::fullStatus, header.type);
+    ASSERT_EQ(2, header.opaque.fullStatus.eof);
+    ASSERT_TRUE(header.flags & MANIFEST_RECORD_FLAG_CONTINUED);
+    header = replayed.fetchOneLogRecord(blocks, extents);
+    ASSERT_FALSE(header.flags & MANIFEST_RECORD_FLAG_CONTINUED);
+    ASSERT_EQ((size_t) blockMap.size(), extents.size());
+    ASSERT_EQ(3, replayed.fetchOneLogRecord(blocks, extents).opaque.updateEof.eof);
+    ASSERT_EQ(RecordType::invalidLog, replayed.fetchOneLogRecord(blocks, extents).type);
+}
+
+/* a chunked record without its last chunk is dropped whole, the log is
+ * truncated to its first chunk */
+TEST_F(TestManifest, TestTornChunkedRecord) {
+    BlockMap blockMap;
+    buildFragmentedBlockMap(blockMap, Manifest::getMaxExtentsPerRecord() + 1);
+
+    RecOpaque opaque;
+    opaque.fullStatus.eof = 0;
+    {
+        Manifest manifest(manifestPath);
+        manifest.logFullStatus(blockMap, opaque);
+    }
+    ASSERT_EQ(0, truncate(manifestPath,
+                          sizeof(RecordHeader) + Manifest::getMaxExtentsPerRecord() * sizeof(BlockExtentRecord)));
+
+    struct stat st;
+    std::vector<Block> blocks;
+    std::vector<BlockExtent> extents;
+    {
+        Manifest manifest(manifestPath);
+        ASSERT_EQ(RecordType::invalidLog, manifest.fetchOneLogRecord(blocks, extents).type);
+        ASSERT_EQ(0u, extents.size());
+        ASSERT_EQ(0, stat(manifestPath, &st));
+        ASSERT_EQ(0, st.st_size);
+    }
+
+    /* a torn chunk in the middle of a record behind a good one */
+    std::vector<Block> inactivated;
+    for (uint32_t i = 0; i < 2 * Manifest::getMaxBlocksPerRecord() + 1; i++) {
+        inactivated.push_back(Block(i, i, LocalBlock, BUCKET_USED));
+    }
+    {
+        Manifest manifest(manifestPath);
+        opaque.updateEof.eof = 1;
+        manifest.logUpdateEof(opaque);
+        manifest.logInactivateBucket(inactivated);
+    }
+    off_t recordOffset = sizeof(RecordHeader);
+    off_t secondChunk = recordOffset + sizeof(RecordHeader) + Manifest::getMaxBlocksPerRecord() * sizeof(BlockRecord);
+    int fd = open(manifestPath, O_RDWR);
+    char c;
+    ASSERT_EQ(1, pread(fd, &c, 1, secondChunk + sizeof(RecordHeader) + 5));
+    c ^= 0x10;
+    ASSERT_EQ(1, pwrite(fd, &c, 1, secondChunk + sizeof(RecordHeader) + 5));
+    close(fd);
+    {
+        Manifest manifest(manifestPath);
+        ASSERT_EQ(1, manifest.fetchOneLogRecord(blocks, extents).opaque.updateEof.eof);
+        ASSERT_EQ(RecordType::invalidLog, manifest.fetchOneLogRecord(blocks, extents).type);
+        ASSERT_EQ(0u, blocks.size());
+        ASSERT_EQ(0, stat(manifestPath, &st));
+        ASSERT_EQ(recordOffset, st.st_size);
+    }
+
+    /* a continued chunk followed by another record */
+    {
+        Manifest manifest(manifestPath);
+        manifest.mfSeek(0, SEEK_END);
+        manifest.logInactivateBucket(inactivated);
+    }
+    ASSERT_EQ(0, truncate(manifestPath, secondChunk));
+    {
+        Manifest manifest(manifestPath);
+        manifest.mfSeek(0, SEEK_END);
+        opaque.updateEof.eof = 2;
+        manifest.logUpdateEof(opaque);
+    }
+    Manifest manifest(manifestPath);
+    ASSERT_EQ(1, manifest.fetchOneLogRecord(blocks, extents).opaque.updateEof.eof);
+    ASSERT_EQ(RecordType::invalidLog, manifest.fetchOneLogRecord(blocks, extents).type);
+    ASSERT_EQ(0u, blocks.size());
+    ASSERT_EQ(0, stat(manifestPath, &st));
+    ASSERT_EQ(recordOffset, st.st_size);
+}
+
+TEST_F(TestManifest, TestCrc32c) {
+    const char *data = "123456789";
+    ASSERT_EQ(0xE3069283, Crc32c::value(data, 9));
+    ASSERT_EQ(0xE3069283, Crc32c::updateSoftware(0, data, 9));
+    ASSERT_EQ(0xE3069283, Crc32c::update(Crc32c::value(data, 4), data + 4, 5));
+
+    std::vector<char> buffer(8192 + 3);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (char) (i * 31 + 7);
+    }
+    for (size_t offset = 0; offset < 3; offset++) {
+        ASSERT_EQ(Crc32c::updateSoftware(0, &buffer[offset], 8192),
+                  Crc32c::value(&buffer[offset], 8192));
+    }
+}
+
+/* a corrupted tail record is dropped and new records follow the last valid one */
+TEST_F(TestManifest, TestCorruptedRecordTruncated) {
+    RecOpaque opaque;
+    struct stat st;
+    {
+        Manifest manifest(manifestPath);
+        opaque.updateEof.eof = 1;
+        manifest.logUpdateEof(opaque);
+        opaque.updateEof.eof = 2;
+        manifest.logUpdateEof(opaque);
+    }
+
+    /* flip one byte of the eof in the second record */
+    int fd = open(manifestPath, O_RDWR);
+    char c;
+    off_t offset = sizeof(RecordHeader) + offsetof(RecordHeader, opaque);
+    ASSERT_EQ(1, pread(fd, &c, 1, offset));
+    c ^= 0x10;
+    ASSERT_EQ(1, pwrite(fd, &c, 1, offset));
+    close(fd);
+
+    {
+        Manifest manifest(manifestPath);
+        std::vector<Block> blocks;
+        std::vector<BlockExtent> extents;
+        RecordHeader header = manifest.fetchOneLogRecord(blocks, extents);
+        ASSERT_EQ(RecordType::updateEof, header.type);
+        ASSERT_EQ(1, header.opaque.updateEof.eof);
+        header = manifest.fetchOneLogRecord(blocks, extents);
+        ASSERT_EQ(RecordType::invalidLog, header.type);
+        ASSERT_EQ(0, stat(manifestPath, &st));
+        ASSERT_EQ(sizeof(RecordHeader), (size_t) st.st_size);
+
+        opaque.updateEof.eof = 3;
+        manifest.logUpdateEof(opaque);
+    }
+
+    Manifest manifest(manifestPath);
+    std::vector<Block> blocks;
+    std::vector<BlockExtent> extents;
+    ASSERT_EQ(1, manifest.fetchOneLogRecord(blocks, extents).opaque.updateEof.eof);
+    ASSERT_EQ(3, manifest.fetchOneLogRecord(blocks, extents).opaque.updateEof.eof);
+    ASSERT_EQ(RecordType::invalidLog, manifest.fetchOneLogRecord(blocks, extents).type);
+}
+
+/* foreign Manifest handles are reused until the file is deleted */
+TEST_F(TestManifest, TestManifestCache) {
+    std::string workDir("/data/gopherwood");
+    FileId fileId;
+    fileId.hashcode = 20180523;
+    fileId.collisionId = 7;
+    std::string fileName = Manifest::getManifestFileName(workDir, fileId);
+    shared_ptr<ManifestCache> cache = ManifestCache::getInstance();
+    mkdir((workDir + Configuration::MANIFEST_FOLDER).c_str(), 0755);
+    remove(fileName.c_str());
+
+    ASSERT_THROW(cache->getManifest(workDir, fileId), GopherwoodInvalidParmException);
+    ASSERT_EQ(0, close(open(fileName.c_str(), O_CREAT | O_RDWR, 0644)));
+
+    shared_ptr<Manifest> manifest = cache->getManifest(workDir, fileId);
+    ASSERT_TRUE(manifest == cache->getManifest(workDir, fileId));
+
+    /* removed by someone else, a new handle is opened after re-creating */
+    remove(fileName.c_str());
+    ASSERT_THROW(cache->getManifest(workDir, fileId), GopherwoodInvalidParmException);
+    ASSERT_EQ(0, close(open(fileName.c_str(), O_CREAT | O_RDWR, 0644)));
+    ASSERT_TRUE(manifest != cache->getManifest(workDir, fileId));
+
+    manifest = cache->getManifest(workDir, fileId);
+    cache->invalidate(workDir, fileId);
+    ASSERT_TRUE(manifest != cache->getManifest(workDir, fileId));
+    cache->invalidate(workDir, fileId);
+    remove(fileName.c_str());
+}
@@ -0,0 +1,419 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/AlignedBufferPool.h"
+#include "block/OssBlockWorker.h"
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/OssBuilder.h"
+#include "file/FileSystem.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+/* Move blocks through whatever object store the test configuration points
+ * at, a local stand-in is enough. Objects are damaged with liboss itself */
+class TestOssBlockWorker: public ::testing::Test {
+public:
+    TestOssBlockWorker() {
+        savedBucketSize = Configuration::LOCAL_BUCKET_SIZE;
+        Configuration::LOCAL_BUCKET_SIZE = 64 * 1024;
+
+        ctx = ossRootBuilder.buildContext();
+        FileSystem::OSS_BUCKET = ossRootBuilder.getBucketName();
+        fd = open("/data/gopherwood/TestOssBlockWorker", O_CREAT | O_RDWR | O_TRUNC, 0644);
+        ftruncate(fd, 2 * Configuration::LOCAL_BUCKET_SIZE);
+        worker = new OssBlockWorker(fd);
+
+        info.fileId.hashcode = 20180401;
+        info.fileId.collisionId = 0;
+        info.blockId = 0;
+        info.bucketId = 0;
+        info.offset = 0;
+        info.dataSize = 40000;
+        info.isLocal = true;
+
+        /* the first half does not compress, the second half does */
+        data.resize(info.dataSize);
+        unsigned int seed = 42;
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = i < data.size() / 2 ? (char) rand_r(&seed) : (char) (i % 64 + 'A');
+        }
+        pwrite(fd, data.data(), data.size(), 0);
+    }
+
+    ~TestOssBlockWorker() {
+        try {
+            worker->deleteBlock(info);
+        } catch (...) {
+        }
+        delete worker;
+        ossDestroyContext(ctx);
+        close(fd);
+        unlink("/data/gopherwood/TestOssBlockWorker");
+        Configuration::LOCAL_BUCKET_SIZE = savedBucketSize;
+        Configuration::OSS_BLOCK_CODEC = BLOCK_CODEC_LZ;
+        Configuration::OSS_CODEC_CHUNK_SIZE = 1024 * 1024;
+        Configuration::OSS_STREAM_WINDOW_SIZE = 4 * 1024 * 1024;
+        Configuration::OSS_STREAM_THREADS = 4;
+        Configuration::OSS_PART_MIN_SIZE = 8 * 1024 * 1024;
+        Configuration::OSS_PART_TARGET_TIME = 500;
+        Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 1024 * 1024;
+        Configuration::OSS_LEGACY_RAW_BLOCKS = false;
+    }
+
+    /* replace the object of the block with the given bytes */
+    void putObject(const std::vector<char> &object, uint32_t part = 0) {
+        ossObject remote = ossPutObject(ctx, FileSystem::OSS_BUCKET.c_str(),
+                                        worker->getOssPartName(info, part).c_str(), false);
+        ASSERT_TRUE(remote != NULL);
+        ASSERT_EQ((int32_t) object.size(), ossWrite(ctx, remote, object.data(), object.size()));
+        ossCloseObject(ctx, remote);
+    }
+
+    bool hasPart(uint32_t part) {
+        ossHeadResult *head = ossHeadObject(ctx, FileSystem::OSS_BUCKET.c_str(),
+                                            worker->getOssPartName(info, part).c_str());
+        free(head);
+        return head != NULL;
+    }
+
+    bool hasIndex() {
+        ossHeadResult *head = ossHeadObject(ctx, FileSystem::OSS_BUCKET.c_str(),
+                                            (worker->getOssObjectName(info) + ".index").c_str());
+        free(head);
+        return head != NULL;
+    }
+
+    std::vector<char> getObject(uint32_t part = 0) {
+        std::string name = worker->getOssPartName(info, part);
+        ossHeadResult *head = ossHeadObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str());
+        std::vector<char> object(head->content_length);
+        free(head);
+        if (object.empty()) {
+            return object;
+        }
+
+        ossObject remote = ossGetObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str(), 0, object.size() - 1);
+        size_t done = 0;
+        int32_t rc;
+        while (done < object.size() &&
+               (rc = ossRead(ctx, remote, object.data() + done, object.size() - done)) > 0) {
+            done += rc;
+        }
+        ossCloseObject(ctx, remote);
+        return object;
+    }
+
+    /* load the block into the second bucket */
+    std::vector<char> loadBlock() {
+        BlockInfo loadInfo = info;
+        loadInfo.bucketId = 1;
+        std::vector<char> loaded(Configuration::LOCAL_BUCKET_SIZE);
+        int64_t size = worker->readBlock(loadInfo);
+        pread(fd, loaded.data(), loaded.size(), Configuration::LOCAL_BUCKET_SIZE);
+        loaded.resize(size);
+        return loaded;
+    }
+
+    bool secondBucketIsEmpty() {
+        std::vector<char> bucket(Configuration::LOCAL_BUCKET_SIZE);
+        pread(fd, bucket.data(), bucket.size(), Configuration::LOCAL_BUCKET_SIZE);
+        return bucket == std::vector<char>(bucket.size(), 0);
+    }
+
+protected:
+    int64_t savedBucketSize;
+    ossContext ctx;
+    int fd;
+    OssBlockWorker *worker;
+    BlockInfo info;
+    std::vector<char> data;
+};
+
+TEST_F(TestOssBlockWorker, TestRoundTrip) {
+    worker->writeBlock(info);
+    ASSERT_EQ(data, loadBlock());
+    ASSERT_LT(getObject().size(), data.size());
+
+    /* chunks spread over the codec threads */
+    Configuration::OSS_CODEC_CHUNK_SIZE = 4096;
+    worker->writeBlock(info);
+    ASSERT_EQ(data, loadBlock());
+
+    Configuration::OSS_BLOCK_CODEC = BLOCK_CODEC_NONE;
+    worker->writeBlock(info);
+    ASSERT_EQ(data, loadBlock());
+    ASSERT_GT(getObject().size(), data.size());
+
+    GWFileInfo fileInfo;
+    worker->getStatistics(&fileInfo);
+    ASSERT_EQ((uint64_t) 3 * data.size(), fileInfo.numBytesEvicted);
+    ASSERT_LT(fileInfo.numBytesUploaded, fileInfo.numBytesEvicted);
+    ASSERT_GT(fileInfo.compressNanos, 0u);
+    ASSERT_GT(fileInfo.decompressNanos, 0u);
+}
+
+TEST_F(TestOssBlockWorker, TestStreamedWindows) {
+    /* 10 chunks in 5 windows */
+    Configuration::OSS_CODEC_CHUNK_SIZE = 4096;
+    Configuration::OSS_STREAM_WINDOW_SIZE = 8192;
+    worker->writeBlock(info);
+    ASSERT_EQ(data, loadBlock());
+
+    /* the window buffers go back to the pool */
+    Internal::shared_ptr<AlignedBufferPool> pool = AlignedBufferPool::getStreamInstance();
+    size_t numFree = pool->getNumFree();
+    ASSERT_GE(numFree, 2u);
+    ASSERT_LE(numFree, Configuration::OSS_STREAM_BUFFER_POOL_SIZE);
+
+    /* the bucket I/O inline, reading back an object of larger windows */
+    Configuration::OSS_STREAM_THREADS = 0;
+    Configuration::OSS_STREAM_WINDOW_SIZE = 4096;
+    ASSERT_EQ(data, loadBlock());
+    worker->writeBlock(info);
+    Configuration::OSS_STREAM_THREADS = 4;
+    ASSERT_EQ(data, loadBlock());
+    ASSERT_EQ(numFree, pool->getNumFree());
+
+    /* a damaged last window fails the load */
+    std::vector<char> object = getObject();
+    object[object.size() - 100] ^= 0x10;
+    putObject(object);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+    ASSERT_EQ(numFree, pool->getNumFree());
+}
+
+TEST_F(TestOssBlockWorker, TestParts) {
+    /* parts of the minimum size, 40000 bytes in 5 parts */
+    Configuration::OSS_CODEC_CHUNK_SIZE = 4096;
+    Configuration::OSS_PART_MIN_SIZE = 8192;
+    Configuration::OSS_PART_TARGET_TIME = 0;
+    worker->writeBlock(info);
+    ASSERT_TRUE(hasPart(4));
+    ASSERT_FALSE(hasPart(5));
+    ASSERT_EQ(data, loadBlock());
+
+    /* fewer parts remove the parts left behind */
+    Configuration::OSS_PART_MIN_SIZE = 16384;
+    worker->writeBlock(info);
+    ASSERT_TRUE(hasPart(2));
+    ASSERT_FALSE(hasPart(3));
+    ASSERT_FALSE(hasPart(4));
+    ASSERT_EQ(data, loadBlock());
+
+    /* a part of an earlier upload, with the same and with another layout */
+    std::vector<char> samePart = getObject(1);
+    Configuration::OSS_PART_MIN_SIZE = 8192;
+    worker->writeBlock(info);
+    std::vector<char> otherPart = getObject(1);
+    Configuration::OSS_PART_MIN_SIZE = 16384;
+    worker->writeBlock(info);
+    putObject(samePart, 1);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+    putObject(otherPart, 1);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+
+    /* at the bandwidth of the test store one stream moves the block */
+    Configuration::OSS_PART_TARGET_TIME = 500;
+    worker->writeBlock(info);
+    ASSERT_FALSE(hasPart(1));
+    ASSERT_EQ(data, loadBlock());
+
+    Configuration::OSS_PART_TARGET_TIME = 0;
+    worker->writeBlock(info);
+    ASSERT_TRUE(hasPart(2));
+    worker->deleteBlock(info);
+    ASSERT_FALSE(hasPart(0));
+    ASSERT_FALSE(hasPart(1));
+    ASSERT_FALSE(hasPart(2));
+}
+
+TEST_F(TestOssBlockWorker, TestPages) {
+    /* 10 chunks in 5 parts, every chunk is a page */
+    Configuration::OSS_CODEC_CHUNK_SIZE = 4096;
+    Configuration::OSS_PART_MIN_SIZE = 8192;
+    Configuration::OSS_PART_TARGET_TIME = 0;
+    Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 4096;
+    worker->writeBlock(info);
+    ASSERT_TRUE(hasIndex());
+
+    /* chunks 3 to 5, in parts 1 and 2 */
+    BlockInfo loadInfo = info;
+    loadInfo.bucketId = 1;
+    std::vector<std::pair<int64_t, int64_t> > loaded;
+    worker->readPages(loadInfo, 12345, 10000, [&loaded](int64_t offset, int64_t length) {
+        loaded.push_back(std::make_pair(offset, length));
+    });
+    int64_t covered = 0;
+    for (size_t i = 0; i < loaded.size(); i++) {
+        ASSERT_LE(12288, loaded[i].first);
+        ASSERT_GE(24576, loaded[i].first + loaded[i].second);
+        covered += loaded[i].second;
+    }
+    ASSERT_EQ(12288, covered);
+
+    std::vector<char> bucket(Configuration::LOCAL_BUCKET_SIZE);
+    pread(fd, bucket.data(), bucket.size(), Configuration::LOCAL_BUCKET_SIZE);
+    ASSERT_TRUE(std::equal(data.begin() + 12288, data.begin() + 24576, bucket.begin() + 12288));
+    ASSERT_EQ(std::vector<char>(12288, 0), std::vector<char>(bucket.begin(), bucket.begin() + 12288));
+    ASSERT_EQ(0, bucket[24576]);
+
+    /* the last chunk is reported up to the end of the bucket */
+    loaded.clear();
+    worker->readPages(loadInfo, 39000, 100, [&loaded](int64_t offset, int64_t length) {
+        loaded.push_back(std::make_pair(offset, length));
+    });
+    ASSERT_EQ(1u, loaded.size());
+    ASSERT_EQ(36864, loaded[0].first);
+    ASSERT_EQ(Configuration::LOCAL_BUCKET_SIZE, loaded[0].first + loaded[0].second);
+
+    /* the rest of the block follows the pages, every chunk is loaded once */
+    std::vector<char> empty(Configuration::LOCAL_BUCKET_SIZE);
+    pwrite(fd, empty.data(), empty.size(), Configuration::LOCAL_BUCKET_SIZE);
+    loaded.clear();
+    ASSERT_EQ((int64_t) data.size(), worker->readPages(loadInfo, 12345, 10000,
+                                                      [&loaded](int64_t offset, int64_t length) {
+        loaded.push_back(std::make_pair(offset, length));
+    }, true));
+    ASSERT_EQ(12288, loaded[0].first);
+    std::sort(loaded.begin(), loaded.end());
+    for (size_t i = 1; i < loaded.size(); i++) {
+        ASSERT_EQ(loaded[i - 1].first + loaded[i - 1].second, loaded[i].first);
+    }
+    ASSERT_EQ(0, loaded.front().first);
+    ASSERT_EQ(Configuration::LOCAL_BUCKET_SIZE, loaded.back().first + loaded.back().second);
+    pread(fd, bucket.data(), bucket.size(), Configuration::LOCAL_BUCKET_SIZE);
+    ASSERT_TRUE(std::equal(data.begin(), data.end(), bucket.begin()));
+
+    /* an upload without an index drops the one before */
+    Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 0;
+    worker->writeBlock(info);
+    ASSERT_FALSE(hasIndex());
+    ASSERT_THROW(worker->readPages(loadInfo, 0, 100, OssBlockWorker::LoadCallback()), GopherwoodIOException);
+
+    /* an index whose head did not commit is not used */
+    Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 4096;
+    worker->writeBlock(info);
+    std::vector<char> head = getObject();
+    worker->writeBlock(info);
+    putObject(head);
+    ASSERT_THROW(worker->readPages(loadInfo, 0, 100, OssBlockWorker::LoadCallback()), GopherwoodIOException);
+
+    /* a part of another upload of the same data fails the checksums, checked or not */
+    worker->writeBlock(info);
+    std::vector<char> stalePart = getObject(1);
+    worker->writeBlock(info);
+    putObject(stalePart, 1);
+    Configuration::OSS_VERIFY_CHECKSUM = false;
+    EXPECT_THROW(worker->readPages(loadInfo, 12345, 100, OssBlockWorker::LoadCallback()), GopherwoodIOException);
+    Configuration::OSS_VERIFY_CHECKSUM = true;
+
+    worker->writeBlock(info);
+    ASSERT_EQ(data, loadBlock());
+    worker->deleteBlock(info);
+    ASSERT_FALSE(hasIndex());
+    ASSERT_FALSE(hasPart(0));
+}
+
+TEST_F(TestOssBlockWorker, TestCorruptedObject) {
+    Configuration::OSS_CODEC_CHUNK_SIZE = 4096;
+    worker->writeBlock(info);
+    std::vector<char> object = getObject();
+    object[object.size() - 100] ^= 0x10;
+    putObject(object);
+
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+    ASSERT_TRUE(secondBucketIsEmpty());
+
+    /* a damaged raw chunk */
+    object = getObject();
+    object[object.size() - 100] ^= 0x10;
+    object[200] ^= 0x01;
+    putObject(object);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+    ASSERT_TRUE(secondBucketIsEmpty());
+
+    /* skipping the checksum still loads the damaged data */
+    Configuration::OSS_BLOCK_CODEC = BLOCK_CODEC_NONE;
+    worker->writeBlock(info);
+    object = getObject();
+    object[12345] ^= 0x10;
+    putObject(object);
+    Configuration::OSS_VERIFY_CHECKSUM = false;
+    std::vector<char> loaded = loadBlock();
+    Configuration::OSS_VERIFY_CHECKSUM = true;
+    ASSERT_EQ(data.size(), loaded.size());
+    ASSERT_NE(data, loaded);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+}
+
+TEST_F(TestOssBlockWorker, TestTruncatedObject) {
+    worker->writeBlock(info);
+    std::vector<char> object = getObject();
+    object.resize(object.size() / 2);
+    putObject(object);
+
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+    ASSERT_TRUE(secondBucketIsEmpty());
+
+    object.resize(8);
+    putObject(object);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+
+    object.clear();
+    putObject(object);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+}
+
+/* blocks uploaded before objects had a header are loaded as they are, only when asked to */
+TEST_F(TestOssBlockWorker, TestLegacyObject) {
+    putObject(data);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+    ASSERT_TRUE(secondBucketIsEmpty());
+
+    Configuration::OSS_LEGACY_RAW_BLOCKS = true;
+    ASSERT_EQ(data, loadBlock());
+
+    /* a block of a single byte */
+    std::vector<char> object(1, 'x');
+    putObject(object);
+    ASSERT_EQ(object, loadBlock());
+
+    /* larger than a bucket, it is no block */
+    object.assign(Configuration::LOCAL_BUCKET_SIZE + 1, 'x');
+    putObject(object);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+
+    /* a block whose header lost its magic is refused again once legacy blocks are off */
+    Configuration::OSS_LEGACY_RAW_BLOCKS = false;
+    worker->writeBlock(info);
+    object = getObject();
+    object[0] ^= 0x01;
+    putObject(object);
+    ASSERT_THROW(loadBlock(), GopherwoodIOException);
+
+    worker->deleteBlock(info);
+    ASSERT_FALSE(hasPart(0));
+}
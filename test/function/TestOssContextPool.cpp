@@ -0,0 +1,96 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Configuration.h"
+#include "common/OssContextPool.h"
+#include "gtest/gtest.h"
+
+#include <set>
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+/* A pool of its own for every test, the process wide one is shared by the
+ * other tests */
+class TestOssContextPool: public ::testing::Test {
+public:
+    TestOssContextPool() : pool(new OssContextPool(2, 60000)) {
+    }
+
+protected:
+    Internal::shared_ptr<OssContextPool> pool;
+};
+
+TEST_F(TestOssContextPool, TestReuse) {
+    ossContext first = pool->acquire();
+    ossContext second = pool->acquire();
+    ASSERT_TRUE(first != NULL);
+    ASSERT_TRUE(first != second);
+    ASSERT_EQ(2u, pool->getNumCreated());
+
+    /* the context given back last is the warmest */
+    pool->release(first);
+    pool->release(second);
+    ASSERT_EQ(2u, pool->getNumIdle());
+    ASSERT_EQ(second, pool->acquire());
+    ASSERT_EQ(first, pool->acquire());
+    ASSERT_EQ(2u, pool->getNumCreated());
+    ASSERT_EQ(0u, pool->getNumIdle());
+
+    /* no more idle contexts than the pool size */
+    ossContext third = pool->acquire();
+    pool->release(first);
+    pool->release(second);
+    pool->release(third);
+    ASSERT_EQ(2u, pool->getNumIdle());
+}
+
+TEST_F(TestOssContextPool, TestFailedContext) {
+    ossContext ctx = pool->acquire();
+    pool->release(ctx, false);
+    ASSERT_EQ(0u, pool->getNumIdle());
+
+    pool->release(pool->acquire());
+    ASSERT_EQ(2u, pool->getNumCreated());
+}
+
+TEST_F(TestOssContextPool, TestTrimIdle) {
+    pool = Internal::shared_ptr<OssContextPool>(new OssContextPool(4, 50));
+    std::set<ossContext> contexts;
+    for (int i = 0; i < 3; i++) {
+        contexts.insert(pool->acquire());
+    }
+    for (ossContext ctx : contexts) {
+        pool->release(ctx);
+    }
+    ASSERT_EQ(3u, pool->getNumIdle());
+
+    usleep(100 * 1000);
+    pool->trim();
+    ASSERT_EQ(0u, pool->getNumIdle());
+
+    /* idle contexts expire on the next acquire too */
+    pool->release(pool->acquire());
+    usleep(100 * 1000);
+    pool->release(pool->acquire());
+    ASSERT_EQ(1u, pool->getNumIdle());
+    ASSERT_EQ(5u, pool->getNumCreated());
+}
@@ -0,0 +1,371 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/OssBlockWorker.h"
+#include "block/OssObjectReader.h"
+#include "block/OssTransferPolicy.h"
+#include "common/Configuration.h"
+#include "common/Exception.h"
+#include "common/OssBuilder.h"
+#include "file/FileSystem.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+/* the object store of the test configuration with faults injected into the
+ * next calls, each counter is used up one call at a time */
+struct FaultyStore {
+    std::atomic<int> failedGets;
+    std::atomic<int> failedReads;
+    std::atomic<int> slowReads;
+    std::atomic<int> failedPuts;
+    std::atomic<int> failedWrites;
+    std::atomic<int> slowHeads;
+    /* ms a slow read or HEAD takes */
+    int64_t readDelay;
+    /* bytes a read returns at most, 0 for no limit */
+    int32_t maxRead;
+};
+
+static bool takeFault(std::atomic<int> &counter) {
+    int value = counter.load();
+    while (value > 0) {
+        if (counter.compare_exchange_weak(value, value - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static OssRequestOps getFaultyOps(Internal::shared_ptr<FaultyStore> store) {
+    OssRequestOps ops = OssTransferPolicy::getDefaultOps();
+    OssRequestOps liboss = ops;
+    ops.getObject = [store, liboss](ossContext ctx, const char *bucket, const char *key,
+                                    int64_t start, int64_t end) -> ossObject {
+        if (takeFault(store->failedGets)) {
+            return NULL;
+        }
+        return liboss.getObject(ctx, bucket, key, start, end);
+    };
+    ops.read = [store, liboss](ossContext ctx, ossObject object, void *buffer, int32_t length) -> int32_t {
+        if (takeFault(store->failedReads)) {
+            return -1;
+        }
+        if (takeFault(store->slowReads)) {
+            usleep(store->readDelay * 1000);
+        }
+        if (store->maxRead > 0) {
+            length = std::min(length, store->maxRead);
+        }
+        return liboss.read(ctx, object, buffer, length);
+    };
+    ops.putObject = [store, liboss](ossContext ctx, const char *bucket, const char *key) -> ossObject {
+        if (takeFault(store->failedPuts)) {
+            return NULL;
+        }
+        return liboss.putObject(ctx, bucket, key);
+    };
+    ops.write = [store, liboss](ossContext ctx, ossObject object, const char *buffer, int32_t length) -> int32_t {
+        if (takeFault(store->failedWrites)) {
+            return -1;
+        }
+        return liboss.write(ctx, object, buffer, length);
+    };
+    ops.headObject = [store, liboss](ossContext ctx, const char *bucket, const char *key) -> ossHeadResult * {
+        if (takeFault(store->slowHeads)) {
+            usleep(store->readDelay * 1000);
+        }
+        return liboss.headObject(ctx, bucket, key);
+    };
+    return ops;
+}
+
+class TestOssTransferPolicy: public ::testing::Test {
+public:
+    TestOssTransferPolicy() : policy(OssTransferPolicy::getInstance()), store(new FaultyStore()) {
+        store->failedGets = 0;
+        store->failedReads = 0;
+        store->slowReads = 0;
+        store->failedPuts = 0;
+        store->failedWrites = 0;
+        store->slowHeads = 0;
+        store->readDelay = 0;
+        store->maxRead = 0;
+        policy->setOps(getFaultyOps(store));
+
+        Configuration::OSS_REQUEST_SIZE = 64 * 1024;
+        Configuration::OSS_RETRY_BASE_DELAY = 1;
+        Configuration::OSS_RETRY_MAX_DELAY = 4;
+        Configuration::OSS_HEDGE_PERCENTILE = 0;
+
+        ctx = ossRootBuilder.buildContext();
+        FileSystem::OSS_BUCKET = ossRootBuilder.getBucketName();
+        name = "gopherwood/TestOssTransferPolicy";
+        data.resize(200000);
+        unsigned int seed = 7;
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = (char) rand_r(&seed);
+        }
+        ossObject remote = ossPutObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str(), false);
+        ossWrite(ctx, remote, data.data(), data.size());
+        ossCloseObject(ctx, remote);
+    }
+
+    ~TestOssTransferPolicy() {
+        policy->setOps(OssTransferPolicy::getDefaultOps());
+        {
+            lock_guard<mutex> lock(policy->mMutex);
+            policy->mLatencies.clear();
+            policy->mSortedLatencies.clear();
+            policy->mNextLatency = 0;
+        }
+        ossDeleteObject(ctx, FileSystem::OSS_BUCKET.c_str(), name.c_str());
+        ossDestroyContext(ctx);
+        Configuration::OSS_REQUEST_SIZE = 1024 * 1024;
+        Configuration::OSS_REQUEST_TIMEOUT = 30000;
+        Configuration::OSS_REQUEST_RETRIES = 3;
+        Configuration::OSS_RETRY_BASE_DELAY = 50;
+        Configuration::OSS_RETRY_MAX_DELAY = 2000;
+        Configuration::OSS_HEDGE_PERCENTILE = 95;
+    }
+
+    /* read the range of the test object */
+    std::vector<char> readObject(int64_t start, int64_t end) {
+        OssObjectReader reader(name, start, end);
+        std::vector<char> object(end - start + 1);
+        object.resize(reader.read(object.data(), object.size()));
+        return object;
+    }
+
+    GWSysInfo getStatistics() {
+        GWSysInfo sysInfo;
+        policy->getStatistics(&sysInfo);
+        return sysInfo;
+    }
+
+protected:
+    Internal::shared_ptr<OssTransferPolicy> policy;
+    Internal::shared_ptr<FaultyStore> store;
+    ossContext ctx;
+    std::string name;
+    std::vector<char> data;
+};
+
+TEST_F(TestOssTransferPolicy, TestRanges) {
+    /* a range in requests of short reads, and past the end of the object */
+    store->maxRead = 1000;
+    GWSysInfo before = getStatistics();
+    ASSERT_EQ(data, readObject(0, data.size() - 1));
+    ASSERT_EQ(data, readObject(0, 2 * data.size()));
+    ASSERT_EQ(std::vector<char>(data.begin() + 12345, data.begin() + 150000), readObject(12345, 149999));
+
+    GWSysInfo after = getStatistics();
+    ASSERT_EQ(before.numOssRetries, after.numOssRetries);
+    ASSERT_GE(after.numOssRequests - before.numOssRequests, 9u);
+    ASSERT_EQ(after.numOssRequests - before.numOssRequests, after.numOssAttempts - before.numOssAttempts);
+
+    /* a missing object is not asked for again */
+    OssObjectReader missing(name + ".missing", 0, 100);
+    char buffer[100];
+    ASSERT_THROW(missing.read(buffer, sizeof(buffer)), GopherwoodIOException);
+    ASSERT_EQ(after.numOssRetries, getStatistics().numOssRetries);
+}
+
+TEST_F(TestOssTransferPolicy, TestRetry) {
+    /* a failed GET, and a read failed in the middle of the stream */
+    store->failedGets = 1;
+    GWSysInfo before = getStatistics();
+    OssObjectReader reader(name, 0, data.size() - 1);
+    std::vector<char> object(data.size());
+    ASSERT_EQ(100000, reader.read(object.data(), 100000));
+    store->failedReads = 2;
+    ASSERT_EQ((int64_t) data.size() - 100000, reader.read(object.data() + 100000, data.size()));
+    ASSERT_EQ(data, object);
+    ASSERT_EQ(3u, getStatistics().numOssRetries - before.numOssRetries);
+
+    /* until the retries run out */
+    store->failedReads = Configuration::OSS_REQUEST_RETRIES + 1;
+    before = getStatistics();
+    ASSERT_THROW(readObject(0, 100), GopherwoodOSSException);
+    GWSysInfo after = getStatistics();
+    ASSERT_EQ((uint64_t) Configuration::OSS_REQUEST_RETRIES, after.numOssRetries - before.numOssRetries);
+    ASSERT_EQ((uint64_t) Configuration::OSS_REQUEST_RETRIES + 1, after.numOssAttempts - before.numOssAttempts);
+
+    /* the backoff is random below a ceiling doubled on every retry */
+    Configuration::OSS_RETRY_BASE_DELAY = 10;
+    Configuration::OSS_RETRY_MAX_DELAY = 30;
+    for (int i = 0; i < 100; i++) {
+        ASSERT_LE(policy->getBackoff(0), 10);
+        ASSERT_LE(policy->getBackoff(1), 20);
+        ASSERT_LE(policy->getBackoff(5), 30);
+    }
+}
+
+TEST_F(TestOssTransferPolicy, TestTimeout) {
+    /* a read that hangs is given up and the request sent again */
+    Configuration::OSS_REQUEST_TIMEOUT = 100;
+    store->readDelay = 1000;
+    store->slowReads = 1;
+    GWSysInfo before = getStatistics();
+    ASSERT_EQ(data, readObject(0, data.size() - 1));
+    GWSysInfo after = getStatistics();
+    ASSERT_EQ(1u, after.numOssTimeouts - before.numOssTimeouts);
+    ASSERT_EQ(1u, after.numOssRetries - before.numOssRetries);
+
+    /* every try times out */
+    store->slowReads = Configuration::OSS_REQUEST_RETRIES + 1;
+    ASSERT_THROW(readObject(0, 100), GopherwoodTimeoutException);
+    ASSERT_EQ((uint64_t) Configuration::OSS_REQUEST_RETRIES + 2,
+              getStatistics().numOssTimeouts - before.numOssTimeouts);
+}
+
+TEST_F(TestOssTransferPolicy, TestHedge) {
+    /* no hedge before enough requests were seen */
+    Configuration::OSS_HEDGE_PERCENTILE = 95;
+    ASSERT_EQ(0, policy->getHedgeDelay());
+    for (int i = 1; i <= 100; i++) {
+        policy->recordLatency(i * 100);
+    }
+    ASSERT_EQ(9600, policy->getHedgeDelay());
+
+    /* a slow read is overtaken by its hedge, the stream goes on with the hedge */
+    store->readDelay = 1000;
+    store->slowReads = 1;
+    GWSysInfo before = getStatistics();
+    ASSERT_EQ(data, readObject(0, data.size() - 1));
+    GWSysInfo after = getStatistics();
+    ASSERT_EQ(0u, after.numOssRetries - before.numOssRetries);
+    ASSERT_GE(after.numOssHedges - before.numOssHedges, 1u);
+    ASSERT_GE(after.numOssHedgeWins - before.numOssHedgeWins, 1u);
+    ASSERT_GT(after.numOssAttempts - before.numOssAttempts, after.numOssRequests - before.numOssRequests);
+
+    /* the percentile follows the window as old latencies leave it */
+    for (int i = 1; i <= 128; i++) {
+        policy->recordLatency(i * 10);
+    }
+    ASSERT_EQ(1220, policy->getHedgeDelay());
+
+    /* no request thread is free, the requests run here and are not hedged */
+    size_t numPooled;
+    {
+        lock_guard<mutex> lock(policy->mMutex);
+        numPooled = policy->mNumPooled;
+        policy->mNumPooled = policy->mNumThreads;
+    }
+    store->readDelay = 1000;
+    store->slowReads = 1;
+    before = getStatistics();
+    ASSERT_EQ(data, readObject(0, data.size() - 1));
+    after = getStatistics();
+    ASSERT_EQ(0u, after.numOssHedges - before.numOssHedges);
+    {
+        lock_guard<mutex> lock(policy->mMutex);
+        policy->mNumPooled = numPooled;
+    }
+
+    Configuration::OSS_HEDGE_PERCENTILE = 0;
+    ASSERT_EQ(0, policy->getHedgeDelay());
+}
+
+TEST_F(TestOssTransferPolicy, TestHead) {
+    /* the size of an object, and -1 for a missing one */
+    OssObjectReader reader(name, 0, data.size() - 1);
+    ASSERT_EQ((int64_t) data.size(), reader.getObjectSize());
+    OssObjectReader missing(name + ".missing", 0, 100);
+    ASSERT_EQ(-1, missing.getObjectSize());
+
+    /* a HEAD that hangs is given up and sent again */
+    Configuration::OSS_REQUEST_TIMEOUT = 100;
+    store->readDelay = 1000;
+    store->slowHeads = 1;
+    GWSysInfo before = getStatistics();
+    ASSERT_EQ((int64_t) data.size(), reader.getObjectSize());
+    GWSysInfo after = getStatistics();
+    ASSERT_EQ(1u, after.numOssTimeouts - before.numOssTimeouts);
+    ASSERT_EQ(1u, after.numOssRetries - before.numOssRetries);
+
+    /* and overtaken by its hedge */
+    Configuration::OSS_REQUEST_TIMEOUT = 30000;
+    Configuration::OSS_HEDGE_PERCENTILE = 95;
+    for (int i = 1; i <= 100; i++) {
+        policy->recordLatency(i * 100);
+    }
+    store->slowHeads = 1;
+    before = getStatistics();
+    ASSERT_EQ((int64_t) data.size(), reader.getObjectSize());
+    after = getStatistics();
+    ASSERT_EQ(0u, after.numOssRetries - before.numOssRetries);
+    ASSERT_EQ(1u, after.numOssHedgeWins - before.numOssHedgeWins);
+}
+
+TEST_F(TestOssTransferPolicy, TestUploadRetry) {
+    /* a block in 5 parts and an index, with failed PUTs and writes */
+    int64_t savedBucketSize = Configuration::LOCAL_BUCKET_SIZE;
+    Configuration::LOCAL_BUCKET_SIZE = 64 * 1024;
+    Configuration::OSS_CODEC_CHUNK_SIZE = 4096;
+    Configuration::OSS_PART_MIN_SIZE = 8192;
+    Configuration::OSS_PART_TARGET_TIME = 0;
+    Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 4096;
+    int fd = open("/data/gopherwood/TestOssTransferPolicy", O_CREAT | O_RDWR | O_TRUNC, 0644);
+    ftruncate(fd, 2 * Configuration::LOCAL_BUCKET_SIZE);
+    pwrite(fd, data.data(), 40000, 0);
+    OssBlockWorker *worker = new OssBlockWorker(fd);
+    BlockInfo info;
+    info.fileId.hashcode = 20181019;
+    info.fileId.collisionId = 0;
+    info.blockId = 0;
+    info.bucketId = 0;
+    info.offset = 0;
+    info.dataSize = 40000;
+    info.isLocal = true;
+
+    store->failedPuts = 2;
+    store->failedWrites = 2;
+    GWSysInfo before = getStatistics();
+    worker->writeBlock(info);
+    ASSERT_EQ(4u, getStatistics().numOssRetries - before.numOssRetries);
+
+    BlockInfo loadInfo = info;
+    loadInfo.bucketId = 1;
+    std::vector<char> loaded(40000);
+    ASSERT_EQ(40000, worker->readBlock(loadInfo));
+    pread(fd, loaded.data(), loaded.size(), Configuration::LOCAL_BUCKET_SIZE);
+    ASSERT_EQ(std::vector<char>(data.begin(), data.begin() + 40000), loaded);
+
+    /* a failed upload leaves the block before it */
+    store->failedPuts = 1000;
+    ASSERT_THROW(worker->writeBlock(info), GopherwoodOSSException);
+    store->failedPuts = 0;
+    ASSERT_EQ(40000, worker->readBlock(loadInfo));
+
+    worker->deleteBlock(info);
+    delete worker;
+    close(fd);
+    unlink("/data/gopherwood/TestOssTransferPolicy");
+    Configuration::LOCAL_BUCKET_SIZE = savedBucketSize;
+    Configuration::OSS_CODEC_CHUNK_SIZE = 1024 * 1024;
+    Configuration::OSS_PART_MIN_SIZE = 8 * 1024 * 1024;
+    Configuration::OSS_PART_TARGET_TIME = 500;
+    Configuration::OSS_PARTIAL_FETCH_PAGE_SIZE = 1024 * 1024;
+}
@@ -0,0 +1,81 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Crc32c.h"
+#include "common/DateTime.h"
+#include "gtest/gtest.h"
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+/* GB/s of fn over the buffer, best of a few rounds */
+template<typename Fn>
+static double Throughput(std::vector<char> &buffer, int rounds, Fn fn) {
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        steady_clock::time_point start = steady_clock::now();
+        fn();
+        double nanos = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        best = std::max(best, buffer.size() / nanos);
+    }
+    return best;
+}
+
+/* CRC32C of whole blocks as done on eviction and load, against memcpy as the
+ * memory bandwidth reference */
+TEST(TestChecksumPerformance, TestCrc32cBlockThroughput) {
+    size_t sizes[] = {64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024};
+    std::vector<char> buffer(64 * 1024 * 1024);
+    std::vector<char> copy(buffer.size());
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (char) (i * 131 + 17);
+    }
+
+    printf("CRC32C hardware accelerated: %s\n", Crc32c::isHardwareAccelerated() ? "yes" : "no");
+    printf("%12s %14s %14s %14s\n", "bytes", "hw GB/s", "sw GB/s", "memcpy GB/s");
+    for (size_t size : sizes) {
+        std::vector<char> block(buffer.begin(), buffer.begin() + size);
+        int rounds = std::max<int>(3, (256 * 1024 * 1024) / size);
+        uint32_t crc = 0;
+        uint32_t softCrc = 0;
+
+        double hw = Throughput(block, rounds, [&]() {
+            crc = Crc32c::value(block.data(), size);
+        });
+        double sw = Throughput(block, 3, [&]() {
+            softCrc = Crc32c::updateSoftware(0, block.data(), size);
+        });
+        double mem = Throughput(block, rounds, [&]() {
+            memcpy(copy.data(), block.data(), size);
+        });
+
+        ASSERT_EQ(softCrc, crc);
+        printf("%12lu %14.2f %14.2f %14.2f\n", size, hw, sw, mem);
+    }
+
+    /* odd lengths and offsets cross the interleaved stream boundaries */
+    for (size_t length = 1; length < 100000; length = length * 3 + 1) {
+        for (size_t offset = 0; offset < 8; offset += 3) {
+            ASSERT_EQ(Crc32c::updateSoftware(0x1234, buffer.data() + offset, length),
+                      Crc32c::update(0x1234, buffer.data() + offset, length));
+        }
+    }
+}
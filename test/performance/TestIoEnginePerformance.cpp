@@ -0,0 +1,194 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/AlignedBufferPool.h"
+#include "block/IoEngine.h"
+#include "common/DateTime.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <sys/mman.h>
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+/* random 4KB reads on a 256MB file at queue depths 1 to 128, per engine */
+TEST(TestIoEnginePerformance, TestRandomReadQueueDepth) {
+    const char *path = "/data/gopherwood/TestIoEnginePerformance";
+    int64_t fileSize = 256L * 1024 * 1024;
+    int64_t blockSize = 4096;
+    int numRequests = 32768;
+    int engines[] = {IO_ENGINE_SYNC, IO_ENGINE_THREADPOOL, IO_ENGINE_URING};
+    uint32_t depths[] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+    remove(path);
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0);
+    {
+        std::vector<char> chunk(4 * 1024 * 1024, 'g');
+        shared_ptr<IoEngine> engine = IoEngine::create(fd, IO_ENGINE_SYNC, 1);
+        for (int64_t off = 0; off < fileSize; off += chunk.size()) {
+            ASSERT_EQ((int64_t) chunk.size(), engine->write(chunk.data(), chunk.size(), off));
+        }
+        fsync(fd);
+    }
+
+    std::vector<int64_t> offsets(numRequests);
+    srand(17);
+    for (int i = 0; i < numRequests; i++) {
+        offsets[i] = (rand() % (fileSize / blockSize)) * blockSize;
+    }
+
+    printf("%12s %6s %12s %14s %14s\n", "engine", "QD", "IOPS", "p50 batch us", "p99 batch us");
+    for (int type : engines) {
+        for (uint32_t depth : depths) {
+            shared_ptr<IoEngine> engine = IoEngine::create(fd, type, depth);
+            std::vector<char> buffer(depth * blockSize);
+            engine->registerBuffer(buffer.data(), buffer.size());
+
+            /* a request completes no later than its batch, so batch latency bounds request latency */
+            std::vector<double> latencies;
+            std::vector<IoRequest> requests(depth);
+            steady_clock::time_point start = steady_clock::now();
+            for (int i = 0; i < numRequests; i += depth) {
+                int num = std::min((int) depth, numRequests - i);
+                for (int j = 0; j < num; j++) {
+                    requests[j] = IoRequest(IoRead, buffer.data() + j * blockSize, blockSize, offsets[i + j]);
+                }
+                steady_clock::time_point batchStart = steady_clock::now();
+                engine->submit(requests.data(), num);
+                latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - batchStart).count() / 1000.0);
+                for (int j = 0; j < num; j++) {
+                    ASSERT_EQ(blockSize, requests[j].result);
+                }
+            }
+            double seconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+
+            std::sort(latencies.begin(), latencies.end());
+            printf("%12s %6u %12.0f %14.1f %14.1f\n", engine->getName(), depth, numRequests / seconds,
+                   latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]);
+        }
+    }
+
+    close(fd);
+    remove(path);
+}
+
+/* pages of the file held in the host page cache */
+static int64_t PageCacheBytes(int fd, int64_t fileSize) {
+    void *addr = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    int64_t pageSize = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((fileSize + pageSize - 1) / pageSize);
+    int64_t resident = 0;
+    if (mincore(addr, fileSize, pages.data()) == 0) {
+        for (size_t i = 0; i < pages.size(); i++) {
+            resident += pages[i] & 1;
+        }
+    }
+    munmap(addr, fileSize);
+    return resident * pageSize;
+}
+
+/* buffered vs O_DIRECT: sequential throughput, page cache footprint and random read IOPS */
+TEST(TestIoEnginePerformance, TestDirectIo) {
+    const char *path = "/data/gopherwood/TestIoEnginePerformance";
+    int64_t fileSize = 256L * 1024 * 1024;
+    int64_t requestSize = 1024 * 1024;
+    int modes[] = {0, O_DIRECT};
+
+    printf("%10s %12s %12s %14s %14s\n", "mode", "write MB/s", "read MB/s", "cache MB (w)", "cache MB (r)");
+    for (int mode : modes) {
+        remove(path);
+        int fd = open(path, O_CREAT | O_RDWR | mode, 0644);
+        ASSERT_GT(fd, 0);
+        shared_ptr<IoEngine> engine = IoEngine::create(fd, IO_ENGINE_SYNC, 1);
+        char *buffer = AlignedBufferPool::allocate(requestSize);
+        memset(buffer, 'g', requestSize);
+
+        steady_clock::time_point start = steady_clock::now();
+        for (int64_t off = 0; off < fileSize; off += requestSize) {
+            ASSERT_EQ(requestSize, engine->write(buffer, requestSize, off));
+        }
+        fsync(fd);
+        double writeSeconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+        int64_t cachedAfterWrite = PageCacheBytes(fd, fileSize);
+
+        /* drop what the write left behind, so the read starts cold in both modes */
+        posix_fadvise(fd, 0, fileSize, POSIX_FADV_DONTNEED);
+        start = steady_clock::now();
+        for (int64_t off = 0; off < fileSize; off += requestSize) {
+            ASSERT_EQ(requestSize, engine->read(buffer, requestSize, off));
+        }
+        double readSeconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+        int64_t cachedAfterRead = PageCacheBytes(fd, fileSize);
+
+        printf("%10s %12.0f %12.0f %14.1f %14.1f\n", mode ? "direct" : "buffered",
+               fileSize / writeSeconds / 1048576, fileSize / readSeconds / 1048576,
+               cachedAfterWrite / 1048576.0, cachedAfterRead / 1048576.0);
+        free(buffer);
+        close(fd);
+    }
+
+    /* device bound random reads, where queue depth pays off */
+    int fd = open(path, O_RDWR | O_DIRECT);
+    ASSERT_GT(fd, 0);
+    int numRequests = 8192;
+    int64_t blockSize = 4096;
+    std::vector<int64_t> offsets(numRequests);
+    srand(17);
+    for (int i = 0; i < numRequests; i++) {
+        offsets[i] = (rand() % (fileSize / blockSize)) * blockSize;
+    }
+
+    int engines[] = {IO_ENGINE_SYNC, IO_ENGINE_URING};
+    uint32_t depths[] = {1, 8, 32, 128};
+    printf("%12s %6s %12s (O_DIRECT random 4KB reads)\n", "engine", "QD", "IOPS");
+    for (int type : engines) {
+        for (uint32_t depth : depths) {
+            shared_ptr<IoEngine> engine = IoEngine::create(fd, type, depth);
+            char *buffer = AlignedBufferPool::allocate(depth * blockSize);
+            engine->registerBuffer(buffer, depth * blockSize);
+            std::vector<IoRequest> requests(depth);
+
+            steady_clock::time_point start = steady_clock::now();
+            for (int i = 0; i < numRequests; i += depth) {
+                int num = std::min((int) depth, numRequests - i);
+                for (int j = 0; j < num; j++) {
+                    requests[j] = IoRequest(IoRead, buffer + j * blockSize, blockSize, offsets[i + j]);
+                }
+                engine->submit(requests.data(), num);
+                for (int j = 0; j < num; j++) {
+                    ASSERT_EQ(blockSize, requests[j].result);
+                }
+            }
+            double seconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+            printf("%12s %6u %12.0f\n", engine->getName(), depth, numRequests / seconds);
+
+            engine.reset();
+            free(buffer);
+        }
+    }
+    close(fd);
+    remove(path);
+}
@@ -0,0 +1,115 @@
+/********************************************************************
+ * 2016 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "common/Crc32c.h"
+#include "common/DateTime.h"
+#include "core/Manifest.h"
+#include "core/SharedMemoryObj.h"
+#include "gtest/gtest.h"
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+/* nanoseconds elapsed since start */
+static double ElapsedNanos(steady_clock::time_point start) {
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count();
+}
+
+/* CRC32C cost for typical manifest record sizes, hardware vs table */
+TEST(TestManifestPerformance, TestCrc32cRecordSizes) {
+    size_t sizes[] = {24, 36, 72, 1024, 4092};
+    int iterations = 1000000;
+    std::vector<char> buffer(4096);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (char) (i * 131 + 17);
+    }
+
+    printf("CRC32C hardware accelerated: %s\n", Crc32c::isHardwareAccelerated() ? "yes" : "no");
+    printf("%10s %14s %14s %14s %14s\n", "bytes", "hw ns/rec", "hw GB/s", "sw ns/rec", "sw GB/s");
+    for (size_t size : sizes) {
+        uint32_t crc = 0;
+        steady_clock::time_point start = steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            crc = Crc32c::update(crc, buffer.data(), size);
+        }
+        double hwNanos = ElapsedNanos(start) / iterations;
+
+        uint32_t softCrc = 0;
+        start = steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            softCrc = Crc32c::updateSoftware(softCrc, buffer.data(), size);
+        }
+        double swNanos = ElapsedNanos(start) / iterations;
+
+        ASSERT_EQ(softCrc, crc);
+        printf("%10lu %14.1f %14.2f %14.1f %14.2f\n", size, hwNanos, size / hwNanos, swNanos, size / swNanos);
+    }
+}
+
+/* checksum share of the manifest append and replay path */
+TEST(TestManifestPerformance, TestManifestAppendReplay) {
+    const char *path = "/data/gopherwood/TestManifestPerformance";
+    int numRecords = 100000;
+    remove(path);
+
+    std::vector<Block> blocks;
+    for (int i = 0; i < 4; i++) {
+        blocks.push_back(Block(i, i, LocalBlock, BUCKET_USED));
+    }
+
+    double appendNanos;
+    {
+        Manifest manifest(path);
+        steady_clock::time_point start = steady_clock::now();
+        for (int i = 0; i < numRecords; i++) {
+            manifest.logInactivateBucket(blocks);
+        }
+        appendNanos = ElapsedNanos(start) / numRecords;
+    }
+
+    double replayNanos;
+    {
+        Manifest manifest(path);
+        std::vector<Block> fetched;
+        std::vector<BlockExtent> extents;
+        int count = 0;
+        steady_clock::time_point start = steady_clock::now();
+        while (manifest.fetchOneLogRecord(fetched, extents).type != RecordType::invalidLog) {
+            fetched.clear();
+            count++;
+        }
+        replayNanos = ElapsedNanos(start) / numRecords;
+        ASSERT_EQ(numRecords, count);
+    }
+
+    size_t recordSize = sizeof(RecordHeader) + blocks.size() * sizeof(BlockRecord);
+    std::vector<char> record(recordSize);
+    steady_clock::time_point start = steady_clock::now();
+    uint32_t crc = 0;
+    for (int i = 0; i < numRecords; i++) {
+        crc = Crc32c::update(crc, record.data(), record.size());
+    }
+    double crcNanos = ElapsedNanos(start) / numRecords;
+
+    printf("record size %lu bytes: append %.1f ns, replay %.1f ns, crc32c %.1f ns (%.2f%% of append)\n",
+           recordSize, appendNanos, replayNanos, crcNanos, crcNanos * 100 / appendNanos);
+    remove(path);
+}
@@ -0,0 +1,132 @@
+/********************************************************************
+ * 2017 -
+ * open source under Apache License Version 2.0
+ ********************************************************************/
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block/LocalBlockWriter.h"
+#include "client/gopherwood.h"
+#include "common/Configuration.h"
+#include "common/DateTime.h"
+#include "gtest/gtest.h"
+
+using namespace Gopherwood;
+using namespace Gopherwood::Internal;
+
+/* small record writes with and without the write combining buffer of GW_SEQACC handles */
+TEST(TestWritePerformance, TestSmallRecordWrite) {
+    char workDir[] = "/data/gopherwood";
+    char fileName[] = "TestWritePerformance/TestSmallRecordWrite";
+    int64_t fileSize = 64L * 1024 * 1024;
+    int recordSizes[] = {128, 1024, 4096};
+    int hints[] = {0, GW_SEQACC};
+
+    GWContextConfig config;
+    config.blockSize = 4 * 1024 * 1024;
+    config.numBlocks = 50;
+    config.numPreDefinedConcurrency = 10;
+    config.severity = LOGSEV_ERROR;
+    gwFormatContext(workDir);
+    gopherwoodFS fs = gwCreateContext(workDir, &config);
+    ASSERT_TRUE(fs != NULL);
+
+    std::vector<char> record(4096, 'r');
+    printf("%12s %10s %12s %12s\n", "record bytes", "mode", "MB/s", "us/write");
+    for (int recordSize : recordSizes) {
+        for (int hint : hints) {
+            gwFile file = gwOpenFile(fs, fileName, GW_CREAT | GW_WRONLY | hint);
+            ASSERT_TRUE(file != NULL);
+
+            int64_t numWrites = fileSize / recordSize;
+            steady_clock::time_point start = steady_clock::now();
+            for (int64_t i = 0; i < numWrites; i++) {
+                ASSERT_EQ(recordSize, gwWrite(fs, file, record.data(), recordSize));
+            }
+            ASSERT_EQ(0, gwFlush(fs, file));
+            double seconds = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+
+            printf("%12d %10s %12.1f %12.2f\n", recordSize, hint ? "buffered" : "direct",
+                   fileSize / seconds / 1048576, seconds * 1e6 / numWrites);
+            ASSERT_EQ(0, gwCloseFile(fs, file));
+            ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+        }
+    }
+    gwDestroyContext(fs);
+}
+
+/* sequential 1MB writes crossing a block every 4MB, synced by gwFlush under each
+ * sync policy; another handle leaves unsynced data in the local space meanwhile.
+ * "fsync/switch" replays the old behaviour of syncing on every block switch */
+TEST(TestWritePerformance, TestSequentialWriteSync) {
+    char workDir[] = "/data/gopherwood";
+    char fileName[] = "TestWritePerformance/TestSequentialWriteSync";
+    char otherName[] = "TestWritePerformance/TestSequentialWriteSyncOther";
+    int64_t blockSize = 4 * 1024 * 1024;
+    int64_t fileSize = 128L * 1024 * 1024;
+    int64_t writeSize = 1024 * 1024;
+    const char *names[] = {"fsync/switch", "none", "range", "full"};
+    int policies[] = {LOCAL_SYNC_FULL, LOCAL_SYNC_NONE, LOCAL_SYNC_RANGE, LOCAL_SYNC_FULL};
+    int32_t savedPolicy = Configuration::LOCAL_SYNC_POLICY;
+
+    GWContextConfig config;
+    config.blockSize = blockSize;
+    config.numBlocks = 100;
+    config.numPreDefinedConcurrency = 10;
+    config.severity = LOGSEV_ERROR;
+    gwFormatContext(workDir);
+    gopherwoodFS fs = gwCreateContext(workDir, &config);
+    ASSERT_TRUE(fs != NULL);
+
+    std::vector<char> buffer(writeSize, 's');
+    printf("%14s %12s %12s %12s\n", "policy", "write ms", "flush ms", "MB/s");
+    for (int i = 0; i < 4; i++) {
+        Configuration::LOCAL_SYNC_POLICY = policies[i];
+
+        /* dirty page cache data owned by someone else */
+        gwFile other = gwOpenFile(fs, otherName, GW_CREAT | GW_WRONLY | GW_SEQACC);
+        ASSERT_TRUE(other != NULL);
+        for (int64_t written = 0; written < fileSize; written += writeSize) {
+            ASSERT_EQ(writeSize, gwWrite(fs, other, buffer.data(), writeSize));
+        }
+
+        gwFile file = gwOpenFile(fs, fileName, GW_CREAT | GW_WRONLY | GW_SEQACC);
+        ASSERT_TRUE(file != NULL);
+        steady_clock::time_point start = steady_clock::now();
+        for (int64_t written = 0; written < fileSize; written += writeSize) {
+            ASSERT_EQ(writeSize, gwWrite(fs, file, buffer.data(), writeSize));
+            if (i == 0 && (written + writeSize) % blockSize == 0) {
+                ASSERT_EQ(0, gwFlush(fs, file));
+            }
+        }
+        steady_clock::time_point flushStart = steady_clock::now();
+        ASSERT_EQ(0, gwFlush(fs, file));
+        steady_clock::time_point end = steady_clock::now();
+
+        double writeMs = duration_cast<microseconds>(flushStart - start).count() / 1000.0;
+        double flushMs = duration_cast<microseconds>(end - flushStart).count() / 1000.0;
+        printf("%14s %12.1f %12.1f %12.1f\n", names[i], writeMs, flushMs,
+               fileSize / ((writeMs + flushMs) / 1000) / 1048576);
+
+        ASSERT_EQ(0, gwCloseFile(fs, file));
+        ASSERT_EQ(0, gwCloseFile(fs, other));
+        ASSERT_EQ(0, gwDeleteFile(fs, fileName));
+        ASSERT_EQ(0, gwDeleteFile(fs, otherName));
+    }
+    Configuration::LOCAL_SYNC_POLICY = savedPolicy;
+    gwDestroyContext(fs);
+}